@@ -673,97 +673,72 @@ static void mask_dilate_thread( void *thread_args_v )
     pv = thread_args->pv;
     segment = thread_args->segment;
 
-    hb_log("mask dilate thread started for segment %d", segment);
+    int xx, yy, pp;
 
-    while (1)
+    int count;
+    int dilation_threshold = 4;
+
+    for (pp = 0; pp < 1; pp++)
     {
-        /*
-         * Wait here until there is work to do.
-         */
-        taskset_thread_wait4start( &pv->mask_dilate_taskset, segment );
+        int width = pv->mask_filtered->plane[pp].width;
+        int height = pv->mask_filtered->plane[pp].height;
+        int stride = pv->mask_filtered->plane[pp].stride;
+
+        int start, stop, p, c, n;
+        segment_start = thread_args->segment_start[pp];
+        segment_stop = segment_start + thread_args->segment_height[pp];
 
-        if (taskset_thread_stop(&pv->mask_dilate_taskset, segment))
+        if (segment_start == 0)
         {
-            /*
-             * No more work to do, exit this thread.
-             */
-            break;
+            start = 1;
+            p = 0;
+            c = 1;
+            n = 2;
         }
-
-        int xx, yy, pp;
-
-        int count;
-        int dilation_threshold = 4;
-
-        for (pp = 0; pp < 1; pp++)
+        else
         {
-            int width = pv->mask_filtered->plane[pp].width;
-            int height = pv->mask_filtered->plane[pp].height;
-            int stride = pv->mask_filtered->plane[pp].stride;
-
-            int start, stop, p, c, n;
-            segment_start = thread_args->segment_start[pp];
-            segment_stop = segment_start + thread_args->segment_height[pp];
-
-            if (segment_start == 0)
-            {
-                start = 1;
-                p = 0;
-                c = 1;
-                n = 2;
-            }
-            else
-            {
-                start = segment_start;
-                p = segment_start - 1;
-                c = segment_start;
-                n = segment_start + 1;
-            }
+            start = segment_start;
+            p = segment_start - 1;
+            c = segment_start;
+            n = segment_start + 1;
+        }
 
-            if (segment_stop == height)
-            {
-                stop = height -1;
-            }
-            else
-            {
-                stop = segment_stop;
-            }
+        if (segment_stop == height)
+        {
+            stop = height -1;
+        }
+        else
+        {
+            stop = segment_stop;
+        }
 
-            uint8_t *curp = &pv->mask_filtered->plane[pp].data[p * stride + 1];
-            uint8_t *cur  = &pv->mask_filtered->plane[pp].data[c * stride + 1];
-            uint8_t *curn = &pv->mask_filtered->plane[pp].data[n * stride + 1];
-            uint8_t *dst = &pv->mask_temp->plane[pp].data[c * stride + 1];
+        uint8_t *curp = &pv->mask_filtered->plane[pp].data[p * stride + 1];
+        uint8_t *cur  = &pv->mask_filtered->plane[pp].data[c * stride + 1];
+        uint8_t *curn = &pv->mask_filtered->plane[pp].data[n * stride + 1];
+        uint8_t *dst = &pv->mask_temp->plane[pp].data[c * stride + 1];
 
-            for (yy = start; yy < stop; yy++)
+        for (yy = start; yy < stop; yy++)
+        {
+            for (xx = 1; xx < width - 1; xx++)
             {
-                for (xx = 1; xx < width - 1; xx++)
+                if (cur[xx])
                 {
-                    if (cur[xx])
-                    {
-                        dst[xx] = 1;
-                        continue;
-                    }
+                    dst[xx] = 1;
+                    continue;
+                }
 
-                    count = curp[xx-1] + curp[xx] + curp[xx+1] +
-                            cur [xx-1] +            cur [xx+1] +
-                            curn[xx-1] + curn[xx] + curn[xx+1];
+                count = curp[xx-1] + curp[xx] + curp[xx+1] +
+                        cur [xx-1] +            cur [xx+1] +
+                        curn[xx-1] + curn[xx] + curn[xx+1];
 
-                    dst[xx] = count >= dilation_threshold;
-                }
-                curp += stride;
-                cur += stride;
-                curn += stride;
-                dst += stride;
+                dst[xx] = count >= dilation_threshold;
             }
+            curp += stride;
+            cur += stride;
+            curn += stride;
+            dst += stride;
         }
-
-        taskset_thread_complete( &pv->mask_dilate_taskset, segment );
     }
-
-    /*
-     * Finished this segment, let everyone know.
-     */
-    taskset_thread_complete( &pv->mask_dilate_taskset, segment );
 }
 
 static void mask_erode_thread( void *thread_args_v )
@@ -775,97 +750,72 @@ static void mask_erode_thread( void *thread_args_v )
     pv = thread_args->pv;
     segment = thread_args->segment;
 
-    hb_log("mask erode thread started for segment %d", segment);
+    int xx, yy, pp;
 
-    while (1)
+    int count;
+    int erosion_threshold = 2;
+
+    for (pp = 0; pp < 1; pp++)
     {
-        /*
-         * Wait here until there is work to do.
-         */
-        taskset_thread_wait4start( &pv->mask_erode_taskset, segment );
+        int width = pv->mask_filtered->plane[pp].width;
+        int height = pv->mask_filtered->plane[pp].height;
+        int stride = pv->mask_filtered->plane[pp].stride;
+
+        int start, stop, p, c, n;
+        segment_start = thread_args->segment_start[pp];
+        segment_stop = segment_start + thread_args->segment_height[pp];
 
-        if (taskset_thread_stop( &pv->mask_erode_taskset, segment ))
+        if (segment_start == 0)
         {
-            /*
-             * No more work to do, exit this thread.
-             */
-            break;
+            start = 1;
+            p = 0;
+            c = 1;
+            n = 2;
         }
-
-        int xx, yy, pp;
-
-        int count;
-        int erosion_threshold = 2;
-
-        for (pp = 0; pp < 1; pp++)
+        else
         {
-            int width = pv->mask_filtered->plane[pp].width;
-            int height = pv->mask_filtered->plane[pp].height;
-            int stride = pv->mask_filtered->plane[pp].stride;
-
-            int start, stop, p, c, n;
-            segment_start = thread_args->segment_start[pp];
-            segment_stop = segment_start + thread_args->segment_height[pp];
-
-            if (segment_start == 0)
-            {
-                start = 1;
-                p = 0;
-                c = 1;
-                n = 2;
-            }
-            else
-            {
-                start = segment_start;
-                p = segment_start - 1;
-                c = segment_start;
-                n = segment_start + 1;
-            }
+            start = segment_start;
+            p = segment_start - 1;
+            c = segment_start;
+            n = segment_start + 1;
+        }
 
-            if (segment_stop == height)
-            {
-                stop = height -1;
-            }
-            else
-            {
-                stop = segment_stop;
-            }
+        if (segment_stop == height)
+        {
+            stop = height -1;
+        }
+        else
+        {
+            stop = segment_stop;
+        }
 
-            uint8_t *curp = &pv->mask_temp->plane[pp].data[p * stride + 1];
-            uint8_t *cur  = &pv->mask_temp->plane[pp].data[c * stride + 1];
-            uint8_t *curn = &pv->mask_temp->plane[pp].data[n * stride + 1];
-            uint8_t *dst = &pv->mask_filtered->plane[pp].data[c * stride + 1];
+        uint8_t *curp = &pv->mask_temp->plane[pp].data[p * stride + 1];
+        uint8_t *cur  = &pv->mask_temp->plane[pp].data[c * stride + 1];
+        uint8_t *curn = &pv->mask_temp->plane[pp].data[n * stride + 1];
+        uint8_t *dst = &pv->mask_filtered->plane[pp].data[c * stride + 1];
 
-            for (yy = start; yy < stop; yy++)
+        for (yy = start; yy < stop; yy++)
+        {
+            for (xx = 1; xx < width - 1; xx++)
             {
-                for (xx = 1; xx < width - 1; xx++)
+                if (cur[xx] == 0)
                 {
-                    if (cur[xx] == 0)
-                    {
-                        dst[xx] = 0;
-                        continue;
-                    }
+                    dst[xx] = 0;
+                    continue;
+                }
 
-                    count = curp[xx-1] + curp[xx] + curp[xx+1] +
-                            cur [xx-1] +            cur [xx+1] +
-                            curn[xx-1] + curn[xx] + curn[xx+1];
+                count = curp[xx-1] + curp[xx] + curp[xx+1] +
+                        cur [xx-1] +            cur [xx+1] +
+                        curn[xx-1] + curn[xx] + curn[xx+1];
 
-                    dst[xx] = count >= erosion_threshold;
-                }
-                curp += stride;
-                cur += stride;
-                curn += stride;
-                dst += stride;
+                dst[xx] = count >= erosion_threshold;
             }
+            curp += stride;
+            cur += stride;
+            curn += stride;
+            dst += stride;
         }
-
-        taskset_thread_complete( &pv->mask_erode_taskset, segment );
     }
-
-    /*
-     * Finished this segment, let everyone know.
-     */
-    taskset_thread_complete( &pv->mask_erode_taskset, segment );
 }
 
 static void mask_filter_thread( void *thread_args_v )
@@ -877,98 +827,73 @@ static void mask_filter_thread( void *thread_args_v )
     pv = thread_args->pv;
     segment = thread_args->segment;
 
-    hb_log("mask filter thread started for segment %d", segment);
+    int xx, yy, pp;
 
-    while (1)
+    for (pp = 0; pp < 1; pp++)
     {
-        /*
-         * Wait here until there is work to do.
-         */
-        taskset_thread_wait4start( &pv->mask_filter_taskset, segment );
+        int width = pv->mask->plane[pp].width;
+        int height = pv->mask->plane[pp].height;
+        int stride = pv->mask->plane[pp].stride;
 
-        if (taskset_thread_stop( &pv->mask_filter_taskset, segment ))
+        int start, stop, p, c, n;
+        segment_start = thread_args->segment_start[pp];
+        segment_stop = segment_start + thread_args->segment_height[pp];
+
+        if (segment_start == 0)
         {
-            /*
-             * No more work to do, exit this thread.
-             */
-            break;
+            start = 1;
+            p = 0;
+            c = 1;
+            n = 2;
         }
-
-        int xx, yy, pp;
-
-        for (pp = 0; pp < 1; pp++)
+        else
         {
-            int width = pv->mask->plane[pp].width;
-            int height = pv->mask->plane[pp].height;
-            int stride = pv->mask->plane[pp].stride;
+            start = segment_start;
+            p = segment_start - 1;
+            c = segment_start;
+            n = segment_start + 1;
+        }
 
-            int start, stop, p, c, n;
-            segment_start = thread_args->segment_start[pp];
-            segment_stop = segment_start + thread_args->segment_height[pp];
+        if (segment_stop == height)
+        {
+            stop = height - 1;
+        }
+        else
+        {
+            stop = segment_stop;
+        }
 
-            if (segment_start == 0)
-            {
-                start = 1;
-                p = 0;
-                c = 1;
-                n = 2;
-            }
-            else
-            {
-                start = segment_start;
-                p = segment_start - 1;
-                c = segment_start;
-                n = segment_start + 1;
-            }
+        uint8_t *curp = &pv->mask->plane[pp].data[p * stride + 1];
+        uint8_t *cur = &pv->mask->plane[pp].data[c * stride + 1];
+        uint8_t *curn = &pv->mask->plane[pp].data[n * stride + 1];
+        uint8_t *dst = (pv->filter_mode == FILTER_CLASSIC ) ?
+            &pv->mask_filtered->plane[pp].data[c * stride + 1] :
+            &pv->mask_temp->plane[pp].data[c * stride + 1] ;
 
-            if (segment_stop == height)
-            {
-                stop = height - 1;
-            }
-            else
+        for (yy = start; yy < stop; yy++)
+        {
+            for (xx = 1; xx < width - 1; xx++)
             {
-                stop = segment_stop;
-            }
+                int h_count, v_count;
 
-            uint8_t *curp = &pv->mask->plane[pp].data[p * stride + 1];
-            uint8_t *cur = &pv->mask->plane[pp].data[c * stride + 1];
-            uint8_t *curn = &pv->mask->plane[pp].data[n * stride + 1];
-            uint8_t *dst = (pv->filter_mode == FILTER_CLASSIC ) ?
-                &pv->mask_filtered->plane[pp].data[c * stride + 1] :
-                &pv->mask_temp->plane[pp].data[c * stride + 1] ;
+                h_count = cur[xx-1] & cur[xx] & cur[xx+1];
+                v_count = curp[xx] & cur[xx] & curn[xx];
 
-            for (yy = start; yy < stop; yy++)
-            {
-                for (xx = 1; xx < width - 1; xx++)
+                if (pv->filter_mode == FILTER_CLASSIC)
                 {
-                    int h_count, v_count;
-
-                    h_count = cur[xx-1] & cur[xx] & cur[xx+1];
-                    v_count = curp[xx] & cur[xx] & curn[xx];
-
-                    if (pv->filter_mode == FILTER_CLASSIC)
-                    {
-                        dst[xx] = h_count;
-                    }
-                    else
-                    {
-                        dst[xx] = h_count & v_count;
-                    }
+                    dst[xx] = h_count;
+                }
+                else
+                {
+                    dst[xx] = h_count & v_count;
                 }
-                curp += stride;
-                cur += stride;
-                curn += stride;
-                dst += stride;
             }
+            curp += stride;
+            cur += stride;
+            curn += stride;
+            dst += stride;
         }
-
-        taskset_thread_complete( &pv->mask_filter_taskset, segment );
     }
-
-    /*
-     * Finished this segment, let everyone know.
-     */
-    taskset_thread_complete( &pv->mask_filter_taskset, segment );
 }
 
 static void decomb_check_thread( void *thread_args_v )
@@ -980,42 +905,17 @@ static void decomb_check_thread( void *thread_args_v )
     pv = thread_args->pv;
     segment = thread_args->segment;
 
-    hb_log("decomb check thread started for segment %d", segment);
+    segment_start = thread_args->segment_start[0];
+    segment_stop = segment_start + thread_args->segment_height[0];
 
-    while (1)
+    if (pv->mode & MODE_FILTER)
     {
-        /*
-         * Wait here until there is work to do.
-         */
-        taskset_thread_wait4start( &pv->decomb_check_taskset, segment );
-
-        if (taskset_thread_stop( &pv->decomb_check_taskset, segment ))
-        {
-            /*
-             * No more work to do, exit this thread.
-             */
-            break;
-        }
-
-        segment_start = thread_args->segment_start[0];
-        segment_stop = segment_start + thread_args->segment_height[0];
-
-        if (pv->mode & MODE_FILTER)
-        {
-            check_filtered_combing_mask(pv, segment, segment_start, segment_stop);
-        }
-        else
-        {
-            check_combing_mask(pv, segment, segment_start, segment_stop);
-        }
-
-        taskset_thread_complete( &pv->decomb_check_taskset, segment );
+        check_filtered_combing_mask(pv, segment, segment_start, segment_stop);
+    }
+    else
+    {
+        check_combing_mask(pv, segment, segment_start, segment_stop);
     }
-
-    /*
-     * Finished this segment, let everyone know.
-     */
-    taskset_thread_complete( &pv->decomb_check_taskset, segment );
 }
 
 /*
@@ -1030,49 +930,24 @@ static void decomb_filter_thread( void *thread_args_v )
     pv = thread_args->pv;
     segment = thread_args->segment;
 
-    hb_log("decomb filter thread started for segment %d", segment);
-
-    while (1)
+    /*
+     * Process segment (for now just from luma)
+     */
+    int pp;
+    for (pp = 0; pp < 1; pp++)
     {
-        /*
-         * Wait here until there is work to do.
-         */
-        taskset_thread_wait4start( &pv->decomb_filter_taskset, segment );
+        segment_start = thread_args->segment_start[pp];
+        segment_stop = segment_start + thread_args->segment_height[pp];
 
-        if (taskset_thread_stop( &pv->decomb_filter_taskset, segment ))
+        if (pv->mode & MODE_GAMMA)
         {
-            /*
-             * No more work to do, exit this thread.
-             */
-            break;
+            detect_gamma_combed_segment( pv, segment_start, segment_stop );
         }
-
-        /*
-         * Process segment (for now just from luma)
-         */
-        int pp;
-        for (pp = 0; pp < 1; pp++)
+        else
         {
-            segment_start = thread_args->segment_start[pp];
-            segment_stop = segment_start + thread_args->segment_height[pp];
-
-            if (pv->mode & MODE_GAMMA)
-            {
-                detect_gamma_combed_segment( pv, segment_start, segment_stop );
-            }
-            else
-            {
-                detect_combed_segment( pv, segment_start, segment_stop );
-            }
+            detect_combed_segment( pv, segment_start, segment_stop );
         }
-
-        taskset_thread_complete( &pv->decomb_filter_taskset, segment );
     }
-
-    /*
-     * Finished this segment, let everyone know.
-     */
-    taskset_thread_complete( &pv->decomb_filter_taskset, segment );
 }
 
 static int comb_segmenter( hb_filter_private_t * pv )
@@ -1164,7 +1039,8 @@ static int comb_detect_init( hb_filter_object_t * filter,
      * Create comb detection taskset.
      */
     if (taskset_init( &pv->decomb_filter_taskset, pv->cpu_count,
-                      sizeof( decomb_thread_arg_t ) ) == 0)
+                      sizeof( decomb_thread_arg_t ),
+                      decomb_filter_thread ) == 0)
     {
         hb_error( "decomb could not initialize taskset" );
     }
@@ -1200,14 +1076,6 @@ static int comb_detect_init( hb_filter_object_t * filter,
             }
         }
 
-        if (taskset_thread_spawn( &pv->decomb_filter_taskset, ii,
-                                 "decomb_filter_segment",
-                                 decomb_filter_thread,
-                                 HB_NORMAL_PRIORITY ) == 0)
-        {
-            hb_error( "decomb could not spawn thread" );
-        }
-
         decomb_prev_thread_args = thread_args;
     }
 
@@ -1222,7 +1090,8 @@ static int comb_detect_init( hb_filter_object_t * filter,
      * Create comb check taskset.
      */
     if (taskset_init( &pv->decomb_check_taskset, pv->comb_check_nthreads,
-                      sizeof( decomb_thread_arg_t ) ) == 0)
+                      sizeof( decomb_thread_arg_t ),
+                      decomb_check_thread ) == 0)
     {
         hb_error( "decomb check could not initialize taskset" );
     }
@@ -1265,21 +1134,14 @@ static int comb_detect_init( hb_filter_object_t * filter,
             }
         }
 
-        if (taskset_thread_spawn( &pv->decomb_check_taskset, ii,
-                                  "decomb_check_segment",
-                                  decomb_check_thread,
-                                  HB_NORMAL_PRIORITY ) == 0)
-        {
-            hb_error( "decomb check could not spawn thread" );
-        }
-
         decomb_prev_thread_args = thread_args;
     }
 
     if (pv->mode & MODE_FILTER)
     {
         if (taskset_init( &pv->mask_filter_taskset, pv->cpu_count,
-                          sizeof( decomb_thread_arg_t ) ) == 0)
+                          sizeof( decomb_thread_arg_t ),
+                          mask_filter_thread ) == 0)
         {
             hb_error( "maske filter could not initialize taskset" );
         }
@@ -1316,21 +1178,14 @@ static int comb_detect_init( hb_filter_object_t * filter,
                 }
             }
 
-            if (taskset_thread_spawn( &pv->mask_filter_taskset, ii,
-                                     "mask_filter_segment",
-                                     mask_filter_thread,
-                                     HB_NORMAL_PRIORITY ) == 0)
-            {
-                hb_error( "mask filter could not spawn thread" );
-            }
-
             decomb_prev_thread_args = thread_args;
         }
 
         if (pv->filter_mode == FILTER_ERODE_DILATE)
         {
             if (taskset_init( &pv->mask_erode_taskset, pv->cpu_count,
-                              sizeof( decomb_thread_arg_t ) ) == 0)
+                              sizeof( decomb_thread_arg_t ),
+                              mask_erode_thread ) == 0)
             {
                 hb_error( "mask erode could not initialize taskset" );
             }
@@ -1367,19 +1222,12 @@ static int comb_detect_init( hb_filter_object_t * filter,
                     }
                 }
 
-                if (taskset_thread_spawn( &pv->mask_erode_taskset, ii,
-                                         "mask_erode_segment",
-                                         mask_erode_thread,
-                                         HB_NORMAL_PRIORITY ) == 0)
-                {
-                    hb_error( "mask erode could not spawn thread" );
-                }
-
                 decomb_prev_thread_args = thread_args;
             }
 
             if (taskset_init( &pv->mask_dilate_taskset, pv->cpu_count,
-                              sizeof( decomb_thread_arg_t ) ) == 0)
+                              sizeof( decomb_thread_arg_t ),
+                              mask_dilate_thread ) == 0)
             {
                 hb_error( "mask dilate could not initialize taskset" );
             }
@@ -1416,14 +1264,6 @@ static int comb_detect_init( hb_filter_object_t * filter,
                     }
                 }
 
-                if (taskset_thread_spawn( &pv->mask_dilate_taskset, ii,
-                                         "mask_dilate_segment",
-                                         mask_dilate_thread,
-                                         HB_NORMAL_PRIORITY ) == 0)
-                {
-                    hb_error( "mask dilate could not spawn thread" );
-                }
-
                 decomb_prev_thread_args = thread_args;
             }
         }
@@ -1526,7 +1366,7 @@ static int comb_detect_work( hb_filter_object_t * filter,
     if (in->s.flags & HB_BUF_FLAG_EOF)
     {
         // Duplicate last frame and process refs
-        store_ref(pv, hb_buffer_dup(pv->ref[2]));
+        store_ref(pv, hb_buffer_ref(pv->ref[2]));
         process_frame(pv);
         hb_buffer_list_append(&pv->out_list, in);
         *buf_out = hb_buffer_list_clear(&pv->out_list);
@@ -1538,7 +1378,7 @@ static int comb_detect_work( hb_filter_object_t * filter,
     if (!pv->comb_detect_ready)
     {
         // If not ready, store duplicate ref and return HB_FILTER_DELAY
-        store_ref(pv, hb_buffer_dup(in));
+        store_ref(pv, hb_buffer_ref(in));
         store_ref(pv, in);
         pv->comb_detect_ready = 1;
         // Wait for next
@@ -3071,23 +3071,32 @@ int hb_buffer_list_size(hb_buffer_list_t *list)
 /**********************************************************************
  * hb_list implementation
  **********************************************************************
- * Basic and slow, but enough for what we need
+ * A growable ring of pointers. Adding or removing items at either end
+ * takes constant time, so lists can be used as queues. Inserting or
+ * removing in the middle moves the items on the shorter side.
  *********************************************************************/
 
-#define HB_LIST_DEFAULT_SIZE 20
+#define HB_LIST_DEFAULT_SIZE 32 // must be a power of 2
 
 struct hb_list_s
 {
     /* Pointers to items in the list */
     void ** items;
 
-    /* How many (void *) allocated in 'items' */
+    /* How many (void *) allocated in 'items', a power of 2 */
     int     items_alloc;
 
     /* How many valid pointers in 'items' */
     int     items_count;
+
+    /* Position of the first item in 'items' */
+    int     items_head;
 };
 
+/* Pointer to the slot of item i */
+#define HB_LIST_SLOT(l, i) \
+    (&(l)->items[((l)->items_head + (i)) & ((l)->items_alloc - 1)])
+
 /**********************************************************************
  * hb_list_init
  **********************************************************************
@@ -3115,6 +3124,28 @@ int hb_list_count( const hb_list_t * l )
     return l->items_count;
 }
 
+/**********************************************************************
+ * hb_list_grow
+ **********************************************************************
+ * Doubles the size of a full list, unwrapping the items so that the
+ * first one is at the start of 'items' again.
+ *********************************************************************/
+static void hb_list_grow( hb_list_t * l )
+{
+    void ** items;
+    int     first;
+
+    items = malloc( 2 * l->items_alloc * sizeof( void * ) );
+    first = l->items_alloc - l->items_head;
+    memcpy( items, &l->items[l->items_head], first * sizeof( void * ) );
+    memcpy( &items[first], l->items, l->items_head * sizeof( void * ) );
+
+    free( l->items );
+    l->items        = items;
+    l->items_alloc *= 2;
+    l->items_head   = 0;
+}
+
 /**********************************************************************
  * hb_list_add
  **********************************************************************
@@ -3131,12 +3162,10 @@ void hb_list_add( hb_list_t * l, void * p )
     if( l->items_count == l->items_alloc )
     {
         /* We need a bigger boat */
-        l->items_alloc += HB_LIST_DEFAULT_SIZE;
-        l->items        = realloc( l->items,
-                                   l->items_alloc * sizeof( void * ) );
+        hb_list_grow( l );
     }
 
-    l->items[l->items_count] = p;
+    *HB_LIST_SLOT( l, l->items_count ) = p;
     (l->items_count)++;
 }
 
@@ -3149,6 +3178,8 @@ void hb_list_add( hb_list_t * l, void * p )
  *********************************************************************/
 void hb_list_insert( hb_list_t * l, int pos, void * p )
 {
+    int i;
+
     if( !p )
     {
         return;
@@ -3157,20 +3188,28 @@ void hb_list_insert( hb_list_t * l, int pos, void * p )
     if( l->items_count == l->items_alloc )
     {
         /* We need a bigger boat */
-        l->items_alloc += HB_LIST_DEFAULT_SIZE;
-        l->items        = realloc( l->items,
-                                   l->items_alloc * sizeof( void * ) );
+        hb_list_grow( l );
     }
 
-    if ( l->items_count != pos )
+    if ( pos < l->items_count / 2 )
     {
-        /* Shift all items after it sizeof( void * ) bytes earlier */
-        memmove( &l->items[pos+1], &l->items[pos],
-                 ( l->items_count - pos ) * sizeof( void * ) );
+        /* Shift the items before it one slot towards the front */
+        l->items_head = ( l->items_head - 1 ) & ( l->items_alloc - 1 );
+        for( i = 0; i < pos; i++ )
+        {
+            *HB_LIST_SLOT( l, i ) = *HB_LIST_SLOT( l, i + 1 );
+        }
+    }
+    else
+    {
+        /* Shift the items after it one slot towards the back */
+        for( i = l->items_count; i > pos; i-- )
+        {
+            *HB_LIST_SLOT( l, i ) = *HB_LIST_SLOT( l, i - 1 );
+        }
     }
 
-
-    l->items[pos] = p;
+    *HB_LIST_SLOT( l, pos ) = p;
     (l->items_count)++;
 }
 
@@ -3182,16 +3221,31 @@ void hb_list_insert( hb_list_t * l, int pos, void * p )
  *********************************************************************/
 void hb_list_rem( hb_list_t * l, void * p )
 {
-    int i;
+    int i, j;
 
     /* Find the item in the list */
     for( i = 0; i < l->items_count; i++ )
     {
-        if( l->items[i] == p )
+        if( *HB_LIST_SLOT( l, i ) == p )
         {
-            /* Shift all items after it sizeof( void * ) bytes earlier */
-            memmove( &l->items[i], &l->items[i+1],
-                     ( l->items_count - i - 1 ) * sizeof( void * ) );
+            if ( i < l->items_count / 2 )
+            {
+                /* Shift the items before it one slot towards the back */
+                for( j = i; j > 0; j-- )
+                {
+                    *HB_LIST_SLOT( l, j ) = *HB_LIST_SLOT( l, j - 1 );
+                }
+                l->items_head = ( l->items_head + 1 ) &
+                                ( l->items_alloc - 1 );
+            }
+            else
+            {
+                /* Shift the items after it one slot towards the front */
+                for( j = i; j < l->items_count - 1; j++ )
+                {
+                    *HB_LIST_SLOT( l, j ) = *HB_LIST_SLOT( l, j + 1 );
+                }
+            }
 
             (l->items_count)--;
             break;
@@ -3212,7 +3266,7 @@ void * hb_list_item( const hb_list_t * l, int i )
         return NULL;
     }
 
-    return l->items[i];
+    return *HB_LIST_SLOT( l, i );
 }
 
 /**********************************************************************
@@ -3648,6 +3702,37 @@ void hb_title_close( hb_title_t ** _t )
     *_t = NULL;
 }
 
+/**********************************************************************
+ * hb_title_copy
+ **********************************************************************
+ * Deep copy of a title, for a job that must not share the title with
+ * the scan results of its handle. The demuxer context (opaque_priv)
+ * belongs to whoever opens the stream and is not copied.
+ *********************************************************************/
+hb_title_t * hb_title_copy( const hb_title_t * src )
+{
+    hb_title_t * t;
+
+    if ( src == NULL )
+        return NULL;
+
+    t = calloc( sizeof( hb_title_t ), 1 );
+    memcpy( t, src, sizeof( hb_title_t ) );
+
+    t->opaque_priv     = NULL;
+    t->list_chapter    = hb_chapter_list_copy( src->list_chapter );
+    t->list_audio      = hb_audio_list_copy( src->list_audio );
+    t->list_subtitle   = hb_subtitle_list_copy( src->list_subtitle );
+    t->list_attachment = hb_attachment_list_copy( src->list_attachment );
+    t->metadata        = hb_metadata_copy( src->metadata );
+    if ( src->video_codec_name != NULL )
+        t->video_codec_name = strdup( src->video_codec_name );
+    if ( src->container_name != NULL )
+        t->container_name = strdup( src->container_name );
+
+    return t;
+}
+
 static void job_setup(hb_job_t * job, hb_title_t * title)
 {
     if ( job == NULL || title == NULL )
@@ -4045,10 +4130,6 @@ hb_filter_object_t * hb_filter_get( int filter_id )
             break;
 #endif
 
-        case HB_FILTER_MT_FRAME:
-            filter = &hb_filter_mt_frame;
-            break;
-
         default:
             filter = NULL;
             break;
@@ -4058,23 +4139,7 @@ hb_filter_object_t * hb_filter_get( int filter_id )
 
 hb_filter_object_t * hb_filter_init( int filter_id )
 {
-    switch (filter_id)
-    {
-        case HB_FILTER_UNSHARP:
-        case HB_FILTER_LAPSHARP:
-        {
-            hb_filter_object_t * wrapper;
-
-            wrapper = hb_filter_copy(hb_filter_get(HB_FILTER_MT_FRAME));
-            wrapper->sub_filter = hb_filter_copy(hb_filter_get(filter_id));
-            wrapper->id = filter_id;
-            wrapper->name = wrapper->sub_filter->name;
-            return wrapper;
-        } break;
-
-        default:
-            return hb_filter_copy(hb_filter_get(filter_id));
-    }
+    return hb_filter_copy(hb_filter_get(filter_id));
 }
 
 /**********************************************************************
@@ -543,6 +543,8 @@ struct hb_job_s
     PRIVATE int     pass_id;
     int             twopass;        // Enable 2-pass encode. Boolean
     int             fastfirstpass;
+    int             frame_cache;    // Keep the filtered frames of the 1st pass
+                                    // for the 2nd pass. Boolean
     char           *encoder_preset;
     char           *encoder_tune;
     char           *encoder_options;
@@ -676,6 +678,9 @@ struct hb_job_s
     volatile int  * die;
     volatile int    done;
 
+    struct hb_interjob_s * interjob; /* Data passed between the passes */
+    int             cpu_count;       /* Logical CPUs this job may keep busy */
+
     uint64_t        st_pause_date;
     uint64_t        st_paused;
 
@@ -1152,6 +1157,18 @@ typedef struct hb_work_info_s
     };
 } hb_work_info_t;
 
+#ifdef __LIBHB__
+// Where a work or filter thread spends its time, see hb_work_loop
+typedef struct
+{
+    uint64_t work;      // us in work()
+    uint64_t wait_in;   // us waiting for input
+    uint64_t wait_out;  // us waiting for room in the output fifo
+    int      buf_in;    // buffers taken from the input fifo
+    int      buf_out;   // buffers pushed to the output fifo
+} hb_work_stats_t;
+#endif
+
 struct hb_work_object_s
 {
     int                 id;
@@ -1199,6 +1216,8 @@ struct hb_work_object_s
     hb_work_object_t  * next;
 
     hb_handle_t       * h;
+
+    hb_work_stats_t     stats;
 #endif
 };
 
@@ -1227,6 +1246,7 @@ extern hb_work_object_t hb_encca_aac;
 extern hb_work_object_t hb_encca_haac;
 extern hb_work_object_t hb_encavcodeca;
 extern hb_work_object_t hb_reader;
+extern hb_work_object_t hb_frame_cache_replay;
 
 #define HB_FILTER_OK      0
 #define HB_FILTER_DELAY   1
@@ -1288,6 +1308,11 @@ struct hb_filter_object_s
     int64_t               chapter_time;
 
     hb_filter_object_t  * sub_filter;
+
+    // Output is also recorded here when the frame cache is recording
+    struct hb_frame_cache_stream_s * cache;
+
+    hb_work_stats_t       stats;
 #endif
 };
 
@@ -1326,9 +1351,7 @@ enum
     HB_FILTER_QSV_POST,
     // default MSDK VPP filter
     HB_FILTER_QSV,
-    HB_FILTER_LAST = HB_FILTER_QSV,
-    // wrapper filter for frame based multi-threading of simple filters
-    HB_FILTER_MT_FRAME
+    HB_FILTER_LAST = HB_FILTER_QSV
 };
 
 hb_filter_object_t * hb_filter_get( int filter_id );
@@ -10,6 +10,32 @@
 #include "hb.h"
 #include "hbffmpeg.h"
 #include "common.h"
+#include "taskset.h"
+
+/*
+ * The output frame is split into horizontal bands that are scaled
+ * concurrently, each with its own SwsContext.  Band boundaries are placed
+ * on output rows that map to whole (even) source rows so every band uses
+ * the same scale factor and filter phase as a whole frame scale.  Each
+ * band is scaled with a few extra rows above and below into a scratch
+ * buffer so the Lanczos taps at the seams see the same neighbours they
+ * would in a whole frame scale; only the band's own rows are copied out.
+ */
+#define CROP_SCALE_MIN_BAND  64   // Minimum output rows per band
+#define CROP_SCALE_TAPS      3    // Lanczos filter radius
+
+typedef struct
+{
+    hb_filter_private_t * pv;
+    struct SwsContext   * context;
+    int                   src_y;    // First source row scaled, incl. margin
+    int                   src_h;    // Source rows scaled, incl. margins
+    int                   dst_y;    // First output row of this band
+    int                   dst_h;    // Output rows of this band
+    int                   margin;   // Extra rows scaled above dst_y
+    hb_buffer_t         * scratch;  // Band output with margins, NULL if
+                                    // the band has no margins
+} crop_scale_thread_arg_t;
 
 struct hb_filter_private_s
 {
@@ -21,8 +47,12 @@ struct hb_filter_private_s
     int                 width_out;
     int                 height_out;
     int                 crop[4];
-    
-    struct SwsContext * context;
+
+    int                 nbands;
+    taskset_t           taskset;    // One task per band
+    uint8_t           * crop_data[4];
+    int                 crop_stride[4];
+    hb_buffer_t       * out;
 };
 
 static int hb_crop_scale_init( hb_filter_object_t * filter,
@@ -36,6 +66,8 @@ static hb_filter_info_t * hb_crop_scale_info( hb_filter_object_t * filter );
 
 static void hb_crop_scale_close( hb_filter_object_t * filter );
 
+static void crop_scale_thread( void * thread_args_v );
+
 static const char crop_scale_template[] =
     "width=^"HB_INT_REG"$:height=^"HB_INT_REG"$:"
     "crop-top=^"HB_INT_REG"$:crop-bottom=^"HB_INT_REG"$:"
@@ -115,6 +147,138 @@ static hb_filter_info_t * hb_crop_scale_info( hb_filter_object_t * filter )
     return info;
 }
 
+static void crop_scale_free_bands( hb_filter_private_t * pv )
+{
+    int ii;
+
+    for (ii = 0; ii < pv->nbands; ii++)
+    {
+        crop_scale_thread_arg_t * band;
+
+        band = taskset_thread_args(&pv->taskset, ii);
+        if (band->context != NULL)
+        {
+            sws_freeContext(band->context);
+        }
+        hb_buffer_close(&band->scratch);
+    }
+    if (pv->nbands > 0)
+    {
+        taskset_fini(&pv->taskset);
+    }
+    pv->nbands = 0;
+}
+
+static int gcd( int a, int b )
+{
+    while (b != 0)
+    {
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// Choose the output bands and create a scaling context for each
+static int crop_scale_setup_bands( hb_filter_private_t * pv,
+                                   hb_buffer_t * in, hb_buffer_t * out )
+{
+    int src_w = in->f.width  - (pv->crop[2] + pv->crop[3]);
+    int src_h = in->f.height - (pv->crop[0] + pv->crop[1]);
+    int dst_w = out->f.width;
+    int dst_h = out->f.height;
+    int nbands, unit, margin, ii;
+
+    crop_scale_free_bands(pv);
+
+    // Output rows in 'unit' steps map to whole, even source rows
+    int g = gcd(src_h, dst_h);
+    int u = dst_h / g;
+    int v = src_h / g;
+    unit = ((u | v) & 1) ? 2 * u : u;
+
+    // Rows on each side of a seam that the filter taps reach,
+    // measured in output rows and doubled for subsampled chroma
+    int upscale = (dst_h + src_h - 1) / src_h;
+    margin = 2 * (CROP_SCALE_TAPS * upscale + 1);
+    margin = (margin + unit - 1) / unit * unit;
+
+    nbands = hb_get_cpu_count();
+    if (nbands > dst_h / CROP_SCALE_MIN_BAND)
+    {
+        nbands = dst_h / CROP_SCALE_MIN_BAND;
+    }
+    if (nbands > dst_h / unit)
+    {
+        nbands = dst_h / unit;
+    }
+    if ((src_h | dst_h) & 1 || margin * 2 > dst_h / (nbands > 0 ? nbands : 1))
+    {
+        nbands = 1;
+    }
+    if (nbands < 1)
+    {
+        nbands = 1;
+    }
+
+    if (taskset_init(&pv->taskset, nbands, sizeof(crop_scale_thread_arg_t),
+                     crop_scale_thread) == 0)
+    {
+        hb_error("crop scale could not initialize taskset");
+        return -1;
+    }
+    pv->nbands = nbands;
+
+    for (ii = 0; ii < nbands; ii++)
+    {
+        crop_scale_thread_arg_t * band;
+        int top, bottom;
+
+        band = taskset_thread_args(&pv->taskset, ii);
+        band->pv      = pv;
+        band->dst_y   = (int64_t)(dst_h / unit) * ii / nbands * unit;
+        if (ii == nbands - 1)
+        {
+            band->dst_h = dst_h - band->dst_y;
+        }
+        else
+        {
+            band->dst_h = (int64_t)(dst_h / unit) * (ii + 1) / nbands * unit -
+                          band->dst_y;
+        }
+
+        top    = band->dst_y - margin;
+        bottom = band->dst_y + band->dst_h + margin;
+        if (top < 0)
+            top = 0;
+        if (bottom > dst_h)
+            bottom = dst_h;
+
+        band->margin = band->dst_y - top;
+        band->src_y  = (int64_t)top * src_h / dst_h;
+        band->src_h  = (int64_t)bottom * src_h / dst_h - band->src_y;
+
+        band->context = hb_sws_get_context(
+                            src_w, band->src_h, in->f.fmt,
+                            dst_w, bottom - top, out->f.fmt,
+                            SWS_LANCZOS|SWS_ACCURATE_RND,
+                            hb_ff_get_colorspace(pv->job->title->color_matrix));
+        if (band->context == NULL)
+        {
+            crop_scale_free_bands(pv);
+            return -1;
+        }
+        if (nbands > 1)
+        {
+            band->scratch = hb_frame_buffer_init(out->f.fmt, dst_w,
+                                                 bottom - top);
+        }
+    }
+
+    return 0;
+}
+
 static void hb_crop_scale_close( hb_filter_object_t * filter )
 {
     hb_filter_private_t * pv = filter->private_data;
@@ -124,61 +288,109 @@ static void hb_crop_scale_close( hb_filter_object_t * filter )
         return;
     }
 
-    if( pv->context )
-    {
-        sws_freeContext( pv->context );
-    }
+    crop_scale_free_bands( pv );
 
     free( pv );
     filter->private_data = NULL;
 }
 
+/*
+ * Scale one band of the output frame.
+ */
+static void crop_scale_thread( void * thread_args_v )
+{
+    crop_scale_thread_arg_t * band = thread_args_v;
+    hb_filter_private_t     * pv = band->pv;
+    hb_buffer_t             * out = pv->out;
+    uint8_t                 * src_data[4] = {NULL}, * dst_data[4];
+    int                       dst_stride[4];
+    int                       pp, y_shift;
+
+    y_shift = av_pix_fmt_desc_get(pv->pix_fmt)->log2_chroma_h;
+    for (pp = 0; pp < 3; pp++)
+    {
+        int shift = pp ? y_shift : 0;
+        src_data[pp] = pv->crop_data[pp] +
+                       (band->src_y >> shift) * pv->crop_stride[pp];
+    }
+
+    if (band->scratch == NULL)
+    {
+        // Whole frame, scale directly into the output
+        hb_picture_fill(dst_data, dst_stride, out);
+        sws_scale(band->context,
+                  (const uint8_t* const*)src_data, pv->crop_stride,
+                  0, band->src_h, dst_data, dst_stride);
+        return;
+    }
+
+    hb_picture_fill(dst_data, dst_stride, band->scratch);
+    sws_scale(band->context,
+              (const uint8_t* const*)src_data, pv->crop_stride,
+              0, band->src_h, dst_data, dst_stride);
+
+    // Copy this band's rows, leaving out the margins
+    y_shift = av_pix_fmt_desc_get(out->f.fmt)->log2_chroma_h;
+    for (pp = 0; pp < 3; pp++)
+    {
+        int      shift = pp ? y_shift : 0;
+        int      yy, first, last;
+        uint8_t *src, *dst;
+
+        first = band->dst_y >> shift;
+        last  = (band->dst_y + band->dst_h + (1 << shift) - 1) >> shift;
+        src   = band->scratch->plane[pp].data +
+                (band->margin >> shift) * band->scratch->plane[pp].stride;
+        dst   = out->plane[pp].data + first * out->plane[pp].stride;
+        for (yy = first; yy < last; yy++)
+        {
+            memcpy(dst, src, out->plane[pp].width);
+            src += band->scratch->plane[pp].stride;
+            dst += out->plane[pp].stride;
+        }
+    }
+}
+
 static hb_buffer_t* crop_scale( hb_filter_private_t * pv, hb_buffer_t * in )
 {
     hb_buffer_t * out;
-    uint8_t     * crop_data[4], * out_data[4];
-    int           crop_stride[4], out_stride[4];
 
     out = hb_video_buffer_init( pv->width_out, pv->height_out );
-    hb_picture_fill(out_data, out_stride, out);
 
     // Crop; this alters the pointer to the data to point to the
     // correct place for cropped frame
-    hb_picture_crop(crop_data, crop_stride, in, pv->crop[0], pv->crop[2]);
+    hb_picture_crop(pv->crop_data, pv->crop_stride, in,
+                    pv->crop[0], pv->crop[2]);
 
-    if (pv->context   == NULL         ||
+    if (pv->nbands    == 0            ||
         pv->width_in  != in->f.width  ||
         pv->height_in != in->f.height ||
         pv->pix_fmt   != in->f.fmt)
     {
-        // Something changed, need a new scaling context.
-        if (pv->context != NULL)
-        {
-            sws_freeContext(pv->context);
-        }
-        
-        pv->context = hb_sws_get_context(
-                            in->f.width  - (pv->crop[2] + pv->crop[3]),
-                            in->f.height - (pv->crop[0] + pv->crop[1]),
-                            in->f.fmt, out->f.width, out->f.height,
-                            out->f.fmt, SWS_LANCZOS|SWS_ACCURATE_RND,
-                            hb_ff_get_colorspace(pv->job->title->color_matrix));
+        // Something changed, need new scaling contexts.
         pv->width_in  = in->f.width;
         pv->height_in = in->f.height;
         pv->pix_fmt   = in->f.fmt;
+        crop_scale_setup_bands(pv, in, out);
     }
 
-    if (pv->context == NULL)
+    if (pv->nbands == 0)
     {
         hb_buffer_close(&out);
         return NULL;
     }
 
-    // Scale crop into out according to the context set up above
-    sws_scale(pv->context,
-              (const uint8_t* const*)crop_data, crop_stride,
-              0, in->f.height - (pv->crop[0] + pv->crop[1]),
-              out_data, out_stride);
+    // Scale crop into out, one band per task
+    pv->out = out;
+    if (pv->nbands == 1)
+    {
+        crop_scale_thread(taskset_thread_args(&pv->taskset, 0));
+    }
+    else
+    {
+        taskset_cycle(&pv->taskset);
+    }
+    pv->out = NULL;
 
     out->s = in->s;
     return out;
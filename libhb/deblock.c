@@ -18,6 +18,8 @@
 
 #include "hb.h"
 #include "hbffmpeg.h"
+#include "taskset.h"
+#include "deblock.h"
 
 #define PP7_QP_DEFAULT    5
 #define PP7_MODE_DEFAULT  2
@@ -25,9 +27,15 @@
 #define XMIN(a,b) ((a) < (b) ? (a) : (b))
 #define XMAX(a,b) ((a) > (b) ? (a) : (b))
 
-typedef short DCTELEM;
-
 //===========================================================================//
+const int pp7_factor[16] =
+{
+    PP7_N/(PP7_N0*PP7_N0), PP7_N/(PP7_N0*PP7_N1), PP7_N/(PP7_N0*PP7_N0), PP7_N/(PP7_N0*PP7_N2),
+    PP7_N/(PP7_N1*PP7_N0), PP7_N/(PP7_N1*PP7_N1), PP7_N/(PP7_N1*PP7_N0), PP7_N/(PP7_N1*PP7_N2),
+    PP7_N/(PP7_N0*PP7_N0), PP7_N/(PP7_N0*PP7_N1), PP7_N/(PP7_N0*PP7_N0), PP7_N/(PP7_N0*PP7_N2),
+    PP7_N/(PP7_N2*PP7_N0), PP7_N/(PP7_N2*PP7_N1), PP7_N/(PP7_N2*PP7_N0), PP7_N/(PP7_N2*PP7_N2),
+};
+
 static const uint8_t  __attribute__((aligned(8))) pp7_dither[8][8] =
 {
     {  0,  48,  12,  60,   3,  51,  15,  63, },
@@ -40,13 +48,28 @@ static const uint8_t  __attribute__((aligned(8))) pp7_dither[8][8] =
     { 42,  26,  38,  22,  41,  25,  37,  21, },
 };
 
+typedef struct
+{
+    hb_filter_private_t * pv;
+    int                   segment;
+    DCTELEM             * block;    // DCT scratch of this thread
+} deblock_thread_arg_t;
+
 struct hb_filter_private_s
 {
     int           pp7_qp;
     int           pp7_mode;
     int           pp7_mpeg2;
     int           pp7_temp_stride;
-    uint8_t     * pp7_src;
+    uint8_t     * pp7_src[3];       // Plane copies with mirrored borders
+    int           pp7_threshold[99][16];
+
+    PP7Functions  functions;
+
+    int           cpu_count;
+    taskset_t     taskset;          // Tasks - one per CPU, a band of rows each
+    hb_buffer_t * in;
+    hb_buffer_t * out;
 };
 
 static int hb_deblock_init( hb_filter_object_t * filter,
@@ -73,7 +96,7 @@ hb_filter_object_t hb_filter_deblock =
     .settings_template = deblock_template,
 };
 
-static inline void pp7_dct_a( DCTELEM * dst, uint8_t * src, int stride )
+static void pp7_dct_a( DCTELEM * dst, const uint8_t * src, int stride )
 {
     int i;
 
@@ -100,7 +123,7 @@ static inline void pp7_dct_a( DCTELEM * dst, uint8_t * src, int stride )
     }
 }
 
-static void pp7_dct_b( DCTELEM * dst, DCTELEM * src )
+static void pp7_dct_b( DCTELEM * dst, const DCTELEM * src )
 {
     int i;
 
@@ -127,25 +150,11 @@ static void pp7_dct_b( DCTELEM * dst, DCTELEM * src )
     }
 }
 
-#define N   (1<<16)
-#define N0  4
-#define N1  5
-#define N2  10
 #define SN0 2
 #define SN1 2.2360679775
 #define SN2 3.16227766017
 
-static const int pp7_factor[16] =
-{
-    N/(N0*N0), N/(N0*N1), N/(N0*N0),N/(N0*N2),
-    N/(N1*N0), N/(N1*N1), N/(N1*N0),N/(N1*N2),
-    N/(N0*N0), N/(N0*N1), N/(N0*N0),N/(N0*N2),
-    N/(N2*N0), N/(N2*N1), N/(N2*N0),N/(N2*N2),
-};
-
-static int pp7_threshold[99][16];
-
-static void pp7_init_threshold( void )
+static void pp7_init_threshold( hb_filter_private_t * pv )
 {
     int qp, i;
     int bias = 0;
@@ -154,14 +163,14 @@ static void pp7_init_threshold( void )
     {
         for( i = 0; i < 16; i++ )
         {
-            pp7_threshold[qp][i] =
+            pv->pp7_threshold[qp][i] =
                 ((i&1)?SN2:SN0) * ((i&4)?SN2:SN0) *
                  XMAX(1,qp) * (1<<2) - 1 - bias;
         }
     }
 }
 
-static int pp7_hard_threshold( DCTELEM * src, int qp )
+static int pp7_hard_threshold( const DCTELEM * src, const int * threshold )
 {
     int i;
     int a;
@@ -169,7 +178,7 @@ static int pp7_hard_threshold( DCTELEM * src, int qp )
     a = src[0] * pp7_factor[0];
     for( i = 1; i < 16; i++ )
     {
-        unsigned int threshold1 = pp7_threshold[qp][i];
+        unsigned int threshold1 = threshold[i];
         unsigned int threshold2 = (threshold1<<1);
         int level= src[i];
         if( ((unsigned)(level+threshold1)) > threshold2 )
@@ -180,7 +189,7 @@ static int pp7_hard_threshold( DCTELEM * src, int qp )
     return (a + (1<<11)) >> 12;
 }
 
-static int pp7_medium_threshold( DCTELEM * src, int qp )
+static int pp7_medium_threshold( const DCTELEM * src, const int * threshold )
 {
     int i;
     int a;
@@ -188,7 +197,7 @@ static int pp7_medium_threshold( DCTELEM * src, int qp )
     a = src[0] * pp7_factor[0];
     for( i = 1; i < 16; i++ )
     {
-        unsigned int threshold1 = pp7_threshold[qp][i];
+        unsigned int threshold1 = threshold[i];
         unsigned int threshold2 = (threshold1<<1);
         int level= src[i];
         if( ((unsigned)(level+threshold1)) > threshold2 )
@@ -213,7 +222,7 @@ static int pp7_medium_threshold( DCTELEM * src, int qp )
     return (a + (1<<11)) >> 12;
 }
 
-static int pp7_soft_threshold( DCTELEM * src, int qp )
+static int pp7_soft_threshold( const DCTELEM * src, const int * threshold )
 {
     int i;
     int a;
@@ -221,7 +230,7 @@ static int pp7_soft_threshold( DCTELEM * src, int qp )
     a = src[0] * pp7_factor[0];
     for( i = 1; i < 16; i++ )
     {
-        unsigned int threshold1 = pp7_threshold[qp][i];
+        unsigned int threshold1 = threshold[i];
         unsigned int threshold2 = (threshold1<<1);
         int level= src[i];
         if( ((unsigned)(level+threshold1))>threshold2 )
@@ -239,25 +248,27 @@ static int pp7_soft_threshold( DCTELEM * src, int qp )
     return (a + (1<<11)) >> 12;
 }
 
-static int ( * pp7_requantize )( DCTELEM * src, int qp ) = pp7_hard_threshold;
+static inline int pp7_stride( hb_filter_private_t * pv, int width, int plane )
+{
+    return plane == 0 ? pv->pp7_temp_stride : ((width+16+15)&(~15));
+}
 
-static void pp7_filter( hb_filter_private_t * pv,
-                        uint8_t * dst,
-                        uint8_t * src,
-                        int width,
-                        int height,
-                        uint8_t * qp_store,
-                        int qp_stride,
-                        int is_luma)
+/*
+ * Copies a plane to pv->pp7_src[plane] and mirrors 8 pixels of it
+ * into the border on each side.
+ */
+static void pp7_pad( hb_filter_private_t * pv,
+                     int plane,
+                     uint8_t * src,
+                     int width,
+                     int height )
 {
     int x, y;
 
-    const int  stride = is_luma ? pv->pp7_temp_stride : ((width+16+15)&(~15));
-    uint8_t  * p_src  = pv->pp7_src + 8*stride;
-    DCTELEM  * block  = (DCTELEM *)(pv->pp7_src);
-    DCTELEM  * temp   = (DCTELEM *)(pv->pp7_src + 32);
+    const int  stride = pp7_stride( pv, width, plane );
+    uint8_t  * p_src  = pv->pp7_src[plane] + 8*stride;
 
-    if( !src || !dst )
+    if( !src )
     {
         return;
     }
@@ -281,8 +292,38 @@ static void pp7_filter( hb_filter_private_t * pv,
         memcpy( p_src + (height+8+y)*stride,
                 p_src + (height-y+7)*stride, stride );
     }
+}
 
-    for( y = 0; y < height; y++ )
+/*
+ * Filters rows y_start to y_end - 1 of a plane that was padded by
+ * pp7_pad.  Rows only depend on the padded plane, so bands of rows
+ * can be filtered in parallel.
+ */
+static void pp7_filter( hb_filter_private_t * pv,
+                        DCTELEM * block,
+                        int plane,
+                        uint8_t * dst,
+                        int width,
+                        int height,
+                        uint8_t * qp_store,
+                        int qp_stride,
+                        int y_start,
+                        int y_end )
+{
+    int x, y;
+
+    const int      is_luma   = plane == 0;
+    const int      stride    = pp7_stride( pv, width, plane );
+    uint8_t      * p_src     = pv->pp7_src[plane] + 8*stride;
+    DCTELEM      * temp      = block + 16;
+    PP7Functions * functions = &pv->functions;
+
+    if( !dst )
+    {
+        return;
+    }
+
+    for( y = y_start; y < y_end; y++ )
     {
         for( x = -8; x < 0; x += 4 )
         {
@@ -290,7 +331,7 @@ static void pp7_filter( hb_filter_private_t * pv,
             uint8_t * src   = p_src + index;
             DCTELEM * tp    = temp+4*x;
 
-            pp7_dct_a( tp+4*8, src, stride );
+            functions->dct_a( tp+4*8, src, stride );
         }
 
         for( x = 0; x < width; )
@@ -323,12 +364,12 @@ static void pp7_filter( hb_filter_private_t * pv,
 
                 if( (x&3) == 0 )
                 {
-                    pp7_dct_a( tp+4*8, src, stride );
+                    functions->dct_a( tp+4*8, src, stride );
                 }
 
-                pp7_dct_b( block, tp );
+                functions->dct_b( block, tp );
 
-                v = pp7_requantize( block, qp );
+                v = functions->requantize( block, pv->pp7_threshold[qp] );
                 v = (v + pp7_dither[y&7][x&7]) >> 6;
                 if( (unsigned)v > 255 )
                 {
@@ -340,6 +381,32 @@ static void pp7_filter( hb_filter_private_t * pv,
     }
 }
 
+/*
+ * Filters this thread's band of rows of all three planes.
+ */
+static void deblock_thread( void * thread_args_v )
+{
+    deblock_thread_arg_t * thread_args = thread_args_v;
+    hb_filter_private_t  * pv          = thread_args->pv;
+    int                    segment     = thread_args->segment;
+    int                    c, height;
+
+    for( c = 0; c < 3; c++ )
+    {
+        height = pv->in->plane[c].height;
+        pp7_filter( pv,
+                    thread_args->block,
+                    c,
+                    pv->out->plane[c].data,
+                    pv->in->plane[c].stride,
+                    height,
+                    NULL, /* TODO: mpi->qscale*/
+                    0,    /* TODO: mpi->qstride*/
+                    height *  segment      / pv->cpu_count,
+                    height * (segment + 1) / pv->cpu_count );
+    }
+}
+
 static int hb_deblock_init( hb_filter_object_t * filter, 
                             hb_filter_init_t * init )
 {
@@ -358,28 +425,71 @@ static int hb_deblock_init( hb_filter_object_t * filter,
         pv->pp7_qp = 0;
     }
 
-    pp7_init_threshold();
+    pp7_init_threshold( pv );
+
+    PP7Functions * functions = &pv->functions;
 
+    functions->dct_a = pp7_dct_a;
+    functions->dct_b = pp7_dct_b;
     switch( pv->pp7_mode )
     {
         case 0:
-            pp7_requantize = pp7_hard_threshold;
+        default:
+            functions->requantize = pp7_hard_threshold;
             break;
         case 1:
-            pp7_requantize = pp7_soft_threshold;
+            functions->requantize = pp7_soft_threshold;
             break;
         case 2:
-            pp7_requantize = pp7_medium_threshold;
+            functions->requantize = pp7_medium_threshold;
             break;
     }
+#if defined(ARCH_X86)
+    pp7_init_x86( functions, pv->pp7_mode );
+#endif
 
     int h = (init->geometry.height + 16 + 15) & (~15);
 
-    pv->pp7_temp_stride = (init->geometry.width + 16 + 15) & (~15);
+    // Rows hold a whole luma line, including the stride padding
+    pv->pp7_temp_stride = (hb_image_stride( AV_PIX_FMT_YUV420P,
+                                            init->geometry.width, 0 ) +
+                           16 + 15) & (~15);
+
+    int ii;
+    for( ii = 0; ii < 3; ii++ )
+    {
+        pv->pp7_src[ii] = malloc( pv->pp7_temp_stride*(h+8)*sizeof(uint8_t) );
+    }
 
-    pv->pp7_src = (uint8_t*)malloc( pv->pp7_temp_stride*(h+8)*sizeof(uint8_t) );
+    pv->cpu_count = hb_get_cpu_count();
+    if( taskset_init( &pv->taskset, pv->cpu_count,
+                      sizeof( deblock_thread_arg_t ), deblock_thread ) == 0 )
+    {
+        hb_error( "deblock could not initialize taskset" );
+        goto fail;
+    }
+
+    for( ii = 0; ii < pv->cpu_count; ii++ )
+    {
+        deblock_thread_arg_t * thread_args;
+
+        thread_args = taskset_thread_args( &pv->taskset, ii );
+        thread_args->pv      = pv;
+        thread_args->segment = ii;
+        thread_args->block   = malloc( 4 * pv->pp7_temp_stride *
+                                       sizeof(DCTELEM) );
+        if( thread_args->block == NULL )
+        {
+            hb_error( "deblock could not allocate thread buffers" );
+            goto fail;
+        }
+    }
 
     return 0;
+
+fail:
+    hb_deblock_close( filter );
+    return -1;
 }
 
 static void hb_deblock_close( hb_filter_object_t * filter )
@@ -391,6 +501,21 @@ static void hb_deblock_close( hb_filter_object_t * filter )
         return;
     }
 
+    int ii;
+    for( ii = 0; ii < pv->taskset.thread_count; ii++ )
+    {
+        deblock_thread_arg_t * thread_args;
+
+        thread_args = taskset_thread_args( &pv->taskset, ii );
+        free( thread_args->block );
+    }
+    taskset_fini( &pv->taskset );
+
+    for( ii = 0; ii < 3; ii++ )
+    {
+        free( pv->pp7_src[ii] );
+    }
+
     free( pv );
     filter->private_data = NULL;
 }
@@ -411,34 +536,19 @@ static int hb_deblock_work( hb_filter_object_t * filter,
 
     if( /*TODO: mpi->qscale ||*/ pv->pp7_qp )
     {
-        out = hb_video_buffer_init( in->f.width, in->f.height );
+        int c;
 
-        pp7_filter( pv,
-                out->plane[0].data,
-                in->plane[0].data,
-                in->plane[0].stride,
-                in->plane[0].height,
-                NULL, /* TODO: mpi->qscale*/
-                0,    /* TODO: mpi->qstride*/
-                1 );
+        out = hb_video_buffer_init( in->f.width, in->f.height );
 
-        pp7_filter( pv,
-                out->plane[1].data,
-                in->plane[1].data,
-                in->plane[1].stride,
-                in->plane[1].height,
-                NULL, /* TODO: mpi->qscale*/
-                0,    /* TODO: mpi->qstride*/
-                0 );
+        for( c = 0; c < 3; c++ )
+        {
+            pp7_pad( pv, c, in->plane[c].data,
+                     in->plane[c].stride, in->plane[c].height );
+        }
 
-        pp7_filter( pv,
-                out->plane[2].data,
-                in->plane[2].data,
-                in->plane[2].stride,
-                in->plane[2].height,
-                NULL, /* TODO: mpi->qscale*/
-                0,    /* TODO: mpi->qstride*/
-                0 );
+        pv->in  = in;
+        pv->out = out;
+        taskset_cycle( &pv->taskset );
 
         out->s = in->s;
 
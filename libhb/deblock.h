@@ -0,0 +1,36 @@
+/* deblock.h
+
+   Copyright (c) 2003-2018 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#ifndef HB_DEBLOCK_H
+#define HB_DEBLOCK_H
+
+typedef short DCTELEM;
+
+#define PP7_N   (1<<16)
+#define PP7_N0  4
+#define PP7_N1  5
+#define PP7_N2  10
+
+// Scale factors of the 4x4 DCT coefficients, defined in deblock.c
+extern const int pp7_factor[16];
+
+typedef struct
+{
+    // Vertical pass of 4 columns, stored transposed
+    void (*dct_a)(DCTELEM *dst, const uint8_t *src, int stride);
+    // Horizontal pass of a 4x4 block
+    void (*dct_b)(DCTELEM *dst, const DCTELEM *src);
+    // Thresholds the coefficients of a block and returns the filtered
+    // pixel.  threshold is the row of the threshold table for the qp.
+    int  (*requantize)(const DCTELEM *src, const int *threshold);
+} PP7Functions;
+
+void pp7_init_x86(PP7Functions *functions, int mode);
+
+#endif // HB_DEBLOCK_H
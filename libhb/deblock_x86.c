@@ -0,0 +1,210 @@
+/* deblock_x86.c
+
+   Copyright (c) 2003-2018 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#include "hb.h"     // needed for ARCH_X86
+
+#if defined(ARCH_X86)
+
+#include <emmintrin.h>
+
+#include "libavutil/cpu.h"
+#include "deblock.h"
+
+/*
+ * All coefficients of 8 bit input fit in 16 bits, so the DCTs are done
+ * with 16 bit lanes and give the same result as the scalar code.
+ */
+
+// Butterflies shared by both passes, x0 to x6 are the 7 taps
+#define PP7_DCT_SSE2(x0, x1, x2, x3, x4, x5, x6, d0, d1, d2, d3)  \
+{                                                                  \
+    __m128i s0 = _mm_add_epi16(x0, x6);                            \
+    __m128i s1 = _mm_add_epi16(x1, x5);                            \
+    __m128i s2 = _mm_add_epi16(x2, x4);                            \
+    __m128i s  = _mm_add_epi16(x3, x3);                            \
+    __m128i s3;                                                    \
+                                                                   \
+    s3 = _mm_sub_epi16(s,  s0);                                    \
+    s0 = _mm_add_epi16(s,  s0);                                    \
+    s  = _mm_add_epi16(s2, s1);                                    \
+    s2 = _mm_sub_epi16(s2, s1);                                    \
+                                                                   \
+    d0 = _mm_add_epi16(s0, s);                                     \
+    d2 = _mm_sub_epi16(s0, s);                                     \
+    d1 = _mm_add_epi16(_mm_add_epi16(s3, s3), s2);                 \
+    d3 = _mm_sub_epi16(s3, _mm_add_epi16(s2, s2));                 \
+}
+
+static inline __m128i load_4x8(const uint8_t *src)
+{
+    int32_t v;
+
+    memcpy(&v, src, sizeof(v));
+    return _mm_unpacklo_epi8(_mm_cvtsi32_si128(v), _mm_setzero_si128());
+}
+
+static void pp7_dct_a_sse2(DCTELEM *dst, const uint8_t *src, int stride)
+{
+    __m128i d0, d1, d2, d3, t0, t1;
+
+    // One lane per column
+    PP7_DCT_SSE2(load_4x8(src + 0*stride), load_4x8(src + 1*stride),
+                 load_4x8(src + 2*stride), load_4x8(src + 3*stride),
+                 load_4x8(src + 4*stride), load_4x8(src + 5*stride),
+                 load_4x8(src + 6*stride), d0, d1, d2, d3);
+
+    // Transpose, column i goes to dst[4*i]
+    t0 = _mm_unpacklo_epi16(d0, d1);
+    t1 = _mm_unpacklo_epi16(d2, d3);
+    _mm_storeu_si128((__m128i*)(dst + 0), _mm_unpacklo_epi32(t0, t1));
+    _mm_storeu_si128((__m128i*)(dst + 8), _mm_unpackhi_epi32(t0, t1));
+}
+
+static void pp7_dct_b_sse2(DCTELEM *dst, const DCTELEM *src)
+{
+    __m128i d0, d1, d2, d3;
+
+    PP7_DCT_SSE2(_mm_loadl_epi64((const __m128i*)(src + 0*4)),
+                 _mm_loadl_epi64((const __m128i*)(src + 1*4)),
+                 _mm_loadl_epi64((const __m128i*)(src + 2*4)),
+                 _mm_loadl_epi64((const __m128i*)(src + 3*4)),
+                 _mm_loadl_epi64((const __m128i*)(src + 4*4)),
+                 _mm_loadl_epi64((const __m128i*)(src + 5*4)),
+                 _mm_loadl_epi64((const __m128i*)(src + 6*4)),
+                 d0, d1, d2, d3);
+
+    _mm_storeu_si128((__m128i*)(dst + 0), _mm_unpacklo_epi64(d0, d1));
+    _mm_storeu_si128((__m128i*)(dst + 8), _mm_unpacklo_epi64(d2, d3));
+}
+
+/*
+ * The requantizers load the 16 thresholds as 16 bit values.  The DC
+ * threshold is zeroed so that the DC coefficient always passes as is,
+ * like it does in the scalar code.
+ */
+static inline void load_threshold(const int *threshold, __m128i *lo, __m128i *hi)
+{
+    const __m128i no_dc = _mm_set_epi16(-1, -1, -1, -1, -1, -1, -1, 0);
+
+    *lo = _mm_packs_epi32(_mm_loadu_si128((const __m128i*)(threshold + 0)),
+                          _mm_loadu_si128((const __m128i*)(threshold + 4)));
+    *hi = _mm_packs_epi32(_mm_loadu_si128((const __m128i*)(threshold + 8)),
+                          _mm_loadu_si128((const __m128i*)(threshold + 12)));
+    *lo = _mm_and_si128(*lo, no_dc);
+}
+
+static inline int weighted_sum(__m128i lo, __m128i hi)
+{
+    const __m128i factor_lo = _mm_setr_epi16(pp7_factor[0],  pp7_factor[1],
+                                             pp7_factor[2],  pp7_factor[3],
+                                             pp7_factor[4],  pp7_factor[5],
+                                             pp7_factor[6],  pp7_factor[7]);
+    const __m128i factor_hi = _mm_setr_epi16(pp7_factor[8],  pp7_factor[9],
+                                             pp7_factor[10], pp7_factor[11],
+                                             pp7_factor[12], pp7_factor[13],
+                                             pp7_factor[14], pp7_factor[15]);
+    __m128i sum;
+
+    sum = _mm_add_epi32(_mm_madd_epi16(lo, factor_lo),
+                        _mm_madd_epi16(hi, factor_hi));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+
+    return (_mm_cvtsi128_si32(sum) + (1<<11)) >> 12;
+}
+
+// Coefficients outside of -t..t, and the coefficient minus t toward 0
+static inline __m128i threshold_soft(__m128i level, __m128i t, __m128i *pass)
+{
+    __m128i pos = _mm_cmpgt_epi16(level, t);
+    __m128i neg = _mm_cmpgt_epi16(_mm_sub_epi16(_mm_setzero_si128(), t), level);
+
+    *pass = _mm_or_si128(pos, neg);
+    return _mm_add_epi16(_mm_sub_epi16(level, _mm_and_si128(t, pos)),
+                         _mm_and_si128(t, neg));
+}
+
+static int pp7_hard_threshold_sse2(const DCTELEM *src, const int *threshold)
+{
+    __m128i lo = _mm_loadu_si128((const __m128i*)(src + 0));
+    __m128i hi = _mm_loadu_si128((const __m128i*)(src + 8));
+    __m128i t_lo, t_hi, pass_lo, pass_hi;
+
+    load_threshold(threshold, &t_lo, &t_hi);
+    threshold_soft(lo, t_lo, &pass_lo);
+    threshold_soft(hi, t_hi, &pass_hi);
+
+    return weighted_sum(_mm_and_si128(lo, pass_lo), _mm_and_si128(hi, pass_hi));
+}
+
+static int pp7_soft_threshold_sse2(const DCTELEM *src, const int *threshold)
+{
+    __m128i lo = _mm_loadu_si128((const __m128i*)(src + 0));
+    __m128i hi = _mm_loadu_si128((const __m128i*)(src + 8));
+    __m128i t_lo, t_hi, pass_lo, pass_hi;
+
+    load_threshold(threshold, &t_lo, &t_hi);
+    lo = threshold_soft(lo, t_lo, &pass_lo);
+    hi = threshold_soft(hi, t_hi, &pass_hi);
+
+    return weighted_sum(_mm_and_si128(lo, pass_lo), _mm_and_si128(hi, pass_hi));
+}
+
+// Coefficients outside of -2t..2t pass as is, others are soft thresholded
+// and doubled
+static inline __m128i threshold_medium(__m128i level, __m128i t)
+{
+    __m128i t2 = _mm_add_epi16(t, t);
+    __m128i pass, soft, hard;
+
+    soft = threshold_soft(level, t, &pass);
+    soft = _mm_add_epi16(soft, soft);
+    hard = _mm_or_si128(_mm_cmpgt_epi16(level, t2),
+                        _mm_cmpgt_epi16(_mm_sub_epi16(_mm_setzero_si128(), t2), level));
+
+    level = _mm_or_si128(_mm_and_si128(hard, level),
+                         _mm_andnot_si128(hard, soft));
+    return _mm_and_si128(level, pass);
+}
+
+static int pp7_medium_threshold_sse2(const DCTELEM *src, const int *threshold)
+{
+    __m128i lo = _mm_loadu_si128((const __m128i*)(src + 0));
+    __m128i hi = _mm_loadu_si128((const __m128i*)(src + 8));
+    __m128i t_lo, t_hi;
+
+    load_threshold(threshold, &t_lo, &t_hi);
+
+    return weighted_sum(threshold_medium(lo, t_lo), threshold_medium(hi, t_hi));
+}
+
+void pp7_init_x86(PP7Functions *functions, int mode)
+{
+    if (av_get_cpu_flags() & AV_CPU_FLAG_SSE2)
+    {
+        functions->dct_a = pp7_dct_a_sse2;
+        functions->dct_b = pp7_dct_b_sse2;
+        switch (mode)
+        {
+            case 0:
+            default:
+                functions->requantize = pp7_hard_threshold_sse2;
+                break;
+            case 1:
+                functions->requantize = pp7_soft_threshold_sse2;
+                break;
+            case 2:
+                functions->requantize = pp7_medium_threshold_sse2;
+                break;
+        }
+        hb_log("Deblock using SSE2 optimizations");
+    }
+}
+
+#endif // ARCH_X86
@@ -436,6 +436,7 @@ static int decavcodecaWork( hb_work_object_t * w, hb_buffer_t ** buf_in,
     // It's likely there are other decoders that expect the same.
     if (in->data != NULL)
     {
+        hb_buffer_make_writable(in);
         memset(in->data + in->size, 0, in->alloc - in->size);
     }
 
@@ -919,6 +920,152 @@ static hb_buffer_t * cc_fill_buffer(hb_work_private_t *pv, uint8_t *cc, int size
     return buf;
 }
 
+/*
+ * Direct rendering
+ *
+ * Video decoders that support it decode into frame buffers taken from
+ * the buffer pools, laid out like any other hb_buffer_t frame.  copy_frame
+ * then passes the decoded picture on by reference instead of copying it.
+ * The payload stays read-only while the decoder may still use the picture
+ * as a reference; filters that modify it get a copy from
+ * hb_buffer_make_writable.
+ */
+static void release_frame_buffer(void *opaque, uint8_t *data)
+{
+    hb_buffer_t * buf = opaque;
+
+    hb_buffer_close(&buf);
+}
+
+static void unref_frame_buffer(void *storage)
+{
+    AVBufferRef * ref = storage;
+
+    av_buffer_unref(&ref);
+}
+
+static int get_frame_buffer(AVCodecContext *context, AVFrame *frame,
+                            int flags)
+{
+    const AVPixFmtDescriptor * desc = av_pix_fmt_desc_get(frame->format);
+    hb_buffer_t * buf;
+    int           linesize_align[AV_NUM_DATA_POINTERS];
+    int           width, height, pp;
+
+    if (!(context->codec->capabilities & AV_CODEC_CAP_DR1) || desc == NULL ||
+        (desc->flags & (AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_PAL |
+                        AV_PIX_FMT_FLAG_PSEUDOPAL | AV_PIX_FMT_FLAG_BITSTREAM)))
+    {
+        return avcodec_default_get_buffer2(context, frame, flags);
+    }
+
+    // Lay the buffer out for the size the decoder crops the picture to,
+    // so that the decoded frame can be passed on as is.
+    width  = frame->width;
+    height = frame->height;
+    if (context->width > 0 && context->height > 0)
+    {
+        width  = MIN(width,  context->width);
+        height = MIN(height, context->height);
+    }
+    buf = hb_frame_buffer_init(frame->format, width, height);
+    if (buf == NULL)
+    {
+        return avcodec_default_get_buffer2(context, frame, flags);
+    }
+
+    // The decoder writes the coded size, aligned by libavcodec.  The
+    // aligned height includes up to 2 rows that some decoders only read.
+    // height_stride is a multiple of 32, so letting those rows go past
+    // the plane never lets a written row do so.
+    width  = frame->width;
+    height = frame->height;
+    avcodec_align_dimensions2(context, &width, &height, linesize_align);
+    for (pp = 0; pp < 4; pp++)
+    {
+        uint8_t * data   = buf->plane[pp].data;
+        int       stride = buf->plane[pp].stride;
+        int       align  = MAX(linesize_align[pp], 1);
+
+        if (data == NULL)
+        {
+            continue;
+        }
+        if (stride % align != 0 || (uintptr_t)data % align != 0 ||
+            av_image_get_linesize(frame->format, width, pp) > stride ||
+            hb_image_height(frame->format, height - 2, pp) >
+                buf->plane[pp].height_stride ||
+            data + hb_image_height(frame->format, height, pp) * stride >
+                buf->data + buf->alloc)
+        {
+            hb_buffer_close(&buf);
+            return avcodec_default_get_buffer2(context, frame, flags);
+        }
+    }
+
+    frame->buf[0] = av_buffer_create(buf->data, buf->size,
+                                     release_frame_buffer, buf, 0);
+    if (frame->buf[0] == NULL)
+    {
+        hb_buffer_close(&buf);
+        return AVERROR(ENOMEM);
+    }
+    for (pp = 0; pp < 4; pp++)
+    {
+        frame->data[pp]     = buf->plane[pp].data;
+        frame->linesize[pp] = buf->plane[pp].data ? buf->plane[pp].stride : 0;
+    }
+    frame->extended_data = frame->data;
+    frame->opaque        = buf;
+
+    return 0;
+}
+
+// Wraps a frame decoded by get_frame_buffer in a buffer that references
+// its payload.  Returns NULL if the frame has to be copied instead, e.g.
+// because it was cropped at the top or left or converted by a filter.
+static hb_buffer_t * wrap_frame(AVFrame *frame)
+{
+    hb_buffer_t * owner = frame->opaque;
+    hb_buffer_t * out;
+    AVBufferRef * ref;
+    int           pp;
+
+    if (owner == NULL || frame->buf[0] == NULL || frame->buf[1] != NULL ||
+        av_buffer_get_opaque(frame->buf[0]) != owner ||
+        frame->format != owner->f.fmt ||
+        frame->width  != owner->f.width || frame->height != owner->f.height)
+    {
+        return NULL;
+    }
+    for (pp = 0; pp < 4; pp++)
+    {
+        if (frame->data[pp] != owner->plane[pp].data ||
+            (frame->data[pp] != NULL &&
+             frame->linesize[pp] != owner->plane[pp].stride))
+        {
+            return NULL;
+        }
+    }
+
+    ref = av_buffer_ref(frame->buf[0]);
+    if (ref == NULL)
+    {
+        return NULL;
+    }
+    out = hb_frame_buffer_wrap(owner->f.fmt, owner->f.width, owner->f.height,
+                               owner->data, owner->size,
+                               ref, unref_frame_buffer);
+    if (out == NULL)
+    {
+        av_buffer_unref(&ref);
+        return NULL;
+    }
+    hb_avframe_set_video_buffer_flags(out, frame, (AVRational){1,1});
+
+    return out;
+}
+
 // copy one video frame into an HB buf. If the frame isn't in our color space
 // or at least one of its dimensions is odd, use sws_scale to convert/rescale it.
 // Otherwise just copy the bits.
@@ -941,7 +1088,11 @@ static hb_buffer_t *copy_frame( hb_work_private_t *pv )
     else
 #endif
     {
-        out = hb_avframe_to_video_buffer(pv->frame, (AVRational){1,1});
+        out = wrap_frame(pv->frame);
+        if (out == NULL)
+        {
+            out = hb_avframe_to_video_buffer(pv->frame, (AVRational){1,1});
+        }
     }
 
     if (pv->frame->pts != AV_NOPTS_VALUE)
@@ -1590,6 +1741,12 @@ static int decavcodecvInit( hb_work_object_t * w, hb_job_t * job )
     if( pv->job && pv->job->title && !pv->job->title->has_resolution_change )
     {
         pv->threads = HB_FFMPEG_THREADS_AUTO;
+        if (pv->job->cpu_count > 0 &&
+            pv->job->cpu_count < hb_get_cpu_count())
+        {
+            // Same as the auto count, on this job's share of the cpus
+            pv->threads = pv->job->cpu_count / 2 + 1;
+        }
     }
 
     AVCodec *codec = NULL;
@@ -1620,6 +1777,7 @@ static int decavcodecvInit( hb_work_object_t * w, hb_job_t * job )
         pv->context->workaround_bugs = FF_BUG_AUTODETECT;
         pv->context->err_recognition = AV_EF_CRCCHECK;
         pv->context->error_concealment = FF_EC_GUESS_MVS|FF_EC_DEBLOCK;
+        pv->context->get_buffer2 = get_frame_buffer;
 
 #ifdef USE_QSV
         if (pv->qsv.decode &&
@@ -1742,6 +1900,7 @@ static int decavcodecvWork( hb_work_object_t * w, hb_buffer_t ** buf_in,
     // It's likely there are other decoders that expect the same.
     if (in->data != NULL)
     {
+        hb_buffer_make_writable(in);
         memset(in->data + in->size, 0, in->alloc - in->size);
     }
 
@@ -1788,6 +1947,7 @@ static int decavcodecvWork( hb_work_object_t * w, hb_buffer_t ** buf_in,
         pv->context->workaround_bugs = FF_BUG_AUTODETECT;
         pv->context->err_recognition = AV_EF_CRCCHECK;
         pv->context->error_concealment = FF_EC_GUESS_MVS|FF_EC_DEBLOCK;
+        pv->context->get_buffer2 = get_frame_buffer;
 
         if ( setup_extradata( w, in ) )
         {
@@ -54,6 +54,8 @@ which will feed EEDI2 interpolations to yadif.
 12-15: EEDI2 will override cubic interpolation
 *****/
 
+#include <assert.h>
+
 #include "hb.h"
 #include "hbffmpeg.h"
 #include "eedi2.h"
@@ -458,35 +460,10 @@ static void eedi2_filter_thread( void *thread_args_v )
     pv = thread_args->pv;
     plane = thread_args->plane;
 
-    hb_log("eedi2 thread started for plane %d", plane);
-
-    while (1)
-    {
-        /*
-         * Wait here until there is work to do.
-         */
-        taskset_thread_wait4start( &pv->eedi2_taskset, plane );
-
-        if( taskset_thread_stop( &pv->eedi2_taskset, plane ) )
-        {
-            /*
-             * No more work to do, exit this thread.
-             */
-            break;
-        }
-
-        /*
-         * Process plane
-         */
-        eedi2_interpolate_plane( pv, plane );
-
-        /*
-         * Finished this segment, let everyone know.
-         */
-        taskset_thread_complete( &pv->eedi2_taskset, plane );
-    }
-
-    taskset_thread_complete( &pv->eedi2_taskset, plane );
+    /*
+     * Process plane
+     */
+    eedi2_interpolate_plane( pv, plane );
 }
 
 // Sets up the input field planes for EEDI2 in pv->eedi_half[SRCPF]
@@ -698,120 +675,89 @@ static void yadif_decomb_filter_thread( void *thread_args_v )
     pv = thread_args->pv;
     segment = thread_args->segment;
 
-    hb_log("yadif thread started for segment %d", segment);
+    yadif_work = &pv->yadif_arguments[segment];
 
-    while (1)
-    {
-        /*
-         * Wait here until there is work to do.
-         */
-        taskset_thread_wait4start( &pv->yadif_taskset, segment );
+    /*
+     * Process all three planes, but only this segment of it.
+     */
+    hb_buffer_t *dst;
+    int parity, tff, mode;
 
-        if( taskset_thread_stop( &pv->yadif_taskset, segment ) )
-        {
-            /*
-             * No more work to do, exit this thread.
-             */
-            break;
-        }
+    mode = pv->yadif_arguments[segment].mode;
+    dst = yadif_work->dst;
+    tff = yadif_work->tff;
+    parity = yadif_work->parity;
 
-        yadif_work = &pv->yadif_arguments[segment];
+    int pp;
+    for (pp = 0; pp < 3; pp++)
+    {
+        int yy;
+        int width = dst->plane[pp].width;
+        int stride = dst->plane[pp].stride;
+        int height = dst->plane[pp].height_stride;
+        int penultimate = height - 2;
 
-        /*
-         * Process all three planes, but only this segment of it.
-         */
-        hb_buffer_t *dst;
-        int parity, tff, mode;
+        segment_start = thread_args->segment_start[pp];
+        segment_stop = segment_start + thread_args->segment_height[pp];
 
-        mode = pv->yadif_arguments[segment].mode;
-        dst = yadif_work->dst;
-        tff = yadif_work->tff;
-        parity = yadif_work->parity;
+        // Filter parity lines
+        int start = parity ? (segment_start + 1) & ~1 : segment_start | 1;
+        uint8_t *dst2 = &dst->plane[pp].data[start * stride];
+        uint8_t *prev = &pv->ref[0]->plane[pp].data[start * stride];
+        uint8_t *cur  = &pv->ref[1]->plane[pp].data[start * stride];
+        uint8_t *next = &pv->ref[2]->plane[pp].data[start * stride];
 
-        int pp;
-        for (pp = 0; pp < 3; pp++)
+        if (mode == MODE_DECOMB_BLEND)
         {
-            int yy;
-            int width = dst->plane[pp].width;
-            int stride = dst->plane[pp].stride;
-            int height = dst->plane[pp].height_stride;
-            int penultimate = height - 2;
-
-            segment_start = thread_args->segment_start[pp];
-            segment_stop = segment_start + thread_args->segment_height[pp];
-
-            // Filter parity lines
-            int start = parity ? (segment_start + 1) & ~1 : segment_start | 1;
-            uint8_t *dst2 = &dst->plane[pp].data[start * stride];
-            uint8_t *prev = &pv->ref[0]->plane[pp].data[start * stride];
-            uint8_t *cur  = &pv->ref[1]->plane[pp].data[start * stride];
-            uint8_t *next = &pv->ref[2]->plane[pp].data[start * stride];
-
-            if (mode == MODE_DECOMB_BLEND)
+            /* These will be useful if we ever do temporal blending. */
+            for( yy = start; yy < segment_stop; yy += 2 )
             {
-                /* These will be useful if we ever do temporal blending. */
-                for( yy = start; yy < segment_stop; yy += 2 )
-                {
-                    /* This line gets blend filtered, not yadif filtered. */
-                    blend_filter_line(&filter, dst2, cur, width, height, stride, yy);
-                    dst2 += stride * 2;
-                    cur += stride * 2;
-                }
+                /* This line gets blend filtered, not yadif filtered. */
+                blend_filter_line(&filter, dst2, cur, width, height, stride, yy);
+                dst2 += stride * 2;
+                cur += stride * 2;
             }
-            else if (mode == MODE_DECOMB_CUBIC)
+        }
+        else if (mode == MODE_DECOMB_CUBIC)
+        {
+            for( yy = start; yy < segment_stop; yy += 2 )
             {
-                for( yy = start; yy < segment_stop; yy += 2 )
-                {
-                    /* Just apply vertical cubic interpolation */
-                    cubic_interpolate_line(dst2, cur, width, height, stride, yy);
-                    dst2 += stride * 2;
-                    cur += stride * 2;
-                }
+                /* Just apply vertical cubic interpolation */
+                cubic_interpolate_line(dst2, cur, width, height, stride, yy);
+                dst2 += stride * 2;
+                cur += stride * 2;
             }
-            else if (mode & MODE_DECOMB_YADIF)
+        }
+        else if (mode & MODE_DECOMB_YADIF)
+        {
+            for( yy = start; yy < segment_stop; yy += 2 )
             {
-                for( yy = start; yy < segment_stop; yy += 2 )
+                if( yy > 1 && yy < penultimate )
                 {
-                    if( yy > 1 && yy < penultimate )
-                    {
-                        // This isn't the top or bottom,
-                        // proceed as normal to yadif
-                        yadif_filter_line(pv, dst2, prev, cur, next, pp,
-                                          width, height, stride,
-                                          parity ^ tff, yy);
-                    }
-                    else
-                    {
-                        // parity == 0 (TFF), y1 = y0
-                        // parity == 1 (BFF), y0 = y1
-                        // parity == 0 (TFF), yu = yp
-                        // parity == 1 (BFF), yp = yu
-                        int yp = (yy ^ parity) * stride;
-                        memcpy(dst2, &pv->ref[1]->plane[pp].data[yp], width);
-                    }
-                    dst2 += stride * 2;
-                    prev += stride * 2;
-                    cur += stride * 2;
-                    next += stride * 2;
+                    // This isn't the top or bottom,
+                    // proceed as normal to yadif
+                    yadif_filter_line(pv, dst2, prev, cur, next, pp,
+                                      width, height, stride,
+                                      parity ^ tff, yy);
                 }
-            }
-            else
-            {
-                // No combing, copy frame
-                for( yy = start; yy < segment_stop; yy += 2 )
+                else
                 {
-                    memcpy(dst2, cur, width);
-                    dst2 += stride * 2;
-                    cur += stride * 2;
+                    // parity == 0 (TFF), y1 = y0
+                    // parity == 1 (BFF), y0 = y1
+                    // parity == 0 (TFF), yu = yp
+                    // parity == 1 (BFF), yp = yu
+                    int yp = (yy ^ parity) * stride;
+                    memcpy(dst2, &pv->ref[1]->plane[pp].data[yp], width);
                 }
+                dst2 += stride * 2;
+                prev += stride * 2;
+                cur += stride * 2;
+                next += stride * 2;
             }
-
-            // Copy unfiltered lines
-            start = !parity ? (segment_start + 1) & ~1 : segment_start | 1;
-            dst2 = &dst->plane[pp].data[start * stride];
-            prev = &pv->ref[0]->plane[pp].data[start * stride];
-            cur  = &pv->ref[1]->plane[pp].data[start * stride];
-            next = &pv->ref[2]->plane[pp].data[start * stride];
+        }
+        else
+        {
+            // No combing, copy frame
             for( yy = start; yy < segment_stop; yy += 2 )
             {
                 memcpy(dst2, cur, width);
@@ -819,13 +765,20 @@ static void yadif_decomb_filter_thread( void *thread_args_v )
                 cur += stride * 2;
             }
         }
-        taskset_thread_complete( &pv->yadif_taskset, segment );
-    }
 
-    /*
-     * Finished this segment, let everyone know.
-     */
-    taskset_thread_complete( &pv->yadif_taskset, segment );
+        // Copy unfiltered lines
+        start = !parity ? (segment_start + 1) & ~1 : segment_start | 1;
+        dst2 = &dst->plane[pp].data[start * stride];
+        prev = &pv->ref[0]->plane[pp].data[start * stride];
+        cur  = &pv->ref[1]->plane[pp].data[start * stride];
+        next = &pv->ref[2]->plane[pp].data[start * stride];
+        for( yy = start; yy < segment_stop; yy += 2 )
+        {
+            memcpy(dst2, cur, width);
+            dst2 += stride * 2;
+            cur += stride * 2;
+        }
+    }
 }
 
 static void yadif_filter( hb_filter_private_t * pv,
@@ -1019,7 +972,8 @@ static int hb_decomb_init( hb_filter_object_t * filter,
     pv->yadif_arguments = malloc( sizeof( yadif_arguments_t ) * pv->cpu_count );
     if( pv->yadif_arguments == NULL ||
         taskset_init( &pv->yadif_taskset, pv->cpu_count,
-                      sizeof( yadif_thread_arg_t ) ) == 0 )
+                      sizeof( yadif_thread_arg_t ),
+                      yadif_decomb_filter_thread ) == 0 )
     {
         hb_error( "yadif could not initialize taskset" );
     }
@@ -1055,13 +1009,6 @@ static int hb_decomb_init( hb_filter_object_t * filter,
             }
         }
         pv->yadif_arguments[ii].dst = NULL;
-        if( taskset_thread_spawn( &pv->yadif_taskset, ii,
-                                 "yadif_filter_segment",
-                                 yadif_decomb_filter_thread,
-                                 HB_NORMAL_PRIORITY ) == 0 )
-        {
-            hb_error( "yadif could not spawn thread" );
-        }
         yadif_prev_thread_args = thread_args;
     }
 
@@ -1071,7 +1018,8 @@ static int hb_decomb_init( hb_filter_object_t * filter,
          * Create eedi2 taskset.
          */
         if( taskset_init( &pv->eedi2_taskset, /*thread_count*/3,
-                          sizeof( eedi2_thread_arg_t ) ) == 0 )
+                          sizeof( eedi2_thread_arg_t ),
+                          eedi2_filter_thread ) == 0 )
         {
             hb_error( "eedi2 could not initialize taskset" );
         }
@@ -1107,14 +1055,6 @@ static int hb_decomb_init( hb_filter_object_t * filter,
 
             eedi2_thread_args->pv = pv;
             eedi2_thread_args->plane = ii;
-
-            if( taskset_thread_spawn( &pv->eedi2_taskset, ii,
-                                      "eedi2_filter_segment",
-                                      eedi2_filter_thread,
-                                      HB_NORMAL_PRIORITY ) == 0 )
-            {
-                hb_error( "eedi2 could not spawn thread" );
-            }
         }
     }
 
@@ -1188,6 +1128,8 @@ static void fill_stride(hb_buffer_t * buf)
 {
     int pp, ii;
 
+    assert(hb_buffer_is_writable(buf));
+
     for (pp = 0; pp < 3; pp++)
     {
         uint8_t * src, * dst;
@@ -1209,8 +1151,8 @@ static void process_frame( hb_filter_private_t * pv )
     if ((pv->mode & MODE_DECOMB_SELECTIVE) &&
         pv->ref[1]->s.combed == HB_COMB_NONE)
     {
-        // Input buffer is not combed.  Just make a dup of it.
-        hb_buffer_t * buf = hb_buffer_dup(pv->ref[1]);
+        // Input buffer is not combed.  Pass along a reference to it.
+        hb_buffer_t * buf = hb_buffer_ref(pv->ref[1]);
         hb_buffer_list_append(&pv->out_list, buf);
         pv->frames++;
         pv->unfiltered++;
@@ -1284,7 +1226,7 @@ static int hb_decomb_work( hb_filter_object_t * filter,
         if (pv->ref[2] != NULL)
         {
             // Duplicate last frame and process refs
-            store_ref(pv, hb_buffer_dup(pv->ref[2]));
+            store_ref(pv, hb_buffer_ref(pv->ref[2]));
             process_frame(pv);
         }
         hb_buffer_list_append(&pv->out_list, in);
@@ -1292,6 +1234,9 @@ static int hb_decomb_work( hb_filter_object_t * filter,
         return HB_FILTER_DONE;
     }
 
+    // fill_stride writes to the input, which upstream filters may
+    // still be referencing
+    hb_buffer_make_writable(in);
     fill_stride(in);
 
     // yadif requires 3 buffers, prev, cur, and next.  For the first
@@ -1299,7 +1244,7 @@ static int hb_decomb_work( hb_filter_object_t * filter,
     if (!pv->yadif_ready)
     {
         // If yadif is not ready, store another ref and return HB_FILTER_DELAY
-        store_ref(pv, hb_buffer_dup(in));
+        store_ref(pv, hb_buffer_ref(in));
         store_ref(pv, in);
         pv->yadif_ready = 1;
         // Wait for next
@@ -1325,6 +1270,7 @@ void hb_deinterlace(hb_buffer_t *dst, hb_buffer_t *src)
     filter.tap[4] = -1;
     filter.normalize = 3;
 
+    hb_buffer_make_writable(src);
     fill_stride(src);
     for (pp = 0; pp < 3; pp++)
     {
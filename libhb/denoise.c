@@ -19,16 +19,48 @@
 
 #include "hb.h"
 #include "hbffmpeg.h"
+#include "taskset.h"
 
 #define HQDN3D_SPATIAL_LUMA_DEFAULT    4.0f
 #define HQDN3D_SPATIAL_CHROMA_DEFAULT  3.0f
 #define HQDN3D_TEMPORAL_LUMA_DEFAULT   6.0f
 
+#define HQDN3D_BANDS_MAX               16
+#define HQDN3D_BAND_MIN_HEIGHT         16  // chroma lines
+
+/*
+ * The spatial filter is recursive from top to bottom, so a band of a
+ * frame can't be started before the band above it is done.  The temporal
+ * filter is recursive from frame to frame, so a band can't be started
+ * before the same band of the previous frame is done.
+ *
+ * Frames are therefore run through a pipeline with one stage per band.
+ * In each taskset cycle stage N filters band N of the frame it holds,
+ * then every frame moves on to the next stage.  All stages run in
+ * parallel and the output is the same as filtering one frame at a time,
+ * at the cost of holding back as many frames as there are bands.
+ */
+typedef struct
+{
+    hb_buffer_t    * in;
+    hb_buffer_t    * out;
+    unsigned short * line[3];   // Spatial filter state of the last band
+} hqdn3d_stage_t;
+
+typedef struct
+{
+    hb_filter_private_t * pv;
+    int                   segment;
+} hqdn3d_thread_arg_t;
+
 struct hb_filter_private_s
 {
     short            hqdn3d_coef[6][512*16];
-    unsigned short * hqdn3d_line;
     unsigned short * hqdn3d_frame[3];
+
+    int              bands;
+    hqdn3d_stage_t   stage[HQDN3D_BANDS_MAX];
+    taskset_t        taskset;
 };
 
 static int hb_denoise_init( hb_filter_object_t * filter,
@@ -89,7 +121,7 @@ static inline unsigned int hqdn3d_lowpass_mul( int prev_mul,
 static void hqdn3d_denoise_temporal( unsigned char * frame_src,
                                      unsigned char * frame_dst,
                                      unsigned short * frame_ant,
-                                     int w, int h,
+                                     int w, int y_start, int y_end,
                                      short * temporal)
 {
     int x, y;
@@ -97,7 +129,11 @@ static void hqdn3d_denoise_temporal( unsigned char * frame_src,
 
     temporal += 0x1000;
 
-    for( y = 0; y < h; y++ )
+    frame_src += y_start * w;
+    frame_dst += y_start * w;
+    frame_ant += y_start * w;
+
+    for( y = y_start; y < y_end; y++ )
     {
         for( x = 0; x < w; x++ )
         {
@@ -113,11 +149,15 @@ static void hqdn3d_denoise_temporal( unsigned char * frame_src,
     }
 }
 
+/*
+ * line_ant holds the filtered line above y_start, it is updated to
+ * the last line of the band for the next band.
+ */
 static void hqdn3d_denoise_spatial( unsigned char * frame_src,
                                     unsigned char * frame_dst,
                                     unsigned short * line_ant,
                                     unsigned short * frame_ant,
-                                    int w, int h,
+                                    int w, int y_start, int y_end,
                                     short * spatial,
                                     short * temporal )
 {
@@ -128,24 +168,37 @@ static void hqdn3d_denoise_spatial( unsigned char * frame_src,
     spatial  += 0x1000;
     temporal += 0x1000;
 
-    /* First line has no top neighbor. Only left one for each tmp and last frame */
-    pixel_ant = frame_src[0]<<8;
-    for ( x = 0; x < w; x++)
+    if( y_start >= y_end )
     {
-        line_ant[x] = tmp = pixel_ant = hqdn3d_lowpass_mul( pixel_ant,
-                                                            frame_src[x]<<8,
-                                                            spatial );
-        frame_ant[x] = tmp = hqdn3d_lowpass_mul( frame_ant[x],
-                                                 tmp,
-                                                 temporal );
-        frame_dst[x] = (tmp+0x7F)>>8;
+        return;
     }
 
-    for( y = 1; y < h; y++ )
+    frame_src += y_start * w;
+    frame_dst += y_start * w;
+    frame_ant += y_start * w;
+
+    if( y_start == 0 )
     {
+        /* First line has no top neighbor. Only left one for each tmp and last frame */
+        pixel_ant = frame_src[0]<<8;
+        for ( x = 0; x < w; x++)
+        {
+            line_ant[x] = tmp = pixel_ant = hqdn3d_lowpass_mul( pixel_ant,
+                                                                frame_src[x]<<8,
+                                                                spatial );
+            frame_ant[x] = tmp = hqdn3d_lowpass_mul( frame_ant[x],
+                                                     tmp,
+                                                     temporal );
+            frame_dst[x] = (tmp+0x7F)>>8;
+        }
         frame_src += w;
         frame_dst += w;
         frame_ant += w;
+        y_start = 1;
+    }
+
+    for( y = y_start; y < y_end; y++ )
+    {
         pixel_ant = frame_src[0]<<8;
         for ( x = 0; x < w-1; x++ )
         {
@@ -167,15 +220,24 @@ static void hqdn3d_denoise_spatial( unsigned char * frame_src,
                                                  tmp,
                                                  temporal );
         frame_dst[x] = (tmp+0x7F)>>8;
+
+        frame_src += w;
+        frame_dst += w;
+        frame_ant += w;
     }
 }
 
+/*
+ * Denoises lines y_start to y_end - 1 of a plane of height h.
+ */
 static void hqdn3d_denoise( unsigned char * frame_src,
                             unsigned char * frame_dst,
                             unsigned short * line_ant,
                             unsigned short ** frame_ant_ptr,
                             int w,
                             int h,
+                            int y_start,
+                            int y_end,
                             short * spatial,
                             short * temporal )
 {
@@ -204,7 +266,7 @@ static void hqdn3d_denoise( unsigned char * frame_src,
                                 frame_dst,
                                 line_ant,
                                 frame_ant,
-                                w, h,
+                                w, y_start, y_end,
                                 spatial,
                                 temporal );
     }
@@ -213,11 +275,86 @@ static void hqdn3d_denoise( unsigned char * frame_src,
         hqdn3d_denoise_temporal( frame_src,
                                  frame_dst,
                                  frame_ant,
-                                 w, h,
+                                 w, y_start, y_end,
                                  temporal);
     }
 }
 
+/*
+ * Denoises this stage's band of all three planes of the stage's frame.
+ */
+static void hqdn3d_thread( void * thread_args_v )
+{
+    hqdn3d_thread_arg_t * thread_args = thread_args_v;
+    hb_filter_private_t * pv          = thread_args->pv;
+    int                   segment     = thread_args->segment;
+    hqdn3d_stage_t      * stage       = &pv->stage[segment];
+    hb_buffer_t         * in          = stage->in;
+    int                   c, coef_index, height;
+
+    if( in == NULL )
+    {
+        return;
+    }
+
+    for ( c = 0; c < 3; c++ )
+    {
+        coef_index = c * 2;
+        height     = in->plane[c].height;
+        hqdn3d_denoise( in->plane[c].data,
+                        stage->out->plane[c].data,
+                        stage->line[c],
+                        &pv->hqdn3d_frame[c],
+                        in->plane[c].stride,
+                        height,
+                        height *  segment      / pv->bands,
+                        height * (segment + 1) / pv->bands,
+                        pv->hqdn3d_coef[coef_index],
+                        pv->hqdn3d_coef[coef_index+1] );
+    }
+}
+
+/*
+ * Puts 'in' into the first stage of the pipeline, runs all stages and
+ * returns the frame that came out of the last stage, if any.
+ */
+static hb_buffer_t * hqdn3d_cycle( hb_filter_private_t * pv,
+                                   hb_buffer_t         * in )
+{
+    hqdn3d_stage_t   last;
+    hqdn3d_stage_t * first = &pv->stage[0];
+    int              c;
+
+    first->in = in;
+    if( in != NULL )
+    {
+        first->out = hb_video_buffer_init( in->f.width, in->f.height );
+        first->out->s = in->s;
+        for ( c = 0; c < 3; c++ )
+        {
+            if( first->line[c] == NULL )
+            {
+                first->line[c] = malloc( in->plane[c].stride *
+                                         sizeof(unsigned short) );
+            }
+        }
+    }
+
+    taskset_cycle( &pv->taskset );
+
+    // Move every frame on to the next stage, the line buffers
+    // of the last stage are reused by the first
+    last = pv->stage[pv->bands - 1];
+    memmove( &pv->stage[1], &pv->stage[0],
+             ( pv->bands - 1 ) * sizeof(hqdn3d_stage_t) );
+    pv->stage[0].in  = NULL;
+    pv->stage[0].out = NULL;
+    memcpy( pv->stage[0].line, last.line, sizeof(last.line) );
+
+    hb_buffer_close( &last.in );
+    return last.out;
+}
+
 static int hb_denoise_init( hb_filter_object_t * filter,
                             hb_filter_init_t * init )
 {
@@ -261,6 +398,38 @@ static int hb_denoise_init( hb_filter_object_t * filter,
     hqdn3d_precalc_coef( pv->hqdn3d_coef[4], spatial_chroma_r );
     hqdn3d_precalc_coef( pv->hqdn3d_coef[5], temporal_chroma_r );
 
+    /*
+     * One band per thread the job may use, each band at least a few
+     * chroma lines high.
+     */
+    pv->bands = MIN( hb_get_cpu_count(), HQDN3D_BANDS_MAX );
+    if( init->job->cpu_count > 0 )
+    {
+        pv->bands = MIN( pv->bands, init->job->cpu_count );
+    }
+    pv->bands = MIN( pv->bands, ( ( init->geometry.height + 1 ) / 2 ) /
+                                HQDN3D_BAND_MIN_HEIGHT );
+    pv->bands = MAX( pv->bands, 1 );
+
+    if( taskset_init( &pv->taskset, pv->bands,
+                      sizeof( hqdn3d_thread_arg_t ), hqdn3d_thread ) == 0 )
+    {
+        hb_error( "denoise could not initialize taskset" );
+        free( pv );
+        filter->private_data = NULL;
+        return -1;
+    }
+
+    int ii;
+    for( ii = 0; ii < pv->bands; ii++ )
+    {
+        hqdn3d_thread_arg_t * thread_args;
+
+        thread_args = taskset_thread_args( &pv->taskset, ii );
+        thread_args->pv      = pv;
+        thread_args->segment = ii;
+    }
+
     return 0;
 }
 
@@ -273,10 +442,17 @@ static void hb_denoise_close( hb_filter_object_t * filter )
         return;
     }
 
-	if( pv->hqdn3d_line )
+    taskset_fini( &pv->taskset );
+
+    int ii, c;
+    for( ii = 0; ii < HQDN3D_BANDS_MAX; ii++ )
     {
-        free( pv->hqdn3d_line );
-        pv->hqdn3d_line = NULL;
+        hb_buffer_close( &pv->stage[ii].in );
+        hb_buffer_close( &pv->stage[ii].out );
+        for( c = 0; c < 3; c++ )
+        {
+            free( pv->stage[ii].line[c] );
+        }
     }
 	if( pv->hqdn3d_frame[0] )
     {
@@ -303,39 +479,27 @@ static int hb_denoise_work( hb_filter_object_t * filter,
                             hb_buffer_t ** buf_out )
 {
     hb_filter_private_t * pv = filter->private_data;
-    hb_buffer_t * in = *buf_in, * out;
+    hb_buffer_t * in = *buf_in;
 
     if (in->s.flags & HB_BUF_FLAG_EOF)
     {
-        *buf_out = in;
+        hb_buffer_list_t list;
+        int              ii;
+
+        // Flush the frames still in the pipeline
+        hb_buffer_list_clear(&list);
+        for (ii = 1; ii < pv->bands; ii++)
+        {
+            hb_buffer_list_append(&list, hqdn3d_cycle(pv, NULL));
+        }
+        hb_buffer_list_append(&list, in);
+        *buf_out = hb_buffer_list_clear(&list);
         *buf_in = NULL;
         return HB_FILTER_DONE;
     }
 
-    out = hb_video_buffer_init( in->f.width, in->f.height );
-
-    if( !pv->hqdn3d_line )
-    {
-        pv->hqdn3d_line = malloc( in->plane[0].stride * sizeof(unsigned short) );
-    }
-
-    int c, coef_index;
-
-    for ( c = 0; c < 3; c++ )
-    {
-        coef_index = c * 2;
-        hqdn3d_denoise( in->plane[c].data,
-                        out->plane[c].data,
-                        pv->hqdn3d_line,
-                        &pv->hqdn3d_frame[c],
-                        in->plane[c].stride,
-                        in->plane[c].height,
-                        pv->hqdn3d_coef[coef_index],
-                        pv->hqdn3d_coef[coef_index+1] );
-    }
-
-    out->s = in->s;
-    *buf_out = out;
+    *buf_out = hqdn3d_cycle(pv, in);
+    *buf_in = NULL;
 
     return HB_FILTER_OK;
 }
@@ -9,6 +9,8 @@
 
 #include "hb.h"
 #include "hbffmpeg.h"
+#include "taskset.h"
+#include "detelecine.h"
 
 /*
  *
@@ -57,6 +59,14 @@ struct pullup_frame
     struct pullup_buffer *buffer;
 };
 
+struct pullup_metric
+{
+    const unsigned char * a;
+    const unsigned char * b;
+    void (*func)(const uint8_t *, const uint8_t *, int, int, int *);
+    int                 * dest;
+};
+
 struct pullup_context
 {
     /* Public interface */
@@ -74,13 +84,22 @@ struct pullup_context
     struct pullup_field *first, *last, *head;
     struct pullup_buffer *buffers;
     int nbuffers;
-    int (*diff)(unsigned char *, unsigned char *, int);
-    int (*comb)(unsigned char *, unsigned char *, int);
-    int (*var)(unsigned char *, unsigned char *, int);
+    PullupFunctions functions;
     int metric_w, metric_h, metric_len, metric_offset;
     struct pullup_frame *frame;
+    /* Metrics of a field, computed on the taskset thread pool */
+    int metric_segments;
+    taskset_t metric_taskset;  /* Tasks - one band of block rows each */
+    struct pullup_metric metrics[3];
+    int nmetrics;
 };
 
+typedef struct pullup_metric_thread_arg_s
+{
+    struct pullup_context * c;
+    int                     segment;
+} pullup_metric_thread_arg_t;
+
 /*
  *
  * DETELECINE FILTER DEFINITIONS
@@ -127,7 +146,7 @@ hb_filter_object_t hb_filter_detelecine =
  *
  */
 
-static int pullup_diff_y( unsigned char  *a, unsigned char * b, int s )
+static int pullup_diff_block_y( const uint8_t * a, const uint8_t * b, int s )
 {
     int i, j, diff = 0;
     for( i = 4; i; i-- )
@@ -141,7 +160,7 @@ static int pullup_diff_y( unsigned char  *a, unsigned char * b, int s )
     return diff;
 }
 
-static int pullup_licomb_y( unsigned char * a, unsigned char * b, int s )
+static int pullup_licomb_block_y( const uint8_t * a, const uint8_t * b, int s )
 {
     int i, j, diff = 0;
     for( i = 4; i; i-- )
@@ -156,7 +175,7 @@ static int pullup_licomb_y( unsigned char * a, unsigned char * b, int s )
     return diff;
 }
 
-static int pullup_var_y( unsigned char * a, unsigned char * b, int s )
+static int pullup_var_block_y( const uint8_t * a, const uint8_t * b, int s )
 {
     int i, j, var = 0;
     for( i = 3; i; i-- )
@@ -170,6 +189,36 @@ static int pullup_var_y( unsigned char * a, unsigned char * b, int s )
     return 4*var;
 }
 
+static void pullup_diff_y( const uint8_t * a, const uint8_t * b, int s,
+                           int blocks, int * dest )
+{
+    int k;
+    for( k = 0; k < blocks; k++ )
+    {
+        dest[k] = pullup_diff_block_y( a + k * 8, b + k * 8, s );
+    }
+}
+
+static void pullup_licomb_y( const uint8_t * a, const uint8_t * b, int s,
+                             int blocks, int * dest )
+{
+    int k;
+    for( k = 0; k < blocks; k++ )
+    {
+        dest[k] = pullup_licomb_block_y( a + k * 8, b + k * 8, s );
+    }
+}
+
+static void pullup_var_y( const uint8_t * a, const uint8_t * b, int s,
+                          int blocks, int * dest )
+{
+    int k;
+    for( k = 0; k < blocks; k++ )
+    {
+        dest[k] = pullup_var_block_y( a + k * 8, b + k * 8, s );
+    }
+}
+
 static void pullup_alloc_metrics( struct pullup_context * c,
                                   struct pullup_field * f )
 {
@@ -178,20 +227,20 @@ static void pullup_alloc_metrics( struct pullup_context * c,
     f->var   = calloc( c->metric_len, sizeof(int) );
 }
 
+/*
+ * Queues a metric for pullup_run_metrics.  Metric blocks are 8 samples
+ * wide (bpp of the metric plane).
+ */
 static void pullup_compute_metric( struct pullup_context * c,
                                    struct pullup_field * fa, int pa,
                                    struct pullup_field * fb, int pb,
-                                   int (* func)( unsigned char *,
-                                                 unsigned char *, int),
+                                   void (* func)( const uint8_t *,
+                                                  const uint8_t *,
+                                                  int, int, int * ),
                                    int * dest )
 {
-    unsigned char *a, *b;
-    int x, y;
-    int mp    = c->metric_plane;
-    int xstep = c->bpp[mp];
-    int ystep = c->stride[mp]<<3;
-    int s     = c->stride[mp]<<1; /* field stride */
-    int w     = c->metric_w*xstep;
+    struct pullup_metric * m;
+    int mp = c->metric_plane;
 
     if( !fa->buffer || !fb->buffer ) return;
 
@@ -202,16 +251,47 @@ static void pullup_compute_metric( struct pullup_context * c,
         return;
     }
 
-    a = fa->buffer->planes[mp] + pa * c->stride[mp] + c->metric_offset;
-    b = fb->buffer->planes[mp] + pb * c->stride[mp] + c->metric_offset;
+    m = &c->metrics[c->nmetrics++];
+    m->a    = fa->buffer->planes[mp] + pa * c->stride[mp] + c->metric_offset;
+    m->b    = fb->buffer->planes[mp] + pb * c->stride[mp] + c->metric_offset;
+    m->func = func;
+    m->dest = dest;
+}
+
+/*
+ * Computes this segment's rows of blocks of all queued metrics.
+ */
+static void pullup_metric_thread( void * thread_args_v )
+{
+    pullup_metric_thread_arg_t * thread_args = thread_args_v;
+    struct pullup_context      * c           = thread_args->c;
+    int                          segment     = thread_args->segment;
+    int mp    = c->metric_plane;
+    int ystep = c->stride[mp]<<3;
+    int s     = c->stride[mp]<<1; /* field stride */
+    int ii, y;
+
+    int segment_start = c->metric_h *  segment      / c->metric_segments;
+    int segment_stop  = c->metric_h * (segment + 1) / c->metric_segments;
 
-    for( y = c->metric_h; y; y-- )
+    for( ii = 0; ii < c->nmetrics; ii++ )
     {
-        for( x = 0; x < w; x += xstep )
+        struct pullup_metric * m = &c->metrics[ii];
+
+        for( y = segment_start; y < segment_stop; y++ )
         {
-            *dest++ = func( a + x, b + x, s );
+            m->func( m->a + y * ystep, m->b + y * ystep, s,
+                     c->metric_w, m->dest + y * c->metric_w );
         }
-        a += ystep; b += ystep;
+    }
+}
+
+static void pullup_run_metrics( struct pullup_context * c )
+{
+    if( c->nmetrics > 0 )
+    {
+        taskset_cycle( &c->metric_taskset );
+        c->nmetrics = 0;
     }
 }
 
@@ -560,12 +640,49 @@ void pullup_init_context( struct pullup_context * c )
 
     if( c->format == PULLUP_FMT_Y )
     {
-        c->diff = pullup_diff_y;
-        c->comb = pullup_licomb_y;
-        c->var  = pullup_var_y;
+        c->functions.diff = pullup_diff_y;
+        c->functions.comb = pullup_licomb_y;
+        c->functions.var  = pullup_var_y;
+#if defined(ARCH_X86)
+        detelecine_init_x86( &c->functions );
+#endif
     }
 }
 
+/*
+ * cpu_count is the number of CPUs the job may use, 0 for all of them.
+ * Each segment gets at least one row of blocks.
+ */
+int pullup_init_metric_threads( struct pullup_context * c, int cpu_count )
+{
+    int ii;
+
+    c->metric_segments = hb_get_cpu_count();
+    if( cpu_count > 0 && cpu_count < c->metric_segments )
+    {
+        c->metric_segments = cpu_count;
+    }
+    c->metric_segments = MIN( c->metric_segments, c->metric_h );
+    c->metric_segments = MAX( c->metric_segments, 1 );
+    if( taskset_init( &c->metric_taskset, c->metric_segments,
+                      sizeof(pullup_metric_thread_arg_t),
+                      pullup_metric_thread ) == 0 )
+    {
+        hb_error( "detelecine: could not initialize taskset" );
+        c->metric_segments = 0;
+        return -1;
+    }
+    for( ii = 0; ii < c->metric_segments; ii++ )
+    {
+        pullup_metric_thread_arg_t * thread_args;
+
+        thread_args = taskset_thread_args( &c->metric_taskset, ii );
+        thread_args->c       = c;
+        thread_args->segment = ii;
+    }
+    return 0;
+}
+
 void pullup_free_context( struct pullup_context * c )
 {
     struct pullup_field * f;
@@ -584,6 +701,11 @@ void pullup_free_context( struct pullup_context * c )
     free( f->comb );
     free(f);
 
+    if( c->metric_segments > 0 )
+    {
+        taskset_fini( &c->metric_taskset );
+    }
+
     free( c->frame );
     free( c );
 }
@@ -788,11 +910,12 @@ void pullup_submit_field( struct pullup_context * c,
     f->affinity = 0;
 
     pullup_compute_metric( c, f, parity, f->prev->prev,
-                           parity, c->diff, f->diffs );
+                           parity, c->functions.diff, f->diffs );
     pullup_compute_metric( c, parity?f->prev:f, 0,
-                           parity?f:f->prev, 1, c->comb, f->comb );
+                           parity?f:f->prev, 1, c->functions.comb, f->comb );
     pullup_compute_metric( c, f, parity, f,
-                           -1, c->var, f->var );
+                           -1, c->functions.var, f->var );
+    pullup_run_metrics( c );
 
     /* Advance the circular list */
     if( !c->first ) c->first = c->head;
@@ -872,6 +995,13 @@ static int hb_detelecine_init( hb_filter_object_t * filter,
 #endif
 
     pullup_init_context( ctx );
+    if( pullup_init_metric_threads( ctx, init->job->cpu_count ) < 0 )
+    {
+        pullup_free_context( ctx );
+        free( pv );
+        filter->private_data = NULL;
+        return -1;
+    }
 
     pv->pullup_fakecount = 1;
     pv->pullup_skipflag = 0;
@@ -0,0 +1,34 @@
+/* detelecine.h
+
+   Copyright (c) 2003-2018 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#ifndef HB_DETELECINE_H
+#define HB_DETELECINE_H
+
+/*
+ * Pullup field metrics.  Each function computes the metric of 'blocks'
+ * horizontally adjacent 8x8 blocks (4 rows of each field) and stores one
+ * value per block in dest.  s is the field stride, twice the line stride.
+ * All implementations give exactly the same values.
+ */
+typedef struct
+{
+    // Sum of absolute differences of a and b
+    void (*diff)(const uint8_t *a, const uint8_t *b, int s,
+                 int blocks, int *dest);
+    // Comb metric of interleaving fields a and b
+    void (*comb)(const uint8_t *a, const uint8_t *b, int s,
+                 int blocks, int *dest);
+    // Vertical variation within field a
+    void (*var)(const uint8_t *a, const uint8_t *b, int s,
+                int blocks, int *dest);
+} PullupFunctions;
+
+void detelecine_init_x86(PullupFunctions *functions);
+
+#endif // HB_DETELECINE_H
@@ -0,0 +1,285 @@
+/* detelecine_x86.c
+
+   Copyright (c) 2003-2018 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#include "hb.h"     // needed for ARCH_X86
+
+#if defined(ARCH_X86)
+
+#include <emmintrin.h>
+#include <immintrin.h>
+
+#include "libavutil/cpu.h"
+#include "detelecine.h"
+
+/*
+ * diff and var are sums of absolute differences of 8 byte rows, which
+ * is exactly what psadbw computes.  Each 64 bit lane of the sad result
+ * holds the sum of one block.
+ */
+
+static inline void store_sad2_sse2(int *dest, __m128i sad)
+{
+    _mm_storel_epi64((__m128i*)dest,
+                     _mm_shuffle_epi32(sad, _MM_SHUFFLE(3, 1, 2, 0)));
+}
+
+static void pullup_diff_y_sse2(const uint8_t *a, const uint8_t *b, int s,
+                               int blocks, int *dest)
+{
+    int k, i;
+
+    for (k = 0; k + 2 <= blocks; k += 2)
+    {
+        const uint8_t *pa = a + k * 8, *pb = b + k * 8;
+        __m128i sad = _mm_setzero_si128();
+
+        for (i = 0; i < 4; i++)
+        {
+            sad = _mm_add_epi64(sad,
+                    _mm_sad_epu8(_mm_loadu_si128((const __m128i*)pa),
+                                 _mm_loadu_si128((const __m128i*)pb)));
+            pa += s; pb += s;
+        }
+        store_sad2_sse2(dest + k, sad);
+    }
+    for (; k < blocks; k++)
+    {
+        const uint8_t *pa = a + k * 8, *pb = b + k * 8;
+        __m128i sad = _mm_setzero_si128();
+
+        for (i = 0; i < 4; i++)
+        {
+            sad = _mm_add_epi64(sad,
+                    _mm_sad_epu8(_mm_loadl_epi64((const __m128i*)pa),
+                                 _mm_loadl_epi64((const __m128i*)pb)));
+            pa += s; pb += s;
+        }
+        dest[k] = _mm_cvtsi128_si32(sad);
+    }
+}
+
+static void pullup_var_y_sse2(const uint8_t *a, const uint8_t *b, int s,
+                              int blocks, int *dest)
+{
+    int k, i;
+
+    for (k = 0; k + 2 <= blocks; k += 2)
+    {
+        const uint8_t *pa = a + k * 8;
+        __m128i sad = _mm_setzero_si128();
+
+        for (i = 0; i < 3; i++)
+        {
+            sad = _mm_add_epi64(sad,
+                    _mm_sad_epu8(_mm_loadu_si128((const __m128i*)pa),
+                                 _mm_loadu_si128((const __m128i*)(pa + s))));
+            pa += s;
+        }
+        store_sad2_sse2(dest + k, _mm_slli_epi64(sad, 2));
+    }
+    for (; k < blocks; k++)
+    {
+        const uint8_t *pa = a + k * 8;
+        __m128i sad = _mm_setzero_si128();
+
+        for (i = 0; i < 3; i++)
+        {
+            sad = _mm_add_epi64(sad,
+                    _mm_sad_epu8(_mm_loadl_epi64((const __m128i*)pa),
+                                 _mm_loadl_epi64((const __m128i*)(pa + s))));
+            pa += s;
+        }
+        dest[k] = 4 * _mm_cvtsi128_si32(sad);
+    }
+}
+
+/*
+ * The comb terms range over -510..510, so they are computed on 16 bit
+ * lanes.  A lane accumulates at most 4 rows of 2 terms (4080), and a
+ * block sums to at most 32640, so nothing overflows.
+ */
+static inline __m128i comb_terms_sse2(__m128i a, __m128i ad,
+                                      __m128i b, __m128i bu)
+{
+    __m128i t1 = _mm_sub_epi16(_mm_add_epi16(a, a), _mm_add_epi16(bu, b));
+    __m128i t2 = _mm_sub_epi16(_mm_add_epi16(b, b), _mm_add_epi16(a, ad));
+
+    t1 = _mm_max_epi16(t1, _mm_sub_epi16(_mm_setzero_si128(), t1));
+    t2 = _mm_max_epi16(t2, _mm_sub_epi16(_mm_setzero_si128(), t2));
+
+    return _mm_add_epi16(t1, t2);
+}
+
+static void pullup_licomb_y_sse2(const uint8_t *a, const uint8_t *b, int s,
+                                 int blocks, int *dest)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ones = _mm_set1_epi16(1);
+    int k, i;
+
+    for (k = 0; k < blocks; k++)
+    {
+        const uint8_t *pa = a + k * 8, *pb = b + k * 8;
+        __m128i acc = _mm_setzero_si128();
+
+        for (i = 0; i < 4; i++)
+        {
+            __m128i va  = _mm_unpacklo_epi8(
+                            _mm_loadl_epi64((const __m128i*)pa), zero);
+            __m128i vad = _mm_unpacklo_epi8(
+                            _mm_loadl_epi64((const __m128i*)(pa + s)), zero);
+            __m128i vb  = _mm_unpacklo_epi8(
+                            _mm_loadl_epi64((const __m128i*)pb), zero);
+            __m128i vbu = _mm_unpacklo_epi8(
+                            _mm_loadl_epi64((const __m128i*)(pb - s)), zero);
+
+            acc = _mm_add_epi16(acc, comb_terms_sse2(va, vad, vb, vbu));
+            pa += s; pb += s;
+        }
+        acc = _mm_madd_epi16(acc, ones);
+        acc = _mm_add_epi32(acc, _mm_unpackhi_epi64(acc, acc));
+        acc = _mm_add_epi32(acc, _mm_srli_epi64(acc, 32));
+        dest[k] = _mm_cvtsi128_si32(acc);
+    }
+}
+
+__attribute__((target("avx2")))
+static inline void store_sad4_avx2(int *dest, __m256i sad)
+{
+    const __m256i idx = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+
+    _mm_storeu_si128((__m128i*)dest,
+        _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(sad, idx)));
+}
+
+__attribute__((target("avx2")))
+static void pullup_diff_y_avx2(const uint8_t *a, const uint8_t *b, int s,
+                               int blocks, int *dest)
+{
+    int k, i;
+
+    for (k = 0; k + 4 <= blocks; k += 4)
+    {
+        const uint8_t *pa = a + k * 8, *pb = b + k * 8;
+        __m256i sad = _mm256_setzero_si256();
+
+        for (i = 0; i < 4; i++)
+        {
+            sad = _mm256_add_epi64(sad,
+                    _mm256_sad_epu8(_mm256_loadu_si256((const __m256i*)pa),
+                                    _mm256_loadu_si256((const __m256i*)pb)));
+            pa += s; pb += s;
+        }
+        store_sad4_avx2(dest + k, sad);
+    }
+    if (k < blocks)
+    {
+        pullup_diff_y_sse2(a + k * 8, b + k * 8, s, blocks - k, dest + k);
+    }
+}
+
+__attribute__((target("avx2")))
+static void pullup_var_y_avx2(const uint8_t *a, const uint8_t *b, int s,
+                              int blocks, int *dest)
+{
+    int k, i;
+
+    for (k = 0; k + 4 <= blocks; k += 4)
+    {
+        const uint8_t *pa = a + k * 8;
+        __m256i sad = _mm256_setzero_si256();
+
+        for (i = 0; i < 3; i++)
+        {
+            sad = _mm256_add_epi64(sad,
+                    _mm256_sad_epu8(
+                        _mm256_loadu_si256((const __m256i*)pa),
+                        _mm256_loadu_si256((const __m256i*)(pa + s))));
+            pa += s;
+        }
+        store_sad4_avx2(dest + k, _mm256_slli_epi64(sad, 2));
+    }
+    if (k < blocks)
+    {
+        pullup_var_y_sse2(a + k * 8, b + k * 8, s, blocks - k, dest + k);
+    }
+}
+
+__attribute__((target("avx2")))
+static inline __m256i comb_terms_avx2(__m256i a, __m256i ad,
+                                      __m256i b, __m256i bu)
+{
+    __m256i t1 = _mm256_sub_epi16(_mm256_add_epi16(a, a),
+                                  _mm256_add_epi16(bu, b));
+    __m256i t2 = _mm256_sub_epi16(_mm256_add_epi16(b, b),
+                                  _mm256_add_epi16(a, ad));
+
+    return _mm256_add_epi16(_mm256_abs_epi16(t1), _mm256_abs_epi16(t2));
+}
+
+// Two blocks per iteration, one in each 128 bit lane
+__attribute__((target("avx2")))
+static void pullup_licomb_y_avx2(const uint8_t *a, const uint8_t *b, int s,
+                                 int blocks, int *dest)
+{
+    const __m256i ones = _mm256_set1_epi16(1);
+    int k, i;
+
+    for (k = 0; k + 2 <= blocks; k += 2)
+    {
+        const uint8_t *pa = a + k * 8, *pb = b + k * 8;
+        __m256i acc = _mm256_setzero_si256();
+
+        for (i = 0; i < 4; i++)
+        {
+            __m256i va  = _mm256_cvtepu8_epi16(
+                            _mm_loadu_si128((const __m128i*)pa));
+            __m256i vad = _mm256_cvtepu8_epi16(
+                            _mm_loadu_si128((const __m128i*)(pa + s)));
+            __m256i vb  = _mm256_cvtepu8_epi16(
+                            _mm_loadu_si128((const __m128i*)pb));
+            __m256i vbu = _mm256_cvtepu8_epi16(
+                            _mm_loadu_si128((const __m128i*)(pb - s)));
+
+            acc = _mm256_add_epi16(acc, comb_terms_avx2(va, vad, vb, vbu));
+            pa += s; pb += s;
+        }
+        acc = _mm256_madd_epi16(acc, ones);
+        acc = _mm256_hadd_epi32(acc, acc);
+        acc = _mm256_hadd_epi32(acc, acc);
+        dest[k]     = _mm_cvtsi128_si32(_mm256_castsi256_si128(acc));
+        dest[k + 1] = _mm_cvtsi128_si32(_mm256_extracti128_si256(acc, 1));
+    }
+    if (k < blocks)
+    {
+        pullup_licomb_y_sse2(a + k * 8, b + k * 8, s, blocks - k, dest + k);
+    }
+}
+
+void detelecine_init_x86(PullupFunctions *functions)
+{
+    int cpu_flags = av_get_cpu_flags();
+
+    if (cpu_flags & AV_CPU_FLAG_AVX2)
+    {
+        functions->diff = pullup_diff_y_avx2;
+        functions->comb = pullup_licomb_y_avx2;
+        functions->var  = pullup_var_y_avx2;
+        hb_log("detelecine: using AVX2 optimizations");
+    }
+    else if (cpu_flags & AV_CPU_FLAG_SSE2)
+    {
+        functions->diff = pullup_diff_y_sse2;
+        functions->comb = pullup_licomb_y_sse2;
+        functions->var  = pullup_var_y_sse2;
+        hb_log("detelecine: using SSE2 optimizations");
+    }
+}
+
+#endif // ARCH_X86
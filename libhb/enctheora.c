@@ -49,7 +49,8 @@ int enctheoraInit( hb_work_object_t * w, hb_job_t * job )
     {
         char filename[1024];
         memset( filename, 0, 1024 );
-        hb_get_tempory_filename( job->h, filename, "theroa.log" );
+        hb_get_tempory_filename( job->h, filename, "theroa.%d.log",
+                                 job->sequence_id );
         if ( job->pass_id == HB_PASS_ENCODE_1ST )
         {
             pv->file = hb_fopen(filename, "wb");
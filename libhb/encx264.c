@@ -11,6 +11,7 @@
 
 #include "hb.h"
 #include "hb_dict.h"
+#include "taskset.h"
 #include "encx264.h"
 
 int  encx264Init( hb_work_object_t *, hb_job_t * );
@@ -28,6 +29,12 @@ hb_work_object_t hb_encx264 =
 
 #define DTS_BUFFER_SIZE 32
 
+typedef struct expand_arguments_s
+{
+    hb_buffer_t * src;
+    hb_buffer_t * dst;
+} expand_arguments_t;
+
 struct hb_work_private_s
 {
     hb_job_t           * job;
@@ -42,8 +49,24 @@ struct hb_work_private_s
 
     // Multiple bit-depth
     const x264_api_t *   api;
+
+    // Widening of 8 bit frames for high bit-depth builds of x264
+    ExpandFunctions      functions;
+    int                  expand_segments;
+    taskset_t            expand_taskset;    // Tasks - one per segment
+    expand_arguments_t   expand_arguments;
 };
 
+typedef struct expand_thread_arg_s
+{
+    hb_work_private_t * pv;
+    int                 segment;
+} expand_thread_arg_t;
+
+static void expand_thread( void * thread_args_v );
+static void expand_row_c( uint16_t * dst, const uint8_t * src,
+                          int shift, int width );
+
 #define HB_X264_API_COUNT   2
 static x264_api_t x264_apis[HB_X264_API_COUNT];
 
@@ -387,6 +410,13 @@ int encx264Init( hb_work_object_t * w, hb_job_t * job )
     param.i_keyint_max = 10 * param.i_keyint_min;
     param.i_log_level  = X264_LOG_INFO;
 
+    /* When jobs run side by side, use x264's auto thread count
+     * (1.5 per cpu) on this job's share of the cpus only. */
+    if (job->cpu_count > 0 && job->cpu_count < hb_get_cpu_count())
+    {
+        param.i_threads = job->cpu_count * 3 / 2;
+    }
+
     /* set up the VUI color model & gamma to match what the COLR atom
      * set in muxmp4.c says. See libhb/muxmp4.c for notes. */
     if( job->color_matrix_code == 5 )
@@ -521,7 +551,8 @@ int encx264Init( hb_work_object_t * w, hb_job_t * job )
             job->pass_id == HB_PASS_ENCODE_2ND )
         {
             memset( pv->filename, 0, 1024 );
-            hb_get_tempory_filename( job->h, pv->filename, "x264.log" );
+            hb_get_tempory_filename( job->h, pv->filename, "x264.%d.log",
+                                     job->sequence_id );
         }
         switch( job->pass_id )
         {
@@ -621,6 +652,48 @@ int encx264Init( hb_work_object_t * w, hb_job_t * job )
     }
     pv->pic_in.img.i_plane = 3;
 
+    if (pv->api->bit_depth > 8)
+    {
+        /*
+         * Frames are widened on the taskset thread pool, a segment of
+         * rows per task, so that the encoder thread is not held up by it.
+         */
+        pv->functions.expand_row = expand_row_c;
+#if defined(ARCH_X86)
+        encx264_init_x86(&pv->functions);
+#endif
+        pv->expand_segments = hb_get_cpu_count();
+        if (job->cpu_count > 0 && job->cpu_count < pv->expand_segments)
+        {
+            pv->expand_segments = job->cpu_count;
+        }
+        // Every segment gets at least one row of the chroma planes
+        if (pv->expand_segments > (job->height + 1) / 2)
+        {
+            pv->expand_segments = MAX(1, (job->height + 1) / 2);
+        }
+        if (taskset_init(&pv->expand_taskset, pv->expand_segments,
+                         sizeof(expand_thread_arg_t), expand_thread) == 0)
+        {
+            hb_error("encx264: could not initialize taskset");
+            pv->api->encoder_close(pv->x264);
+            hb_chapter_queue_close(&pv->chapter_queue);
+            free(pv);
+            w->private_data = NULL;
+            return 1;
+        }
+
+        int ii;
+        for (ii = 0; ii < pv->expand_segments; ii++)
+        {
+            expand_thread_arg_t * thread_args;
+
+            thread_args = taskset_thread_args(&pv->expand_taskset, ii);
+            thread_args->pv      = pv;
+            thread_args->segment = ii;
+        }
+    }
+
     return 0;
 }
 
@@ -636,6 +709,11 @@ void encx264Close( hb_work_object_t * w )
 
     hb_chapter_queue_close(&pv->chapter_queue);
 
+    if (pv->expand_segments > 0)
+    {
+        taskset_fini(&pv->expand_taskset);
+    }
+
     pv->api->encoder_close( pv->x264 );
     free( pv );
     w->private_data = NULL;
@@ -762,29 +840,66 @@ static hb_buffer_t *nal_encode( hb_work_object_t *w, x264_picture_t *pic_out,
     return buf;
 }
 
-static hb_buffer_t * expand_buf(int bit_depth, hb_buffer_t *in)
+static void expand_row_c( uint16_t * dst, const uint8_t * src,
+                          int shift, int width )
 {
-    hb_buffer_t *buf;
-    int          pp;
-    int          shift = bit_depth - 8;
+    int xx;
+
+    for (xx = 0; xx < width; xx++)
+    {
+        dst[xx] = (uint16_t)src[xx] << shift;
+    }
+}
+
+/*
+ * Widen this segment of all three planes.
+ */
+static void expand_thread( void * thread_args_v )
+{
+    expand_thread_arg_t * thread_args = thread_args_v;
+    hb_work_private_t   * pv          = thread_args->pv;
+    int                   segment     = thread_args->segment;
+    hb_buffer_t         * in          = pv->expand_arguments.src;
+    hb_buffer_t         * buf         = pv->expand_arguments.dst;
+    int                   shift       = pv->api->bit_depth - 8;
+    int                   pp, yy;
 
-    buf = hb_frame_buffer_init(AV_PIX_FMT_YUV420P16BE,
-                               in->f.width, in->f.height);
     for (pp = 0; pp < 3; pp++)
     {
-        int       xx, yy;
-        uint8_t  *src =  in->plane[pp].data;
-        uint16_t *dst = (uint16_t*)buf->plane[pp].data;
-        for (yy = 0; yy < in->plane[pp].height; yy++)
+        int height        = in->plane[pp].height;
+        int segment_start = height *  segment      / pv->expand_segments;
+        int segment_stop  = height * (segment + 1) / pv->expand_segments;
+
+        uint8_t  *src =  in->plane[pp].data + segment_start *
+                         in->plane[pp].stride;
+        uint16_t *dst = (uint16_t*)(buf->plane[pp].data + segment_start *
+                                    buf->plane[pp].stride);
+        for (yy = segment_start; yy < segment_stop; yy++)
         {
-            for (xx = 0; xx < in->plane[pp].width; xx++)
-            {
-                dst[xx] = (uint16_t)src[xx] << shift;
-            }
+            pv->functions.expand_row(dst, src, shift, in->plane[pp].width);
             src +=  in->plane[pp].stride;
             dst += buf->plane[pp].stride / 2;
         }
     }
+}
+
+/*
+ * High bit-depth builds of x264 only take 16 bit input.  The frame is
+ * widened segment by segment on the taskset thread pool; this blocks
+ * until the whole frame is done.
+ */
+static hb_buffer_t * expand_buf(hb_work_private_t *pv, hb_buffer_t *in)
+{
+    hb_buffer_t *buf;
+
+    buf = hb_frame_buffer_init(AV_PIX_FMT_YUV420P16BE,
+                               in->f.width, in->f.height);
+    pv->expand_arguments.src = in;
+    pv->expand_arguments.dst = buf;
+    taskset_cycle(&pv->expand_taskset);
+    pv->expand_arguments.src = NULL;
+    pv->expand_arguments.dst = NULL;
+
     return buf;
 }
 
@@ -797,7 +912,7 @@ static hb_buffer_t *x264_encode( hb_work_object_t *w, hb_buffer_t *in )
     /* Point x264 at our current buffers Y(UV) data.  */
     if (pv->pic_in.img.i_csp & X264_CSP_HIGH_DEPTH)
     {
-        tmp = expand_buf(pv->api->bit_depth, in);
+        tmp = expand_buf(pv, in);
         pv->pic_in.img.i_stride[0] = tmp->plane[0].stride;
         pv->pic_in.img.i_stride[1] = tmp->plane[1].stride;
         pv->pic_in.img.i_stride[2] = tmp->plane[2].stride;
@@ -59,6 +59,18 @@ typedef struct x264_api_s
     void    (*picture_init)(x264_picture_t*);
 } x264_api_t;
 
+typedef struct
+{
+    // Widens 'width' 8 bit samples of src to 16 bit samples in dst,
+    // shifted left by 'shift' bits.
+    void (*expand_row)(uint16_t      *dst,
+                       const uint8_t *src,
+                       int            shift,
+                       int            width);
+} ExpandFunctions;
+
+void               encx264_init_x86(ExpandFunctions *functions);
+
 void               hb_x264_global_init(void);
 const x264_api_t * hb_x264_api_get(int bit_depth);
 
@@ -0,0 +1,87 @@
+/* encx264_x86.c
+
+   Copyright (c) 2003-2018 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#include "hb.h"     // needed for ARCH_X86
+
+#if defined(ARCH_X86)
+
+#include <emmintrin.h>
+#include <immintrin.h>
+
+#include "libavutil/cpu.h"
+#include "encx264.h"
+
+static void expand_row_sse2(uint16_t      *dst,
+                            const uint8_t *src,
+                            int            shift,
+                            int            width)
+{
+    const __m128i zero  = _mm_setzero_si128();
+    const __m128i count = _mm_cvtsi32_si128(shift);
+    int xx;
+
+    for (xx = 0; xx + 16 <= width; xx += 16)
+    {
+        __m128i s  = _mm_loadu_si128((const __m128i*)(src + xx));
+        __m128i lo = _mm_sll_epi16(_mm_unpacklo_epi8(s, zero), count);
+        __m128i hi = _mm_sll_epi16(_mm_unpackhi_epi8(s, zero), count);
+
+        _mm_storeu_si128((__m128i*)(dst + xx),     lo);
+        _mm_storeu_si128((__m128i*)(dst + xx + 8), hi);
+    }
+    for (; xx < width; xx++)
+    {
+        dst[xx] = (uint16_t)src[xx] << shift;
+    }
+}
+
+__attribute__((target("avx2")))
+static void expand_row_avx2(uint16_t      *dst,
+                            const uint8_t *src,
+                            int            shift,
+                            int            width)
+{
+    const __m128i count = _mm_cvtsi32_si128(shift);
+    int xx;
+
+    for (xx = 0; xx + 32 <= width; xx += 32)
+    {
+        __m256i lo = _mm256_cvtepu8_epi16(
+                        _mm_loadu_si128((const __m128i*)(src + xx)));
+        __m256i hi = _mm256_cvtepu8_epi16(
+                        _mm_loadu_si128((const __m128i*)(src + xx + 16)));
+
+        _mm256_storeu_si256((__m256i*)(dst + xx),
+                            _mm256_sll_epi16(lo, count));
+        _mm256_storeu_si256((__m256i*)(dst + xx + 16),
+                            _mm256_sll_epi16(hi, count));
+    }
+    for (; xx < width; xx++)
+    {
+        dst[xx] = (uint16_t)src[xx] << shift;
+    }
+}
+
+void encx264_init_x86(ExpandFunctions *functions)
+{
+    int cpu_flags = av_get_cpu_flags();
+
+    if (cpu_flags & AV_CPU_FLAG_AVX2)
+    {
+        functions->expand_row = expand_row_avx2;
+        hb_log("encx264: using AVX2 optimizations");
+    }
+    else if (cpu_flags & AV_CPU_FLAG_SSE2)
+    {
+        functions->expand_row = expand_row_sse2;
+        hb_log("encx264: using SSE2 optimizations");
+    }
+}
+
+#endif // ARCH_X86
@@ -148,6 +148,18 @@ int encx265Init(hb_work_object_t *w, hb_job_t *job)
                                  0.5;
     param->keyframeMax = param->keyframeMin * 10;
 
+    /* When jobs run side by side, size the thread pool
+     * to this job's share of the cpus. */
+    if (job->cpu_count > 0 && job->cpu_count < hb_get_cpu_count())
+    {
+        char pools[16];
+        snprintf(pools, sizeof(pools), "%d", job->cpu_count);
+        if (param_parse(pv, param, "pools", pools))
+        {
+            goto fail;
+        }
+    }
+
     /*
      * Video Signal Type (color description only).
      *
@@ -258,7 +270,8 @@ int encx265Init(hb_work_object_t *w, hb_job_t *job)
             char stats_file[1024] = "";
             char pass[2];
             snprintf(pass, sizeof(pass), "%d", job->pass_id);
-            hb_get_tempory_filename(job->h, stats_file, "x265.log");
+            hb_get_tempory_filename(job->h, stats_file, "x265.%d.log",
+                                    job->sequence_id);
             if (param_parse(pv, param, "stats", stats_file) ||
                 param_parse(pv, param, "pass", pass))
             {
@@ -283,7 +296,8 @@ int encx265Init(hb_work_object_t *w, hb_job_t *job)
     {
         if (param->csvfn == NULL)
         {
-            hb_get_tempory_filename(job->h, pv->csvfn, "x265.csv");
+            hb_get_tempory_filename(job->h, pv->csvfn, "x265.%d.csv",
+                                    job->sequence_id);
             param->csvfn = pv->csvfn;
         }
         else
@@ -48,6 +48,17 @@ struct hb_fifo_s
     hb_buffer_t  * first;
     hb_buffer_t  * last;
 
+    // Single producer / single consumer mode (see hb_fifo_init_spsc).
+    // The producer owns 'tail', the consumer owns 'head'.  Buffers that
+    // do not fit in the ring are queued on first/last under 'lock' and
+    // counted in 'overflow'.  'size' is updated atomically in this mode.
+    int            spsc;
+    hb_buffer_t ** ring;
+    uint32_t       ring_mask;
+    uint32_t       head;
+    uint32_t       tail;
+    uint32_t       overflow;
+
 #if defined(HB_FIFO_DEBUG)
     // Fifo list for debugging
     hb_fifo_t    * next;
@@ -75,6 +86,41 @@ static hb_fifo_t fifo_list =
  * too much memory. */
 #define BUFFER_POOL_MAX_ELEMENTS 32
 
+/* Each thread keeps a small cache of free buffers for every pool in front
+ * of the global pools, so a thread that releases a buffer and allocates
+ * another of the same size (e.g. a filter recycling frames) never takes
+ * the pool lock.  A cache holds up to BUFFER_CACHE_BYTES worth of buffers
+ * per pool (at least BUFFER_CACHE_MIN_ELEMENTS).  Empty caches are refilled
+ * from the global pool and full caches flushed to it half a cache at a
+ * time under a single lock.  A thread's cache is flushed when it exits.
+ * Only its own thread touches a cache, without any lock.  To release the
+ * buffers cached by threads that are still alive, hb_buffer_pool_free
+ * bumps a flush generation, and each thread flushes its cache the next
+ * time it allocates or closes a buffer.  All caches are kept on a list so
+ * hb_buffer_pool_close can take back the buffers of idle threads once no
+ * other thread runs. */
+#if !defined(HB_NO_BUFFER_POOL) && !defined(HB_BUFFER_DEBUG)
+#define HB_BUFFER_CACHE 1
+#endif
+#define BUFFER_CACHE_BYTES        (16 << 20)
+#define BUFFER_CACHE_MIN_ELEMENTS 2
+#define BUFFER_CACHE_MAX_ELEMENTS 16
+
+typedef struct
+{
+    int           count;
+    hb_buffer_t * list;
+} buffer_cache_slot_t;
+
+typedef struct buffer_cache_s buffer_cache_t;
+struct buffer_cache_s
+{
+    int                   flush_gen;    // cache_flush_gen last flushed at
+    buffer_cache_t      * prev;
+    buffer_cache_t      * next;
+    buffer_cache_slot_t   slot[MAX_BUFFER_POOLS];
+};
+
 struct hb_buffer_pools_s
 {
     int64_t allocated;
@@ -82,6 +128,12 @@ struct hb_buffer_pools_s
 #if !defined(HB_NO_BUFFER_POOL)
     hb_fifo_t *pool[MAX_BUFFER_POOLS];
 #endif
+#if defined(HB_BUFFER_CACHE)
+    hb_tls_t  *cache;
+    int        cache_flush_gen;
+    hb_lock_t *cache_lock;  // Protects cache_list
+    buffer_cache_t *cache_list;
+#endif
 #if defined(HB_BUFFER_DEBUG)
     hb_list_t *alloc_list;
 #endif
@@ -91,6 +143,11 @@ struct hb_buffer_pools_s
 #if defined(HB_BUFFER_DEBUG)
 static int hb_fifo_contains( hb_fifo_t *f, hb_buffer_t *b );
 #endif
+#if defined(HB_BUFFER_CACHE)
+static void buffer_cache_close( void * _cache );
+static buffer_cache_t * buffer_cache_get( void );
+static void buffer_cache_flush_all( buffer_cache_t * cache );
+#endif
 
 void hb_buffer_pool_init( void )
 {
@@ -122,6 +179,36 @@ void hb_buffer_pool_init( void )
         buffers.pool[i]->buffer_size = 1 << i;
     }
 #endif
+#if defined(HB_BUFFER_CACHE)
+    buffers.cache_lock = hb_lock_init();
+    buffers.cache_list = NULL;
+    buffers.cache = hb_tls_init(buffer_cache_close);
+#endif
+}
+
+/* Releases the pools' buffers and the per-thread caches.  No other
+ * libhb thread may be running (see hb_global_close). */
+void hb_buffer_pool_close( void )
+{
+#if defined(HB_BUFFER_CACHE)
+    // Threads that are still alive keep their caches until here.  They
+    // no longer use them, so their buffers can be taken back.  Once the
+    // key is deleted their destructors no longer run.
+    buffer_cache_t * cache, * next;
+    hb_tls_close(&buffers.cache);
+    hb_lock(buffers.cache_lock);
+    for (cache = buffers.cache_list; cache != NULL; cache = next)
+    {
+        next = cache->next;
+        buffer_cache_flush_all(cache);
+        free(cache);
+    }
+    buffers.cache_list = NULL;
+    hb_unlock(buffers.cache_lock);
+    hb_lock_close(&buffers.cache_lock);
+#endif
+
+    hb_buffer_pool_free();
 }
 
 #if defined(HB_FIFO_DEBUG)
@@ -209,6 +296,12 @@ void fifo_list_validate( void )
     buffer_pools_validate();
     while ( next )
     {
+        if ( next->spsc )
+        {
+            // The ring can not be inspected safely from another thread
+            next = next->next;
+            continue;
+        }
         count = 0;
         hb_lock( next->lock );
         b = next->first;
@@ -272,6 +365,14 @@ void hb_buffer_pool_free( void )
     int i;
     int64_t freed = 0;
 
+#if defined(HB_BUFFER_CACHE)
+    // Buffers cached by exited threads have already been returned to
+    // the pools.  Have the remaining threads return theirs the next
+    // time they use their cache, and return this thread's now.
+    hb_atomic_add(&buffers.cache_flush_gen, 1);
+    buffer_cache_get();
+#endif
+
     hb_lock(buffers.lock);
 
 #if defined(HB_BUFFER_DEBUG)
@@ -325,7 +426,7 @@ void hb_buffer_pool_free( void )
     hb_unlock(buffers.lock);
 }
 
-static hb_fifo_t *size_to_pool( int size )
+static int size_to_pool_index( int size )
 {
 #if !defined(HB_NO_BUFFER_POOL)
     int i;
@@ -333,13 +434,177 @@ static hb_fifo_t *size_to_pool( int size )
     {
         if ( size <= (1 << i) )
         {
-            return buffers.pool[i];
+            return i;
         }
     }
+#endif
+    return -1;
+}
+
+static hb_fifo_t *size_to_pool( int size )
+{
+#if !defined(HB_NO_BUFFER_POOL)
+    int i = size_to_pool_index( size );
+    if ( i >= 0 )
+    {
+        return buffers.pool[i];
+    }
 #endif
     return NULL;
 }
 
+// Releases a buffer that is not going back to a pool
+static void buffer_free( hb_buffer_t * b )
+{
+    if( b->data )
+    {
+        free(b->data);
+        hb_lock(buffers.lock);
+        buffers.allocated -= b->alloc;
+        hb_unlock(buffers.lock);
+    }
+    free( b );
+}
+
+#if defined(HB_BUFFER_CACHE)
+static int buffer_cache_max( int pool )
+{
+    int max = BUFFER_CACHE_BYTES >> pool;
+    return MAX(BUFFER_CACHE_MIN_ELEMENTS, MIN(BUFFER_CACHE_MAX_ELEMENTS, max));
+}
+
+// Returns the calling thread's cache, flushed if hb_buffer_pool_free
+// was called since the thread last used it
+static buffer_cache_t * buffer_cache_get( void )
+{
+    buffer_cache_t * cache;
+    int              gen;
+
+    if (buffers.cache == NULL)
+    {
+        return NULL;
+    }
+    gen   = hb_atomic_load(&buffers.cache_flush_gen);
+    cache = hb_tls_get(buffers.cache);
+    if (cache != NULL && cache->flush_gen != gen)
+    {
+        buffer_cache_flush_all(cache);
+        cache->flush_gen = gen;
+    }
+    if (cache == NULL)
+    {
+        cache = calloc(1, sizeof(buffer_cache_t));
+        if (cache == NULL)
+        {
+            return NULL;
+        }
+        cache->flush_gen = gen;
+
+        hb_lock(buffers.cache_lock);
+        cache->next = buffers.cache_list;
+        if (cache->next != NULL)
+        {
+            cache->next->prev = cache;
+        }
+        buffers.cache_list = cache;
+        hb_unlock(buffers.cache_lock);
+
+        hb_tls_set(buffers.cache, cache);
+    }
+    return cache;
+}
+
+// Moves up to 'count' buffers from the head of the global pool 'f'
+// into the cache slot
+static void buffer_cache_refill( buffer_cache_slot_t * slot, hb_fifo_t * f,
+                                 int count )
+{
+    hb_buffer_t * b;
+
+    hb_lock( f->lock );
+    while( count-- > 0 && f->size > 0 )
+    {
+        b         = f->first;
+        f->first  = b->next;
+        f->size  -= 1;
+        b->next   = slot->list;
+        slot->list = b;
+        slot->count++;
+    }
+    hb_unlock( f->lock );
+}
+
+// Moves 'count' buffers from the cache slot to the head of the global
+// pool 'f'. Buffers that don't fit in the global pool are freed.
+static void buffer_cache_flush( buffer_cache_slot_t * slot, hb_fifo_t * f,
+                                int count )
+{
+    hb_buffer_t * b;
+
+    hb_lock( f->lock );
+    while( count > 0 && f->size < f->capacity )
+    {
+        b          = slot->list;
+        slot->list = b->next;
+        slot->count--;
+        count--;
+
+        b->next  = f->first;
+        if( f->size == 0 )
+        {
+            f->last = b;
+        }
+        f->first = b;
+        f->size += 1;
+    }
+    hb_unlock( f->lock );
+
+    while( count-- > 0 )
+    {
+        b          = slot->list;
+        slot->list = b->next;
+        slot->count--;
+        buffer_free( b );
+    }
+}
+
+// Returns all buffers of the cache to the global pools.
+static void buffer_cache_flush_all( buffer_cache_t * cache )
+{
+    int i;
+
+    for ( i = BUFFER_POOL_FIRST; i <= BUFFER_POOL_LAST; ++i )
+    {
+        buffer_cache_flush( &cache->slot[i], buffers.pool[i],
+                            cache->slot[i].count );
+    }
+}
+
+// Called on thread exit. Returns all cached buffers to the global pools.
+static void buffer_cache_close( void * _cache )
+{
+    buffer_cache_t * cache = _cache;
+
+    hb_lock( buffers.cache_lock );
+    if( cache->prev != NULL )
+    {
+        cache->prev->next = cache->next;
+    }
+    else
+    {
+        buffers.cache_list = cache->next;
+    }
+    if( cache->next != NULL )
+    {
+        cache->next->prev = cache->prev;
+    }
+    hb_unlock( buffers.cache_lock );
+
+    buffer_cache_flush_all( cache );
+    free( cache );
+}
+#endif
+
 hb_buffer_t * hb_buffer_init_internal( int size )
 {
     hb_buffer_t * b;
@@ -349,11 +614,36 @@ hb_buffer_t * hb_buffer_init_internal( int size )
     // sometimes we feed data to these libraries starting from arbitrary
     // points within the buffer.
     int alloc = size + 16;
+    int pool_index = size_to_pool_index( alloc );
     hb_fifo_t *buffer_pool = size_to_pool( alloc );
 
     if( buffer_pool )
     {
+#if defined(HB_BUFFER_CACHE)
+        buffer_cache_t * cache = buffer_cache_get();
+        b = NULL;
+        if( cache != NULL )
+        {
+            buffer_cache_slot_t * slot = &cache->slot[pool_index];
+            if( slot->count == 0 )
+            {
+                buffer_cache_refill( slot, buffer_pool,
+                                     buffer_cache_max( pool_index ) / 2 );
+            }
+            if( slot->count > 0 )
+            {
+                b          = slot->list;
+                slot->list = b->next;
+                slot->count--;
+            }
+        }
+        else
+        {
+            b = hb_fifo_get( buffer_pool );
+        }
+#else
         b = hb_fifo_get( buffer_pool );
+#endif
 
         if( b )
         {
@@ -401,7 +691,8 @@ hb_buffer_t * hb_buffer_init_internal( int size )
         /* FIXME */
         b->data  = malloc( b->alloc + 17 );
 #else
-        b->data  = memalign( 16, b->alloc );
+        // Aligned for decoders that decode directly into frame buffers
+        b->data  = memalign( 64, b->alloc );
 #endif
 
         if( !b->data )
@@ -434,6 +725,29 @@ hb_buffer_t * hb_buffer_init( int size )
     return hb_buffer_init_internal(size);
 }
 
+// Allocates a buffer header without a payload, for buffers that borrow
+// the payload of other buffers or of some external storage.
+static hb_buffer_t * buffer_header_init( void )
+{
+    hb_buffer_t * b = calloc( sizeof( hb_buffer_t ), 1 );
+
+    if( b == NULL )
+    {
+        hb_log( "out of memory" );
+        return NULL;
+    }
+    b->s.start        = AV_NOPTS_VALUE;
+    b->s.stop         = AV_NOPTS_VALUE;
+    b->s.renderOffset = AV_NOPTS_VALUE;
+    b->s.scr_sequence = -1;
+#if defined(HB_BUFFER_DEBUG)
+    hb_lock(buffers.lock);
+    hb_list_add(buffers.alloc_list, b);
+    hb_unlock(buffers.lock);
+#endif
+    return b;
+}
+
 hb_buffer_t * hb_buffer_eof_init(void)
 {
     hb_buffer_t * buf = hb_buffer_init(0);
@@ -445,6 +759,10 @@ void hb_buffer_realloc( hb_buffer_t * b, int size )
 {
     if ( size > b->alloc || b->data == NULL )
     {
+        if ( b->shared != NULL || b->storage != NULL )
+        {
+            hb_buffer_make_writable( b );
+        }
         uint32_t orig = b->data != NULL ? b->alloc : 0;
         hb_fifo_t *buffer_pool = size_to_pool(size);
         if (buffer_pool != NULL)
@@ -499,6 +817,113 @@ hb_buffer_t * hb_buffer_dup( const hb_buffer_t * src )
     return buf;
 }
 
+// Creates a new buffer that shares the payload of 'src' without copying
+// it. Metadata is copied, so the new buffer can be modified, queued and
+// closed independently of 'src'. The payload is released when the last
+// buffer that references it is closed. Buffers that share their payload
+// must not write to it without calling hb_buffer_make_writable first.
+hb_buffer_t * hb_buffer_ref( hb_buffer_t * src )
+{
+    hb_buffer_t * buf;
+
+    if ( src == NULL )
+        return NULL;
+
+    if ( src->data == NULL )
+        return hb_buffer_dup( src );
+
+    if ( src->shared == NULL )
+    {
+        src->shared = malloc( sizeof( *src->shared ) );
+        if ( src->shared == NULL )
+            return hb_buffer_dup( src );
+        *src->shared = 1;
+    }
+
+    buf = buffer_header_init();
+    if ( buf == NULL )
+        return NULL;
+
+    hb_atomic_add( src->shared, 1 );
+    buf->size         = src->size;
+    buf->alloc        = src->alloc;
+    buf->data         = src->data;
+    buf->shared       = src->shared;
+    buf->storage      = src->storage;
+    buf->storage_free = src->storage_free;
+    buf->s            = src->s;
+    buf->f            = src->f;
+    memcpy( buf->plane, src->plane, sizeof( buf->plane ) );
+
+#ifdef USE_QSV
+    memcpy(&buf->qsv_details, &src->qsv_details, sizeof(src->qsv_details));
+#endif
+
+    return buf;
+}
+
+// Returns 1 if the payload of 'b' belongs to 'b' alone, so that it may
+// be modified in place.  Code that writes to the payload of a buffer it
+// received asserts this after calling hb_buffer_make_writable.
+int hb_buffer_is_writable( const hb_buffer_t * b )
+{
+    return b->storage == NULL &&
+           ( b->shared == NULL || hb_atomic_load( b->shared ) == 1 );
+}
+
+// Gives 'b' a private copy of its payload if the payload is shared with
+// other buffers or owned by external storage. Must be called before
+// modifying the payload of a buffer that may have been shared with
+// hb_buffer_ref or wrapped with hb_frame_buffer_wrap.
+int hb_buffer_make_writable( hb_buffer_t * b )
+{
+    hb_buffer_t * tmp;
+    uint8_t     * data;
+    int           alloc, p;
+
+    if ( b == NULL || ( b->shared == NULL && b->storage == NULL ) )
+        return 0;
+
+    if ( b->storage == NULL && hb_atomic_load( b->shared ) == 1 )
+    {
+        // Nobody else holds a reference, so nobody can take a new one
+        free( b->shared );
+        b->shared = NULL;
+        return 0;
+    }
+
+    tmp = hb_buffer_init( b->size );
+    if ( tmp == NULL )
+        return -1;
+    memcpy( tmp->data, b->data, b->size );
+
+    // Move the private copy to 'b' and drop b's reference to the
+    // shared payload
+    data              = b->data;
+    alloc             = b->alloc;
+    b->data           = tmp->data;
+    b->alloc          = tmp->alloc;
+    tmp->data         = data;
+    tmp->alloc        = alloc;
+    tmp->shared       = b->shared;
+    tmp->storage      = b->storage;
+    tmp->storage_free = b->storage_free;
+    b->shared         = NULL;
+    b->storage        = NULL;
+    b->storage_free   = NULL;
+    hb_buffer_close( &tmp );
+
+    for ( p = 0; p < 4; p++ )
+    {
+        if ( b->plane[p].data != NULL )
+        {
+            b->plane[p].data = b->data + ( b->plane[p].data - data );
+        }
+    }
+
+    return 0;
+}
+
 int hb_buffer_copy(hb_buffer_t * dst, const hb_buffer_t * src)
 {
     if (src == NULL || dst == NULL)
@@ -507,6 +932,9 @@ int hb_buffer_copy(hb_buffer_t * dst, const hb_buffer_t * src)
     if ( dst->size < src->size )
         return -1;
 
+    if ( hb_buffer_make_writable( dst ) )
+        return -1;
+
     memcpy( dst->data, src->data, src->size );
     dst->s = src->s;
     dst->f = src->f;
@@ -597,6 +1025,46 @@ hb_buffer_t * hb_frame_buffer_init( int pix_fmt, int width, int height )
     return buf;
 }
 
+// Creates a buffer for an uncompressed picture whose payload is 'data',
+// which must be laid out like the payload of hb_frame_buffer_init.
+// The payload belongs to 'storage' and is released by calling
+// 'storage_free' when the last buffer referencing it is closed.
+hb_buffer_t * hb_frame_buffer_wrap( int pix_fmt, int width, int height,
+                                    uint8_t * data, int size, void * storage,
+                                    void (* storage_free)( void * ) )
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(pix_fmt);
+    hb_buffer_t * buf;
+    int p;
+    uint8_t has_plane[4] = {0,};
+
+    if (desc == NULL)
+    {
+        return NULL;
+    }
+    for( p = 0; p < 4; p++ )
+    {
+        has_plane[desc->comp[p].plane] = 1;
+    }
+
+    buf = buffer_header_init();
+    if( buf == NULL )
+        return NULL;
+
+    buf->size         = size;
+    buf->alloc        = size;
+    buf->data         = data;
+    buf->storage      = storage;
+    buf->storage_free = storage_free;
+    buf->s.type       = FRAME_BUF;
+    buf->f.width      = width;
+    buf->f.height     = height;
+    buf->f.fmt        = pix_fmt;
+
+    hb_buffer_init_planes_internal( buf, has_plane );
+    return buf;
+}
+
 // this routine reallocs a buffer for an uncompressed YUV420 video frame
 // with dimensions width x height.
 void hb_video_buffer_realloc( hb_buffer_t * buf, int width, int height )
@@ -638,15 +1106,21 @@ void hb_video_buffer_realloc( hb_buffer_t * buf, int width, int height )
 // from src to dst.
 void hb_buffer_swap_copy( hb_buffer_t *src, hb_buffer_t *dst )
 {
-    uint8_t *data  = dst->data;
-    int      size  = dst->size;
-    int      alloc = dst->alloc;
+    uint8_t *data    = dst->data;
+    int      size    = dst->size;
+    int      alloc   = dst->alloc;
+    int     *shared  = dst->shared;
+    void    *storage = dst->storage;
+    void   (*storage_free)( void * ) = dst->storage_free;
 
     *dst = *src;
 
-    src->data  = data;
-    src->size  = size;
-    src->alloc = alloc;
+    src->data         = data;
+    src->size         = size;
+    src->alloc        = alloc;
+    src->shared       = shared;
+    src->storage      = storage;
+    src->storage_free = storage_free;
 }
 
 // Frees the specified buffer list.
@@ -684,6 +1158,53 @@ void hb_buffer_close( hb_buffer_t ** _b )
 
         b->next = NULL;
 
+        if( b->shared != NULL )
+        {
+            if( hb_atomic_sub( b->shared, 1 ) > 0 )
+            {
+                // The payload is still referenced by other buffers.
+                // Only release this buffer's header.
+                b->data = NULL;
+            }
+            else
+            {
+                free( b->shared );
+            }
+            b->shared = NULL;
+        }
+
+        if( b->storage != NULL )
+        {
+            // The payload does not belong to the buffer pools
+            if( b->data != NULL )
+            {
+                b->storage_free( b->storage );
+            }
+            b->data         = NULL;
+            b->storage      = NULL;
+            b->storage_free = NULL;
+        }
+
+#if defined(HB_BUFFER_CACHE)
+        buffer_cache_t * cache;
+        if( buffer_pool && b->data && ( cache = buffer_cache_get() ) != NULL )
+        {
+            int pool_index = size_to_pool_index( b->alloc );
+            int max = buffer_cache_max( pool_index );
+            buffer_cache_slot_t * slot = &cache->slot[pool_index];
+
+            if( slot->count >= max )
+            {
+                buffer_cache_flush( slot, buffer_pool, max / 2 );
+            }
+            b->next    = slot->list;
+            slot->list = b;
+            slot->count++;
+            b = next;
+            continue;
+        }
+#endif
+
 #if defined(HB_BUFFER_DEBUG)
         hb_lock(buffers.lock);
         hb_list_rem(buffers.alloc_list, b);
@@ -704,14 +1225,7 @@ void hb_buffer_close( hb_buffer_t ** _b )
         }
         // either the pool is full or this size doesn't use a pool
         // free the buf 
-        if( b->data )
-        {
-            free(b->data);
-            hb_lock(buffers.lock);
-            buffers.allocated -= b->alloc;
-            hb_unlock(buffers.lock);
-        }
-        free( b );
+        buffer_free( b );
         b = next;
     }
 
@@ -837,6 +1351,181 @@ void hb_image_close(hb_image_t **_image)
     }
 }
 
+/*
+ * Single producer / single consumer fifo
+ *
+ * Most fifos in the pipeline connect exactly one producer thread to
+ * exactly one consumer thread.  For these, buffers are passed through a
+ * power of 2 ring of pointers that the producer fills at 'tail' and the
+ * consumer drains at 'head' without taking the fifo lock.  The lock and
+ * condition variables are only used when one side has to sleep because
+ * the fifo is empty or full.
+ *
+ * hb_fifo_push is not allowed to block and may append more buffers than
+ * the fifo capacity, so buffers that do not fit in the ring spill into the
+ * regular locked list.  Once anything has spilled, the producer keeps
+ * spilling until the consumer has drained the overflow list.  The consumer
+ * always drains the ring first, which preserves ordering.
+ */
+#define SPSC_RING_MAX 1024
+
+static hb_buffer_t * spsc_see( hb_fifo_t * f, uint32_t n )
+{
+    hb_buffer_t * b = NULL;
+    uint32_t      overflow, avail;
+
+    // Read overflow before tail. Anything that spilled into the overflow
+    // list was pushed after everything currently in the ring.
+    overflow = hb_atomic_load( &f->overflow );
+    avail    = hb_atomic_load( &f->tail ) - f->head;
+    if( n < avail )
+    {
+        return f->ring[( f->head + n ) & f->ring_mask];
+    }
+    if( overflow > n - avail )
+    {
+        hb_lock( f->lock );
+        b = f->first;
+        for( n -= avail; n > 0 && b != NULL; n-- )
+        {
+            b = b->next;
+        }
+        hb_unlock( f->lock );
+    }
+    return b;
+}
+
+static void spsc_signal_full( hb_fifo_t * f, uint32_t size )
+{
+    hb_atomic_fence();
+    if( hb_atomic_load( &f->wait_full ) && size <= f->capacity - f->thresh )
+    {
+        hb_lock( f->lock );
+        hb_atomic_store( &f->wait_full, 0 );
+        hb_cond_signal( f->cond_full );
+        hb_unlock( f->lock );
+    }
+}
+
+static hb_buffer_t * spsc_get( hb_fifo_t * f )
+{
+    hb_buffer_t * b;
+    uint32_t      overflow;
+
+    overflow = hb_atomic_load( &f->overflow );
+    if( f->head != hb_atomic_load( &f->tail ) )
+    {
+        b = f->ring[f->head & f->ring_mask];
+        hb_atomic_store( &f->head, f->head + 1 );
+    }
+    else if( overflow > 0 )
+    {
+        hb_lock( f->lock );
+        b        = f->first;
+        f->first = b->next;
+        b->next  = NULL;
+        hb_atomic_sub( &f->overflow, 1 );
+        hb_unlock( f->lock );
+    }
+    else
+    {
+        return NULL;
+    }
+    spsc_signal_full( f, hb_atomic_sub( &f->size, 1 ) );
+
+    return b;
+}
+
+// Waits until the fifo is no longer empty or FIFO_TIMEOUT milliseconds
+// have elapsed.
+static void spsc_wait_empty( hb_fifo_t * f )
+{
+    if( hb_atomic_load( &f->size ) > 0 )
+    {
+        return;
+    }
+    hb_lock( f->lock );
+    hb_atomic_store( &f->wait_empty, 1 );
+    hb_atomic_fence();
+    if( hb_atomic_load( &f->size ) == 0 )
+    {
+        hb_cond_timedwait( f->cond_empty, f->lock, FIFO_TIMEOUT );
+    }
+    hb_atomic_store( &f->wait_empty, 0 );
+    hb_unlock( f->lock );
+}
+
+// Waits until the fifo is no longer full or FIFO_TIMEOUT milliseconds
+// have elapsed.
+static void spsc_wait_full( hb_fifo_t * f )
+{
+    if( hb_atomic_load( &f->size ) < f->capacity )
+    {
+        return;
+    }
+    hb_lock( f->lock );
+    hb_atomic_store( &f->wait_full, 1 );
+    hb_atomic_fence();
+    if( hb_atomic_load( &f->size ) >= f->capacity )
+    {
+        if (f->cond_alert_full != NULL)
+            hb_cond_broadcast( f->cond_alert_full );
+        hb_cond_timedwait( f->cond_full, f->lock, FIFO_TIMEOUT );
+    }
+    hb_atomic_store( &f->wait_full, 0 );
+    hb_unlock( f->lock );
+}
+
+static void spsc_push( hb_fifo_t * f, hb_buffer_t * b )
+{
+    hb_buffer_t * next;
+    uint32_t      count = 0, size;
+
+    while( b != NULL )
+    {
+        next    = b->next;
+        b->next = NULL;
+        if( hb_atomic_load( &f->overflow ) == 0 &&
+            f->tail - hb_atomic_load( &f->head ) <= f->ring_mask )
+        {
+            f->ring[f->tail & f->ring_mask] = b;
+            hb_atomic_store( &f->tail, f->tail + 1 );
+        }
+        else
+        {
+            hb_lock( f->lock );
+            if( f->first == NULL )
+            {
+                f->first = b;
+            }
+            else
+            {
+                f->last->next = b;
+            }
+            f->last = b;
+            hb_atomic_add( &f->overflow, 1 );
+            hb_unlock( f->lock );
+        }
+        count++;
+        b = next;
+    }
+
+    size = hb_atomic_add( &f->size, count );
+    if (size >= f->capacity &&
+        f->cond_alert_full != NULL)
+    {
+        hb_cond_broadcast( f->cond_alert_full );
+    }
+    hb_atomic_fence();
+    if( hb_atomic_load( &f->wait_empty ) )
+    {
+        hb_lock( f->lock );
+        hb_atomic_store( &f->wait_empty, 0 );
+        hb_cond_signal( f->cond_empty );
+        hb_unlock( f->lock );
+    }
+}
+
 hb_fifo_t * hb_fifo_init( int capacity, int thresh )
 {
     hb_fifo_t * f;
@@ -855,6 +1544,30 @@ hb_fifo_t * hb_fifo_init( int capacity, int thresh )
     return f;
 }
 
+// Creates a fifo that may only be pushed to by one thread and read by
+// one other thread at a time.  hb_fifo_push_head is rejected and
+// hb_fifo_size_bytes must be called from the consumer thread.
+hb_fifo_t * hb_fifo_init_spsc( int capacity, int thresh )
+{
+    hb_fifo_t * f = hb_fifo_init( capacity, thresh );
+    uint32_t    ring_size = 1;
+
+    while( ring_size < capacity && ring_size < SPSC_RING_MAX )
+    {
+        ring_size <<= 1;
+    }
+    f->ring = calloc( ring_size, sizeof( hb_buffer_t * ) );
+    if( f->ring == NULL )
+    {
+        // Fall back to the locked fifo
+        return f;
+    }
+    f->ring_mask = ring_size - 1;
+    f->spsc      = 1;
+
+    return f;
+}
+
 void hb_fifo_register_full_cond( hb_fifo_t * f, hb_cond_t * c )
 {
     f->cond_alert_full = c;
@@ -865,6 +1578,14 @@ int hb_fifo_size_bytes( hb_fifo_t * f )
     int ret = 0;
     hb_buffer_t * link;
 
+    if( f->spsc )
+    {
+        uint32_t ii, tail = hb_atomic_load( &f->tail );
+        for( ii = f->head; ii != tail; ii++ )
+        {
+            ret += f->ring[ii & f->ring_mask]->size;
+        }
+    }
     hb_lock( f->lock );
     link = f->first;
     while ( link )
@@ -881,6 +1602,10 @@ int hb_fifo_size( hb_fifo_t * f )
 {
     int ret;
 
+    if( f->spsc )
+    {
+        return hb_atomic_load( &f->size );
+    }
     hb_lock( f->lock );
     ret = f->size;
     hb_unlock( f->lock );
@@ -892,6 +1617,10 @@ int hb_fifo_is_full( hb_fifo_t * f )
 {
     int ret;
 
+    if( f->spsc )
+    {
+        return hb_atomic_load( &f->size ) >= f->capacity;
+    }
     hb_lock( f->lock );
     ret = ( f->size >= f->capacity );
     hb_unlock( f->lock );
@@ -903,6 +1632,10 @@ float hb_fifo_percent_full( hb_fifo_t * f )
 {
     float ret;
 
+    if( f->spsc )
+    {
+        return hb_atomic_load( &f->size ) / f->capacity;
+    }
     hb_lock( f->lock );
     ret = f->size / f->capacity;
     hb_unlock( f->lock );
@@ -916,6 +1649,11 @@ hb_buffer_t * hb_fifo_get_wait( hb_fifo_t * f )
 {
     hb_buffer_t * b;
 
+    if( f->spsc )
+    {
+        spsc_wait_empty( f );
+        return spsc_get( f );
+    }
     hb_lock( f->lock );
     if( f->size < 1 )
     {
@@ -946,6 +1684,10 @@ hb_buffer_t * hb_fifo_get( hb_fifo_t * f )
 {
     hb_buffer_t * b;
 
+    if( f->spsc )
+    {
+        return spsc_get( f );
+    }
     hb_lock( f->lock );
     if( f->size < 1 )
     {
@@ -970,6 +1712,11 @@ hb_buffer_t * hb_fifo_see_wait( hb_fifo_t * f )
 {
     hb_buffer_t * b;
 
+    if( f->spsc )
+    {
+        spsc_wait_empty( f );
+        return spsc_see( f, 0 );
+    }
     hb_lock( f->lock );
     if( f->size < 1 )
     {
@@ -993,6 +1740,10 @@ hb_buffer_t * hb_fifo_see( hb_fifo_t * f )
 {
     hb_buffer_t * b;
 
+    if( f->spsc )
+    {
+        return spsc_see( f, 0 );
+    }
     hb_lock( f->lock );
     if( f->size < 1 )
     {
@@ -1009,6 +1760,10 @@ hb_buffer_t * hb_fifo_see2( hb_fifo_t * f )
 {
     hb_buffer_t * b;
 
+    if( f->spsc )
+    {
+        return spsc_see( f, 1 );
+    }
     hb_lock( f->lock );
     if( f->size < 2 )
     {
@@ -1027,6 +1782,11 @@ int hb_fifo_full_wait( hb_fifo_t * f )
 {
     int result;
 
+    if( f->spsc )
+    {
+        spsc_wait_full( f );
+        return hb_atomic_load( &f->size ) < f->capacity;
+    }
     hb_lock( f->lock );
     if( f->size >= f->capacity )
     {
@@ -1047,6 +1807,12 @@ void hb_fifo_push_wait( hb_fifo_t * f, hb_buffer_t * b )
         return;
     }
 
+    if( f->spsc )
+    {
+        spsc_wait_full( f );
+        spsc_push( f, b );
+        return;
+    }
     hb_lock( f->lock );
     if( f->size >= f->capacity )
     {
@@ -1086,6 +1852,11 @@ void hb_fifo_push( hb_fifo_t * f, hb_buffer_t * b )
         return;
     }
 
+    if( f->spsc )
+    {
+        spsc_push( f, b );
+        return;
+    }
     hb_lock( f->lock );
     if (f->size >= f->capacity &&
         f->cond_alert_full != NULL)
@@ -1116,6 +1887,7 @@ void hb_fifo_push( hb_fifo_t * f, hb_buffer_t * b )
 }
 
 // Prepends the specified packet list to the start of the specified FIFO.
+// Not supported on spsc fifos, the packets are dropped.
 void hb_fifo_push_head( hb_fifo_t * f, hb_buffer_t * b )
 {
     hb_buffer_t * tmp;
@@ -1126,6 +1898,15 @@ void hb_fifo_push_head( hb_fifo_t * f, hb_buffer_t * b )
         return;
     }
 
+    if( f->spsc )
+    {
+        // Only the producer may write to the ring, and pushing to the
+        // tail instead would reorder the stream
+        hb_error( "hb_fifo_push_head: not supported on spsc fifo, "
+                  "dropping the buffers" );
+        hb_buffer_close( &b );
+        return;
+    }
     hb_lock( f->lock );
     if (f->size >= f->capacity &&
         f->cond_alert_full != NULL)
@@ -1175,6 +1956,7 @@ void hb_fifo_close( hb_fifo_t ** _f )
     hb_lock_close( &f->lock );
     hb_cond_close( &f->cond_empty );
     hb_cond_close( &f->cond_full );
+    free( f->ring );
 
 #if defined(HB_FIFO_DEBUG)
     // Remove the fifo from the global fifo list
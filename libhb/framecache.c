@@ -0,0 +1,893 @@
+/* framecache.c
+
+   Copyright (c) 2003-2018 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*
+ * Frame cache for two-pass encodes.
+ *
+ * During the 1st pass, everything that would be handed to the encoders
+ * and the muxer is recorded: the filtered video frames, the synchronized
+ * audio and the passthru subtitles.  The 2nd pass replays the recording
+ * instead of running the reader, the decoders, sync and the filters again.
+ *
+ * Buffers are kept in memory until the memory budget is used up.  After
+ * that, each stream continues in a temporary file.  Video frames are
+ * stored in the file as lossless ffvhuff packets, everything else as is.
+ */
+
+#include <errno.h>
+
+#include "hb.h"
+#include "hbffmpeg.h"
+
+typedef struct
+{
+    int                  size;   // size of the payload that follows
+    int                  coded;  // payload is an ffvhuff packet
+    hb_buffer_settings_t s;
+    hb_image_format_t    f;
+} cache_record_t;
+
+struct hb_frame_cache_stream_s
+{
+    hb_frame_cache_t * cache;
+    int                index;
+    int                used;
+    int                eof;
+    int                error;
+    int                count;
+
+    // Buffers that fit in the memory budget, oldest first
+    hb_buffer_list_t   list;
+
+    // Buffers that did not, they follow the buffers in 'list'
+    int                spill;
+    int                spill_count;
+    char               filename[1024];
+    FILE             * file;
+    uint8_t          * payload;
+    int                payload_size;
+
+    // Lossless video coding of spilled frames
+    int                coder_failed;
+    AVCodecContext   * encoder;
+    AVCodecContext   * decoder;
+    AVFrame          * frame;
+
+    // Stream configuration created by the 1st pass decoders
+    hb_esconfig_t    * config;
+    uint8_t          * extradata;
+    int                extradata_size;
+};
+
+struct hb_frame_cache_s
+{
+    hb_lock_t               * lock;
+    int64_t                   ram_size;     // memory held by this cache
+    int64_t                   ram_limit;    // budget of all caches
+    int                       complete;
+
+    int                       audio_count;
+    int                       subtitle_count;
+    int                       stream_count;
+    hb_frame_cache_stream_t * streams;
+};
+
+// Memory held by the frame caches of all jobs.  Jobs that run at the
+// same time share one budget, so it is counted process wide.
+static int64_t cache_ram_used;
+
+static int64_t cache_ram_limit( void )
+{
+    // Use up to a quarter of the physical memory
+#if defined(_SC_PHYS_PAGES) && defined(_SC_PAGESIZE)
+    long pages     = sysconf(_SC_PHYS_PAGES);
+    long page_size = sysconf(_SC_PAGESIZE);
+
+    if (pages > 0 && page_size > 0)
+    {
+        return (int64_t)pages * page_size / 4;
+    }
+#endif
+    return 1024LL * 1024 * 1024;
+}
+
+// Takes 'size' bytes from the shared budget.  Returns 0 if they don't fit.
+static int cache_ram_reserve( hb_frame_cache_t * cache, int64_t size )
+{
+    int64_t used = hb_atomic_load(&cache_ram_used);
+
+    do
+    {
+        if (used + size > cache->ram_limit)
+        {
+            return 0;
+        }
+    } while (!hb_atomic_cas(&cache_ram_used, &used, used + size));
+
+    hb_lock(cache->lock);
+    cache->ram_size += size;
+    hb_unlock(cache->lock);
+    return 1;
+}
+
+static void cache_ram_release( hb_frame_cache_t * cache, int64_t size )
+{
+    hb_atomic_sub(&cache_ram_used, size);
+    hb_lock(cache->lock);
+    cache->ram_size -= size;
+    hb_unlock(cache->lock);
+}
+
+hb_frame_cache_t * hb_frame_cache_init( hb_job_t * job )
+{
+    hb_frame_cache_t * cache;
+    int                ii;
+
+    cache = calloc(1, sizeof(hb_frame_cache_t));
+    if (cache == NULL)
+    {
+        return NULL;
+    }
+    cache->audio_count    = hb_list_count(job->list_audio);
+    cache->subtitle_count = hb_list_count(job->list_subtitle);
+    cache->stream_count   = 1 + cache->audio_count + cache->subtitle_count;
+    cache->streams        = calloc(cache->stream_count,
+                                   sizeof(hb_frame_cache_stream_t));
+    cache->lock           = hb_lock_init();
+    cache->ram_limit      = cache_ram_limit();
+    if (cache->streams == NULL || cache->lock == NULL)
+    {
+        hb_frame_cache_close(&cache);
+        return NULL;
+    }
+
+    for (ii = 0; ii < cache->stream_count; ii++)
+    {
+        hb_frame_cache_stream_t * stream = &cache->streams[ii];
+
+        stream->cache = cache;
+        stream->index = ii;
+        stream->used  = 1;
+        if (ii > cache->audio_count)
+        {
+            // Only passthru subtitles reach the muxer, burned in
+            // subtitles are already part of the video frames
+            hb_subtitle_t * subtitle;
+            subtitle = hb_list_item(job->list_subtitle,
+                                    ii - 1 - cache->audio_count);
+            stream->used = subtitle->config.dest == PASSTHRUSUB;
+        }
+        hb_get_tempory_filename(job->h, stream->filename,
+                                "framecache.%d.%d.bin", job->sequence_id, ii);
+    }
+    hb_log("frame cache: recording 1st pass, %"PRId64" MB in memory "
+           "shared by all jobs", cache->ram_limit >> 20);
+
+    return cache;
+}
+
+void hb_frame_cache_close( hb_frame_cache_t ** _cache )
+{
+    hb_frame_cache_t * cache = *_cache;
+    int                ii;
+
+    if (cache == NULL)
+    {
+        return;
+    }
+    if (cache->ram_size > 0)
+    {
+        // Buffers that were not replayed
+        hb_atomic_sub(&cache_ram_used, cache->ram_size);
+    }
+    for (ii = 0; cache->streams != NULL && ii < cache->stream_count; ii++)
+    {
+        hb_frame_cache_stream_t * stream = &cache->streams[ii];
+
+        hb_buffer_list_close(&stream->list);
+        if (stream->file != NULL)
+        {
+            fclose(stream->file);
+            unlink(stream->filename);
+        }
+        hb_avcodec_free_context(&stream->encoder);
+        hb_avcodec_free_context(&stream->decoder);
+        av_frame_free(&stream->frame);
+        av_free(stream->payload);
+        free(stream->config);
+        free(stream->extradata);
+    }
+    free(cache->streams);
+    hb_lock_close(&cache->lock);
+    free(cache);
+
+    *_cache = NULL;
+}
+
+hb_frame_cache_stream_t * hb_frame_cache_video( hb_frame_cache_t * cache )
+{
+    if (cache == NULL)
+    {
+        return NULL;
+    }
+    return &cache->streams[0];
+}
+
+hb_frame_cache_stream_t * hb_frame_cache_audio( hb_frame_cache_t * cache,
+                                                int index )
+{
+    if (cache == NULL || index < 0 || index >= cache->audio_count)
+    {
+        return NULL;
+    }
+    return &cache->streams[1 + index];
+}
+
+hb_frame_cache_stream_t * hb_frame_cache_subtitle( hb_frame_cache_t * cache,
+                                                   int index )
+{
+    hb_frame_cache_stream_t * stream;
+
+    if (cache == NULL || index < 0 || index >= cache->subtitle_count)
+    {
+        return NULL;
+    }
+    stream = &cache->streams[1 + cache->audio_count + index];
+    return stream->used ? stream : NULL;
+}
+
+static int open_encoder( hb_frame_cache_stream_t * stream, hb_buffer_t * buf )
+{
+    AVCodec        * codec;
+    AVCodecContext * context;
+
+    codec = avcodec_find_encoder(AV_CODEC_ID_FFVHUFF);
+    if (codec == NULL)
+    {
+        return -1;
+    }
+    context = avcodec_alloc_context3(codec);
+    if (context == NULL)
+    {
+        return -1;
+    }
+    context->width     = buf->f.width;
+    context->height    = buf->f.height;
+    context->pix_fmt   = buf->f.fmt;
+    context->time_base = (AVRational){1, 90000};
+
+    // Single threaded so that every frame comes out right away
+    if (hb_avcodec_open(context, codec, NULL, 0))
+    {
+        hb_avcodec_free_context(&context);
+        return -1;
+    }
+    stream->encoder = context;
+    return 0;
+}
+
+static int open_decoder( hb_frame_cache_stream_t * stream )
+{
+    AVCodec        * codec;
+    AVCodecContext * context;
+
+    codec = avcodec_find_decoder(AV_CODEC_ID_FFVHUFF);
+    if (codec == NULL || stream->encoder == NULL)
+    {
+        return -1;
+    }
+    context = avcodec_alloc_context3(codec);
+    if (context == NULL)
+    {
+        return -1;
+    }
+    context->width   = stream->encoder->width;
+    context->height  = stream->encoder->height;
+    context->pix_fmt = stream->encoder->pix_fmt;
+    if (stream->encoder->extradata_size > 0)
+    {
+        context->extradata = av_mallocz(stream->encoder->extradata_size +
+                                        AV_INPUT_BUFFER_PADDING_SIZE);
+        if (context->extradata == NULL)
+        {
+            hb_avcodec_free_context(&context);
+            return -1;
+        }
+        memcpy(context->extradata, stream->encoder->extradata,
+               stream->encoder->extradata_size);
+        context->extradata_size = stream->encoder->extradata_size;
+    }
+    stream->frame = av_frame_alloc();
+    if (stream->frame == NULL ||
+        hb_avcodec_open(context, codec, NULL, 0))
+    {
+        hb_avcodec_free_context(&context);
+        return -1;
+    }
+    stream->decoder = context;
+    return 0;
+}
+
+static int write_record( hb_frame_cache_stream_t * stream,
+                         cache_record_t * record, const uint8_t * data )
+{
+    if (fwrite(record, sizeof(*record), 1, stream->file) != 1 ||
+        (record->size > 0 &&
+         fwrite(data, record->size, 1, stream->file) != 1))
+    {
+        return -1;
+    }
+    stream->spill_count++;
+    return 0;
+}
+
+static int spill_buffer( hb_frame_cache_stream_t * stream, hb_buffer_t * buf )
+{
+    cache_record_t record;
+
+    memset(&record, 0, sizeof(record));
+    record.s = buf->s;
+    record.f = buf->f;
+
+    if (buf->s.type == FRAME_BUF && !stream->coder_failed)
+    {
+        if (stream->encoder == NULL && open_encoder(stream, buf))
+        {
+            hb_log("frame cache: ffvhuff unavailable, storing raw frames");
+            stream->coder_failed = 1;
+        }
+        if (stream->encoder != NULL &&
+            buf->f.width  == stream->encoder->width  &&
+            buf->f.height == stream->encoder->height &&
+            buf->f.fmt    == stream->encoder->pix_fmt)
+        {
+            AVFrame  frame = {0};
+            AVPacket pkt;
+            int      pp, ret;
+
+            for (pp = 0; pp < 4; pp++)
+            {
+                frame.data[pp]     = buf->plane[pp].data;
+                frame.linesize[pp] = buf->plane[pp].stride;
+            }
+            frame.width  = buf->f.width;
+            frame.height = buf->f.height;
+            frame.format = buf->f.fmt;
+            frame.pts    = stream->spill_count;
+
+            av_init_packet(&pkt);
+            ret = avcodec_send_frame(stream->encoder, &frame);
+            if (ret >= 0)
+            {
+                ret = avcodec_receive_packet(stream->encoder, &pkt);
+            }
+            if (ret < 0)
+            {
+                hb_log("frame cache: ffvhuff encoding failed");
+                return -1;
+            }
+            record.size  = pkt.size;
+            record.coded = 1;
+            ret = write_record(stream, &record, pkt.data);
+            av_packet_unref(&pkt);
+            return ret;
+        }
+    }
+
+    record.size = buf->size;
+    return write_record(stream, &record, buf->data);
+}
+
+/*
+ * Records a copy of 'buf', the caller keeps ownership.  An EOF buffer
+ * marks the stream as complete.
+ */
+void hb_frame_cache_write( hb_frame_cache_stream_t * stream, hb_buffer_t * buf )
+{
+    hb_frame_cache_t * cache = stream->cache;
+
+    for (; buf != NULL; buf = buf->next)
+    {
+        if (stream->eof || stream->error)
+        {
+            return;
+        }
+        if (buf->s.flags & HB_BUF_FLAG_EOF)
+        {
+            stream->eof = 1;
+            return;
+        }
+
+        if (!stream->spill)
+        {
+            hb_buffer_t * copy = NULL;
+
+            if (cache_ram_reserve(cache, buf->size))
+            {
+                copy = hb_buffer_dup(buf);
+                if (copy == NULL)
+                {
+                    cache_ram_release(cache, buf->size);
+                    stream->error = 1;
+                    return;
+                }
+                hb_buffer_list_append(&stream->list, copy);
+                stream->count++;
+                continue;
+            }
+
+            // Once a stream spills, the rest of it must follow in the file
+            // to preserve the order
+            stream->spill = 1;
+            stream->file  = hb_fopen(stream->filename, "w+b");
+            if (stream->file == NULL)
+            {
+                hb_error("frame cache: can't create %s, %s",
+                         stream->filename, strerror(errno));
+                stream->error = 1;
+                return;
+            }
+        }
+        if (spill_buffer(stream, buf))
+        {
+            hb_error("frame cache: writing %s failed", stream->filename);
+            stream->error = 1;
+            return;
+        }
+        stream->count++;
+    }
+}
+
+/*
+ * Called when the 1st pass has finished.  Saves what the 2nd pass needs
+ * from the skipped decoders and decides whether the recording is usable.
+ */
+void hb_frame_cache_finish( hb_frame_cache_t * cache, hb_job_t * job )
+{
+    int     ii, ram_count = 0, spill_count = 0;
+    int64_t spill_size = 0;
+
+    if (cache == NULL)
+    {
+        return;
+    }
+
+    cache->complete = !*job->die && *job->done_error == HB_ERROR_NONE;
+    for (ii = 0; ii < cache->stream_count; ii++)
+    {
+        hb_frame_cache_stream_t * stream = &cache->streams[ii];
+
+        if (!stream->used)
+        {
+            continue;
+        }
+        ram_count += hb_buffer_list_count(&stream->list);
+        if (stream->file != NULL)
+        {
+            if (fflush(stream->file) != 0)
+            {
+                stream->error = 1;
+            }
+            spill_count += stream->spill_count;
+            spill_size  += ftello(stream->file);
+        }
+        if (!stream->eof || stream->error)
+        {
+            cache->complete = 0;
+            continue;
+        }
+
+        if (ii > 0 && ii <= cache->audio_count)
+        {
+            hb_audio_t * audio = hb_list_item(job->list_audio, ii - 1);
+
+            // Passthru audio has no encoder to recreate its configuration
+            if (audio->config.out.codec & HB_ACODEC_PASS_FLAG)
+            {
+                stream->config = malloc(sizeof(hb_esconfig_t));
+                if (stream->config == NULL)
+                {
+                    cache->complete = 0;
+                    continue;
+                }
+                *stream->config = audio->priv.config;
+            }
+        }
+        else if (ii > cache->audio_count)
+        {
+            hb_subtitle_t * subtitle;
+
+            subtitle = hb_list_item(job->list_subtitle,
+                                    ii - 1 - cache->audio_count);
+            if (subtitle->extradata_size > 0)
+            {
+                stream->extradata = malloc(subtitle->extradata_size);
+                if (stream->extradata == NULL)
+                {
+                    cache->complete = 0;
+                    continue;
+                }
+                memcpy(stream->extradata, subtitle->extradata,
+                       subtitle->extradata_size);
+                stream->extradata_size = subtitle->extradata_size;
+            }
+        }
+    }
+
+    if (cache->complete)
+    {
+        hb_log("frame cache: %d buffers, %"PRId64" MB in memory, "
+               "%d buffers, %"PRId64" MB on disk",
+               ram_count, cache->ram_size >> 20,
+               spill_count, spill_size >> 20);
+    }
+    else
+    {
+        hb_log("frame cache: 1st pass recording is incomplete");
+    }
+}
+
+/*
+ * Returns 1 if the 2nd pass of 'job' can replay the cache.
+ */
+int hb_frame_cache_usable( hb_frame_cache_t * cache, hb_job_t * job )
+{
+    int ii;
+
+    if (cache == NULL || !cache->complete ||
+        cache->audio_count    != hb_list_count(job->list_audio) ||
+        cache->subtitle_count != hb_list_count(job->list_subtitle))
+    {
+        return 0;
+    }
+    for (ii = 0; ii < cache->subtitle_count; ii++)
+    {
+        hb_subtitle_t * subtitle = hb_list_item(job->list_subtitle, ii);
+        hb_frame_cache_stream_t * stream;
+
+        stream = &cache->streams[1 + cache->audio_count + ii];
+        if (stream->used != (subtitle->config.dest == PASSTHRUSUB))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static hb_buffer_t * read_record( hb_frame_cache_stream_t * stream )
+{
+    cache_record_t   record;
+    hb_buffer_t    * buf;
+
+    if (fread(&record, sizeof(record), 1, stream->file) != 1 ||
+        record.size < 0)
+    {
+        return NULL;
+    }
+    if (!record.coded)
+    {
+        buf = hb_buffer_init(record.size);
+        if (buf == NULL ||
+            (record.size > 0 &&
+             fread(buf->data, record.size, 1, stream->file) != 1))
+        {
+            hb_buffer_close(&buf);
+            return NULL;
+        }
+        buf->s = record.s;
+        buf->f = record.f;
+        if (buf->s.type == FRAME_BUF)
+        {
+            hb_buffer_init_planes(buf);
+        }
+        return buf;
+    }
+
+    if (stream->decoder == NULL && open_decoder(stream))
+    {
+        hb_error("frame cache: can't open ffvhuff decoder");
+        return NULL;
+    }
+    if (stream->payload_size < record.size)
+    {
+        av_free(stream->payload);
+        stream->payload = av_mallocz(record.size +
+                                     AV_INPUT_BUFFER_PADDING_SIZE);
+        stream->payload_size = stream->payload != NULL ? record.size : 0;
+        if (stream->payload == NULL)
+        {
+            return NULL;
+        }
+    }
+    if (fread(stream->payload, record.size, 1, stream->file) != 1)
+    {
+        return NULL;
+    }
+
+    AVPacket pkt;
+    int      pp, ret;
+
+    av_init_packet(&pkt);
+    pkt.data = stream->payload;
+    pkt.size = record.size;
+    ret = avcodec_send_packet(stream->decoder, &pkt);
+    if (ret >= 0)
+    {
+        ret = avcodec_receive_frame(stream->decoder, stream->frame);
+    }
+    if (ret < 0)
+    {
+        hb_error("frame cache: ffvhuff decoding failed");
+        return NULL;
+    }
+
+    buf = hb_frame_buffer_init(record.f.fmt, record.f.width, record.f.height);
+    if (buf == NULL)
+    {
+        av_frame_unref(stream->frame);
+        return NULL;
+    }
+    buf->s = record.s;
+    buf->f = record.f;
+    for (pp = 0; pp < 4; pp++)
+    {
+        uint8_t * dst = buf->plane[pp].data;
+        uint8_t * src = stream->frame->data[pp];
+        int       len, yy;
+
+        if (dst == NULL || src == NULL)
+        {
+            continue;
+        }
+        len = av_image_get_linesize(record.f.fmt, record.f.width, pp);
+        for (yy = 0; yy < buf->plane[pp].height; yy++)
+        {
+            memcpy(dst, src, len);
+            dst += buf->plane[pp].stride;
+            src += stream->frame->linesize[pp];
+        }
+    }
+    av_frame_unref(stream->frame);
+
+    return buf;
+}
+
+/*
+ * Returns the next recorded buffer of 'stream', or NULL once all of
+ * them have been returned or on error.
+ */
+static hb_buffer_t * cache_read( hb_frame_cache_stream_t * stream )
+{
+    hb_frame_cache_t * cache = stream->cache;
+    hb_buffer_t      * buf;
+
+    buf = hb_buffer_list_rem_head(&stream->list);
+    if (buf != NULL)
+    {
+        cache_ram_release(cache, buf->size);
+        return buf;
+    }
+    if (stream->file == NULL || stream->spill_count <= 0)
+    {
+        return NULL;
+    }
+    buf = read_record(stream);
+    if (buf == NULL)
+    {
+        hb_error("frame cache: reading %s failed", stream->filename);
+        stream->error = 1;
+        return NULL;
+    }
+    stream->spill_count--;
+    return buf;
+}
+
+/***********************************************************************
+ * Replay work object
+ ***********************************************************************
+ * Source of one stream in a 2nd pass that replays the frame cache.
+ **********************************************************************/
+struct hb_work_private_s
+{
+    hb_job_t                * job;
+    hb_frame_cache_stream_t * stream;
+    int                       video;
+
+    // Progress of the video stream
+    int                       frame_count;
+    int                       est_frame_count;
+    uint64_t                  st_counts[4];
+    uint64_t                  st_dates[4];
+    uint64_t                  st_first;
+};
+
+static int  replay_init( hb_work_object_t *, hb_job_t * );
+static int  replay_work( hb_work_object_t *, hb_buffer_t **, hb_buffer_t ** );
+static void replay_close( hb_work_object_t * );
+
+hb_work_object_t hb_frame_cache_replay =
+{
+    WORK_CACHE_REPLAY,
+    "Frame cache replay",
+    replay_init,
+    replay_work,
+    replay_close
+};
+
+static int replay_init( hb_work_object_t * w, hb_job_t * job )
+{
+    hb_interjob_t     * interjob = job->interjob;
+    hb_frame_cache_t  * cache = interjob->frame_cache;
+    hb_work_private_t * pv;
+    int                 ii;
+
+    pv = calloc(1, sizeof(hb_work_private_t));
+    if (pv == NULL)
+    {
+        return 1;
+    }
+    w->private_data = pv;
+    pv->job         = job;
+
+    if (w->audio != NULL)
+    {
+        for (ii = 0; ii < hb_list_count(job->list_audio); ii++)
+        {
+            if (hb_list_item(job->list_audio, ii) == w->audio)
+            {
+                pv->stream = hb_frame_cache_audio(cache, ii);
+                break;
+            }
+        }
+        if (pv->stream != NULL && pv->stream->config != NULL)
+        {
+            w->audio->priv.config = *pv->stream->config;
+        }
+    }
+    else if (w->subtitle != NULL)
+    {
+        for (ii = 0; ii < hb_list_count(job->list_subtitle); ii++)
+        {
+            if (hb_list_item(job->list_subtitle, ii) == w->subtitle)
+            {
+                pv->stream = hb_frame_cache_subtitle(cache, ii);
+                break;
+            }
+        }
+        if (pv->stream != NULL && pv->stream->extradata != NULL)
+        {
+            free(w->subtitle->extradata);
+            w->subtitle->extradata = malloc(pv->stream->extradata_size);
+            if (w->subtitle->extradata == NULL)
+            {
+                w->subtitle->extradata_size = 0;
+                return 1;
+            }
+            memcpy(w->subtitle->extradata, pv->stream->extradata,
+                   pv->stream->extradata_size);
+            w->subtitle->extradata_size = pv->stream->extradata_size;
+        }
+    }
+    else
+    {
+        pv->stream          = hb_frame_cache_video(cache);
+        pv->video           = 1;
+        pv->est_frame_count = interjob->frame_count;
+    }
+    if (pv->stream == NULL)
+    {
+        hb_error("frame cache: no recording for stream");
+        return 1;
+    }
+    if (pv->stream->file != NULL &&
+        fseeko(pv->stream->file, 0, SEEK_SET) != 0)
+    {
+        hb_error("frame cache: can't rewind %s", pv->stream->filename);
+        return 1;
+    }
+
+    return 0;
+}
+
+static void replay_close( hb_work_object_t * w )
+{
+    hb_work_private_t * pv = w->private_data;
+
+    if (pv == NULL)
+    {
+        return;
+    }
+    if (pv->video)
+    {
+        hb_log("frame cache: replayed %d video frames", pv->frame_count);
+    }
+    free(pv);
+    w->private_data = NULL;
+}
+
+static void update_state( hb_work_private_t * pv )
+{
+    hb_job_t   * job = pv->job;
+    hb_state_t   state;
+
+    if (pv->frame_count == 0)
+    {
+        pv->st_first = hb_get_date();
+        job->st_pause_date = -1;
+        job->st_paused = 0;
+    }
+
+    if (hb_get_date() > pv->st_dates[3] + 1000)
+    {
+        memmove(&pv->st_dates[0], &pv->st_dates[1], 3 * sizeof(uint64_t));
+        memmove(&pv->st_counts[0], &pv->st_counts[1], 3 * sizeof(uint64_t));
+        pv->st_dates[3]  = hb_get_date();
+        pv->st_counts[3] = pv->frame_count;
+    }
+
+    hb_get_job_state(job, &state);
+    state.state = HB_STATE_WORKING;
+
+#define p state.param.working
+    p.progress = pv->est_frame_count > 0 ?
+                 (float)pv->frame_count / pv->est_frame_count : 0;
+    if (p.progress > 1.0)
+    {
+        p.progress = 1.0;
+    }
+    p.rate_cur = 1000.0 * (pv->st_counts[3] - pv->st_counts[0]) /
+                          (pv->st_dates[3]  - pv->st_dates[0]);
+    if (hb_get_date() > pv->st_first + 4000)
+    {
+        int eta;
+        p.rate_avg = 1000.0 * pv->st_counts[3] /
+                     (pv->st_dates[3] - pv->st_first - job->st_paused);
+        eta = (pv->est_frame_count - pv->st_counts[3]) / p.rate_avg;
+        p.hours   = eta / 3600;
+        p.minutes = (eta % 3600) / 60;
+        p.seconds = eta % 60;
+    }
+    else
+    {
+        p.rate_avg = 0.0;
+        p.hours    = -1;
+        p.minutes  = -1;
+        p.seconds  = -1;
+    }
+#undef p
+
+    hb_set_job_state(job, &state);
+}
+
+static int replay_work( hb_work_object_t * w, hb_buffer_t ** buf_in,
+                        hb_buffer_t ** buf_out )
+{
+    hb_work_private_t * pv = w->private_data;
+    hb_buffer_t       * buf;
+
+    buf = cache_read(pv->stream);
+    if (buf == NULL)
+    {
+        if (pv->stream->error)
+        {
+            *pv->job->done_error = HB_ERROR_UNKNOWN;
+            *pv->job->die = 1;
+        }
+        *buf_out = hb_buffer_eof_init();
+        return HB_WORK_DONE;
+    }
+    if (pv->video)
+    {
+        update_state(pv);
+        pv->frame_count++;
+    }
+    *buf_out = buf;
+
+    return HB_WORK_OK;
+}
@@ -7,6 +7,8 @@
    For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
  */
 
+#include <assert.h>
+
 #include "hb.h"
 #include "hbffmpeg.h"
 #include "taskset.h"
@@ -24,7 +26,7 @@ struct hb_filter_private_s
 {
     int                    cpu_count;
 
-    taskset_t              grayscale_taskset;   // Threads - one per CPU
+    taskset_t              grayscale_taskset;   // Tasks - one per CPU
     grayscale_arguments_t *grayscale_arguments; // Arguments to thread for work
 };
 
@@ -58,13 +60,12 @@ typedef struct grayscale_thread_arg_s {
 } grayscale_thread_arg_t;
 
 /*
- * gray this segment of all three planes in a single thread.
+ * gray this segment of all three planes.
  */
 void grayscale_filter_thread( void *thread_args_v )
 {
     grayscale_arguments_t *grayscale_work = NULL;
     hb_filter_private_t * pv;
-    int run = 1;
     int plane;
     int segment, segment_start, segment_stop;
     grayscale_thread_arg_t *thread_args = thread_args_v;
@@ -73,60 +74,34 @@ void grayscale_filter_thread( void *thread_args_v )
     pv = thread_args->pv;
     segment = thread_args->segment;
 
-    hb_log("Grayscale thread started for segment %d", segment);
-
-    while( run )
+    grayscale_work = &pv->grayscale_arguments[segment];
+    if (grayscale_work->src == NULL)
     {
-        /*
-         * Wait here until there is work to do.
-         */
-        taskset_thread_wait4start( &pv->grayscale_taskset, segment );
+        hb_error( "Thread started when no work available" );
+        return;
+    }
 
-        if( taskset_thread_stop( &pv->grayscale_taskset, segment ) )
+    /*
+     * Process all three planes, but only this segment of it.
+     */
+    src_buf = grayscale_work->src;
+    for (plane = 1; plane < 3; plane++)
+    {
+        int src_stride = src_buf->plane[plane].stride;
+        int height     = src_buf->plane[plane].height;
+        segment_start = (height / pv->cpu_count) * segment;
+        if (segment == pv->cpu_count - 1)
         {
             /*
-             * No more work to do, exit this thread.
+             * Final segment
              */
-            run = 0;
-            goto report_completion;
-        }
-
-        grayscale_work = &pv->grayscale_arguments[segment];
-        if (grayscale_work->src == NULL)
-        {
-            hb_error( "Thread started when no work available" );
-            hb_snooze(500);
-            goto report_completion;
+            segment_stop = height;
+        } else {
+            segment_stop = (height / pv->cpu_count) * (segment + 1);
         }
 
-        /*
-         * Process all three planes, but only this segment of it.
-         */
-        src_buf = grayscale_work->src;
-        for (plane = 1; plane < 3; plane++)
-        {
-            int src_stride = src_buf->plane[plane].stride;
-            int height     = src_buf->plane[plane].height;
-            segment_start = (height / pv->cpu_count) * segment;
-            if (segment == pv->cpu_count - 1)
-            {
-                /*
-                 * Final segment
-                 */
-                segment_stop = height;
-            } else {
-                segment_stop = (height / pv->cpu_count) * (segment + 1);
-            }
-
-            memset(&src_buf->plane[plane].data[segment_start * src_stride],
-                   0x80, (segment_stop - segment_start) * src_stride);
-        }
-
-report_completion:
-        /*
-         * Finished this segment, let everyone know.
-         */
-        taskset_thread_complete( &pv->grayscale_taskset, segment );
+        memset(&src_buf->plane[plane].data[segment_start * src_stride],
+               0x80, (segment_stop - segment_start) * src_stride);
     }
 }
 
@@ -144,6 +119,8 @@ static void grayscale_filter( hb_filter_private_t * pv,
 
     int segment;
 
+    assert(hb_buffer_is_writable(in));
+
     for( segment = 0; segment < pv->cpu_count; segment++ )
     {
         /*
@@ -153,7 +130,7 @@ static void grayscale_filter( hb_filter_private_t * pv,
     }
 
     /*
-     * Allow the taskset threads to make one pass over the data.
+     * Run each segment once on the taskset thread pool.
      */
     taskset_cycle( &pv->grayscale_taskset );
 
@@ -178,7 +155,8 @@ static int hb_grayscale_init( hb_filter_object_t * filter,
                                      pv->cpu_count);
     if (pv->grayscale_arguments == NULL ||
         taskset_init( &pv->grayscale_taskset, pv->cpu_count,
-                      sizeof( grayscale_thread_arg_t ) ) == 0)
+                      sizeof( grayscale_thread_arg_t ),
+                      grayscale_filter_thread ) == 0)
     {
         hb_error( "grayscale could not initialize taskset" );
     }
@@ -193,14 +171,6 @@ static int hb_grayscale_init( hb_filter_object_t * filter,
         thread_args->pv = pv;
         thread_args->segment = ii;
         pv->grayscale_arguments[ii].src = NULL;
-
-        if (taskset_thread_spawn(&pv->grayscale_taskset, ii,
-                                 "grayscale_filter_segment",
-                                 grayscale_filter_thread,
-                                 HB_NORMAL_PRIORITY ) == 0)
-        {
-            hb_error( "grayscale could not spawn thread" );
-        }
     }
 
     return 0;
@@ -246,6 +216,7 @@ static int hb_grayscale_work( hb_filter_object_t * filter,
     }
 
     // Grayscale!
+    hb_buffer_make_writable(in);
     grayscale_filter(pv, in);
 
     *buf_out = in;
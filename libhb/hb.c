@@ -10,6 +10,7 @@
 #include "hb.h"
 #include "hbffmpeg.h"
 #include "encx264.h"
+#include "taskset.h"
 #include "libavfilter/avfilter.h"
 #include <stdio.h>
 #include <unistd.h>
@@ -44,13 +45,19 @@ struct hb_handle_s
        from this one (see work.c) */
     int            sequence_id;
     hb_list_t    * jobs;
-    hb_job_t     * current_job;
+    hb_job_t     * current_job; // First of the running jobs
+    hb_list_t    * running;     // hb_job_state_t of each running job
+    int            job_limit;   // Jobs processed at the same time
     volatile int   work_die;
     hb_error_code  work_error;
     hb_thread_t  * work_thread;
 
     hb_lock_t    * state_lock;
     hb_state_t     state;
+    hb_value_t   * work_stats;  // Per stage stats of each job, see
+                                // hb_set_work_stats
+
+    hb_preview_store_t * previews; // Scan previews of title_set
 
     int            paused;
     hb_lock_t    * pause_lock;
@@ -66,6 +73,12 @@ struct hb_handle_s
     void         * system_sleep_opaque;
 };
 
+typedef struct
+{
+    hb_job_t   * job;
+    hb_state_t   state;
+} hb_job_state_t;
+
 hb_work_object_t * hb_objects = NULL;
 int hb_instance_counter = 0;
 
@@ -240,6 +253,8 @@ hb_handle_t * hb_init( int verbose )
 
 	h->title_set.list_title = hb_list_init();
     h->jobs       = hb_list_init();
+    h->running    = hb_list_init();
+    h->job_limit  = 1;
 
     h->state_lock  = hb_lock_init();
     h->state.state = HB_STATE_IDLE;
@@ -247,6 +262,7 @@ hb_handle_t * hb_init( int verbose )
     h->pause_lock = hb_lock_init();
 
     h->interjob = calloc( sizeof( hb_interjob_t ), 1 );
+    h->previews = hb_preview_store_init( h );
 
     /* Start library thread */
     hb_log( "hb_init: starting libhb thread" );
@@ -337,38 +353,7 @@ int hb_get_build( hb_handle_t * h )
  */
 void hb_remove_previews( hb_handle_t * h )
 {
-    char            filename[1024];
-    char            dirname[1024];
-    hb_title_t    * title;
-    int             i, count, len;
-    DIR           * dir;
-    struct dirent * entry;
-
-    memset( dirname, 0, 1024 );
-    hb_get_temporary_directory( dirname );
-    dir = opendir( dirname );
-    if (dir == NULL) return;
-
-    count = hb_list_count( h->title_set.list_title );
-    while( ( entry = readdir( dir ) ) )
-    {
-        if( entry->d_name[0] == '.' )
-        {
-            continue;
-        }
-        for( i = 0; i < count; i++ )
-        {
-            title = hb_list_item( h->title_set.list_title, i );
-            len = snprintf( filename, 1024, "%d_%d", h->id, title->index );
-            if (strncmp(entry->d_name, filename, len) == 0)
-            {
-                snprintf( filename, 1024, "%s/%s", dirname, entry->d_name );
-                unlink( filename );
-                break;
-            }
-        }
-    }
-    closedir( dir );
+    hb_preview_store_clear( h->previews );
 }
 
 /**
@@ -377,7 +362,8 @@ void hb_remove_previews( hb_handle_t * h )
  * @param path location of VIDEO_TS folder.
  * @param title_index Desired title to scan.  0 for all titles.
  * @param preview_count Number of preview images to generate.
- * @param store_previews Whether or not to write previews to disk.
+ * @param store_previews Whether or not to keep the previews for
+ *        hb_get_preview2 (see hb_set_preview_memory_limit).
  */
 void hb_scan( hb_handle_t * h, const char * path, int title_index,
               int preview_count, int store_previews, uint64_t min_duration )
@@ -472,113 +458,35 @@ hb_title_set_t * hb_get_title_set( hb_handle_t * h )
 
 int hb_save_preview( hb_handle_t * h, int title, int preview, hb_buffer_t *buf )
 {
-    FILE * file;
-    char   filename[1024];
-    char   reason[80];
-
-    hb_get_tempory_filename( h, filename, "%d_%d_%d",
-                             hb_get_instance_id(h), title, preview );
-
-    file = hb_fopen(filename, "wb");
-    if( !file )
-    {
-        if (strerror_r(errno, reason, 79) != 0)
-            strcpy(reason, "unknown -- strerror_r() failed");
-
-        hb_error( "hb_save_preview: Failed to open %s (reason: %s)", filename, reason );
-        return -1;
-    }
-
-    int pp, hh;
-    for( pp = 0; pp < 3; pp++ )
-    {
-        uint8_t *data = buf->plane[pp].data;
-        int stride = buf->plane[pp].stride;
-        int w = buf->plane[pp].width;
-        int h = buf->plane[pp].height;
-
-        for( hh = 0; hh < h; hh++ )
-        {
-            if (fwrite( data, w, 1, file ) < w)
-            {
-                if (ferror(file))
-                {
-                    if (strerror_r(errno, reason, 79) != 0)
-                        strcpy(reason, "unknown -- strerror_r() failed");
-
-                    hb_error( "hb_save_preview: Failed to write line %d to %s (reason: %s). Preview will be incomplete.",
-                              hh, filename, reason );
-                    goto done;
-                }
-            }
-            data += stride;
-        }
-    }
-
-done:
-    fclose( file );
-
-    return 0;
+    return hb_preview_store_put( h->previews, title, preview, buf );
 }
 
 hb_buffer_t * hb_read_preview(hb_handle_t * h, hb_title_t *title, int preview)
 {
-    FILE * file;
-    char   filename[1024];
-    char   reason[80];
-
-    hb_get_tempory_filename(h, filename, "%d_%d_%d",
-                            hb_get_instance_id(h), title->index, preview);
-
-    file = hb_fopen(filename, "rb");
-    if (!file)
-    {
-        if (strerror_r(errno, reason, 79) != 0)
-            strcpy(reason, "unknown -- strerror_r() failed");
-
-        hb_error( "hb_read_preview: Failed to open %s (reason: %s)", filename, reason );
-        return NULL;
-    }
-
     hb_buffer_t * buf;
     buf = hb_frame_buffer_init(AV_PIX_FMT_YUV420P,
                                title->geometry.width, title->geometry.height);
 
-    if (!buf)
-        goto done;
-
-    int pp, hh;
-    for (pp = 0; pp < 3; pp++)
+    if (buf != NULL &&
+        hb_preview_store_get(h->previews, title->index, preview, buf) < 0)
     {
-        uint8_t *data = buf->plane[pp].data;
-        int stride = buf->plane[pp].stride;
-        int w = buf->plane[pp].width;
-        int h = buf->plane[pp].height;
-
-        for (hh = 0; hh < h; hh++)
-        {
-            if (fread(data, w, 1, file) < w)
-            {
-                if (ferror(file))
-                {
-                    if (strerror_r(errno, reason, 79) != 0)
-                        strcpy(reason, "unknown -- strerror_r() failed");
-
-                    hb_error( "hb_read_preview: Failed to read line %d from %s (reason: %s). Preview will be incomplete.",
-                          hh, filename, reason );
-                    goto done;
-                }
-            }
-            data += stride;
-        }
+        hb_buffer_close(&buf);
     }
 
-done:
-    fclose(file);
-
     return buf;
 }
 
+/**
+ * Sets how much memory scan previews may use.  Previews are stored
+ * compressed past half of it, and in a temporary file once it is used up.
+ * @param h Handle to hb_handle_t
+ * @param limit Size in bytes
+ */
+void hb_set_preview_memory_limit( hb_handle_t * h, int64_t limit )
+{
+    hb_preview_store_set_limit( h->previews, limit );
+}
+
 hb_image_t* hb_get_preview2(hb_handle_t * h, int title_idx, int picture,
                             hb_geometry_settings_t *geo, int deinterlace)
 {
@@ -1530,13 +1438,25 @@ void hb_start( hb_handle_t * h )
     p.seconds   = -1;
     p.sequence_id = 0;
 #undef p
+    hb_value_free( &h->work_stats );
     hb_unlock( h->state_lock );
 
     h->paused = 0;
 
     h->work_die    = 0;
     h->work_error  = HB_ERROR_NONE;
-    h->work_thread = hb_work_init( h->jobs, &h->work_die, &h->work_error, &h->current_job );
+    h->work_thread = hb_work_init( h->jobs, &h->work_die, &h->work_error,
+                                   h->job_limit );
+}
+
+/**
+ * Sets how many jobs hb_start processes at the same time.
+ * @param h Handle to hb_handle_t.
+ * @param count Number of jobs, takes effect on the next hb_start.
+ */
+void hb_set_job_limit( hb_handle_t * h, int count )
+{
+    h->job_limit = MAX( count, 1 );
 }
 
 /**
@@ -1547,12 +1467,18 @@ void hb_pause( hb_handle_t * h )
 {
     if( !h->paused )
     {
+        int ii;
+
         hb_lock( h->pause_lock );
         h->paused = 1;
 
-        hb_current_job( h )->st_pause_date = hb_get_date();
-
         hb_lock( h->state_lock );
+        for (ii = 0; ii < hb_list_count(h->running); ii++)
+        {
+            hb_job_state_t * js = hb_list_item(h->running, ii);
+            js->job->st_pause_date = hb_get_date();
+            js->state.state = HB_STATE_PAUSED;
+        }
         h->state.state = HB_STATE_PAUSED;
         hb_unlock( h->state_lock );
     }
@@ -1566,12 +1492,18 @@ void hb_resume( hb_handle_t * h )
 {
     if( h->paused )
     {
-#define job hb_current_job( h )
-        if( job->st_pause_date != -1 )
+        int ii;
+
+        hb_lock( h->state_lock );
+        for (ii = 0; ii < hb_list_count(h->running); ii++)
         {
-           job->st_paused += hb_get_date() - job->st_pause_date;
+            hb_job_t * job = ((hb_job_state_t*)hb_list_item(h->running, ii))->job;
+            if( job->st_pause_date != -1 )
+            {
+               job->st_paused += hb_get_date() - job->st_pause_date;
+            }
         }
-#undef job
+        hb_unlock( h->state_lock );
 
         hb_unlock( h->pause_lock );
         h->paused = 0;
@@ -1584,8 +1516,20 @@ void hb_resume( hb_handle_t * h )
  */
 void hb_stop( hb_handle_t * h )
 {
+    int ii;
+
     h->work_error = HB_ERROR_CANCELED;
     h->work_die   = 1;
+
+    // Jobs running concurrently have their own die flag
+    hb_lock( h->state_lock );
+    for (ii = 0; ii < hb_list_count(h->running); ii++)
+    {
+        hb_job_t * job = ((hb_job_state_t*)hb_list_item(h->running, ii))->job;
+        *job->die = 1;
+    }
+    hb_unlock( h->state_lock );
+
     hb_resume( h );
 }
 
@@ -1645,12 +1589,16 @@ void hb_close( hb_handle_t ** _h )
     hb_list_close( &h->title_set.list_title );
 
     hb_list_close( &h->jobs );
+    hb_list_close( &h->running );
+    hb_value_free( &h->work_stats );
     hb_lock_close( &h->state_lock );
     hb_lock_close( &h->pause_lock );
 
     hb_system_sleep_opaque_close(&h->system_sleep_opaque);
 
+    hb_frame_cache_close( &h->interjob->frame_cache );
     free( h->interjob );
+    hb_preview_store_close( &h->previews );
 
     free( h );
     *_h = NULL;
@@ -1683,6 +1631,7 @@ int hb_global_init()
     /* HB work objects */
     hb_register(&hb_muxer);
     hb_register(&hb_reader);
+    hb_register(&hb_frame_cache_replay);
     hb_register(&hb_sync_video);
     hb_register(&hb_sync_audio);
     hb_register(&hb_sync_subtitle);
@@ -1721,6 +1670,11 @@ int hb_global_init()
      */
     hb_buffer_pool_init();
 
+    /*
+     * Initialise the filter thread pool
+     */
+    hb_taskset_pool_init();
+
     // Initialize the builtin presets hb_dict_t
     hb_presets_builtin_init();
 
@@ -1737,6 +1691,8 @@ void hb_global_close()
     struct dirent * entry;
 
     hb_presets_free();
+    hb_taskset_pool_close();
+    hb_buffer_pool_close();
 
     /* Find and remove temp folder */
     memset( dirname, 0, 1024 );
@@ -1909,11 +1865,201 @@ void hb_set_state( hb_handle_t * h, hb_state_t * s )
     hb_unlock( h->pause_lock );
 }
 
+/**
+ * Returns the running job entry of a job, called with state_lock held.
+ */
+static hb_job_state_t * find_job_state( hb_handle_t * h, hb_job_t * job )
+{
+    int ii;
+
+    for (ii = 0; ii < hb_list_count(h->running); ii++)
+    {
+        hb_job_state_t * js = hb_list_item(h->running, ii);
+        if (js->job == job)
+        {
+            return js;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Registers a job pass that starts processing, see work.c.
+ * @param h Handle to hb_handle_t
+ * @param job Handle to the hb_job_t of the pass
+ */
+void hb_add_running_job( hb_handle_t * h, hb_job_t * job )
+{
+    hb_job_state_t * js = calloc(1, sizeof(hb_job_state_t));
+
+    js->job         = job;
+    js->state.state = HB_STATE_WORKING;
+    js->state.param.working.sequence_id = job->sequence_id;
+
+    hb_lock( h->state_lock );
+    hb_list_add(h->running, js);
+    h->current_job = ((hb_job_state_t*)hb_list_item(h->running, 0))->job;
+    hb_unlock( h->state_lock );
+}
+
+/**
+ * Unregisters a job pass that finished processing.
+ * @param h Handle to hb_handle_t
+ * @param job Handle to the hb_job_t of the pass
+ */
+void hb_rem_running_job( hb_handle_t * h, hb_job_t * job )
+{
+    hb_job_state_t * js;
+
+    hb_lock( h->state_lock );
+    js = find_job_state(h, job);
+    if (js != NULL)
+    {
+        hb_list_rem(h->running, js);
+        free(js);
+    }
+    js = hb_list_item(h->running, 0);
+    h->current_job = js != NULL ? js->job : NULL;
+    hb_unlock( h->state_lock );
+}
+
+/**
+ * Sets the state of a running job.
+ * The handle state follows the first running job, so UIs that only
+ * look at hb_get_state see one job progressing as before. A json job
+ * waits for its title scan on the handle state, so it is left alone
+ * while scanning.
+ * @param job Handle to hb_job_t
+ * @param s Handle to new hb_state_t
+ */
+void hb_set_job_state( hb_job_t * job, hb_state_t * s )
+{
+    hb_handle_t    * h = job->h;
+    hb_job_state_t * js;
+
+    hb_lock( h->pause_lock );
+    hb_lock( h->state_lock );
+    js = find_job_state(h, job);
+    if (js == NULL)
+    {
+        memcpy( &h->state, s, sizeof( hb_state_t ) );
+    }
+    else
+    {
+        memcpy( &js->state, s, sizeof( hb_state_t ) );
+        if( js->state.state == HB_STATE_WORKING ||
+            js->state.state == HB_STATE_SEARCHING )
+        {
+            js->state.param.working.sequence_id = job->sequence_id;
+        }
+        if (js == hb_list_item(h->running, 0) &&
+            h->state.state != HB_STATE_SCANNING)
+        {
+            memcpy( &h->state, &js->state, sizeof( hb_state_t ) );
+        }
+    }
+    hb_unlock( h->state_lock );
+    hb_unlock( h->pause_lock );
+}
+
+/**
+ * Returns the state of a running job.
+ * @param job Handle to hb_job_t
+ * @param s Handle to hb_state_t which to copy the state data.
+ */
+void hb_get_job_state( hb_job_t * job, hb_state_t * s )
+{
+    hb_handle_t    * h = job->h;
+    hb_job_state_t * js;
+
+    hb_lock( h->state_lock );
+    js = find_job_state(h, job);
+    memcpy( s, js != NULL ? &js->state : &h->state, sizeof( hb_state_t ) );
+    hb_unlock( h->state_lock );
+}
+
+/**
+ * Returns a copy of the states of all running jobs.
+ * @param h Handle to hb_handle_t
+ * @param states Set to an array of hb_state_t, to be freed by the caller.
+ * @returns The number of running jobs
+ */
+int hb_get_job_states( hb_handle_t * h, hb_state_t ** states )
+{
+    int ii, count;
+
+    hb_lock( h->state_lock );
+    count = hb_list_count(h->running);
+    *states = calloc(count + 1, sizeof(hb_state_t));
+    for (ii = 0; ii < count; ii++)
+    {
+        hb_job_state_t * js = hb_list_item(h->running, ii);
+        (*states)[ii] = js->state;
+    }
+    hb_unlock( h->state_lock );
+
+    return count;
+}
+
 void hb_set_work_error( hb_handle_t * h, hb_error_code err )
 {
     h->work_error = err;
 }
 
+/**
+ * Sets the per stage statistics of a job pass.  Each job keeps the
+ * statistics of its last completed pass, so jobs running at the same
+ * time (see hb_set_job_limit) do not replace each other's.
+ * @param h Handle to hb_handle_t
+ * @param job The job pass the statistics were taken from
+ * @param stats Array of stage dicts, ownership is taken
+ */
+void hb_set_work_stats( hb_handle_t * h, hb_job_t * job, hb_value_t * stats )
+{
+    hb_dict_t * dict = hb_dict_init();
+    int         ii;
+
+    hb_dict_set_int(dict, "SequenceID", job->sequence_id);
+    hb_dict_set_int(dict, "PassID", job->pass_id);
+    hb_dict_set(dict, "Stages", stats);
+
+    hb_lock( h->state_lock );
+    if ( h->work_stats == NULL )
+    {
+        h->work_stats = hb_value_array_init();
+    }
+    for ( ii = 0; ii < hb_value_array_len( h->work_stats ); ii++ )
+    {
+        hb_dict_t * entry = hb_value_array_get( h->work_stats, ii );
+        if ( hb_dict_get_int( entry, "SequenceID" ) == job->sequence_id )
+        {
+            hb_value_array_remove( h->work_stats, ii );
+            break;
+        }
+    }
+    hb_value_array_append( h->work_stats, dict );
+    hb_unlock( h->state_lock );
+}
+
+/**
+ * Returns a copy of the per stage statistics of the jobs processed
+ * since hb_start, or NULL if no job pass has completed.
+ * @param h Handle to hb_handle_t
+ */
+hb_value_t * hb_get_work_stats( hb_handle_t * h )
+{
+    hb_value_t * stats = NULL;
+
+    hb_lock( h->state_lock );
+    if ( h->work_stats != NULL )
+    {
+        stats = hb_value_dup( h->work_stats );
+    }
+    hb_unlock( h->state_lock );
+
+    return stats;
+}
+
 void hb_system_sleep_allow(hb_handle_t *h)
 {
     hb_system_sleep_private_enable(h->system_sleep_opaque);
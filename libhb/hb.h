@@ -77,6 +77,11 @@ int           hb_save_preview( hb_handle_t * h, int title, int preview,
                                hb_buffer_t *buf );
 hb_buffer_t * hb_read_preview( hb_handle_t * h, hb_title_t *title,
                                int preview );
+/* hb_set_preview_memory_limit()
+   Scan previews are kept in memory, in at most this many bytes. Previews
+   stored after half of it is used are compressed, and previews that do
+   not fit are kept in a temporary file. */
+void          hb_set_preview_memory_limit( hb_handle_t * h, int64_t limit );
 hb_image_t  * hb_get_preview2(hb_handle_t * h, int title_idx, int picture,
                               hb_geometry_settings_t *geo, int deinterlace);
 void          hb_set_anamorphic_size2(hb_geometry_t *src_geo,
@@ -104,6 +109,11 @@ void          hb_pause( hb_handle_t * );
 void          hb_resume( hb_handle_t * );
 void          hb_stop( hb_handle_t * );
 
+/* hb_set_job_limit()
+   Sets how many jobs of the queue hb_start() processes at the same
+   time (default 1). Each running job gets an equal share of the CPUs. */
+void          hb_set_job_limit( hb_handle_t *, int );
+
 void          hb_system_sleep_allow(hb_handle_t*);
 void          hb_system_sleep_prevent(hb_handle_t*);
 
@@ -117,6 +127,7 @@ typedef struct hb_interjob_s
     hb_rational_t vrate;     /* measured output vrate              */
 
     hb_subtitle_t *select_subtitle; /* foreign language scan subtitle */
+    struct hb_frame_cache_s *frame_cache; /* 1st pass output for 2nd pass */
 } hb_interjob_t;
 
 hb_interjob_t * hb_interjob_get( hb_handle_t * ); 
@@ -126,6 +137,11 @@ hb_interjob_t * hb_interjob_get( hb_handle_t * );
    Look at test/test.c to see how to use it. */
 void hb_get_state( hb_handle_t *, hb_state_t * );
 void hb_get_state2( hb_handle_t *, hb_state_t * );
+/* hb_get_job_states()
+   Returns the number of running jobs and a copy of their states in
+   *states, to be freed by the caller. hb_get_state() only reports the
+   job that was started first. */
+int  hb_get_job_states( hb_handle_t *, hb_state_t ** states );
 
 /* hb_close()
    Aborts all current jobs if any, frees memory. */
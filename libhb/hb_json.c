@@ -156,6 +156,30 @@ char* hb_get_state_json( hb_handle_t * h )
     hb_get_state(h, &state);
     hb_dict_t *dict = hb_state_to_dict(&state);
 
+    hb_value_t *stats = hb_get_work_stats(h);
+    if (dict != NULL && stats != NULL)
+    {
+        hb_dict_set(dict, "WorkStats", stats);
+    }
+    else
+    {
+        hb_value_free(&stats);
+    }
+
+    // Progress of each job when several run at once, see hb_set_job_limit
+    hb_state_t *job_states;
+    int ii, count = hb_get_job_states(h, &job_states);
+    if (dict != NULL && count > 0)
+    {
+        hb_value_array_t *jobs = hb_value_array_init();
+        for (ii = 0; ii < count; ii++)
+        {
+            hb_value_array_append(jobs, hb_state_to_dict(&job_states[ii]));
+        }
+        hb_dict_set(dict, "Jobs", jobs);
+    }
+    free(job_states);
+
     char *json_state = hb_value_get_json(dict);
     hb_value_free(&dict);
 
@@ -659,6 +683,8 @@ hb_dict_t* hb_job_to_dict( const hb_job_t * job )
         hb_dict_set(video_dict, "TwoPass", hb_value_bool(job->twopass));
         hb_dict_set(video_dict, "Turbo",
                             hb_value_bool(job->fastfirstpass));
+        hb_dict_set(video_dict, "FrameCache",
+                            hb_value_bool(job->frame_cache));
     }
     if (job->encoder_preset != NULL)
     {
@@ -993,10 +1019,10 @@ hb_job_t* hb_dict_to_job( hb_handle_t * h, hb_dict_t *dict )
     // PAR {Num, Den}
     "s?{s:i, s:i},"
     // Video {Codec, Quality, Bitrate, Preset, Tune, Profile, Level, Options
-    //        TwoPass, Turbo, ColorMatrixCode,
+    //        TwoPass, Turbo, FrameCache, ColorMatrixCode,
     //        QSV {Decode, AsyncDepth}}
     "s:{s:o, s?f, s?i, s?s, s?s, s?s, s?s, s?s,"
-    "   s?b, s?b, s?i,"
+    "   s?b, s?b, s?b, s?i,"
     "   s?{s?b, s?i}},"
     // Audio {CopyMask, FallbackEncoder, AudioList}
     "s?{s?o, s?o, s?o},"
@@ -1040,6 +1066,7 @@ hb_job_t* hb_dict_to_job( hb_handle_t * h, hb_dict_t *dict )
             "Options",              unpack_s(&video_options),
             "TwoPass",              unpack_b(&job->twopass),
             "Turbo",                unpack_b(&job->fastfirstpass),
+            "FrameCache",           unpack_b(&job->frame_cache),
             "ColorMatrixCode",      unpack_i(&job->color_matrix_code),
             "QSV",
                 "Decode",           unpack_b(&job->qsv.decode),
@@ -37,13 +37,21 @@ void hb_list_empty( hb_list_t ** );
 
 hb_title_t * hb_title_init( char * dvd, int index );
 void         hb_title_close( hb_title_t ** );
+hb_title_t * hb_title_copy( const hb_title_t * );
 
 /***********************************************************************
  * hb.c
  **********************************************************************/
 int  hb_get_pid( hb_handle_t * );
 void hb_set_state( hb_handle_t *, hb_state_t * );
+void hb_set_job_state( hb_job_t *, hb_state_t * );
+void hb_get_job_state( hb_job_t *, hb_state_t * );
+void hb_add_running_job( hb_handle_t *, hb_job_t * );
+void hb_rem_running_job( hb_handle_t *, hb_job_t * );
 void hb_set_work_error( hb_handle_t * h, hb_error_code err );
+void hb_set_work_stats( hb_handle_t * h, hb_job_t * job,
+                        hb_value_t * stats );
+hb_value_t * hb_get_work_stats( hb_handle_t * h );
 void hb_job_setup_passes(hb_handle_t *h, hb_job_t *job, hb_list_t *list_pass);
 
 /***********************************************************************
@@ -150,6 +158,18 @@ struct hb_buffer_s
     // Store this data here when read and pass to decoder.
     hb_buffer_t * palette;
 
+    // Reference count of 'data' when it is shared with other buffers
+    // created by hb_buffer_ref. NULL if this buffer is the only owner.
+    // Shared data is read-only, see hb_buffer_make_writable.
+    int         * shared;
+
+    // Payload owned by somebody else, e.g. a frame of a decoder's frame
+    // pool, instead of the buffer pools. 'storage_free' releases it when
+    // the last buffer that references the payload is closed. Such
+    // payloads are read-only, see hb_buffer_make_writable.
+    void        * storage;
+    void       (* storage_free)( void * storage );
+
     // Packets in a list:
     //   the next packet in the list
     hb_buffer_t * next;
@@ -157,16 +177,23 @@ struct hb_buffer_s
 
 void hb_buffer_pool_init( void );
 void hb_buffer_pool_free( void );
+void hb_buffer_pool_close( void );
 
 hb_buffer_t * hb_buffer_init( int size );
 hb_buffer_t * hb_buffer_eof_init( void );
 hb_buffer_t * hb_frame_buffer_init( int pix_fmt, int w, int h);
+hb_buffer_t * hb_frame_buffer_wrap( int pix_fmt, int w, int h,
+                                    uint8_t * data, int size, void * storage,
+                                    void (* storage_free)( void * ) );
 void          hb_buffer_init_planes( hb_buffer_t * b );
 void          hb_buffer_realloc( hb_buffer_t *, int size );
 void          hb_video_buffer_realloc( hb_buffer_t * b, int w, int h );
 void          hb_buffer_reduce( hb_buffer_t * b, int size );
 void          hb_buffer_close( hb_buffer_t ** );
 hb_buffer_t * hb_buffer_dup( const hb_buffer_t * src );
+hb_buffer_t * hb_buffer_ref( hb_buffer_t * src );
+int           hb_buffer_make_writable( hb_buffer_t * b );
+int           hb_buffer_is_writable( const hb_buffer_t * b );
 int           hb_buffer_copy( hb_buffer_t * dst, const hb_buffer_t * src );
 void          hb_buffer_swap_copy( hb_buffer_t *src, hb_buffer_t *dst );
 hb_image_t  * hb_image_init(int pix_fmt, int width, int height);
@@ -176,6 +203,7 @@ int           hb_picture_crop(uint8_t *data[], int stride[], hb_buffer_t *b,
                               int top, int left);
 
 hb_fifo_t   * hb_fifo_init( int capacity, int thresh );
+hb_fifo_t   * hb_fifo_init_spsc( int capacity, int thresh );
 void          hb_fifo_register_full_cond( hb_fifo_t * f, hb_cond_t * c );
 int           hb_fifo_size( hb_fifo_t * );
 int           hb_fifo_size_bytes( hb_fifo_t * );
@@ -259,7 +287,8 @@ hb_thread_t * hb_scan_init( hb_handle_t *, volatile int * die,
                             hb_title_set_t * title_set, int preview_count, 
                             int store_previews, uint64_t min_duration );
 hb_thread_t * hb_work_init( hb_list_t * jobs,
-                            volatile int * die, hb_error_code * error, hb_job_t ** job );
+                            volatile int * die, hb_error_code * error,
+                            int job_limit );
 void ReadLoop( void * _w );
 void hb_work_loop( void * );
 hb_work_object_t * hb_muxer_init( hb_job_t * );
@@ -274,6 +303,39 @@ hb_work_object_t * hb_video_encoder( hb_handle_t *, int );
  **********************************************************************/
 hb_work_object_t * hb_sync_init( hb_job_t * job );
 
+/***********************************************************************
+ * framecache.c
+ **********************************************************************/
+typedef struct hb_frame_cache_s        hb_frame_cache_t;
+typedef struct hb_frame_cache_stream_s hb_frame_cache_stream_t;
+
+hb_frame_cache_t        * hb_frame_cache_init( hb_job_t * job );
+void                      hb_frame_cache_close( hb_frame_cache_t ** );
+hb_frame_cache_stream_t * hb_frame_cache_video( hb_frame_cache_t * );
+hb_frame_cache_stream_t * hb_frame_cache_audio( hb_frame_cache_t *, int );
+hb_frame_cache_stream_t * hb_frame_cache_subtitle( hb_frame_cache_t *, int );
+void                      hb_frame_cache_write( hb_frame_cache_stream_t *,
+                                                hb_buffer_t * );
+void                      hb_frame_cache_finish( hb_frame_cache_t *,
+                                                 hb_job_t * );
+int                       hb_frame_cache_usable( hb_frame_cache_t *,
+                                                 hb_job_t * );
+
+/***********************************************************************
+ * preview.c
+ **********************************************************************/
+typedef struct hb_preview_store_s hb_preview_store_t;
+
+hb_preview_store_t * hb_preview_store_init( hb_handle_t * );
+void                 hb_preview_store_close( hb_preview_store_t ** );
+void                 hb_preview_store_clear( hb_preview_store_t * );
+void                 hb_preview_store_set_limit( hb_preview_store_t *,
+                                                 int64_t limit );
+int                  hb_preview_store_put( hb_preview_store_t *, int title,
+                                           int preview, hb_buffer_t * );
+int                  hb_preview_store_get( hb_preview_store_t *, int title,
+                                           int preview, hb_buffer_t * );
+
 /***********************************************************************
  * mpegdemux.c
  **********************************************************************/
@@ -350,6 +412,7 @@ int          hb_stream_seek( hb_stream_t *, float );
 int          hb_stream_seek_ts( hb_stream_t * stream, int64_t ts );
 int          hb_stream_seek_chapter( hb_stream_t *, int );
 int          hb_stream_chapter( hb_stream_t * );
+void         hb_stream_set_ids( hb_stream_t *, const int * ids, int count );
 
 hb_buffer_t * hb_ts_decode_pkt( hb_stream_t *stream, const uint8_t * pkt,
                                 int chapter, int discontinuity );
@@ -441,7 +504,8 @@ enum
     WORK_ENCAVCODEC_AUDIO,
     WORK_MUX,
     WORK_READER,
-    WORK_DECPGSSUB
+    WORK_DECPGSSUB,
+    WORK_CACHE_REPLAY
 };
 
 extern hb_filter_object_t hb_filter_detelecine;
@@ -460,7 +524,6 @@ extern hb_filter_object_t hb_filter_pad;
 extern hb_filter_object_t hb_filter_lapsharp;
 extern hb_filter_object_t hb_filter_unsharp;
 extern hb_filter_object_t hb_filter_avfilter;
-extern hb_filter_object_t hb_filter_mt_frame;
 
 #ifdef USE_QSV
 extern hb_filter_object_t hb_filter_qsv;
@@ -8,6 +8,8 @@
  */
 
 #include "hb.h"
+#include "taskset.h"
+#include "lapsharp.h"
 
 #define LAPSHARP_STRENGTH_LUMA_DEFAULT   0.2
 #define LAPSHARP_STRENGTH_CHROMA_DEFAULT 0.2
@@ -22,12 +24,6 @@ typedef struct
     int    kernel;    // which kernel to use; kernels[kernel]
 } lapsharp_plane_context_t;
 
-typedef struct {
-    const int   *mem;
-    const int    size;
-    const double coef;
-} kernel_t;
-
 // 4-neighbor Laplacian kernel (lap)
 // Sharpens vertical and horizontal edges, less effective on diagonals
 // size = 3, coef = 1.0
@@ -82,9 +78,21 @@ static kernel_t kernels[] =
     { kernel_isolog, 5, 1.0 / 15 }
 };
 
+typedef struct
+{
+    hb_filter_private_t *pv;
+    int                  segment;
+} lapsharp_thread_arg_t;
+
 struct hb_filter_private_s
 {
     lapsharp_plane_context_t plane_ctx[3];
+    LapsharpFunctions        functions;
+
+    int                      thread_count;
+    taskset_t                taskset;   // Tasks - one band of rows each
+    hb_buffer_t             *in;
+    hb_buffer_t             *out;
 };
 
 static int hb_lapsharp_init(hb_filter_object_t *filter,
@@ -113,45 +121,97 @@ hb_filter_object_t hb_filter_lapsharp =
     .settings_template = hb_lapsharp_template,
 };
 
-static void hb_lapsharp(const uint8_t *src,
+static void lapsharp_filter_row(const uint8_t  *src,
+                                      uint8_t  *dst,
+                                const int       x_start,
+                                const int       x_end,
+                                const int       stride,
+                                const kernel_t *kernel,
+                                const double    strength)
+{
+    const int offset_min = -((kernel->size - 1) / 2);
+    const int offset_max =   (kernel->size + 1) / 2;
+    int16_t   pixel;
+    for (int x = x_start; x < x_end; x++)
+    {
+        pixel = 0;
+        for (int k = offset_min; k < offset_max; k++)
+        {
+            for (int j = offset_min; j < offset_max; j++)
+            {
+                pixel += kernel->mem[((j - offset_min) * kernel->size) + k - offset_min] * *(src + stride*j + (x + k));
+            }
+        }
+        pixel = (int16_t)(((pixel * kernel->coef) - *(src + x)) * strength) + *(src + x);
+        pixel = pixel < 0 ? 0 : pixel;
+        pixel = pixel > 255 ? 255 : pixel;
+        *(dst + x) = (uint8_t)(pixel);
+    }
+}
+
+static void hb_lapsharp(hb_filter_private_t *pv,
+                        const uint8_t *src,
                               uint8_t *dst,
                         const int width,
                         const int height,
                         const int stride,
+                        const int y_start,
+                        const int y_end,
                         lapsharp_plane_context_t * ctx)
 {
     const kernel_t *kernel = &kernels[ctx->kernel];
 
     // Sharpen using selected kernel
-    const int offset_min    = -((kernel->size - 1) / 2);
     const int offset_max    =   (kernel->size + 1) / 2;
     const int stride_border =   (stride - width) / 2;
-    int16_t   pixel;
-    for (int y = 0; y < height; y++)
+    const int x_start       = stride_border + offset_max;
+    const int x_end         = width + stride_border - offset_max + 1;
+    for (int y = y_start; y < y_end; y++)
     {
-        for (int x = 0; x < width; x++)
+        const uint8_t *src_row = src + stride*y;
+              uint8_t *dst_row = dst + stride*y;
+
+        if ((y < offset_max) ||
+            (y > height - offset_max) ||
+            (x_start >= x_end))
         {
-            if ((y < offset_max) ||
-                (y > height - offset_max) ||
-                (x < stride_border + offset_max) ||
-                (x > width + stride_border - offset_max))
-            {
-                *(dst + stride*y + x) = *(src + stride*y + x);
-                continue;
-            }
-            pixel = 0;
-            for (int k = offset_min; k < offset_max; k++)
-            {
-                for (int j = offset_min; j < offset_max; j++)
-                {
-                    pixel += kernel->mem[((j - offset_min) * kernel->size) + k - offset_min] * *(src + stride*(y + j) + (x + k));
-                }
-            }
-            pixel = (int16_t)(((pixel * kernel->coef) - *(src + stride*y + x)) * ctx->strength) + *(src + stride*y + x);
-            pixel = pixel < 0 ? 0 : pixel;
-            pixel = pixel > 255 ? 255 : pixel;
-            *(dst + stride*y + x) = (uint8_t)(pixel);
+            memcpy(dst_row, src_row, width);
+            continue;
         }
+        memcpy(dst_row, src_row, MIN(x_start, width));
+        pv->functions.filter_row(src_row, dst_row, x_start, MIN(x_end, width),
+                                 stride, kernel, ctx->strength);
+        if (x_end < width)
+        {
+            memcpy(dst_row + x_end, src_row + x_end, width - x_end);
+        }
+    }
+}
+
+/*
+ * Sharpens this task's band of rows of each plane.  Bands only read
+ * the source frame, so they are independent of each other.
+ */
+static void lapsharp_thread(void *thread_args_v)
+{
+    lapsharp_thread_arg_t *thread_args = thread_args_v;
+    hb_filter_private_t   *pv          = thread_args->pv;
+    int                    segment     = thread_args->segment;
+
+    for (int c = 0; c < 3; c++)
+    {
+        lapsharp_plane_context_t * ctx = &pv->plane_ctx[c];
+        int height = pv->in->plane[c].height;
+
+        hb_lapsharp(pv,
+                    pv->in->plane[c].data,
+                    pv->out->plane[c].data,
+                    pv->in->plane[c].width,
+                    height,
+                    pv->in->plane[c].stride,
+                    height *  segment      / pv->thread_count,
+                    height * (segment + 1) / pv->thread_count,
+                    ctx);
     }
 }
 
@@ -253,6 +313,28 @@ static int hb_lapsharp_init(hb_filter_object_t *filter,
         }
     }
 
+    pv->functions.filter_row = lapsharp_filter_row;
+#if defined(ARCH_X86)
+    lapsharp_init_x86(&pv->functions);
+#endif
+
+    pv->thread_count = hb_get_cpu_count();
+    if (taskset_init(&pv->taskset, pv->thread_count,
+                     sizeof(lapsharp_thread_arg_t), lapsharp_thread) == 0)
+    {
+        hb_error("Lapsharp could not initialize taskset");
+        hb_lapsharp_close(filter);
+        return -1;
+    }
+    for (int ii = 0; ii < pv->thread_count; ii++)
+    {
+        lapsharp_thread_arg_t *thread_args;
+
+        thread_args = taskset_thread_args(&pv->taskset, ii);
+        thread_args->pv      = pv;
+        thread_args->segment = ii;
+    }
+
     return 0;
 }
 
@@ -265,6 +347,7 @@ static void hb_lapsharp_close(hb_filter_object_t * filter)
         return;
     }
 
+    taskset_fini(&pv->taskset);
     free(pv);
     filter->private_data = NULL;
 }
@@ -285,17 +368,9 @@ static int hb_lapsharp_work(hb_filter_object_t *filter,
 
     out = hb_frame_buffer_init(in->f.fmt, in->f.width, in->f.height);
 
-    int c;
-    for (c = 0; c < 3; c++)
-    {
-        lapsharp_plane_context_t * ctx = &pv->plane_ctx[c];
-        hb_lapsharp(in->plane[c].data,
-                    out->plane[c].data,
-                    in->plane[c].width,
-                    in->plane[c].height,
-                    in->plane[c].stride,
-                    ctx);
-    }
+    pv->in  = in;
+    pv->out = out;
+    taskset_cycle(&pv->taskset);
 
     out->s = in->s;
     *buf_out = out;
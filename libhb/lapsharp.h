@@ -0,0 +1,34 @@
+/* lapsharp.h
+
+   Copyright (c) 2003-2018 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#ifndef HB_LAPSHARP_H
+#define HB_LAPSHARP_H
+
+typedef struct {
+    const int   *mem;
+    const int    size;
+    const double coef;
+} kernel_t;
+
+typedef struct
+{
+    // Sharpens pixels x_start to x_end - 1 of the row at src, all
+    // pixels of the kernel around them must be inside the plane
+    void (*filter_row)(const uint8_t  *src,
+                             uint8_t  *dst,
+                       const int       x_start,
+                       const int       x_end,
+                       const int       stride,
+                       const kernel_t *kernel,
+                       const double    strength);
+} LapsharpFunctions;
+
+void lapsharp_init_x86(LapsharpFunctions *functions);
+
+#endif // HB_LAPSHARP_H
@@ -0,0 +1,130 @@
+/* lapsharp_x86.c
+
+   Copyright (c) 2003-2018 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#include "hb.h"     // needed for ARCH_X86
+
+#if defined(ARCH_X86)
+
+#include <immintrin.h>
+
+#include "libavutil/cpu.h"
+#include "lapsharp.h"
+
+/*
+ * The weighted sum of 8 bit pixels fits in 16 bits for all kernels, so
+ * it is done with 16 bit lanes.  The strength is then applied in double
+ * precision, exactly like the scalar code does, so the output matches.
+ */
+
+__attribute__((target("avx2")))
+static inline __m128i sharpen_4(__m128i sum, __m128i orig,
+                                __m256d coef, __m256d strength)
+{
+    __m256d p = _mm256_cvtepi32_pd(sum);
+    __m256d s = _mm256_cvtepi32_pd(orig);
+
+    p = _mm256_mul_pd(_mm256_sub_pd(_mm256_mul_pd(p, coef), s), strength);
+    return _mm_add_epi32(_mm256_cvttpd_epi32(p), orig);
+}
+
+__attribute__((target("avx2")))
+static inline void sharpen_8(uint8_t *dst, __m128i sum16, __m128i orig16,
+                             __m256d coef, __m256d strength)
+{
+    __m128i sum  = _mm_cvtepi16_epi32(sum16);
+    __m128i orig = _mm_cvtepi16_epi32(orig16);
+    __m128i lo, hi;
+
+    lo = sharpen_4(sum, orig, coef, strength);
+    sum  = _mm_cvtepi16_epi32(_mm_srli_si128(sum16, 8));
+    orig = _mm_cvtepi16_epi32(_mm_srli_si128(orig16, 8));
+    hi = sharpen_4(sum, orig, coef, strength);
+
+    // Results are small enough that saturating packs clamp to 0..255
+    lo = _mm_packs_epi32(lo, hi);
+    _mm_storel_epi64((__m128i*)dst, _mm_packus_epi16(lo, lo));
+}
+
+__attribute__((target("avx2")))
+static void lapsharp_filter_row_avx2(const uint8_t  *src,
+                                           uint8_t  *dst,
+                                     const int       x_start,
+                                     const int       x_end,
+                                     const int       stride,
+                                     const kernel_t *kernel,
+                                     const double    strength)
+{
+    const int     offset_min = -((kernel->size - 1) / 2);
+    const int     offset_max =   (kernel->size + 1) / 2;
+    const __m256d coef_pd     = _mm256_set1_pd(kernel->coef);
+    const __m256d strength_pd = _mm256_set1_pd(strength);
+    int x = x_start;
+
+    while (x + 16 <= x_end)
+    {
+        __m256i sum = _mm256_setzero_si256();
+        __m256i orig;
+
+        for (int j = offset_min; j < offset_max; j++)
+        {
+            for (int k = offset_min; k < offset_max; k++)
+            {
+                const int w = kernel->mem[((j - offset_min) * kernel->size) + k - offset_min];
+                if (w == 0)
+                {
+                    continue;
+                }
+                __m256i pix = _mm256_cvtepu8_epi16(_mm_loadu_si128(
+                              (const __m128i*)(src + stride*j + x + k)));
+                sum = _mm256_add_epi16(sum,
+                          _mm256_mullo_epi16(pix, _mm256_set1_epi16(w)));
+            }
+        }
+        orig = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(src + x)));
+
+        sharpen_8(dst + x, _mm256_castsi256_si128(sum),
+                  _mm256_castsi256_si128(orig), coef_pd, strength_pd);
+        sharpen_8(dst + x + 8, _mm256_extracti128_si256(sum, 1),
+                  _mm256_extracti128_si256(orig, 1), coef_pd, strength_pd);
+
+        x += 16;
+        if (x < x_end && x + 16 > x_end && x_end - x_start >= 16)
+        {
+            // Redo the last block so that it ends at x_end
+            x = x_end - 16;
+        }
+    }
+
+    for (; x < x_end; x++)
+    {
+        int16_t pixel = 0;
+        for (int k = offset_min; k < offset_max; k++)
+        {
+            for (int j = offset_min; j < offset_max; j++)
+            {
+                pixel += kernel->mem[((j - offset_min) * kernel->size) + k - offset_min] * *(src + stride*j + (x + k));
+            }
+        }
+        pixel = (int16_t)(((pixel * kernel->coef) - *(src + x)) * strength) + *(src + x);
+        pixel = pixel < 0 ? 0 : pixel;
+        pixel = pixel > 255 ? 255 : pixel;
+        *(dst + x) = (uint8_t)(pixel);
+    }
+}
+
+void lapsharp_init_x86(LapsharpFunctions *functions)
+{
+    if (av_get_cpu_flags() & AV_CPU_FLAG_AVX2)
+    {
+        functions->filter_row = lapsharp_filter_row_avx2;
+        hb_log("Lapsharp using AVX2 optimizations");
+    }
+}
+
+#endif // ARCH_X86
@@ -11,6 +11,7 @@
 #include "libavformat/avformat.h"
 #include "libavutil/avstring.h"
 #include "libavutil/intreadwrite.h"
+#include "libavutil/opt.h"
 
 #include "hb.h"
 #include "lang.h"
@@ -27,6 +28,7 @@ struct hb_mux_data_s
     AVStream    *st;
 
     int64_t  duration;
+    int64_t  samples;
 
     hb_buffer_t * delay_buf;
 
@@ -47,6 +49,9 @@ struct hb_mux_object_s
 
     int                 ntracks;
     hb_mux_data_t    ** tracks;
+
+    int                 moov_size;  // space reserved for the MP4 moov
+    int                 moov_free;  // the reserved space is a 'free' box
 };
 
 enum
@@ -107,6 +112,186 @@ static char* lookup_lang_code(int mux, char *iso639_2)
     return out;
 }
 
+/* Upper bounds of what libavformat's mov muxer writes to the moov.
+ * Each sample may take a sample table entry in stsz, stts, ctts and
+ * stss and start a chunk of its own (stco or co64 plus stsc). */
+#define MOOV_HEADER_SIZE        (64 * 1024)
+#define MOOV_TRACK_SIZE         (4 * 1024)
+#define MOOV_VIDEO_SAMPLE_SIZE  48
+#define MOOV_SAMPLE_SIZE        32
+
+/***********************************************************************
+ * moov_size_bound
+ ***********************************************************************
+ * Computes how large the moov can get for the given number of samples
+ * in each track, or for the number of samples muxed so far if samples
+ * is NULL.
+ **********************************************************************/
+static int64_t moov_size_bound(hb_mux_object_t *m, const int64_t *samples)
+{
+    int64_t size = MOOV_HEADER_SIZE;
+    int     ii, nchapters;
+
+    for (ii = 0; ii < m->ntracks; ii++)
+    {
+        hb_mux_data_t * track = m->tracks[ii];
+        int64_t         count = samples ? samples[ii] : track->samples;
+
+        size += MOOV_TRACK_SIZE + track->st->codecpar->extradata_size;
+        if (track->type == MUX_TYPE_VIDEO)
+        {
+            size += count * MOOV_VIDEO_SAMPLE_SIZE;
+        }
+        else
+        {
+            size += count * MOOV_SAMPLE_SIZE;
+        }
+    }
+
+    // Chapters are written as a text track
+    nchapters = samples ? hb_list_count(m->job->list_chapter)
+                        : m->oc->nb_chapters;
+    if (m->job->chapter_markers && nchapters > 0)
+    {
+        size += MOOV_TRACK_SIZE + (int64_t)nchapters * MOOV_SAMPLE_SIZE;
+    }
+
+    return size;
+}
+
+/***********************************************************************
+ * estimate_moov_size
+ ***********************************************************************
+ * Estimates the space to reserve for the moov from the duration of the
+ * encode.  Returns 0 if no estimate can be made.
+ **********************************************************************/
+static int estimate_moov_size(hb_mux_object_t *m)
+{
+    hb_job_t   * job = m->job;
+    hb_title_t * title = job->title;
+    int64_t      duration, size;
+    int64_t    * samples;
+    double       fps;
+    int          ii, count;
+
+    if (job->pts_to_stop > 0)
+    {
+        duration = job->pts_to_stop;
+    }
+    else if (job->frame_to_stop > 0)
+    {
+        duration = (int64_t)job->frame_to_stop * title->vrate.den * 90000 /
+                   title->vrate.num;
+    }
+    else
+    {
+        duration = 0;
+        count = hb_list_count(job->list_chapter);
+        for (ii = job->chapter_start; ii <= job->chapter_end && ii <= count;
+             ii++)
+        {
+            hb_chapter_t * chapter = hb_list_item(job->list_chapter, ii - 1);
+            duration += chapter->duration;
+        }
+        if (count == 0 || duration <= 0)
+        {
+            duration = title->duration;
+        }
+    }
+    if (duration <= 0 || job->vrate.num <= 0 || job->vrate.den <= 0)
+    {
+        return 0;
+    }
+
+    // Leave a quarter on top for variable frame rates, e.g. telecined
+    // sources, and audio frames that are smaller than expected
+    duration += duration / 4;
+    fps = (double)job->vrate.num / job->vrate.den;
+    if (title->vrate.num > 0 && title->vrate.den > 0)
+    {
+        fps = MAX(fps, (double)title->vrate.num / title->vrate.den);
+    }
+
+    samples = calloc(m->ntracks, sizeof(int64_t));
+    for (ii = 0; ii < m->ntracks; ii++)
+    {
+        hb_mux_data_t * track = m->tracks[ii];
+
+        switch (track->type)
+        {
+            case MUX_TYPE_VIDEO:
+                samples[ii] = duration * fps / 90000;
+                break;
+
+            case MUX_TYPE_AUDIO:
+            {
+                int jj, spf = 0;
+                for (jj = 0; jj < hb_list_count(job->list_audio); jj++)
+                {
+                    hb_audio_t * audio = hb_list_item(job->list_audio, jj);
+                    if (audio->priv.mux_data == track)
+                    {
+                        spf = audio->config.out.samples_per_frame;
+                        break;
+                    }
+                }
+                if (spf <= 0)
+                {
+                    spf = 1024;
+                }
+                samples[ii] = duration * track->st->codecpar->sample_rate /
+                              spf / 90000;
+            } break;
+
+            case MUX_TYPE_SUBTITLE:
+                // A subtitle and an empty gap sample every second
+                samples[ii] = duration * 2 / 90000;
+                break;
+        }
+    }
+    size = moov_size_bound(m, samples);
+    free(samples);
+
+    return size > INT_MAX ? 0 : size;
+}
+
+/***********************************************************************
+ * check_moov_reservation
+ ***********************************************************************
+ * Reads back the start of the output and checks that it is laid out as
+ * 'ftyp', the reserved space and an 8 byte box + 'mdat' header ending at
+ * pos.  The 8 byte box is 'free' for the mp4 and ipod muxers and 'wide'
+ * for mov.  libavformat does not document what it writes around the
+ * reservation, so the 'free' box header is only written where this was
+ * verified.
+ **********************************************************************/
+static int check_moov_reservation(hb_mux_object_t *m, int64_t pos)
+{
+    uint8_t   head[8], mdat[16];
+    FILE    * file;
+    int       ok = 0;
+
+    avio_flush(m->oc->pb);
+    file = hb_fopen(m->job->file, "rb");
+    if (file == NULL)
+    {
+        return 0;
+    }
+    if (fread(head, 1, sizeof(head), file) == sizeof(head) &&
+        fseeko(file, pos - sizeof(mdat), SEEK_SET) == 0 &&
+        fread(mdat, 1, sizeof(mdat), file) == sizeof(mdat))
+    {
+        ok = !memcmp(head + 4, "ftyp", 4) &&
+             (int64_t)AV_RB32(head) + m->moov_size + sizeof(mdat) == pos &&
+             AV_RB32(mdat) == 8 && (!memcmp(mdat + 4, "free", 4) ||
+                                    !memcmp(mdat + 4, "wide", 4)) &&
+             !memcmp(mdat + 12, "mdat", 4);
+    }
+    fclose(file);
+
+    return ok;
+}
+
 /**********************************************************************
  * avformatInit
  **********************************************************************
@@ -155,10 +340,7 @@ static int avformatInit( hb_mux_object_t * m )
             meta_mux = META_MUX_MP4;
 
             av_dict_set(&av_opts, "brand", "mp42", 0);
-            if (job->mp4_optimize)
-                av_dict_set(&av_opts, "movflags", "faststart+disable_chpl", 0);
-            else
-                av_dict_set(&av_opts, "movflags", "+disable_chpl", 0);
+            av_dict_set(&av_opts, "movflags", "+disable_chpl", 0);
             break;
 
         case HB_MUX_AV_MKV:
@@ -1022,6 +1204,25 @@ static int avformatInit( hb_mux_object_t * m )
     strftime(now_8601, sizeof(now_8601), "%Y-%m-%dT%H:%M:%SZ", now_utc);
     av_dict_set(&m->oc->metadata, "creation_time", now_8601, 0);
 
+    if (job->mux == HB_MUX_AV_MP4 && job->mp4_optimize)
+    {
+        // Reserve space for the moov in front of the media data so that
+        // it can be written in place when the encode is done.  Fall back
+        // to having libavformat rewrite the file if there is nothing to
+        // base an estimate on.
+        m->moov_size = estimate_moov_size(m);
+        if (m->moov_size > 0)
+        {
+            char moov_size[16];
+            snprintf(moov_size, sizeof(moov_size), "%d", m->moov_size);
+            av_dict_set(&av_opts, "moov_size", moov_size, 0);
+        }
+        else
+        {
+            av_dict_set(&av_opts, "movflags", "+faststart", AV_DICT_APPEND);
+        }
+    }
+
     ret = avformat_write_header(m->oc, &av_opts);
     if( ret < 0 )
     {
@@ -1030,6 +1231,29 @@ static int avformatInit( hb_mux_object_t * m )
         goto error;
     }
 
+    if (m->moov_size > 0)
+    {
+        // libavformat skips over the reserved space and only fills it
+        // when the moov is written there.  Make it a 'free' box so that
+        // the file stays valid if the moov does not fit and ends up
+        // being placed elsewhere.
+        int64_t pos = avio_tell(m->oc->pb);
+        if (check_moov_reservation(m, pos))
+        {
+            avio_seek(m->oc->pb, pos - 16 - m->moov_size, SEEK_SET);
+            avio_wb32(m->oc->pb, m->moov_size);
+            avio_write(m->oc->pb, (const uint8_t*)"free", 4);
+            avio_seek(m->oc->pb, pos, SEEK_SET);
+            m->moov_free = 1;
+        }
+        else
+        {
+            hb_log("muxavformat: unexpected layout around the reserved "
+                   "moov space, leaving it as is");
+        }
+        hb_log("muxavformat: reserved %d bytes for the moov", m->moov_size);
+    }
+
     AVDictionaryEntry *t = NULL;
     while( ( t = av_dict_get( av_opts, "", t, AV_DICT_IGNORE_SUFFIX ) ) )
     {
@@ -1122,6 +1346,7 @@ static int avformatMux(hb_mux_object_t *m, hb_mux_data_t *track, hb_buffer_t *bu
                 empty_pkt.duration = 90;
                 empty_pkt.stream_index = track->st->index;
                 av_interleaved_write_frame(m->oc, &empty_pkt);
+                track->samples++;
             }
         }
         return 0;
@@ -1278,6 +1503,7 @@ static int avformatMux(hb_mux_object_t *m, hb_mux_data_t *track, hb_buffer_t *bu
                         *job->die = 1;
                         return -1;
                     }
+                    track->samples++;
                 }
                 if (track->st->codecpar->codec_id == AV_CODEC_ID_MOV_TEXT)
                 {
@@ -1390,6 +1616,7 @@ static int avformatMux(hb_mux_object_t *m, hb_mux_data_t *track, hb_buffer_t *bu
 
     pkt.stream_index = track->st->index;
     int ret = av_interleaved_write_frame(m->oc, &pkt);
+    track->samples++;
     if (sub_out != NULL)
     {
         free(sub_out);
@@ -1498,6 +1725,27 @@ static int avformatEnd(hb_mux_object_t *m)
         }
     }
 
+    if (m->moov_size > 0)
+    {
+        int64_t moov_size = moov_size_bound(m, NULL);
+        if (moov_size > m->moov_size)
+        {
+            // libavformat would overwrite the start of the media data
+            // with a moov that does not fit.  Let it rewrite the file
+            // with the moov moved to the front instead.
+            hb_log("muxavformat: moov may need up to %"PRId64" bytes, "
+                   "%d reserved, rewriting for fast start",
+                   moov_size, m->moov_size);
+            if (!m->moov_free)
+            {
+                hb_error("muxavformat: the reserved moov space could not "
+                         "be marked free, the output may not be readable");
+            }
+            av_opt_set_int(m->oc->priv_data, "moov_size", 0, 0);
+            av_opt_set(m->oc->priv_data, "movflags", "+faststart", 0);
+        }
+    }
+
     av_write_trailer(m->oc);
     avio_close(m->oc->pb);
     avformat_free_context(m->oc);
@@ -30,6 +30,11 @@
  * Large number of frames (film >3, animation >6) may cause temporal smearing.
  * Prefiltering can potentially improve weight decisions, yielding better results for difficult sources.
  *
+ * By default each thread denoises a whole frame, so frames are buffered per thread.
+ * The tile option instead splits every frame into horizontal tiles, one per thread,
+ * which bounds memory and latency by the frame count rather than the thread count.
+ * Output is identical in both modes.
+ *
  * Prefilter enum combos:
  *     1: Mean 3x3
  *     2: Mean 5x5
@@ -109,12 +114,6 @@ typedef struct
     hb_buffer_settings_t s;
 } Frame;
 
-struct PixelSum
-{
-    float weight_sum;
-    float pixel_sum;
-};
-
 typedef struct
 {
     hb_filter_private_t *pv;
@@ -131,6 +130,7 @@ struct hb_filter_private_s
     int    nframes[3];     // temporal search depth in frames
     int    prefilter[3];   // prefilter mode, can improve weight analysis
     int    threads;        // number of frame threads to use, 0 == auto
+    int    tile;           // split each frame into tiles, one per thread
 
     float  exptable[3][NLMEANS_EXPSIZE];
     float  weight_fact_table[3];
@@ -141,6 +141,12 @@ struct hb_filter_private_s
     Frame      *frame;
     int         next_frame;
     int         max_frames;
+    int         cycle_frames;  // frames output per taskset cycle
+
+    // Current frame in tile mode
+    Frame       *tile_frame;
+    int          tile_nframes[3];
+    hb_buffer_t *tile_out;
 
     taskset_t   taskset;
     nlmeans_thread_arg_t **thread_data;
@@ -153,6 +159,7 @@ static int nlmeans_work(hb_filter_object_t *filter,
 static void nlmeans_close(hb_filter_object_t *filter);
 
 static void nlmeans_filter_thread(void *thread_args_v);
+static void nlmeans_tile_thread(void *thread_args_v);
 
 static const char nlmeans_template[] =
     "y-strength=^"HB_FLOAT_REG"$:y-origin-tune=^"HB_FLOAT_REG"$:"
@@ -164,7 +171,7 @@ static const char nlmeans_template[] =
     "cr-strength=^"HB_FLOAT_REG"$:cr-origin-tune=^"HB_FLOAT_REG"$:"
     "cr-patch-size=^"HB_INT_REG"$:cr-range=^"HB_INT_REG"$:"
     "cr-frame-count=^"HB_INT_REG"$:cr-prefilter=^"HB_INT_REG"$:"
-    "threads=^"HB_INT_REG"$";
+    "threads=^"HB_INT_REG"$:tile=^"HB_BOOL_REG"$";
 
 hb_filter_object_t hb_filter_nlmeans =
 {
@@ -745,6 +752,43 @@ static void build_integral_scalar(uint32_t *integral,
     }
 }
 
+static void accumulate_weights_scalar(const uint32_t        *integral_ptr1,
+                                      const uint32_t        *integral_ptr2,
+                                            int              n,
+                                      const uint8_t         *compare,
+                                            struct PixelSum *tmp_data,
+                                            int              count,
+                                      const float           *exptable,
+                                            float            weight_fact_table,
+                                            int              diff_max)
+{
+    for (int x = 0; x < count; x++)
+    {
+        // Difference between patches
+        const int diff = (uint32_t)(integral_ptr2[n] - integral_ptr2[0] - integral_ptr1[n] + integral_ptr1[0]);
+
+        // Sum pixel with weight
+        if (diff < diff_max)
+        {
+            const int diffidx = diff * weight_fact_table;
+
+            //float weight = exp(-diff*weightFact);
+            const float weight = exptable[diffidx];
+
+            tmp_data[x].weight_sum += weight;
+            tmp_data[x].pixel_sum  += weight * compare[x];
+        }
+
+        integral_ptr1++;
+        integral_ptr2++;
+    }
+}
+
+/*
+ * Denoises rows y_start to y_end - 1 of a plane.  The rows of a plane
+ * can be done in separate calls, e.g. in parallel, and the result is
+ * the same as when the whole plane is done in one call.
+ */
 static void nlmeans_plane(NLMeansFunctions *functions,
                           Frame *frame,
                           int prefilter,
@@ -754,6 +798,8 @@ static void nlmeans_plane(NLMeansFunctions *functions,
                           int dst_w,
                           int dst_s,
                           int dst_h,
+                          int y_start,
+                          int y_end,
                           double h_param,
                           double origin_tune,
                           int n,
@@ -765,6 +811,9 @@ static void nlmeans_plane(NLMeansFunctions *functions,
     const int n_half = (n-1) /2;
     const int r_half = (r-1) /2;
 
+    // Prefilter the source before taking image_pre, it is replaced
+    nlmeans_prefilter(&frame[0].plane[plane], prefilter);
+
     // Source image
     const uint8_t *src     = frame[0].plane[plane].image;
     const uint8_t *src_pre = frame[0].plane[plane].image_pre;
@@ -772,16 +821,25 @@ static void nlmeans_plane(NLMeansFunctions *functions,
     const int border = frame[0].plane[plane].border;
     const int bw     = w + 2 * border;
 
+    // Rows that are filtered, the others are copied from the source
+    const int yc_start = MAX(y_start, n_half);
+    const int yc_end   = MIN(y_end, dst_h - n_half);
+
+    // Integral image rows needed for the patches of the filtered rows.
+    // The zero row above the first one stands in for the rows above.
+    const int integral_y = MAX(y_start - n_half, 0);
+    const int integral_h = MIN(y_end + n_half, dst_h) - integral_y;
+
     // Allocate temporary pixel sums
-    struct PixelSum *tmp_data = calloc(dst_w * dst_h, sizeof(struct PixelSum));
+    struct PixelSum *tmp_data = calloc(dst_w * (y_end - y_start), sizeof(struct PixelSum));
 
     // Allocate integral image
     const int integral_stride    = ((dst_w + 15) / 16 * 16) + 2 * 16;
-    uint32_t* const integral_mem = calloc(integral_stride * (dst_h+1), sizeof(uint32_t));
+    uint32_t* const integral_mem = calloc(integral_stride * (integral_h+1), sizeof(uint32_t));
     uint32_t* const integral     = integral_mem + integral_stride + 16;
 
     // Iterate through available frames
-    for (int f = 0; f < nframes; f++)
+    for (int f = 0; f < nframes && yc_start < yc_end; f++)
     {
         nlmeans_prefilter(&frame[f].plane[plane], prefilter);
 
@@ -798,13 +856,12 @@ static void nlmeans_plane(NLMeansFunctions *functions,
                 // Apply special weight tuning to origin patch
                 if (dx == 0 && dy == 0 && f == 0)
                 {
-                    // TODO: Parallelize this
-                    for (int y = n_half; y < dst_h-n + n_half; y++)
+                    for (int y = yc_start; y < MIN(y_end, dst_h-n + n_half); y++)
                     {
                         for (int x = n_half; x < dst_w-n + n_half; x++)
                         {
-                            tmp_data[y*dst_w + x].weight_sum += origin_tune;
-                            tmp_data[y*dst_w + x].pixel_sum  += origin_tune * src[y*bw + x];
+                            tmp_data[(y-y_start)*dst_w + x].weight_sum += origin_tune;
+                            tmp_data[(y-y_start)*dst_w + x].pixel_sum  += origin_tune * src[y*bw + x];
                         }
                     }
                     continue;
@@ -813,54 +870,40 @@ static void nlmeans_plane(NLMeansFunctions *functions,
                 // Build integral
                 functions->build_integral(integral,
                                           integral_stride,
-                                          src,
-                                          src_pre,
-                                          compare,
-                                          compare_pre,
+                                          src         + integral_y*bw,
+                                          src_pre     + integral_y*bw,
+                                          compare     + integral_y*bw,
+                                          compare_pre + integral_y*bw,
                                           w,
                                           border,
                                           dst_w,
-                                          dst_h,
+                                          integral_h,
                                           dx,
                                           dy);
 
                 // Average displacement
-                // TODO: Parallelize this
-                for (int y = 0; y <= dst_h-n; y++)
+                for (int yc = yc_start; yc < yc_end; yc++)
                 {
+                    const int y = yc - n_half - integral_y;
                     const uint32_t *integral_ptr1 = integral + (y  -1)*integral_stride - 1;
                     const uint32_t *integral_ptr2 = integral + (y+n-1)*integral_stride - 1;
 
-                    for (int x = 0; x <= dst_w-n; x++)
-                    {
-                        const int xc = x + n_half;
-                        const int yc = y + n_half;
-
-                        // Difference between patches
-                        const int diff = (uint32_t)(integral_ptr2[n] - integral_ptr2[0] - integral_ptr1[n] + integral_ptr1[0]);
-
-                        // Sum pixel with weight
-                        if (diff < diff_max)
-                        {
-                            const int diffidx = diff * weight_fact_table;
-
-                            //float weight = exp(-diff*weightFact);
-                            const float weight = exptable[diffidx];
-
-                            tmp_data[yc*dst_w + xc].weight_sum += weight;
-                            tmp_data[yc*dst_w + xc].pixel_sum  += weight * compare[(yc+dy)*bw + xc + dx];
-                        }
-
-                        integral_ptr1++;
-                        integral_ptr2++;
-                    }
+                    functions->accumulate_weights(integral_ptr1,
+                                                  integral_ptr2,
+                                                  n,
+                                                  compare + (yc+dy)*bw + n_half + dx,
+                                                  tmp_data + (yc-y_start)*dst_w + n_half,
+                                                  dst_w - n + 1,
+                                                  exptable,
+                                                  weight_fact_table,
+                                                  diff_max);
                 }
             }
         }
     }
 
     // Copy edges
-    for (int y = 0; y < dst_h; y++)
+    for (int y = y_start; y < y_end; y++)
     {
         for (int x = 0; x < n_half; x++)
         {
@@ -870,17 +913,23 @@ static void nlmeans_plane(NLMeansFunctions *functions,
     }
     for (int y = 0; y < n_half; y++)
     {
-        memcpy(dst +           y*dst_s, src -     (y+1)*bw, dst_w);
-        memcpy(dst + (dst_h-y-1)*dst_s, src + (y+dst_h)*bw, dst_w);
+        if (y >= y_start && y < y_end)
+        {
+            memcpy(dst +           y*dst_s, src -     (y+1)*bw, dst_w);
+        }
+        if (dst_h-y-1 >= y_start && dst_h-y-1 < y_end)
+        {
+            memcpy(dst + (dst_h-y-1)*dst_s, src + (y+dst_h)*bw, dst_w);
+        }
     }
 
     // Copy main image
     uint8_t result;
-    for (int y = n_half; y < dst_h-n_half; y++)
+    for (int y = yc_start; y < yc_end; y++)
     {
         for (int x = n_half; x < dst_w-n_half; x++)
         {
-            result = (uint8_t)(tmp_data[y*dst_w + x].pixel_sum / tmp_data[y*dst_w + x].weight_sum);
+            result = (uint8_t)(tmp_data[(y-y_start)*dst_w + x].pixel_sum / tmp_data[(y-y_start)*dst_w + x].weight_sum);
             *(dst + y*dst_s + x) = result ? result : *(src + y*bw + x);
         }
     }
@@ -897,7 +946,8 @@ static int nlmeans_init(hb_filter_object_t *filter,
     hb_filter_private_t *pv = filter->private_data;
     NLMeansFunctions *functions = &pv->functions;
 
-    functions->build_integral = build_integral_scalar;
+    functions->build_integral     = build_integral_scalar;
+    functions->accumulate_weights = accumulate_weights_scalar;
 #if defined(ARCH_X86)
     nlmeans_init_x86(functions);
 #endif
@@ -940,6 +990,7 @@ static int nlmeans_init(hb_filter_object_t *filter,
         hb_dict_extract_int(&pv->prefilter[2],      dict, "cr-prefilter");
 
         hb_dict_extract_int(&pv->threads,           dict, "threads");
+        hb_dict_extract_bool(&pv->tile,             dict, "tile");
     }
 
     // Cascade values
@@ -997,8 +1048,11 @@ static int nlmeans_init(hb_filter_object_t *filter,
     // Sanitize
     if (pv->threads < 1) { pv->threads = hb_get_cpu_count(); }
 
-    pv->frame = calloc(pv->threads + pv->max_frames, sizeof(Frame));
-    for (int ii = 0; ii < pv->threads + pv->max_frames; ii++)
+    // In tile mode all threads work on one frame at a time
+    pv->cycle_frames = pv->tile ? 1 : pv->threads;
+
+    pv->frame = calloc(pv->cycle_frames + pv->max_frames, sizeof(Frame));
+    for (int ii = 0; ii < pv->cycle_frames + pv->max_frames; ii++)
     {
         for (int c = 0; c < 3; c++)
         {
@@ -1008,7 +1062,9 @@ static int nlmeans_init(hb_filter_object_t *filter,
 
     pv->thread_data = malloc(pv->threads * sizeof(nlmeans_thread_arg_t*));
     if (taskset_init(&pv->taskset, pv->threads,
-                     sizeof(nlmeans_thread_arg_t)) == 0)
+                     sizeof(nlmeans_thread_arg_t),
+                     pv->tile ? nlmeans_tile_thread :
+                                nlmeans_filter_thread) == 0)
     {
         hb_error("NLMeans could not initialize taskset");
         goto fail;
@@ -1024,12 +1080,6 @@ static int nlmeans_init(hb_filter_object_t *filter,
         }
         pv->thread_data[ii]->pv = pv;
         pv->thread_data[ii]->segment = ii;
-        if (taskset_thread_spawn(&pv->taskset, ii, "nlmeans_filter",
-                                 nlmeans_filter_thread, HB_NORMAL_PRIORITY) == 0)
-        {
-            hb_error("NLMeans could not spawn thread");
-            goto fail;
-        }
     }
 
     return 0;
@@ -1053,7 +1103,7 @@ static void nlmeans_close(hb_filter_object_t *filter)
     taskset_fini(&pv->taskset);
     for (int c = 0; c < 3; c++)
     {
-        for (int f = 0; f < pv->nframes[c]; f++)
+        for (int f = 0; f < pv->cycle_frames + pv->max_frames; f++)
         {
             if (pv->frame[f].plane[c].mem_pre != NULL &&
                 pv->frame[f].plane[c].mem_pre != pv->frame[f].plane[c].mem)
@@ -1069,7 +1119,7 @@ static void nlmeans_close(hb_filter_object_t *filter)
         }
     }
 
-    for (int ii = 0; ii < pv->threads + pv->max_frames; ii++)
+    for (int ii = 0; ii < pv->cycle_frames + pv->max_frames; ii++)
     {
         for (int c = 0; c < 3; c++)
         {
@@ -1089,67 +1139,129 @@ static void nlmeans_filter_thread(void *thread_args_v)
     hb_filter_private_t *pv = thread_data->pv;
     int segment = thread_data->segment;
 
-    hb_log("NLMeans thread started for segment %d", segment);
+    Frame *frame = &pv->frame[segment];
+    hb_buffer_t *buf;
+    buf = hb_frame_buffer_init(frame->fmt, frame->width, frame->height);
 
-    while (1)
-    {
-        // Wait until there is work to do.
-        taskset_thread_wait4start(&pv->taskset, segment);
+    NLMeansFunctions *functions = &pv->functions;
 
-        if (taskset_thread_stop(&pv->taskset, segment))
+    for (int c = 0; c < 3; c++)
+    {
+        if (pv->prefilter[c] & NLMEANS_PREFILTER_MODE_PASSTHRU)
         {
-            break;
+            nlmeans_prefilter(&frame->plane[c], pv->prefilter[c]);
+            nlmeans_deborder(&frame->plane[c], buf->plane[c].data,
+                             buf->plane[c].width, buf->plane[c].stride,
+                             buf->plane[c].height);
+            continue;
+        }
+        if (pv->strength[c] == 0)
+        {
+            nlmeans_deborder(&frame->plane[c], buf->plane[c].data,
+                             buf->plane[c].width, buf->plane[c].stride,
+                             buf->plane[c].height);
+            continue;
         }
 
-        Frame *frame = &pv->frame[segment];
-        hb_buffer_t *buf;
-        buf = hb_frame_buffer_init(frame->fmt, frame->width, frame->height);
+        // Process current plane
+        nlmeans_plane(functions,
+                      frame,
+                      pv->prefilter[c],
+                      c,
+                      pv->nframes[c],
+                      buf->plane[c].data,
+                      buf->plane[c].width,
+                      buf->plane[c].stride,
+                      buf->plane[c].height,
+                      0,
+                      buf->plane[c].height,
+                      pv->strength[c],
+                      pv->origin_tune[c],
+                      pv->patch_size[c],
+                      pv->range[c],
+                      pv->exptable[c],
+                      pv->weight_fact_table[c],
+                      pv->diff_max[c]);
+    }
+    buf->s = pv->frame[segment].s;
+    thread_data->out = buf;
+}
 
-        NLMeansFunctions *functions = &pv->functions;
+static void nlmeans_tile_thread(void *thread_args_v)
+{
+    nlmeans_thread_arg_t *thread_data = thread_args_v;
+    hb_filter_private_t *pv = thread_data->pv;
+    int segment = thread_data->segment;
 
-        for (int c = 0; c < 3; c++)
-        {
-            if (pv->prefilter[c] & NLMEANS_PREFILTER_MODE_PASSTHRU)
-            {
-                nlmeans_prefilter(&frame->plane[c], pv->prefilter[c]);
-                nlmeans_deborder(&frame->plane[c], buf->plane[c].data,
-                                 buf->plane[c].width, buf->plane[c].stride,
-                                 buf->plane[c].height);
-                continue;
-            }
-            if (pv->strength[c] == 0)
-            {
-                nlmeans_deborder(&frame->plane[c], buf->plane[c].data,
-                                 buf->plane[c].width, buf->plane[c].stride,
-                                 buf->plane[c].height);
-                continue;
-            }
+    Frame *frame = pv->tile_frame;
+    hb_buffer_t *buf = pv->tile_out;
 
-            // Process current plane
-            nlmeans_plane(functions,
-                          frame,
-                          pv->prefilter[c],
-                          c,
-                          pv->nframes[c],
-                          buf->plane[c].data,
-                          buf->plane[c].width,
-                          buf->plane[c].stride,
-                          buf->plane[c].height,
-                          pv->strength[c],
-                          pv->origin_tune[c],
-                          pv->patch_size[c],
-                          pv->range[c],
-                          pv->exptable[c],
-                          pv->weight_fact_table[c],
-                          pv->diff_max[c]);
+    NLMeansFunctions *functions = &pv->functions;
+
+    for (int c = 0; c < 3; c++)
+    {
+        if (pv->tile_nframes[c] == 0)
+        {
+            continue;
         }
-        buf->s = pv->frame[segment].s;
-        thread_data->out = buf;
 
-        // Finished this segment, notify.
-        taskset_thread_complete(&pv->taskset, segment);
+        // Process this thread's tile of the current plane
+        const int height = buf->plane[c].height;
+        nlmeans_plane(functions,
+                      frame,
+                      pv->prefilter[c],
+                      c,
+                      pv->tile_nframes[c],
+                      buf->plane[c].data,
+                      buf->plane[c].width,
+                      buf->plane[c].stride,
+                      height,
+                      height *  segment      / pv->threads,
+                      height * (segment + 1) / pv->threads,
+                      pv->strength[c],
+                      pv->origin_tune[c],
+                      pv->patch_size[c],
+                      pv->range[c],
+                      pv->exptable[c],
+                      pv->weight_fact_table[c],
+                      pv->diff_max[c]);
     }
-    taskset_thread_complete(&pv->taskset, segment);
+}
+
+// Denoises one frame in tile mode, using up to nframes frames
+static hb_buffer_t * nlmeans_filter_tiled(hb_filter_private_t *pv,
+                                          Frame *frame, int nframes)
+{
+    hb_buffer_t *buf;
+    buf = hb_frame_buffer_init(frame->fmt, frame->width, frame->height);
+
+    for (int c = 0; c < 3; c++)
+    {
+        pv->tile_nframes[c] = 0;
+        if (pv->prefilter[c] & NLMEANS_PREFILTER_MODE_PASSTHRU)
+        {
+            nlmeans_prefilter(&frame->plane[c], pv->prefilter[c]);
+            nlmeans_deborder(&frame->plane[c], buf->plane[c].data,
+                             buf->plane[c].width, buf->plane[c].stride,
+                             buf->plane[c].height);
+            continue;
+        }
+        if (pv->strength[c] == 0)
+        {
+            nlmeans_deborder(&frame->plane[c], buf->plane[c].data,
+                             buf->plane[c].width, buf->plane[c].stride,
+                             buf->plane[c].height);
+            continue;
+        }
+        pv->tile_nframes[c] = MIN(pv->nframes[c], nframes);
+    }
+
+    pv->tile_frame = frame;
+    pv->tile_out   = buf;
+    taskset_cycle(&pv->taskset);
+
+    buf->s = frame->s;
+    return buf;
 }
 
 static void nlmeans_add_frame(hb_filter_private_t *pv, hb_buffer_t *buf)
@@ -1174,17 +1286,39 @@ static void nlmeans_add_frame(hb_filter_private_t *pv, hb_buffer_t *buf)
 
 static hb_buffer_t * nlmeans_filter(hb_filter_private_t *pv)
 {
-    if (pv->next_frame < pv->max_frames + pv->threads)
+    hb_buffer_list_t list;
+    hb_buffer_list_clear(&list);
+
+    if (pv->tile)
     {
-        return NULL;
+        if (pv->next_frame < pv->max_frames)
+        {
+            return NULL;
+        }
+        hb_buffer_list_append(&list,
+                              nlmeans_filter_tiled(pv, &pv->frame[0],
+                                                   pv->max_frames));
     }
+    else
+    {
+        if (pv->next_frame < pv->max_frames + pv->threads)
+        {
+            return NULL;
+        }
 
-    taskset_cycle(&pv->taskset);
+        taskset_cycle(&pv->taskset);
+
+        // Collect results from taskset
+        for (int t = 0; t < pv->threads; t++)
+        {
+            hb_buffer_list_append(&list, pv->thread_data[t]->out);
+        }
+    }
 
     // Free buffers that are not needed for next taskset cycle
     for (int c = 0; c < 3; c++)
     {
-        for (int t = 0; t < pv->threads; t++)
+        for (int t = 0; t < pv->cycle_frames; t++)
         {
             // Release last frame in buffer
             if (pv->frame[t].plane[c].mem_pre != NULL &&
@@ -1205,23 +1339,16 @@ static hb_buffer_t * nlmeans_filter(hb_filter_private_t *pv)
     {
         // Don't move the mutex!
         Frame frame = pv->frame[f];
-        pv->frame[f] = pv->frame[f+pv->threads];
+        pv->frame[f] = pv->frame[f+pv->cycle_frames];
         for (int c = 0; c < 3; c++)
         {
             pv->frame[f].plane[c].mutex = frame.plane[c].mutex;
-            pv->frame[f+pv->threads].plane[c].mem_pre = NULL;
-            pv->frame[f+pv->threads].plane[c].mem = NULL;
+            pv->frame[f+pv->cycle_frames].plane[c].mem_pre = NULL;
+            pv->frame[f+pv->cycle_frames].plane[c].mem = NULL;
         }
     }
-    pv->next_frame -= pv->threads;
+    pv->next_frame -= pv->cycle_frames;
 
-    // Collect results from taskset
-    hb_buffer_list_t list;
-    hb_buffer_list_clear(&list);
-    for (int t = 0; t < pv->threads; t++)
-    {
-        hb_buffer_list_append(&list, pv->thread_data[t]->out);
-    }
     return hb_buffer_list_clear(&list);
 }
 
@@ -1232,6 +1359,13 @@ static hb_buffer_t * nlmeans_filter_flush(hb_filter_private_t *pv)
     hb_buffer_list_clear(&list);
     for (int f = 0; f < pv->next_frame; f++)
     {
+        if (pv->tile)
+        {
+            hb_buffer_list_append(&list,
+                nlmeans_filter_tiled(pv, &pv->frame[f], pv->next_frame - f));
+            continue;
+        }
+
         Frame *frame = &pv->frame[f];
         hb_buffer_t *buf;
         buf = hb_frame_buffer_init(frame->fmt, frame->width, frame->height);
@@ -1271,6 +1405,8 @@ static hb_buffer_t * nlmeans_filter_flush(hb_filter_private_t *pv)
                           buf->plane[c].width,
                           buf->plane[c].stride,
                           buf->plane[c].height,
+                          0,
+                          buf->plane[c].height,
                           pv->strength[c],
                           pv->origin_tune[c],
                           pv->patch_size[c],
@@ -13,6 +13,7 @@
 #if defined(ARCH_X86)
 
 #include <emmintrin.h>
+#include <immintrin.h>
 
 #include "libavutil/cpu.h"
 #include "nlmeans.h"
@@ -143,9 +144,183 @@ static void build_integral_sse2(uint32_t *integral,
     }
 }
 
+__attribute__((target("avx2")))
+static void build_integral_avx2(uint32_t *integral,
+                                int       integral_stride,
+                          const uint8_t  *src,
+                          const uint8_t  *src_pre,
+                          const uint8_t  *compare,
+                          const uint8_t  *compare_pre,
+                                int       w,
+                                int       border,
+                                int       dst_w,
+                                int       dst_h,
+                                int       dx,
+                                int       dy)
+{
+    const int bw = w + 2 * border;
+    const __m256i last = _mm256_set1_epi32(7);
+
+    for (int y = 0; y < dst_h; y++)
+    {
+        __m256i prevadd = _mm256_setzero_si256();
+
+        const uint8_t *p1 = src_pre + y*bw;
+        const uint8_t *p2 = compare_pre + (y+dy)*bw + dx;
+        uint32_t *out = integral + (y*integral_stride);
+
+        for (int x = 0; x < dst_w; x += 16)
+        {
+            __m256i pa, pb, diff;
+            __m256i ldiff, hdiff;
+            __m256i tmp;
+
+            pa = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i*)p1)); // Load and widen 16 source  pixels
+            pb = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i*)p2)); // Load and widen 16 compare pixels
+
+            diff = _mm256_sub_epi16(pa, pb);           // Diff source and compare
+            diff = _mm256_mullo_epi16(diff, diff);     // Square diff, fits in 16 bits unsigned
+
+            ldiff = _mm256_cvtepu16_epi32(_mm256_castsi256_si128(diff));      // Widen squares 0-7
+            hdiff = _mm256_cvtepu16_epi32(_mm256_extracti128_si256(diff, 1)); // Widen squares 8-15
+
+            // Prefix sum of squares 0-7.  Shifts stay within 128 bit
+            // lanes, so carry the low lane total into the high lane.
+            tmp = _mm256_slli_si256(ldiff, 4);
+            ldiff = _mm256_add_epi32(ldiff, tmp);
+            tmp = _mm256_slli_si256(ldiff, 8);
+            ldiff = _mm256_add_epi32(ldiff, tmp);
+            tmp = _mm256_shuffle_epi32(ldiff, 0xff);
+            tmp = _mm256_permute2x128_si256(tmp, tmp, 0x08);
+            ldiff = _mm256_add_epi32(ldiff, tmp);
+            ldiff = _mm256_add_epi32(ldiff, prevadd);  // Add previous total
+
+            prevadd = _mm256_permutevar8x32_epi32(ldiff, last); // Broadcast running total
+
+            // Prefix sum of squares 8-15
+            tmp = _mm256_slli_si256(hdiff, 4);
+            hdiff = _mm256_add_epi32(hdiff, tmp);
+            tmp = _mm256_slli_si256(hdiff, 8);
+            hdiff = _mm256_add_epi32(hdiff, tmp);
+            tmp = _mm256_shuffle_epi32(hdiff, 0xff);
+            tmp = _mm256_permute2x128_si256(tmp, tmp, 0x08);
+            hdiff = _mm256_add_epi32(hdiff, tmp);
+            hdiff = _mm256_add_epi32(hdiff, prevadd);  // Add previous total
+
+            prevadd = _mm256_permutevar8x32_epi32(hdiff, last); // Broadcast running total
+
+            // Store
+            _mm256_storeu_si256((__m256i*)(out),   ldiff);
+            _mm256_storeu_si256((__m256i*)(out+8), hdiff);
+
+            // Increment
+            out += 16;
+            p1  += 16;
+            p2  += 16;
+        }
+
+        if (y > 0)
+        {
+            out = integral + y*integral_stride;
+
+            for (int x = 0; x < dst_w; x += 16)
+            {
+                _mm256_storeu_si256((__m256i*)out,
+                    _mm256_add_epi32(_mm256_loadu_si256((__m256i*)(out-integral_stride)),
+                                     _mm256_loadu_si256((__m256i*)(out))));
+
+                _mm256_storeu_si256((__m256i*)(out+8),
+                    _mm256_add_epi32(_mm256_loadu_si256((__m256i*)(out+8-integral_stride)),
+                                     _mm256_loadu_si256((__m256i*)(out+8))));
+
+                out += 16;
+            }
+        }
+    }
+}
+
+/*
+ * Same as accumulate_weights_scalar, 8 pixels at a time.  The float math
+ * is done in the same order as the scalar code, so the sums are identical.
+ * Pixels with diff >= diff_max add 0 to the sums.
+ */
+__attribute__((target("avx2")))
+static void accumulate_weights_avx2(const uint32_t        *integral_ptr1,
+                                    const uint32_t        *integral_ptr2,
+                                          int              n,
+                                    const uint8_t         *compare,
+                                          struct PixelSum *tmp_data,
+                                          int              count,
+                                    const float           *exptable,
+                                          float            weight_fact_table,
+                                          int              diff_max)
+{
+    const __m256  fact = _mm256_set1_ps(weight_fact_table);
+    const __m256i max  = _mm256_set1_epi32(diff_max);
+    int x = 0;
+
+    for (; x + 8 <= count; x += 8)
+    {
+        __m256i diff, mask, diffidx;
+        __m256  weight, pixel, lo, hi;
+
+        // Difference between patches
+        diff = _mm256_sub_epi32(_mm256_loadu_si256((__m256i*)(integral_ptr2 + x + n)),
+                                _mm256_loadu_si256((__m256i*)(integral_ptr2 + x)));
+        diff = _mm256_sub_epi32(diff, _mm256_loadu_si256((__m256i*)(integral_ptr1 + x + n)));
+        diff = _mm256_add_epi32(diff, _mm256_loadu_si256((__m256i*)(integral_ptr1 + x)));
+
+        mask = _mm256_cmpgt_epi32(max, diff);
+        if (_mm256_testz_si256(mask, mask))
+        {
+            continue;
+        }
+
+        // Look up weights, only where diff < diff_max
+        diffidx = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_cvtepi32_ps(diff), fact));
+        weight  = _mm256_mask_i32gather_ps(_mm256_setzero_ps(), exptable, diffidx,
+                                           _mm256_castsi256_ps(mask), 4);
+
+        pixel = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i*)(compare + x))));
+        pixel = _mm256_mul_ps(weight, pixel);
+
+        // Interleave into weight_sum, pixel_sum pairs and accumulate
+        lo = _mm256_unpacklo_ps(weight, pixel);
+        hi = _mm256_unpackhi_ps(weight, pixel);
+        _mm256_storeu_ps((float*)(tmp_data + x),
+                         _mm256_add_ps(_mm256_loadu_ps((float*)(tmp_data + x)),
+                                       _mm256_permute2f128_ps(lo, hi, 0x20)));
+        _mm256_storeu_ps((float*)(tmp_data + x + 4),
+                         _mm256_add_ps(_mm256_loadu_ps((float*)(tmp_data + x + 4)),
+                                       _mm256_permute2f128_ps(lo, hi, 0x31)));
+    }
+
+    for (; x < count; x++)
+    {
+        const int diff = (uint32_t)(integral_ptr2[x+n] - integral_ptr2[x] - integral_ptr1[x+n] + integral_ptr1[x]);
+
+        if (diff < diff_max)
+        {
+            const int diffidx = diff * weight_fact_table;
+            const float weight = exptable[diffidx];
+
+            tmp_data[x].weight_sum += weight;
+            tmp_data[x].pixel_sum  += weight * compare[x];
+        }
+    }
+}
+
 void nlmeans_init_x86(NLMeansFunctions *functions)
 {
-    if (av_get_cpu_flags() & AV_CPU_FLAG_SSE2)
+    const int cpu_flags = av_get_cpu_flags();
+
+    if (cpu_flags & AV_CPU_FLAG_AVX2)
+    {
+        functions->build_integral     = build_integral_avx2;
+        functions->accumulate_weights = accumulate_weights_avx2;
+        hb_log("NLMeans using AVX2 optimizations");
+    }
+    else if (cpu_flags & AV_CPU_FLAG_SSE2)
     {
         functions->build_integral = build_integral_sse2;
         hb_log("NLMeans using SSE2 optimizations");
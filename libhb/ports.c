@@ -873,12 +873,19 @@ static void attribute_align_thread hb_thread_func( void * _t )
  * function: the thread routine
  * arg:      argument of the routine
  * priority: HB_LOW_PRIORITY or HB_NORMAL_PRIORITY
+ *
+ * Returns NULL if the thread could not be started.
  ***********************************************************************/
 hb_thread_t * hb_thread_init( const char * name, void (* function)(void *),
                               void * arg, int priority )
 {
     hb_thread_t * t = calloc( sizeof( hb_thread_t ), 1 );
 
+    if( t == NULL )
+    {
+        hb_error( "hb_thread_init: out of memory starting \"%s\"", name );
+        return NULL;
+    }
     t->name     = strdup( name );
     t->function = function;
     t->arg      = arg;
@@ -893,8 +900,17 @@ hb_thread_t * hb_thread_init( const char * name, void (* function)(void *),
     resume_thread( t->thread );
 
 #elif USE_PTHREAD
-    pthread_create( &t->thread, NULL,
-                    (void * (*)( void * )) hb_thread_func, t );
+    int ret = pthread_create( &t->thread, NULL,
+                              (void * (*)( void * )) hb_thread_func, t );
+    if( ret != 0 )
+    {
+        hb_error( "hb_thread_init: can't start thread \"%s\", %s",
+                  name, strerror( ret ) );
+        hb_lock_close( &t->lock );
+        free( t->name );
+        free( t );
+        return NULL;
+    }
 
 //#elif defined( SYS_CYGWIN )
 //    t->thread = CreateThread( NULL, 0,
@@ -912,12 +928,18 @@ hb_thread_t * hb_thread_init( const char * name, void (* function)(void *),
 /************************************************************************
  * hb_thread_close()
  ************************************************************************
- * Joins the thread and frees memory.
+ * Joins the thread and frees memory.  Does nothing for a thread that
+ * hb_thread_init could not start.
  ***********************************************************************/
 void hb_thread_close( hb_thread_t ** _t )
 {
     hb_thread_t * t = *_t;
 
+    if( t == NULL )
+    {
+        return;
+    }
+
     /* Join the thread */
 #if defined( SYS_BEOS )
     long exit_value;
@@ -972,9 +994,11 @@ struct hb_lock_s
  * hb_lock_init()
  * hb_lock_close()
  * hb_lock()
+ * hb_trylock()
  * hb_unlock()
  ************************************************************************
  * Basic wrappers to OS-specific semaphore or mutex functions.
+ * hb_trylock returns 1 if the lock was taken, 0 if it is held elsewhere.
  ***********************************************************************/
 hb_lock_t * hb_lock_init()
 {
@@ -1030,6 +1054,17 @@ void hb_lock( hb_lock_t * l )
 #endif
 }
 
+int hb_trylock( hb_lock_t * l )
+{
+#if defined( SYS_BEOS )
+    return acquire_sem_etc( l->sem, 1, B_RELATIVE_TIMEOUT, 0 ) == B_OK;
+#elif USE_PTHREAD
+    return pthread_mutex_trylock( &l->mutex ) == 0;
+//#elif defined( SYS_CYGWIN )
+//    return WaitForSingleObject( l->mutex, 0 ) == WAIT_OBJECT_0;
+#endif
+}
+
 void hb_unlock( hb_lock_t * l )
 {
 #if defined( SYS_BEOS )
@@ -1180,6 +1215,68 @@ void hb_cond_broadcast( hb_cond_t * c )
 #endif
 }
 
+/************************************************************************
+ * Thread local storage
+ ***********************************************************************/
+struct hb_tls_s
+{
+#if USE_PTHREAD
+    pthread_key_t key;
+#endif
+};
+
+/************************************************************************
+ * hb_tls_init()
+ ************************************************************************
+ * destructor: called with the thread's value when a thread that has set
+ *             a non-NULL value exits. May be NULL.
+ ***********************************************************************/
+hb_tls_t * hb_tls_init( void (* destructor)(void *) )
+{
+    hb_tls_t * tls = calloc( sizeof( hb_tls_t ), 1 );
+
+#if USE_PTHREAD
+    if (pthread_key_create( &tls->key, destructor ))
+    {
+        free( tls );
+        return NULL;
+    }
+#endif
+
+    return tls;
+}
+
+void hb_tls_close( hb_tls_t ** _tls )
+{
+    hb_tls_t * tls = *_tls;
+
+    if (tls == NULL)
+    {
+        return;
+    }
+#if USE_PTHREAD
+    pthread_key_delete( tls->key );
+#endif
+    free( tls );
+    *_tls = NULL;
+}
+
+void * hb_tls_get( hb_tls_t * tls )
+{
+#if USE_PTHREAD
+    return pthread_getspecific( tls->key );
+#else
+    return NULL;
+#endif
+}
+
+void hb_tls_set( hb_tls_t * tls, void * value )
+{
+#if USE_PTHREAD
+    pthread_setspecific( tls->key, value );
+#endif
+}
+
 /************************************************************************
  * Network
  ***********************************************************************/
@@ -149,6 +149,7 @@ void          hb_yield(void);
 hb_lock_t * hb_lock_init();
 void        hb_lock_close( hb_lock_t ** );
 void        hb_lock( hb_lock_t * );
+int         hb_trylock( hb_lock_t * );
 void        hb_unlock( hb_lock_t * );
 
 /************************************************************************
@@ -163,6 +164,31 @@ void        hb_cond_signal( hb_cond_t * );
 void        hb_cond_broadcast( hb_cond_t * c );
 void        hb_cond_close( hb_cond_t ** );
 
+/************************************************************************
+ * Thread local storage
+ ***********************************************************************/
+typedef struct hb_tls_s hb_tls_t;
+
+hb_tls_t * hb_tls_init( void (* destructor)(void *) );
+void       hb_tls_close( hb_tls_t ** );
+void     * hb_tls_get( hb_tls_t * );
+void       hb_tls_set( hb_tls_t *, void * );
+
+/************************************************************************
+ * Atomics
+ *
+ * Thin wrappers around the gcc/clang __atomic builtins.  Loads acquire,
+ * stores release and read-modify-write operations are fully ordered.
+ ***********************************************************************/
+#define hb_atomic_load( p )      __atomic_load_n( (p), __ATOMIC_ACQUIRE )
+#define hb_atomic_store( p, v )  __atomic_store_n( (p), (v), __ATOMIC_RELEASE )
+#define hb_atomic_add( p, v )    __atomic_add_fetch( (p), (v), __ATOMIC_SEQ_CST )
+#define hb_atomic_sub( p, v )    __atomic_sub_fetch( (p), (v), __ATOMIC_SEQ_CST )
+#define hb_atomic_cas( p, e, d ) \
+    __atomic_compare_exchange_n( (p), (e), (d), 0, \
+                                 __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST )
+#define hb_atomic_fence()        __atomic_thread_fence( __ATOMIC_SEQ_CST )
+
 /************************************************************************
  * Network
  ***********************************************************************/
@@ -0,0 +1,354 @@
+/* preview.c
+
+   Copyright (c) 2003-2018 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*
+ * Preview store.
+ *
+ * Scan keeps the preview pictures of each title here, so hb_get_preview2
+ * does not touch the disk.  Pictures are stored as packed YUV 4:2:0
+ * planes, the way they used to be written to the temporary directory.
+ * Once the stored pictures use half of the memory limit, further pictures
+ * are deflated before they are stored.  Pictures that would take the
+ * store past the limit are appended to a file in the temporary directory
+ * instead, so every picture stays available.
+ */
+
+#include <errno.h>
+#include <zlib.h>
+
+#include "hb.h"
+
+#define PREVIEW_MEMORY_LIMIT (256 * 1024 * 1024)
+
+typedef struct
+{
+    int       title;
+    int       preview;
+    int       compressed;
+    size_t    size;         // size of the packed planes
+    size_t    data_size;    // size of data, less than size if compressed
+    uint8_t * data;         // NULL if the data is in the spill file
+    int64_t   offset;       // position of the data in the spill file
+} preview_t;
+
+struct hb_preview_store_s
+{
+    hb_lock_t * lock;
+    hb_list_t * list;
+    int64_t     limit;
+    int64_t     used;       // memory used by the data of the pictures
+
+    // Pictures that did not fit in the memory limit
+    char        filename[1024];
+    FILE      * file;
+};
+
+hb_preview_store_t * hb_preview_store_init( hb_handle_t * h )
+{
+    hb_preview_store_t * store = calloc( 1, sizeof( hb_preview_store_t ) );
+
+    if ( store == NULL )
+    {
+        return NULL;
+    }
+    store->lock  = hb_lock_init();
+    store->list  = hb_list_init();
+    store->limit = PREVIEW_MEMORY_LIMIT;
+    hb_get_tempory_filename( h, store->filename, "%d_previews",
+                             hb_get_instance_id( h ) );
+
+    return store;
+}
+
+static void preview_close( preview_t ** _p )
+{
+    preview_t * p = *_p;
+
+    if ( p != NULL )
+    {
+        free( p->data );
+        free( p );
+    }
+    *_p = NULL;
+}
+
+/* Called with the store lock held */
+static preview_t * preview_find( hb_preview_store_t * store,
+                                 int title, int preview )
+{
+    int ii;
+
+    for ( ii = 0; ii < hb_list_count( store->list ); ii++ )
+    {
+        preview_t * p = hb_list_item( store->list, ii );
+        if ( p->title == title && p->preview == preview )
+        {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+void hb_preview_store_clear( hb_preview_store_t * store )
+{
+    preview_t * p;
+
+    hb_lock( store->lock );
+    while ( ( p = hb_list_item( store->list, 0 ) ) != NULL )
+    {
+        hb_list_rem( store->list, p );
+        preview_close( &p );
+    }
+    store->used = 0;
+    if ( store->file != NULL )
+    {
+        fclose( store->file );
+        store->file = NULL;
+        unlink( store->filename );
+    }
+    hb_unlock( store->lock );
+}
+
+void hb_preview_store_close( hb_preview_store_t ** _store )
+{
+    hb_preview_store_t * store = *_store;
+
+    if ( store == NULL )
+    {
+        return;
+    }
+    hb_preview_store_clear( store );
+    hb_list_close( &store->list );
+    hb_lock_close( &store->lock );
+    free( store );
+    *_store = NULL;
+}
+
+void hb_preview_store_set_limit( hb_preview_store_t * store, int64_t limit )
+{
+    hb_lock( store->lock );
+    store->limit = limit;
+    hb_unlock( store->lock );
+}
+
+/* Moves the data of p to the end of the spill file.  Called with the
+ * store lock held. */
+static int preview_spill( hb_preview_store_t * store, preview_t * p )
+{
+    if ( store->file == NULL )
+    {
+        store->file = hb_fopen( store->filename, "w+b" );
+        if ( store->file == NULL )
+        {
+            hb_error( "hb_preview_store_put: can't create %s, %s",
+                      store->filename, strerror( errno ) );
+            return -1;
+        }
+    }
+    if ( fseeko( store->file, 0, SEEK_END ) != 0 ||
+         ( p->offset = ftello( store->file ) ) < 0 ||
+         fwrite( p->data, p->data_size, 1, store->file ) != 1 ||
+         fflush( store->file ) != 0 )
+    {
+        hb_error( "hb_preview_store_put: writing %s failed, %s",
+                  store->filename, strerror( errno ) );
+        return -1;
+    }
+    free( p->data );
+    p->data = NULL;
+
+    return 0;
+}
+
+/***********************************************************************
+ * hb_preview_store_put
+ ***********************************************************************
+ * Stores a copy of the picture in buf as preview 'preview' of title
+ * 'title', replacing any previous picture.
+ **********************************************************************/
+int hb_preview_store_put( hb_preview_store_t * store, int title, int preview,
+                          hb_buffer_t * buf )
+{
+    preview_t * p;
+    uint8_t   * dst;
+    int         pp, hh;
+
+    p = calloc( 1, sizeof( preview_t ) );
+    if ( p == NULL )
+    {
+        hb_error( "hb_preview_store_put: out of memory" );
+        return -1;
+    }
+    p->title   = title;
+    p->preview = preview;
+    for ( pp = 0; pp < 3; pp++ )
+    {
+        p->size += (size_t)buf->plane[pp].width * buf->plane[pp].height;
+    }
+    p->data = malloc( p->size );
+    if ( p->data == NULL )
+    {
+        hb_error( "hb_preview_store_put: out of memory" );
+        free( p );
+        return -1;
+    }
+
+    dst = p->data;
+    for ( pp = 0; pp < 3; pp++ )
+    {
+        uint8_t * src = buf->plane[pp].data;
+        for ( hh = 0; hh < buf->plane[pp].height; hh++ )
+        {
+            memcpy( dst, src, buf->plane[pp].width );
+            dst += buf->plane[pp].width;
+            src += buf->plane[pp].stride;
+        }
+    }
+    p->data_size = p->size;
+
+    hb_lock( store->lock );
+    int compress = store->used + (int64_t)p->size > store->limit / 2;
+    hb_unlock( store->lock );
+
+    if ( compress )
+    {
+        uLongf    size = compressBound( p->size );
+        uint8_t * data = malloc( size );
+
+        if ( data != NULL &&
+             compress2( data, &size, p->data, p->size, Z_BEST_SPEED ) == Z_OK &&
+             size < p->size )
+        {
+            free( p->data );
+            p->data       = data;
+            p->data_size  = size;
+            p->compressed = 1;
+        }
+        else
+        {
+            free( data );
+        }
+    }
+
+    hb_lock( store->lock );
+    preview_t * old = preview_find( store, title, preview );
+    if ( old != NULL )
+    {
+        // A replaced picture in the spill file is left there unused
+        hb_list_rem( store->list, old );
+        if ( old->data != NULL )
+        {
+            store->used -= old->data_size;
+        }
+        preview_close( &old );
+    }
+    if ( store->used + (int64_t)p->data_size > store->limit )
+    {
+        if ( preview_spill( store, p ) < 0 )
+        {
+            hb_unlock( store->lock );
+            preview_close( &p );
+            return -1;
+        }
+    }
+    else
+    {
+        store->used += p->data_size;
+    }
+    hb_list_add( store->list, p );
+    hb_unlock( store->lock );
+
+    return 0;
+}
+
+/***********************************************************************
+ * hb_preview_store_get
+ ***********************************************************************
+ * Copies preview 'preview' of title 'title' into buf, which must have
+ * the dimensions of the stored picture.
+ **********************************************************************/
+int hb_preview_store_get( hb_preview_store_t * store, int title, int preview,
+                          hb_buffer_t * buf )
+{
+    preview_t * p;
+    uint8_t   * data = NULL, * inflated = NULL, * src;
+    size_t      size = 0;
+    int         pp, hh, ret = -1;
+
+    for ( pp = 0; pp < 3; pp++ )
+    {
+        size += (size_t)buf->plane[pp].width * buf->plane[pp].height;
+    }
+
+    // A rescan may replace the preview, copy it out under the lock
+    hb_lock( store->lock );
+    p = preview_find( store, title, preview );
+    if ( p == NULL )
+    {
+        hb_error( "hb_preview_store_get: no preview %d for title %d",
+                  preview, title );
+        goto done;
+    }
+    if ( p->size != size )
+    {
+        hb_error( "hb_preview_store_get: preview %d of title %d has size %d, "
+                  "expected %d", preview, title, (int)p->size, (int)size );
+        goto done;
+    }
+
+    src = p->data;
+    if ( src == NULL )
+    {
+        data = malloc( p->data_size );
+        if ( data == NULL ||
+             fseeko( store->file, p->offset, SEEK_SET ) != 0 ||
+             fread( data, p->data_size, 1, store->file ) != 1 )
+        {
+            hb_error( "hb_preview_store_get: failed to read preview %d "
+                      "of title %d from %s", preview, title,
+                      store->filename );
+            goto done;
+        }
+        src = data;
+    }
+    if ( p->compressed )
+    {
+        uLongf out_size = size;
+
+        inflated = malloc( size );
+        if ( inflated == NULL ||
+             uncompress( inflated, &out_size, src, p->data_size ) != Z_OK ||
+             out_size != size )
+        {
+            hb_error( "hb_preview_store_get: failed to inflate preview %d "
+                      "of title %d", preview, title );
+            goto done;
+        }
+        src = inflated;
+    }
+
+    for ( pp = 0; pp < 3; pp++ )
+    {
+        uint8_t * dst = buf->plane[pp].data;
+        for ( hh = 0; hh < buf->plane[pp].height; hh++ )
+        {
+            memcpy( dst, src, buf->plane[pp].width );
+            src += buf->plane[pp].width;
+            dst += buf->plane[pp].stride;
+        }
+    }
+    ret = 0;
+
+done:
+    hb_unlock( store->lock );
+    free( data );
+    free( inflated );
+
+    return ret;
+}
@@ -87,6 +87,36 @@ static int64_t chapter_end_pts(hb_title_t * title, int chapter_end )
     return duration;
 }
 
+/*
+ * Foreign audio search only looks at subtitle packets, so the demuxer
+ * can skip everything else.  Video is still read when it is decoded
+ * or when its timestamps are needed to find the end chapter.
+ */
+static void select_scan_streams( hb_work_private_t * r )
+{
+    hb_job_t      * job = r->job;
+    hb_subtitle_t * subtitle;
+    int           * ids;
+    int             ii, count = 0;
+
+    ids = malloc((hb_list_count(job->list_subtitle) + 1) * sizeof(int));
+    if (ids == NULL)
+    {
+        return;
+    }
+    for (ii = 0; (subtitle = hb_list_item(job->list_subtitle, ii)); ii++)
+    {
+        ids[count++] = subtitle->id;
+    }
+    if (job->fifo_mpeg2 != NULL ||
+        job->chapter_end < hb_list_count(job->list_chapter))
+    {
+        ids[count++] = r->title->video_id;
+    }
+    hb_stream_set_ids(r->stream, ids, count);
+    free(ids);
+}
+
 static int hb_reader_open( hb_work_private_t * r )
 {
     if ( r->title->type == HB_BD_TYPE )
@@ -227,6 +257,10 @@ static int hb_reader_open( hb_work_private_t * r )
             r->duration -= chapter_end_pts(r->job->title,
                                            r->job->chapter_start - 1);
         }
+        if (r->job->indepth_scan)
+        {
+            select_scan_streams(r);
+        }
     }
     else
     {
@@ -420,7 +454,16 @@ static void reader_send_eof( hb_work_private_t * r )
     int ii;
 
     // send eof buffers downstream to decoders to signal we're done.
-    push_buf(r, r->job->fifo_mpeg2, hb_buffer_eof_init());
+    // Subtitle search may run without a video decoder, in which case
+    // sync gets the video eof directly.
+    if (r->job->fifo_mpeg2 != NULL)
+    {
+        push_buf(r, r->job->fifo_mpeg2, hb_buffer_eof_init());
+    }
+    else
+    {
+        push_buf(r, r->job->fifo_raw, hb_buffer_eof_init());
+    }
 
     hb_audio_t *audio;
     for (ii = 0; (audio = hb_list_item(r->job->list_audio, ii)); ++ii)
@@ -614,7 +657,7 @@ static void UpdateState( hb_work_private_t  * r )
         r->st_first = now;
     }
 
-    hb_get_state2(r->job->h, &state);
+    hb_get_job_state(r->job, &state);
 #define p state.param.working
     state.state = HB_STATE_WORKING;
     p.progress  = (float) r->last_pts / (float) r->duration;
@@ -646,7 +689,7 @@ static void UpdateState( hb_work_private_t  * r )
     }
 #undef p
 
-    hb_set_state( r->job->h, &state );
+    hb_set_job_state( r->job, &state );
 }
 
 /***********************************************************************
@@ -664,7 +707,8 @@ static hb_fifo_t ** GetFifoForId( hb_work_private_t * r, int id )
 
     if (id == title->video_id)
     {
-        if (job->indepth_scan && r->start_found)
+        if (job->fifo_mpeg2 == NULL ||
+            (job->indepth_scan && r->start_found))
         {
             /*
              * Ditch the video here during the indepth scan until
@@ -7,8 +7,11 @@
    For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
  */
 
+#include <assert.h>
+
 #include "hb.h"
 #include "hbffmpeg.h"
+#include "rendersub.h"
 #include <ass/ass.h>
 
 #define ABS(a) ((a) > 0 ? (a) : (-(a)))
@@ -21,6 +24,7 @@ struct hb_filter_private_s
     struct SwsContext * sws;
     int                 sws_width;
     int                 sws_height;
+    BlendFunctions      functions;
 
     // VOBSUB
     hb_list_t         * sub_list; // List of active subs
@@ -101,15 +105,81 @@ hb_filter_object_t hb_filter_render_sub =
     .close         = hb_rendersub_close,
 };
 
-static void blend( hb_buffer_t *dst, hb_buffer_t *src, int left, int top )
+static void blend_row_c( uint8_t *dst, const uint8_t *src,
+                         const uint8_t *alpha, int alpha_shift, int width )
+{
+    int xx, a;
+
+    for( xx = 0; xx < width; xx++ )
+    {
+        a = alpha[xx << alpha_shift];
+        dst[xx] = ( (uint16_t)dst[xx] * ( 255 - a ) +
+                    (uint16_t)src[xx] * a ) / 255;
+    }
+}
+
+/*
+ * Shrink [x0, x1) x [y0, y1) to the part of the overlay that has
+ * non-zero alpha.  Returns 0 if the overlay is fully transparent there.
+ * Samples with zero alpha are left unchanged by the blend, so skipping
+ * them does not change the result.
+ */
+static int blend_bounds( hb_buffer_t *src, int *x0, int *y0,
+                         int *x1, int *y1 )
 {
     int xx, yy;
+    int left = *x1, right = *x0, top = -1, bottom = -1;
+    uint8_t *a_in;
+
+    for( yy = *y0; yy < *y1; yy++ )
+    {
+        a_in = src->plane[3].data + yy * src->plane[3].stride;
+        for( xx = *x0; xx < *x1 && !a_in[xx]; xx++ );
+        if( xx == *x1 )
+        {
+            // Transparent row
+            continue;
+        }
+        if( xx < left )
+        {
+            left = xx;
+        }
+        for( xx = *x1 - 1; !a_in[xx]; xx-- );
+        if( xx + 1 > right )
+        {
+            right = xx + 1;
+        }
+        if( top < 0 )
+        {
+            top = yy;
+        }
+        bottom = yy + 1;
+    }
+    if( top < 0 )
+    {
+        return 0;
+    }
+    *x0 = left;
+    *x1 = right;
+    *y0 = top;
+    *y1 = bottom;
+    return 1;
+}
+
+static void blend( BlendFunctions *functions, hb_buffer_t *dst,
+                   hb_buffer_t *src, int left, int top )
+{
+    int yy;
     int ww, hh;
     int x0, y0;
     uint8_t *y_in, *y_out;
     uint8_t *u_in, *u_out;
     uint8_t *v_in, *v_out;
-    uint8_t *a_in, alpha;
+    uint8_t *a_in;
+
+    // Subtitles are blended in place
+    hb_buffer_make_writable( dst );
+    assert( hb_buffer_is_writable( dst ) );
 
     x0 = y0 = 0;
     if( left < 0 )
@@ -131,25 +201,7 @@ static void blend( hb_buffer_t *dst, hb_buffer_t *src, int left, int top )
     {
         hh = dst->f.height - top + y0;
     }
-    // Blend luma
-    for( yy = y0; yy < hh; yy++ )
-    {
-        y_in   = src->plane[0].data + yy * src->plane[0].stride;
-        y_out   = dst->plane[0].data + ( yy + top ) * dst->plane[0].stride;
-        a_in = src->plane[3].data + yy * src->plane[3].stride;
-        for( xx = x0; xx < ww; xx++ )
-        {
-            alpha = a_in[xx];
-            /*
-             * Merge the luminance and alpha with the picture
-             */
-            y_out[left + xx] =
-                ( (uint16_t)y_out[left + xx] * ( 255 - alpha ) +
-                     (uint16_t)y_in[xx] * alpha ) / 255;
-        }
-    }
 
-    // Blend U & V
     // Assumes source and dest are the same PIX_FMT
     int hshift = 0;
     int wshift = 0;
@@ -158,7 +210,49 @@ static void blend( hb_buffer_t *dst, hb_buffer_t *src, int left, int top )
     if( dst->plane[1].width < dst->plane[0].width )
         wshift = 1;
 
-    for( yy = y0 >> hshift; yy < hh >> hshift; yy++ )
+    // Visible chroma samples.  When left or top is odd the first one is
+    // rounded up, so that it does not land left of or above the frame.
+    int cx0 = ( x0 + ( 1 << wshift ) - 1 ) >> wshift, cx1 = ww >> wshift;
+    int cy0 = ( y0 + ( 1 << hshift ) - 1 ) >> hshift, cy1 = hh >> hshift;
+
+    // Only blend the part of the overlay that is not fully transparent.
+    // The bounds cover the alpha samples used by both luma and chroma.
+    int bx0 = x0, bx1 = ww;
+    int by0 = y0, by1 = hh;
+    if( bx0 >= bx1 || by0 >= by1 ||
+        !blend_bounds( src, &bx0, &by0, &bx1, &by1 ) )
+    {
+        return;
+    }
+    x0 = MAX( x0, bx0 );
+    y0 = MAX( y0, by0 );
+    ww = MIN( ww, bx1 );
+    hh = MIN( hh, by1 );
+    cx0 = MAX( cx0, ( bx0 + ( 1 << wshift ) - 1 ) >> wshift );
+    cy0 = MAX( cy0, ( by0 + ( 1 << hshift ) - 1 ) >> hshift );
+    cx1 = MIN( cx1, ( ( bx1 - 1 ) >> wshift ) + 1 );
+    cy1 = MIN( cy1, ( ( by1 - 1 ) >> hshift ) + 1 );
+
+    // Blend luma
+    for( yy = y0; yy < hh && x0 < ww; yy++ )
+    {
+        y_in   = src->plane[0].data + yy * src->plane[0].stride;
+        y_out   = dst->plane[0].data + ( yy + top ) * dst->plane[0].stride;
+        a_in = src->plane[3].data + yy * src->plane[3].stride;
+        /*
+         * Merge the luminance and alpha with the picture
+         */
+        functions->blend_row( y_out + left + x0, y_in + x0, a_in + x0,
+                              0, ww - x0 );
+    }
+
+    // Blend U & V
+    if( cx1 <= cx0 )
+    {
+        return;
+    }
+
+    for( yy = cy0; yy < cy1; yy++ )
     {
         u_in = src->plane[1].data + yy * src->plane[1].stride;
         u_out = dst->plane[1].data + ( yy + ( top >> hshift ) ) * dst->plane[1].stride;
@@ -166,20 +260,13 @@ static void blend( hb_buffer_t *dst, hb_buffer_t *src, int left, int top )
         v_out = dst->plane[2].data + ( yy + ( top >> hshift ) ) * dst->plane[2].stride;
         a_in = src->plane[3].data + ( yy << hshift ) * src->plane[3].stride;
 
-        for( xx = x0 >> wshift; xx < ww >> wshift; xx++ )
-        {
-            alpha = a_in[xx << wshift];
+        // Blend averge U and alpha
+        functions->blend_row( u_out + ( left >> wshift ) + cx0, u_in + cx0,
+                              a_in + ( cx0 << wshift ), wshift, cx1 - cx0 );
 
-            // Blend averge U and alpha
-            u_out[(left >> wshift) + xx] =
-                ( (uint16_t)u_out[(left >> wshift) + xx] * ( 255 - alpha ) +
-                  (uint16_t)u_in[xx] * alpha ) / 255;
-
-            // Blend V and alpha
-            v_out[(left >> wshift) + xx] =
-                ( (uint16_t)v_out[(left >> wshift) + xx] * ( 255 - alpha ) +
-                  (uint16_t)v_in[xx] * alpha ) / 255;
-        }
+        // Blend V and alpha
+        functions->blend_row( v_out + ( left >> wshift ) + cx0, v_in + cx0,
+                              a_in + ( cx0 << wshift ), wshift, cx1 - cx0 );
     }
 }
 
@@ -187,7 +274,7 @@ static void blend( hb_buffer_t *dst, hb_buffer_t *src, int left, int top )
 // as the original title diminsions
 static void ApplySub( hb_filter_private_t * pv, hb_buffer_t * buf, hb_buffer_t * sub )
 {
-    blend( buf, sub, sub->f.x, sub->f.y );
+    blend( &pv->functions, buf, sub, sub->f.x, sub->f.y );
 }
 
 static hb_buffer_t * ScaleSubtitle(hb_filter_private_t *pv,
@@ -940,6 +1027,11 @@ static int hb_rendersub_init( hb_filter_object_t * filter,
     hb_subtitle_t *subtitle;
     int ii;
 
+    pv->functions.blend_row = blend_row_c;
+#if defined(ARCH_X86)
+    rendersub_init_x86(&pv->functions);
+#endif
+
     // Find the subtitle we need
     for( ii = 0; ii < hb_list_count(init->job->list_subtitle); ii++ )
     {
@@ -0,0 +1,22 @@
+/* rendersub.h
+
+   Copyright (c) 2003-2018 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+typedef struct
+{
+    // Blends 'width' samples of src over dst.  The alpha for sample xx
+    // is alpha[xx << alpha_shift].  Results must match blend_row_c
+    // exactly: (dst * (255 - a) + src * a) / 255, rounded down.
+    void (*blend_row)(uint8_t       *dst,
+                      const uint8_t *src,
+                      const uint8_t *alpha,
+                      int            alpha_shift,
+                      int            width);
+} BlendFunctions;
+
+void rendersub_init_x86(BlendFunctions *functions);
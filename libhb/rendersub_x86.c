@@ -0,0 +1,146 @@
+/* rendersub_x86.c
+
+   Copyright (c) 2003-2018 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#include "hb.h"     // needed for ARCH_X86
+
+#if defined(ARCH_X86)
+
+#include <emmintrin.h>
+#include <immintrin.h>
+
+#include "libavutil/cpu.h"
+#include "rendersub.h"
+
+/*
+ * The blend is computed in 16 bit lanes:
+ *     x = dst * (255 - a) + src * a         (at most 255 * 255)
+ *     x / 255 = (x + 1 + (x >> 8)) >> 8     (exact for 0 <= x <= 65025)
+ * which gives the same result as the scalar blend_row_c.
+ */
+
+static void blend_row_sse2(uint8_t       *dst,
+                           const uint8_t *src,
+                           const uint8_t *alpha,
+                           int            alpha_shift,
+                           int            width)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one  = _mm_set1_epi16(1);
+    const __m128i c255 = _mm_set1_epi16(255);
+    int xx;
+
+    for (xx = 0; xx + 16 <= width; xx += 16)
+    {
+        __m128i d  = _mm_loadu_si128((const __m128i*)(dst + xx));
+        __m128i s  = _mm_loadu_si128((const __m128i*)(src + xx));
+        __m128i dl = _mm_unpacklo_epi8(d, zero);
+        __m128i dh = _mm_unpackhi_epi8(d, zero);
+        __m128i sl = _mm_unpacklo_epi8(s, zero);
+        __m128i sh = _mm_unpackhi_epi8(s, zero);
+        __m128i al, ah;
+
+        if (alpha_shift)
+        {
+            // Use every other alpha sample
+            const uint8_t *a = alpha + (xx << 1);
+            al = _mm_and_si128(_mm_loadu_si128((const __m128i*)a), c255);
+            ah = _mm_and_si128(_mm_loadu_si128((const __m128i*)(a + 16)),
+                               c255);
+        }
+        else
+        {
+            __m128i a = _mm_loadu_si128((const __m128i*)(alpha + xx));
+            al = _mm_unpacklo_epi8(a, zero);
+            ah = _mm_unpackhi_epi8(a, zero);
+        }
+
+        __m128i xl = _mm_add_epi16(_mm_mullo_epi16(dl, _mm_sub_epi16(c255, al)),
+                                   _mm_mullo_epi16(sl, al));
+        __m128i xh = _mm_add_epi16(_mm_mullo_epi16(dh, _mm_sub_epi16(c255, ah)),
+                                   _mm_mullo_epi16(sh, ah));
+        xl = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(xl, one),
+                                          _mm_srli_epi16(xl, 8)), 8);
+        xh = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(xh, one),
+                                          _mm_srli_epi16(xh, 8)), 8);
+
+        _mm_storeu_si128((__m128i*)(dst + xx), _mm_packus_epi16(xl, xh));
+    }
+    for (; xx < width; xx++)
+    {
+        int a = alpha[xx << alpha_shift];
+        dst[xx] = (dst[xx] * (255 - a) + src[xx] * a) / 255;
+    }
+}
+
+__attribute__((target("avx2")))
+static void blend_row_avx2(uint8_t       *dst,
+                           const uint8_t *src,
+                           const uint8_t *alpha,
+                           int            alpha_shift,
+                           int            width)
+{
+    const __m256i one  = _mm256_set1_epi16(1);
+    const __m256i c255 = _mm256_set1_epi16(255);
+    int xx;
+
+    for (xx = 0; xx + 16 <= width; xx += 16)
+    {
+        __m256i d = _mm256_cvtepu8_epi16(
+                        _mm_loadu_si128((const __m128i*)(dst + xx)));
+        __m256i s = _mm256_cvtepu8_epi16(
+                        _mm_loadu_si128((const __m128i*)(src + xx)));
+        __m256i a;
+
+        if (alpha_shift)
+        {
+            // Use every other alpha sample
+            a = _mm256_and_si256(
+                    _mm256_loadu_si256((const __m256i*)(alpha + (xx << 1))),
+                    c255);
+        }
+        else
+        {
+            a = _mm256_cvtepu8_epi16(
+                    _mm_loadu_si128((const __m128i*)(alpha + xx)));
+        }
+
+        __m256i x = _mm256_add_epi16(
+                        _mm256_mullo_epi16(d, _mm256_sub_epi16(c255, a)),
+                        _mm256_mullo_epi16(s, a));
+        x = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(x, one),
+                                               _mm256_srli_epi16(x, 8)), 8);
+
+        // packus works within 128 bit lanes, gather the two low halves
+        x = _mm256_permute4x64_epi64(_mm256_packus_epi16(x, x), 0x08);
+        _mm_storeu_si128((__m128i*)(dst + xx), _mm256_castsi256_si128(x));
+    }
+    for (; xx < width; xx++)
+    {
+        int a = alpha[xx << alpha_shift];
+        dst[xx] = (dst[xx] * (255 - a) + src[xx] * a) / 255;
+    }
+}
+
+void rendersub_init_x86(BlendFunctions *functions)
+{
+    int cpu_flags = av_get_cpu_flags();
+
+    if (cpu_flags & AV_CPU_FLAG_AVX2)
+    {
+        functions->blend_row = blend_row_avx2;
+        hb_log("rendersub: using AVX2 optimizations");
+    }
+    else if (cpu_flags & AV_CPU_FLAG_SSE2)
+    {
+        functions->blend_row = blend_row_sse2;
+        hb_log("rendersub: using SSE2 optimizations");
+    }
+}
+
+#endif // ARCH_X86
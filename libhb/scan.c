@@ -10,10 +10,13 @@
 #include "hb.h"
 #include "hbffmpeg.h"
 
+typedef struct scan_pool_s scan_pool_t;
+
 typedef struct
 {
     hb_handle_t  * h;
     volatile int * die;
+    scan_pool_t  * pool;
 
     char         * path;
     int            title_index;
@@ -30,9 +33,39 @@ typedef struct
     uint64_t       min_title_duration;
 } hb_scan_t;
 
+/* Titles are scanned by a pool of workers. Each worker has a copy of
+ * the hb_scan_t with its own BD or DVD handle, takes the next title
+ * index from the pool and stores its result at that index, so the
+ * title set comes out in the same order as a sequential scan. */
+struct scan_pool_s
+{
+    hb_lock_t    * lock;
+    int            next;        // Next title index to hand out
+    int            count;       // Number of titles
+    int            done;        // Titles finished
+    float          progress;    // Last reported progress
+    void        (* update)( hb_scan_t *, int );
+
+    hb_title_t  ** titles;      // Result of each title
+    int          * npreviews;   // Previews decoded for each title
+};
+
+typedef struct
+{
+    hb_scan_t      scan;
+    void        (* func)( hb_scan_t *, int );
+} scan_worker_t;
+
 #define PREVIEW_READ_THRESH (200)
+#define SCAN_THREADS_MAX (8)
 
 static void ScanFunc( void * );
+static void scan_pool_run( hb_scan_t *, int count,
+                           void (* func)( hb_scan_t *, int ),
+                           void (* update)( hb_scan_t *, int ) );
+static void ScanDVDTitle( hb_scan_t *, int index );
+static void ScanBatchTitle( hb_scan_t *, int index );
+static void ScanPreviews( hb_scan_t *, int index );
 static int  DecodePreviews( hb_scan_t *, hb_title_t * title, int flush );
 static void LookForAudio(hb_scan_t *scan, hb_title_t *title, hb_buffer_t *b);
 static int  AllAudioOK( hb_title_t * title );
@@ -40,7 +73,8 @@ static void UpdateState1(hb_scan_t *scan, int title);
 static void UpdateState2(hb_scan_t *scan, int title);
 static void UpdateState3(hb_scan_t *scan, int preview);
 
-static const char *aspect_to_string(hb_rational_t *dar)
+// Titles are scanned in parallel, so the string goes in the caller's buffer
+static const char *aspect_to_string(hb_rational_t *dar, char arstr[32])
 {
     double aspect = (double)dar->num / dar->den;
     switch ( (int)(aspect * 9.) )
@@ -48,11 +82,10 @@ static const char *aspect_to_string(hb_rational_t *dar)
         case 9 * 4 / 3:    return "4:3";
         case 9 * 16 / 9:   return "16:9";
     }
-    static char arstr[32];
     if (aspect >= 1)
-        sprintf(arstr, "%.2f:1", aspect);
+        snprintf(arstr, 32, "%.2f:1", aspect);
     else
-        sprintf(arstr, "1:%.2f", 1. / aspect );
+        snprintf(arstr, 32, "1:%.2f", 1. / aspect );
     return arstr;
 }
 
@@ -92,13 +125,18 @@ static void ScanFunc( void * _data )
 {
     hb_scan_t  * data = (hb_scan_t *) _data;
     hb_title_t * title;
-    int          i;
+    scan_pool_t  pool;
+    int          i, count;
     int          feature = 0;
 
     data->bd = NULL;
     data->dvd = NULL;
     data->stream = NULL;
 
+    memset( &pool, 0, sizeof( pool ) );
+    pool.lock  = hb_lock_init();
+    data->pool = &pool;
+
     /* Try to open the path as a DVD. If it fails, try as a file */
     if( ( data->bd = hb_bd_init( data->h, data->path ) ) )
     {
@@ -113,7 +151,8 @@ static void ScanFunc( void * _data )
         }
         else
         {
-            /* Scan all titles */
+            /* Scan all titles. This only reads the playlists that
+             * hb_bd_init loaded, so it is not worth a worker pool. */
             for( i = 0; i < hb_bd_title_count( data->bd ); i++ )
             {
                 UpdateState1(data, i + 1);
@@ -139,13 +178,15 @@ static void ScanFunc( void * _data )
         else
         {
             /* Scan all titles */
-            for( i = 0; i < hb_dvd_title_count( data->dvd ); i++ )
+            count = hb_dvd_title_count( data->dvd );
+            pool.titles = calloc( count, sizeof( hb_title_t * ) );
+            scan_pool_run( data, count, ScanDVDTitle, UpdateState1 );
+            for( i = 0; i < count; i++ )
             {
-                UpdateState1(data, i + 1);
-                hb_list_add( data->title_set->list_title,
-                             hb_dvd_title_scan( data->dvd,
-                            i + 1, data->min_title_duration ) );
+                hb_list_add( data->title_set->list_title, pool.titles[i] );
             }
+            free( pool.titles );
+            pool.titles = NULL;
             feature = hb_dvd_main_feature( data->dvd,
                                            data->title_set->list_title );
         }
@@ -164,18 +205,18 @@ static void ScanFunc( void * _data )
         else
         {
             /* Scan all titles */
-            for( i = 0; i < hb_batch_title_count( data->batch ); i++ )
+            count = hb_batch_title_count( data->batch );
+            pool.titles = calloc( count, sizeof( hb_title_t * ) );
+            scan_pool_run( data, count, ScanBatchTitle, UpdateState1 );
+            for( i = 0; i < count; i++ )
             {
-                hb_title_t * title;
-
-                UpdateState1(data, i + 1);
-                title = hb_batch_title_scan(data->batch, i + 1,
-                                            data->min_title_duration);
-                if ( title != NULL )
+                if ( pool.titles[i] != NULL )
                 {
-                    hb_list_add( data->title_set->list_title, title );
+                    hb_list_add( data->title_set->list_title, pool.titles[i] );
                 }
             }
+            free( pool.titles );
+            pool.titles = NULL;
         }
     }
     else
@@ -204,30 +245,28 @@ static void ScanFunc( void * _data )
         }
     }
 
-    for( i = 0; i < hb_list_count( data->title_set->list_title ); )
+    /* Decode previews */
+    /* this will also detect more AC3 / DTS information */
+    count = hb_list_count( data->title_set->list_title );
+    pool.titles    = calloc( count, sizeof( hb_title_t * ) );
+    pool.npreviews = calloc( count, sizeof( int ) );
+    for( i = 0; i < count; i++ )
+    {
+        pool.titles[i] = hb_list_item( data->title_set->list_title, i );
+    }
+    scan_pool_run( data, count, ScanPreviews, UpdateState2 );
+    if ( *data->die )
+    {
+        goto finish;
+    }
+
+    for( i = 0; i < count; i++ )
     {
         int j, npreviews;
         hb_audio_t * audio;
 
-        if ( *data->die )
-        {
-            goto finish;
-        }
-        title = hb_list_item( data->title_set->list_title, i );
-
-        UpdateState2(data, i + 1);
-
-        /* Decode previews */
-        /* this will also detect more AC3 / DTS information */
-        npreviews = DecodePreviews( data, title, 1 );
-        if (npreviews < 2)
-        {
-            // Try harder to get some valid frames
-            // Allow libav to return "corrupt" frames
-            hb_log("scan: Too few previews (%d), trying harder", npreviews);
-            title->flags |= HBTF_NO_IDR;
-            npreviews = DecodePreviews( data, title, 0 );
-        }
+        title = pool.titles[i];
+        npreviews = pool.npreviews[i];
         if (npreviews == 0)
         {
             /* TODO: free things */
@@ -282,7 +321,6 @@ static void ScanFunc( void * _data )
                 subtitle->height = title->geometry.height;
             }
         }
-        i++;
     }
 
     data->title_set->feature = feature;
@@ -321,12 +359,158 @@ finish:
     {
         hb_batch_close( &data->batch );
     }
+    free( pool.titles );
+    free( pool.npreviews );
+    hb_lock_close( &pool.lock );
     free( data->path );
     free( data );
     _data = NULL;
     hb_buffer_pool_free();
 }
 
+/***********************************************************************
+ * scan_pool_next
+ ***********************************************************************
+ * Hands out the next title index of the pool, or -1 when all titles
+ * are taken or the scan was canceled.
+ **********************************************************************/
+static int scan_pool_next( hb_scan_t * data )
+{
+    scan_pool_t * pool = data->pool;
+    int           index = -1;
+
+    hb_lock( pool->lock );
+    if ( !*data->die && pool->next < pool->count )
+    {
+        index = pool->next++;
+        pool->update( data, index + 1 );
+    }
+    hb_unlock( pool->lock );
+
+    return index;
+}
+
+static void scan_worker_func( void * _w )
+{
+    scan_worker_t * w = _w;
+    int             index;
+
+    while ( ( index = scan_pool_next( &w->scan ) ) >= 0 )
+    {
+        w->func( &w->scan, index );
+
+        hb_lock( w->scan.pool->lock );
+        w->scan.pool->done++;
+        hb_unlock( w->scan.pool->lock );
+    }
+}
+
+/***********************************************************************
+ * scan_pool_run
+ ***********************************************************************
+ * Runs func on each of count titles with up to SCAN_THREADS_MAX
+ * workers. The first worker runs in the scan thread and uses the
+ * source handles of data, the others open their own BD or DVD handle
+ * since those can only read one place at a time.
+ **********************************************************************/
+static void scan_pool_run( hb_scan_t * data, int count,
+                           void (* func)( hb_scan_t *, int ),
+                           void (* update)( hb_scan_t *, int ) )
+{
+    scan_pool_t    * pool = data->pool;
+    scan_worker_t  * workers;
+    hb_thread_t   ** threads;
+    int              ii, thread_count;
+
+    pool->next     = 0;
+    pool->count    = count;
+    pool->done     = 0;
+    pool->progress = 0;
+    pool->update   = update;
+
+    thread_count = MIN( MIN( hb_get_cpu_count(), SCAN_THREADS_MAX ), count );
+    thread_count = MAX( thread_count, 1 );
+
+    workers = calloc( thread_count, sizeof( scan_worker_t ) );
+    threads = calloc( thread_count, sizeof( hb_thread_t * ) );
+    for ( ii = 0; ii < thread_count; ii++ )
+    {
+        workers[ii].scan = *data;
+        workers[ii].func = func;
+        if ( ii == 0 )
+        {
+            continue;
+        }
+        if ( data->bd != NULL )
+        {
+            workers[ii].scan.bd = hb_bd_init( data->h, data->path );
+            if ( workers[ii].scan.bd == NULL )
+                break;
+        }
+        else if ( data->dvd != NULL )
+        {
+            workers[ii].scan.dvd = hb_dvd_init( data->h, data->path );
+            if ( workers[ii].scan.dvd == NULL )
+                break;
+        }
+    }
+    thread_count = ii;
+    if ( thread_count > 1 )
+    {
+        hb_log( "scan: %d titles, %d scan threads", count, thread_count );
+    }
+
+    for ( ii = 1; ii < thread_count; ii++ )
+    {
+        threads[ii] = hb_thread_init( "scan", scan_worker_func, &workers[ii],
+                                      HB_NORMAL_PRIORITY );
+    }
+    scan_worker_func( &workers[0] );
+    for ( ii = 1; ii < thread_count; ii++ )
+    {
+        hb_thread_close( &threads[ii] );
+        if ( workers[ii].scan.bd != NULL )
+        {
+            hb_bd_close( &workers[ii].scan.bd );
+        }
+        if ( workers[ii].scan.dvd != NULL )
+        {
+            hb_dvd_close( &workers[ii].scan.dvd );
+        }
+    }
+    free( threads );
+    free( workers );
+}
+
+static void ScanDVDTitle( hb_scan_t * data, int index )
+{
+    data->pool->titles[index] = hb_dvd_title_scan( data->dvd, index + 1,
+                                                   data->min_title_duration );
+}
+
+static void ScanBatchTitle( hb_scan_t * data, int index )
+{
+    data->pool->titles[index] = hb_batch_title_scan( data->batch, index + 1,
+                                                     data->min_title_duration );
+}
+
+static void ScanPreviews( hb_scan_t * data, int index )
+{
+    hb_title_t * title = data->pool->titles[index];
+    int          npreviews;
+
+    npreviews = DecodePreviews( data, title, 1 );
+    if (npreviews < 2 && !*data->die)
+    {
+        // Try harder to get some valid frames
+        // Allow libav to return "corrupt" frames
+        hb_log("scan: Too few previews (%d), trying harder", npreviews);
+        title->flags |= HBTF_NO_IDR;
+        npreviews = DecodePreviews( data, title, 0 );
+    }
+    data->pool->npreviews[index] = npreviews;
+}
+
 // -----------------------------------------------
 // stuff related to cropping
 
@@ -554,6 +738,7 @@ static int DecodePreviews( hb_scan_t * data, hb_title_t * title, int flush )
     hb_stream_t      * stream = NULL;
     info_list_t      * info_list;
     int                abort_audio = 0;
+    char               arstr[32];
 
     info_list = calloc(data->preview_count+1, sizeof(*info_list));
     crop_record_t *crops = crop_record_init( data->preview_count );
@@ -1060,7 +1245,7 @@ skip_preview:
                 npreviews, title->geometry.width, title->geometry.height,
                 (float)title->vrate.num / title->vrate.den,
                 title->crop[0], title->crop[1], title->crop[2], title->crop[3],
-                aspect_to_string(&title->dar),
+                aspect_to_string(&title->dar, arstr),
                 title->geometry.par.num, title->geometry.par.den);
 
         if (title->video_decode_support != HB_DECODE_SUPPORT_SW)
@@ -1452,9 +1637,11 @@ static void UpdateState2(hb_scan_t *scan, int title)
     p.preview_cur = 1;
     p.preview_count = scan->preview_count;
     if (scan->title_index)
-        p.progress = (float)(p.title_cur - 1) / p.title_count;
+        p.progress = (float)scan->pool->done / p.title_count;
     else
-        p.progress = 0.5 + 0.5 * (float)(p.title_cur - 1) / p.title_count;
+        p.progress = 0.5 + 0.5 * (float)scan->pool->done / p.title_count;
+    p.progress = MAX(p.progress, scan->pool->progress);
+    scan->pool->progress = p.progress;
 #undef p
 
     hb_set_state(scan->h, &state);
@@ -1464,15 +1651,22 @@ static void UpdateState3(hb_scan_t *scan, int preview)
 {
     hb_state_t state;
 
+    // Titles decode previews in parallel, so progress counts the
+    // finished titles plus the current one of the calling worker and
+    // never goes backwards.
+    hb_lock(scan->pool->lock);
     hb_get_state2(scan->h, &state);
 #define p state.param.scanning
     p.preview_cur = preview;
     p.preview_count = scan->preview_count;
     if (scan->title_index)
-        p.progress = ((float)p.title_cur - 1 + ((float)p.preview_cur / p.preview_count)) / p.title_count;
+        p.progress = ((float)scan->pool->done + ((float)p.preview_cur / p.preview_count)) / p.title_count;
     else
-        p.progress = 0.5 + 0.5 * ((float)p.title_cur - 1 + ((float)p.preview_cur / p.preview_count)) / p.title_count;
+        p.progress = 0.5 + 0.5 * ((float)scan->pool->done + ((float)p.preview_cur / p.preview_count)) / p.title_count;
+    p.progress = MAX(p.progress, scan->pool->progress);
+    scan->pool->progress = p.progress;
 #undef p
 
     hb_set_state(scan->h, &state);
+    hb_unlock(scan->pool->lock);
 }
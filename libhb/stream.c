@@ -14,6 +14,7 @@
 #include "hb.h"
 #include "hbffmpeg.h"
 #include "lang.h"
+#include "stream_io.h"
 #include "libbluray/bluray.h"
 
 #define min(a, b) a < b ? a : b
@@ -181,7 +182,6 @@ struct hb_stream_s
         int64_t last_timestamp; // used for discontinuity detection when
                                 // there are no PCRs
 
-        uint8_t *packet;        // buffer for one TS packet
         hb_ts_stream_t *list;
         int count;
         int alloc;
@@ -209,7 +209,7 @@ struct hb_stream_s
 #define         TS_HAS_RSEI (1 << 2)    // "Restart point" SEI seen
 
     char    *path;
-    FILE    *file_handle;
+    hb_stream_io_t *file_handle;
     hb_stream_type_t hb_stream_type;
     hb_title_t *title;
 
@@ -547,7 +547,7 @@ static int hb_stream_check_for_ps(hb_stream_t *stream)
     uint8_t sc_buf[4];
     int pos = 0;
 
-    fseek(stream->file_handle, 0, SEEK_SET);
+    hb_stream_io_seek(stream->file_handle, 0, SEEK_SET);
 
     // program streams should start with a PACK then some other mpeg start
     // code (usually a SYS but that might be missing if we only have a clip).
@@ -555,7 +555,7 @@ static int hb_stream_check_for_ps(hb_stream_t *stream)
     {
         int offset;
 
-        if ( fread(buf, 1, sizeof(buf), stream->file_handle) != sizeof(buf) )
+        if ( hb_stream_io_read(stream->file_handle, buf, sizeof(buf)) != sizeof(buf) )
             return 0;
 
         for ( offset = 0; offset < 8*1024-27; ++offset )
@@ -585,23 +585,23 @@ static int hb_stream_check_for_ps(hb_stream_t *stream)
                 data_len = (b[4] << 8) + b[5];
                 if ( data_len && sid > 0xba && sid < 0xf9 )
                 {
-                    prev = ftell( stream->file_handle );
+                    prev = hb_stream_io_tell( stream->file_handle );
                     pos = prev - ( sizeof(buf) - offset );
                     pos += pes_offset + 6 + data_len;
-                    fseek( stream->file_handle, pos, SEEK_SET );
-                    if ( fread(sc_buf, 1, 4, stream->file_handle) != 4 )
+                    hb_stream_io_seek( stream->file_handle, pos, SEEK_SET );
+                    if ( hb_stream_io_read(stream->file_handle, sc_buf, 4) != 4 )
                         return 0;
                     if (sc_buf[0] == 0x00 && sc_buf[1] == 0x00 &&
                         sc_buf[2] == 0x01)
                     {
                         return 1;
                     }
-                    fseek( stream->file_handle, prev, SEEK_SET );
+                    hb_stream_io_seek( stream->file_handle, prev, SEEK_SET );
                 }
             }
         }
-        fseek( stream->file_handle, -27, SEEK_CUR );
-        pos = ftell( stream->file_handle );
+        hb_stream_io_seek( stream->file_handle, -27, SEEK_CUR );
+        pos = hb_stream_io_tell( stream->file_handle );
     }
     return 0;
 }
@@ -610,7 +610,7 @@ static int hb_stream_get_type(hb_stream_t *stream)
 {
     uint8_t buf[2048*4];
 
-    if ( fread(buf, 1, sizeof(buf), stream->file_handle) == sizeof(buf) )
+    if ( hb_stream_io_read(stream->file_handle, buf, sizeof(buf)) == sizeof(buf) )
     {
         int psize;
         if ( ( psize = hb_stream_check_for_ts(buf) ) != 0 )
@@ -641,17 +641,11 @@ static void hb_stream_delete_dynamic( hb_stream_t *d )
 {
     if( d->file_handle )
     {
-        fclose( d->file_handle );
-        d->file_handle = NULL;
+        hb_stream_io_close( &d->file_handle );
     }
 
     int i=0;
 
-    if ( d->ts.packet )
-    {
-        free( d->ts.packet );
-        d->ts.packet = NULL;
-    }
     if ( d->ts.list )
     {
         for (i = 0; i < d->ts.count; i++)
@@ -819,7 +813,7 @@ hb_stream_open(hb_handle_t *h, char *path, hb_title_t *title, int scan)
         return NULL;
     }
 
-    FILE *f = hb_fopen(path, "rb");
+    hb_stream_io_t *f = hb_stream_io_open(path);
     if ( f == NULL )
     {
         hb_log( "hb_stream_open: open %s failed", path );
@@ -829,7 +823,7 @@ hb_stream_open(hb_handle_t *h, char *path, hb_title_t *title, int scan)
     hb_stream_t *d = calloc( sizeof( hb_stream_t ), 1 );
     if ( d == NULL )
     {
-        fclose( f );
+        hb_stream_io_close( &f );
         hb_log( "hb_stream_open: can't allocate space for %s stream state", path );
         return NULL;
     }
@@ -861,8 +855,7 @@ hb_stream_open(hb_handle_t *h, char *path, hb_title_t *title, int scan)
             hb_stream_seek( d, 0. );
             return d;
         }
-        fclose( d->file_handle );
-        d->file_handle = NULL;
+        hb_stream_io_close( &d->file_handle );
         if ( ffmpeg_open( d, title, scan ) )
         {
             return d;
@@ -870,7 +863,7 @@ hb_stream_open(hb_handle_t *h, char *path, hb_title_t *title, int scan)
     }
     if ( d->file_handle )
     {
-        fclose( d->file_handle );
+        hb_stream_io_close( &d->file_handle );
     }
     if (d->path)
     {
@@ -945,7 +938,6 @@ hb_stream_t * hb_bd_stream_open( hb_handle_t *h, hb_title_t *title )
     d->file_handle = NULL;
     d->title = title;
     d->path = NULL;
-    d->ts.packet = NULL;
 
     int pid = title->video_id;
     int stream_type = title->video_stream_type;
@@ -1129,27 +1121,29 @@ hb_title_t * hb_stream_title_scan(hb_stream_t *stream, hb_title_t * title)
  */
 static const uint8_t *next_packet( hb_stream_t *stream )
 {
-    uint8_t *buf = stream->ts.packet + stream->packetsize - 188;
+    const uint8_t *packet, *buf;
 
     while ( 1 )
     {
-        if ( fread(stream->ts.packet, 1, stream->packetsize, stream->file_handle) !=
-             stream->packetsize )
+        // The packet is normally used in place in the read ahead buffer
+        packet = hb_stream_io_next(stream->file_handle, stream->packetsize);
+        if ( packet == NULL )
         {
             int err;
-            if ((err = ferror(stream->file_handle)) != 0)
+            if ((err = hb_stream_io_error(stream->file_handle)) != 0)
             {
                 hb_error("next_packet: error (%d)", err);
                 hb_set_work_error(stream->h, HB_ERROR_READ);
             }
             return NULL;
         }
+        buf = packet + stream->packetsize - 188;
         if (buf[0] == 0x47)
         {
             return buf;
         }
         // lost sync - back up to where we started then try to re-establish.
-        off_t pos = ftello(stream->file_handle) - stream->packetsize;
+        off_t pos = hb_stream_io_tell(stream->file_handle) - stream->packetsize;
         off_t pos2 = align_to_next_packet(stream);
         if ( pos2 == 0 )
         {
@@ -1170,21 +1164,19 @@ static void skip_to_next_pack( hb_stream_t *src_stream )
     uint32_t strt_code = -1;
     int c;
 
-    flockfile( src_stream->file_handle );
-    while ( ( c = getc_unlocked( src_stream->file_handle ) ) != EOF )
+    while ( ( c = hb_stream_io_getc( src_stream->file_handle ) ) != EOF )
     {
         strt_code = ( strt_code << 8 ) | c;
         if ( strt_code == 0x000001ba )
             // we found the start of the next pack
             break;
     }
-    funlockfile( src_stream->file_handle );
 
     // if we didn't terminate on an eof back up so the next read
     // starts on the pack boundary.
     if ( c != EOF )
     {
-        fseeko( src_stream->file_handle, -4, SEEK_CUR );
+        hb_stream_io_seek( src_stream->file_handle, -4, SEEK_CUR );
     }
 }
 
@@ -1543,7 +1535,7 @@ static struct pts_pos hb_sample_pts(hb_stream_t *stream, uint64_t fpos)
     {
         const uint8_t *buf;
         int adapt_len;
-        fseeko( stream->file_handle, fpos, SEEK_SET );
+        hb_stream_io_seek( stream->file_handle, fpos, SEEK_SET );
         align_to_next_packet( stream );
         int pid = stream->ts.list[ts_index_of_video(stream)].pid;
         buf = hb_ts_stream_getPEStype( stream, pid, &adapt_len );
@@ -1571,7 +1563,7 @@ static struct pts_pos hb_sample_pts(hb_stream_t *stream, uint64_t fpos)
                 ++stream->has_IDRs;
             }
         }
-        pp.pos = ftello(stream->file_handle);
+        pp.pos = hb_stream_io_tell(stream->file_handle);
         if ( !stream->has_IDRs )
         {
             // Scan a little more to see if we will stumble upon one
@@ -1596,7 +1588,7 @@ static struct pts_pos hb_sample_pts(hb_stream_t *stream, uint64_t fpos)
 
         // round address down to nearest dvd sector start
         fpos &=~ ( HB_DVD_READ_BUFFER_SIZE - 1 );
-        fseeko( stream->file_handle, fpos, SEEK_SET );
+        hb_stream_io_seek( stream->file_handle, fpos, SEEK_SET );
         if ( stream->hb_stream_type == program )
         {
             skip_to_next_pack( stream );
@@ -1641,7 +1633,7 @@ static struct pts_pos hb_sample_pts(hb_stream_t *stream, uint64_t fpos)
         }
 
         pp.pts = pes_info.pts;
-        pp.pos = ftello(stream->file_handle);
+        pp.pos = hb_stream_io_tell(stream->file_handle);
     }
     return pp;
 }
@@ -1701,8 +1693,7 @@ static void hb_stream_duration(hb_stream_t *stream, hb_title_t *inTitle)
     struct pts_pos *pp = ptspos;
     int i;
 
-    fseeko(stream->file_handle, 0, SEEK_END);
-    uint64_t fsize = ftello(stream->file_handle);
+    uint64_t fsize = hb_stream_io_size(stream->file_handle);
     uint64_t fincr = fsize / NDURSAMPLES;
     uint64_t fpos = fincr / 2;
     for ( i = NDURSAMPLES; --i >= 0; fpos += fincr )
@@ -1716,7 +1707,7 @@ static void hb_stream_duration(hb_stream_t *stream, hb_title_t *inTitle)
     inTitle->minutes  = ( dur % 3600 ) / 60;
     inTitle->seconds  = dur % 60;
 
-    rewind(stream->file_handle);
+    hb_stream_io_seek(stream->file_handle, 0, SEEK_SET);
 }
 
 /***********************************************************************
@@ -1808,6 +1799,31 @@ int hb_stream_chapter( hb_stream_t * src_stream )
     return( src_stream->chapter );
 }
 
+/***********************************************************************
+ * hb_stream_set_ids
+ ***********************************************************************
+ * Tells the demuxer which elementary streams will be read so that it
+ * can skip the data of all the others.  Only libav streams can skip
+ * reading, TS and PS streams are always read in full.
+ **********************************************************************/
+void hb_stream_set_ids( hb_stream_t * stream, const int * ids, int count )
+{
+    int ii, jj;
+
+    if ( stream->hb_stream_type != ffmpeg )
+    {
+        return;
+    }
+    for ( ii = 0; ii < stream->ffmpeg_ic->nb_streams; ii++ )
+    {
+        AVStream * st = stream->ffmpeg_ic->streams[ii];
+
+        for ( jj = 0; jj < count && ids[jj] != ii; jj++ )
+            ;
+        st->discard = jj < count ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+    }
+}
+
 /***********************************************************************
  * hb_stream_seek
  ***********************************************************************
@@ -1821,16 +1837,15 @@ int hb_stream_seek( hb_stream_t * stream, float f )
     }
     off_t stream_size, cur_pos, new_pos;
     double pos_ratio = f;
-    cur_pos = ftello( stream->file_handle );
-    fseeko( stream->file_handle, 0, SEEK_END );
-    stream_size = ftello( stream->file_handle );
+    cur_pos = hb_stream_io_tell( stream->file_handle );
+    stream_size = hb_stream_io_size( stream->file_handle );
     new_pos = (off_t) ((double) (stream_size) * pos_ratio);
     new_pos &=~ (HB_DVD_READ_BUFFER_SIZE - 1);
 
-    int r = fseeko( stream->file_handle, new_pos, SEEK_SET );
+    int r = hb_stream_io_seek( stream->file_handle, new_pos, SEEK_SET );
     if (r == -1)
     {
-        fseeko( stream->file_handle, cur_pos, SEEK_SET );
+        hb_stream_io_seek( stream->file_handle, cur_pos, SEEK_SET );
         return 0;
     }
 
@@ -2223,8 +2238,6 @@ static int hb_ts_stream_init(hb_stream_t *stream)
     }
     stream->pes.count = 0;
 
-    stream->ts.packet = malloc( stream->packetsize );
-
     // Find the audio and video pids in the stream
     if (hb_ts_stream_find_pids(stream) < 0)
     {
@@ -2400,25 +2413,26 @@ static void hb_ps_stream_init(hb_stream_t *stream)
 
 static off_t align_to_next_packet(hb_stream_t *stream)
 {
-    uint8_t buf[MAX_HOLE];
+    const uint8_t *buf;
     off_t pos = 0;
-    off_t start = ftello(stream->file_handle);
+    off_t start = hb_stream_io_tell(stream->file_handle);
     off_t orig;
 
     if ( start >= stream->packetsize ) {
         start -= stream->packetsize;
-        fseeko(stream->file_handle, start, SEEK_SET);
+        hb_stream_io_seek(stream->file_handle, start, SEEK_SET);
     }
     orig = start;
 
     while (1)
     {
-        if (fread(buf, sizeof(buf), 1, stream->file_handle) == 1)
+        buf = hb_stream_io_next(stream->file_handle, MAX_HOLE);
+        if (buf != NULL)
         {
             const uint8_t *bp = buf;
             int i;
 
-            for ( i = sizeof(buf) - 8 * stream->packetsize; --i >= 0; ++bp )
+            for ( i = MAX_HOLE - 8 * stream->packetsize; --i >= 0; ++bp )
             {
                 if ( have_ts_sync( bp, stream->packetsize, 8 ) )
                 {
@@ -2430,13 +2444,13 @@ static off_t align_to_next_packet(hb_stream_t *stream)
                 pos = ( bp - buf ) - stream->packetsize + 188;
                 break;
             }
-            fseeko(stream->file_handle, -8 * stream->packetsize, SEEK_CUR);
-            start = ftello(stream->file_handle);
+            hb_stream_io_seek(stream->file_handle, -8 * stream->packetsize, SEEK_CUR);
+            start = hb_stream_io_tell(stream->file_handle);
         }
         else
         {
             int err;
-            if ((err = ferror(stream->file_handle)) != 0)
+            if ((err = hb_stream_io_error(stream->file_handle)) != 0)
             {
                 hb_error("align_to_next_packet: error (%d)", err);
                 hb_set_work_error(stream->h, HB_ERROR_READ);
@@ -2444,7 +2458,7 @@ static off_t align_to_next_packet(hb_stream_t *stream)
             return 0;
         }
     }
-    fseeko(stream->file_handle, start+pos, SEEK_SET);
+    hb_stream_io_seek(stream->file_handle, start+pos, SEEK_SET);
     return start - orig + pos;
 }
 
@@ -3259,8 +3273,7 @@ static int hb_ps_read_packet( hb_stream_t * stream, hb_buffer_t *b )
     int c;
 
 #define cp (b->data)
-    flockfile( stream->file_handle );
-    while ( ( c = getc_unlocked( stream->file_handle ) ) != EOF )
+    while ( ( c = hb_stream_io_getc( stream->file_handle ) ) != EOF )
     {
         start_code = ( start_code << 8 ) | c;
         if ( ( start_code >> 8 )== 0x000001 )
@@ -3292,7 +3305,7 @@ static int hb_ps_read_packet( hb_stream_t * stream, hb_buffer_t *b )
         }
 
         // There are at least 8 bytes.  More if this is mpeg2 pack.
-        if (fread( cp+pos, 1, 8, stream->file_handle ) < 8)
+        if (hb_stream_io_read( stream->file_handle, cp+pos, 8 ) < 8)
             goto done;
 
         int mark = cp[pos] >> 4;
@@ -3301,12 +3314,12 @@ static int hb_ps_read_packet( hb_stream_t * stream, hb_buffer_t *b )
         if ( mark != 0x02 )
         {
             // mpeg-2 pack,
-            if (fread( cp+pos, 1, 2, stream->file_handle ) == 2)
+            if (hb_stream_io_read( stream->file_handle, cp+pos, 2 ) == 2)
             {
                 int len = cp[start+13] & 0x7;
                 pos += 2;
                 if (len > 0 &&
-                    fread( cp+pos, 1, len, stream->file_handle ) == len)
+                    hb_stream_io_read( stream->file_handle, cp+pos, len ) == len)
                     pos += len;
                 else
                     goto done;
@@ -3319,11 +3332,11 @@ static int hb_ps_read_packet( hb_stream_t * stream, hb_buffer_t *b )
     else if ( stream_id >= 0xbb )
     {
         int len = 0;
-        c = getc_unlocked( stream->file_handle );
+        c = hb_stream_io_getc( stream->file_handle );
         if ( c == EOF )
             goto done;
         len = c << 8;
-        c = getc_unlocked( stream->file_handle );
+        c = hb_stream_io_getc( stream->file_handle );
         if ( c == EOF )
             goto done;
         len |= c;
@@ -3339,7 +3352,7 @@ static int hb_ps_read_packet( hb_stream_t * stream, hb_buffer_t *b )
         if ( len )
         {
             // Length is non-zero, read the packet all at once
-            len = fread( cp+pos, 1, len, stream->file_handle );
+            len = hb_stream_io_read( stream->file_handle, cp+pos, len );
             pos += len;
         }
         else
@@ -3347,7 +3360,7 @@ static int hb_ps_read_packet( hb_stream_t * stream, hb_buffer_t *b )
             // Length is zero, read bytes till we find a start code.
             // Only video PES packets are allowed to have zero length.
             start_code = -1;
-            while ( ( c = getc_unlocked( stream->file_handle ) ) != EOF )
+            while ( ( c = hb_stream_io_getc( stream->file_handle ) ) != EOF )
             {
                 start_code = ( start_code << 8 ) | c;
                 if ( pos  >= b->alloc )
@@ -3366,14 +3379,14 @@ static int hb_ps_read_packet( hb_stream_t * stream, hb_buffer_t *b )
             if ( c == EOF )
                 goto done;
             pos -= 4;
-            fseeko( stream->file_handle, -4, SEEK_CUR );
+            hb_stream_io_seek( stream->file_handle, -4, SEEK_CUR );
         }
     }
     else
     {
         // Unknown, find next start code
         start_code = -1;
-        while ( ( c = getc_unlocked( stream->file_handle ) ) != EOF )
+        while ( ( c = hb_stream_io_getc( stream->file_handle ) ) != EOF )
         {
             start_code = ( start_code << 8 ) | c;
             if ( pos  >= b->alloc )
@@ -3390,15 +3403,14 @@ static int hb_ps_read_packet( hb_stream_t * stream, hb_buffer_t *b )
         if ( c == EOF )
             goto done;
         pos -= 4;
-        fseeko( stream->file_handle, -4, SEEK_CUR );
+        hb_stream_io_seek( stream->file_handle, -4, SEEK_CUR );
     }
 
 done:
     // Parse packet for information we might need
-    funlockfile( stream->file_handle );
 
     int err;
-    if ((err = ferror(stream->file_handle)) != 0)
+    if ((err = hb_stream_io_error(stream->file_handle)) != 0)
     {
         hb_error("hb_ps_read_packet: error (%d)", err);
         hb_set_work_error(stream->h, HB_ERROR_READ);
@@ -3778,7 +3790,7 @@ static void hb_ps_stream_find_streams(hb_stream_t *stream)
     int ii, jj;
     hb_buffer_t *buf  = hb_buffer_init(HB_DVD_READ_BUFFER_SIZE);
 
-    fseeko( stream->file_handle, 0, SEEK_SET );
+    hb_stream_io_seek( stream->file_handle, 0, SEEK_SET );
     // Scan beginning of file, then if no program stream map is found
     // seek to 20% and scan again since there's occasionally no
     // audio at the beginning (particularly for vobs).
@@ -4391,9 +4403,8 @@ static int hb_ts_stream_find_pids(hb_stream_t *stream)
     // changes PMTs (and thus video & audio PIDs) when 'programs' change. Since
     // we may have the tail of the previous program at the beginning of this
     // file, take our PMT from the middle of the file.
-    fseeko(stream->file_handle, 0, SEEK_END);
-    uint64_t fsize = ftello(stream->file_handle);
-    fseeko(stream->file_handle, fsize >> 1, SEEK_SET);
+    uint64_t fsize = hb_stream_io_size(stream->file_handle);
+    hb_stream_io_seek(stream->file_handle, fsize >> 1, SEEK_SET);
     align_to_next_packet(stream);
 
     // Read the Transport Stream Packets (188 bytes each) looking at first for PID 0 (the PAT PID), then decode that
@@ -0,0 +1,334 @@
+/* stream_io.c
+
+   Copyright (c) 2003-2018 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#include <errno.h>
+
+#include "hb.h"
+#include "stream_io.h"
+
+#define BLOCK_SIZE  HB_STREAM_IO_BLOCK_SIZE
+#define BLOCK_COUNT HB_STREAM_IO_BLOCK_COUNT
+
+/*
+ * Read ahead thread.  Fills blocks in file order starting at
+ * next_offset, staying up to 'depth' blocks ahead of the reader.
+ * The file is only touched by this thread once it is started.
+ */
+static void io_thread( void * _io )
+{
+    hb_stream_io_t * io = _io;
+    int64_t          file_pos = 0;
+
+    hb_lock( io->lock );
+    while ( !io->stop )
+    {
+        if ( io->eof || io->count >= io->depth )
+        {
+            hb_cond_wait( io->cond, io->lock );
+            continue;
+        }
+
+        int                    generation = io->generation;
+        int64_t                offset = io->next_offset;
+        hb_stream_io_block_t * b;
+        size_t                 len = 0;
+        int                    error = 0;
+
+        b = &io->blocks[( io->head + io->count ) % BLOCK_COUNT];
+        hb_unlock( io->lock );
+
+        // The reader never looks at a block that is not counted yet,
+        // so it can be filled without holding the lock.
+        if ( b->data == NULL )
+        {
+            b->data = malloc( BLOCK_SIZE );
+        }
+        if ( b->data == NULL )
+        {
+            error = ENOMEM;
+        }
+        else if ( file_pos != offset &&
+                  fseeko( io->file, offset, SEEK_SET ) != 0 )
+        {
+            error = errno;
+            file_pos = -1;
+        }
+        else
+        {
+            len = fread( b->data, 1, BLOCK_SIZE, io->file );
+            error = ferror( io->file );
+            clearerr( io->file );
+            file_pos = offset + len;
+        }
+
+        hb_lock( io->lock );
+        if ( generation != io->generation )
+        {
+            // The reader seeked elsewhere while we were reading
+            continue;
+        }
+        b->offset = offset;
+        b->len    = len;
+        b->error  = error;
+        io->count++;
+        io->next_offset = offset + len;
+        if ( len < BLOCK_SIZE )
+        {
+            io->eof = 1;
+        }
+        hb_cond_broadcast( io->cond );
+    }
+    hb_unlock( io->lock );
+}
+
+// Makes block 'idx' (relative to head) the window. Called with the lock held.
+static void io_set_window( hb_stream_io_t * io, int idx )
+{
+    hb_stream_io_block_t * b = &io->blocks[( io->head + idx ) % BLOCK_COUNT];
+
+    io->owned  = idx + 1;
+    io->data   = b->data;
+    io->len    = b->len;
+    io->offset = b->offset;
+    io->pos    = 0;
+    if ( b->error )
+    {
+        io->error = b->error;
+    }
+}
+
+/*
+ * Moves the window to the next block.  Returns 0 at EOF, in which case
+ * the window is left as it was.
+ */
+static int io_fill( hb_stream_io_t * io )
+{
+    hb_lock( io->lock );
+    if ( io->owned == 2 )
+    {
+        // Release the block before the window
+        io->head = ( io->head + 1 ) % BLOCK_COUNT;
+        io->count--;
+        io->owned--;
+    }
+    // Reading sequentially, read further ahead
+    if ( io->depth < BLOCK_COUNT )
+    {
+        io->depth++;
+    }
+    hb_cond_broadcast( io->cond );
+
+    while ( io->count <= io->owned && !io->eof && !io->stop )
+    {
+        hb_cond_wait( io->cond, io->lock );
+    }
+    if ( io->count <= io->owned )
+    {
+        hb_unlock( io->lock );
+        return 0;
+    }
+    io_set_window( io, io->owned );
+    hb_unlock( io->lock );
+
+    return io->len > 0;
+}
+
+hb_stream_io_t * hb_stream_io_open( const char * path )
+{
+    hb_stream_io_t * io;
+    FILE           * f;
+
+    f = hb_fopen( path, "rb" );
+    if ( f == NULL )
+    {
+        return NULL;
+    }
+    io = calloc( 1, sizeof( hb_stream_io_t ) );
+    if ( io == NULL )
+    {
+        fclose( f );
+        return NULL;
+    }
+
+    // Blocks are read straight into our own buffers
+    setvbuf( f, NULL, _IONBF, 0 );
+    fseeko( f, 0, SEEK_END );
+    io->size = ftello( f );
+    fseeko( f, 0, SEEK_SET );
+
+    io->file   = f;
+    io->depth  = 1;
+    io->lock   = hb_lock_init();
+    io->cond   = hb_cond_init();
+    io->thread = hb_thread_init( "stream_io", io_thread, io,
+                                 HB_NORMAL_PRIORITY );
+
+    return io;
+}
+
+void hb_stream_io_close( hb_stream_io_t ** _io )
+{
+    hb_stream_io_t * io = *_io;
+    int              ii;
+
+    if ( io == NULL )
+    {
+        return;
+    }
+
+    hb_lock( io->lock );
+    io->stop = 1;
+    hb_cond_broadcast( io->cond );
+    hb_unlock( io->lock );
+    hb_thread_close( &io->thread );
+
+    fclose( io->file );
+    for ( ii = 0; ii < BLOCK_COUNT; ii++ )
+    {
+        free( io->blocks[ii].data );
+    }
+    free( io->spill );
+    hb_lock_close( &io->lock );
+    hb_cond_close( &io->cond );
+    free( io );
+
+    *_io = NULL;
+}
+
+int hb_stream_io_getc_slow( hb_stream_io_t * io )
+{
+    if ( !io_fill( io ) )
+    {
+        return EOF;
+    }
+    return io->data[io->pos++];
+}
+
+size_t hb_stream_io_read( hb_stream_io_t * io, void * buf, size_t len )
+{
+    uint8_t * dst = buf;
+    size_t    done = 0;
+
+    while ( done < len )
+    {
+        if ( io->pos >= io->len && !io_fill( io ) )
+        {
+            break;
+        }
+        size_t n = MIN( len - done, io->len - io->pos );
+        memcpy( dst + done, io->data + io->pos, n );
+        io->pos += n;
+        done    += n;
+    }
+    return done;
+}
+
+/*
+ * Returns a pointer to the next 'len' bytes and moves past them, or NULL
+ * if there are fewer than 'len' bytes left.  The data is only valid
+ * until the next call on 'io'.
+ */
+const uint8_t * hb_stream_io_next( hb_stream_io_t * io, size_t len )
+{
+    const uint8_t * p;
+
+    if ( io->pos < io->len && io->len - io->pos >= len )
+    {
+        // Common case, no copy
+        p = io->data + io->pos;
+        io->pos += len;
+        return p;
+    }
+
+    // Straddles two blocks, copy it
+    if ( io->spill_size < len )
+    {
+        free( io->spill );
+        io->spill = malloc( len );
+        io->spill_size = io->spill != NULL ? len : 0;
+        if ( io->spill == NULL )
+        {
+            return NULL;
+        }
+    }
+    if ( hb_stream_io_read( io, io->spill, len ) != len )
+    {
+        return NULL;
+    }
+    return io->spill;
+}
+
+int hb_stream_io_seek( hb_stream_io_t * io, int64_t offset, int whence )
+{
+    int ii;
+
+    if ( whence == SEEK_CUR )
+    {
+        offset += hb_stream_io_tell( io );
+    }
+    else if ( whence == SEEK_END )
+    {
+        offset += io->size;
+    }
+    if ( offset < 0 )
+    {
+        return -1;
+    }
+
+    // Inside the window
+    if ( io->owned > 0 && offset >= io->offset &&
+         offset <= io->offset + (int64_t)io->len )
+    {
+        io->pos = offset - io->offset;
+        return 0;
+    }
+
+    hb_lock( io->lock );
+    // Inside a block that has already been read
+    for ( ii = 0; ii < io->count; ii++ )
+    {
+        hb_stream_io_block_t * b = &io->blocks[( io->head + ii ) % BLOCK_COUNT];
+        if ( offset >= b->offset && offset < b->offset + (int64_t)b->len )
+        {
+            break;
+        }
+    }
+    if ( ii < io->count )
+    {
+        // Keep the block before it, release the rest
+        if ( ii > 1 )
+        {
+            io->head   = ( io->head + ii - 1 ) % BLOCK_COUNT;
+            io->count -= ii - 1;
+            ii = 1;
+        }
+    }
+    else
+    {
+        // Restart read ahead at the block that holds offset
+        io->generation++;
+        io->count       = 0;
+        io->owned       = 0;
+        io->eof         = 0;
+        io->depth       = 1;
+        io->next_offset = offset & ~(int64_t)( BLOCK_SIZE - 1 );
+        hb_cond_broadcast( io->cond );
+        while ( io->count == 0 && !io->stop )
+        {
+            hb_cond_wait( io->cond, io->lock );
+        }
+        ii = 0;
+    }
+    io_set_window( io, ii );
+    // May be past the end of the window if offset is past EOF
+    io->pos = offset - io->offset;
+    hb_unlock( io->lock );
+
+    return 0;
+}
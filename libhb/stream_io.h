@@ -0,0 +1,104 @@
+/* stream_io.h
+
+   Copyright (c) 2003-2018 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#ifndef HB_STREAM_IO_H
+#define HB_STREAM_IO_H
+
+/*
+ * File reader used by the transport and program stream demuxers.
+ *
+ * The file is read in large blocks by a background thread that stays a
+ * few blocks ahead of the demuxer.  The block being parsed is exposed as
+ * a window of file data so that packets can be looked at in place with
+ * hb_stream_io_next() and single bytes can be fetched without a call
+ * into stdio.
+ */
+
+#define HB_STREAM_IO_BLOCK_SIZE   (2 << 20)   // Bytes per read, power of 2
+#define HB_STREAM_IO_BLOCK_COUNT  8
+
+typedef struct hb_stream_io_s hb_stream_io_t;
+
+typedef struct
+{
+    uint8_t * data;
+    int64_t   offset;   // File offset of data[0]
+    size_t    len;      // Bytes read, less than block size at EOF
+    int       error;    // ferror() of the read
+} hb_stream_io_block_t;
+
+struct hb_stream_io_s
+{
+    // Current window of file data.  The window is a block owned by
+    // the reader.
+    const uint8_t * data;
+    size_t          pos;        // Read position, relative to data
+    size_t          len;        // Bytes available at data
+    int64_t         offset;     // File offset of data[0]
+    int             error;
+
+    int64_t         size;       // File size when opened
+    uint8_t       * spill;      // Copy of packets that straddle blocks
+    size_t          spill_size;
+
+    // Read ahead.  Blocks[head] up to blocks[head + count - 1] are
+    // filled, in file order.  The reader owns the first 'owned' of
+    // them, the window is the last one it owns.  The one before the
+    // window is kept so that short seeks backwards stay in memory.
+    FILE                 * file;
+    hb_thread_t          * thread;
+    hb_lock_t            * lock;
+    hb_cond_t            * cond;
+    hb_stream_io_block_t   blocks[HB_STREAM_IO_BLOCK_COUNT];
+    int                    head;
+    int                    count;
+    int                    owned;
+    int                    depth;       // Blocks to read ahead, ramps up
+    int64_t                next_offset; // Offset of the next block to read
+    int                    generation;  // Changed when read ahead restarts
+    int                    eof;
+    int                    stop;
+};
+
+hb_stream_io_t * hb_stream_io_open( const char * path );
+void             hb_stream_io_close( hb_stream_io_t ** );
+size_t           hb_stream_io_read( hb_stream_io_t *, void * buf, size_t len );
+const uint8_t  * hb_stream_io_next( hb_stream_io_t *, size_t len );
+int              hb_stream_io_seek( hb_stream_io_t *, int64_t offset,
+                                    int whence );
+int              hb_stream_io_getc_slow( hb_stream_io_t * );
+
+/*
+ * Returns the next byte or EOF.
+ */
+static inline int hb_stream_io_getc( hb_stream_io_t * io )
+{
+    if ( io->pos < io->len )
+    {
+        return io->data[io->pos++];
+    }
+    return hb_stream_io_getc_slow( io );
+}
+
+static inline int64_t hb_stream_io_tell( hb_stream_io_t * io )
+{
+    return io->offset + io->pos;
+}
+
+static inline int64_t hb_stream_io_size( hb_stream_io_t * io )
+{
+    return io->size;
+}
+
+static inline int hb_stream_io_error( hb_stream_io_t * io )
+{
+    return io->error;
+}
+
+#endif // HB_STREAM_IO_H
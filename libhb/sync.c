@@ -80,6 +80,17 @@ typedef struct
     hb_fifo_t         * fifo_in;
     hb_fifo_t         * fifo_out;
 
+    // Buffers handed to sync that have not been moved to in_queue yet.
+    // The inbox has its own lock so that a stream can queue input
+    // without waiting for common->mutex.  queue_len mirrors the in_queue
+    // count for readers that do not hold common->mutex.
+    hb_lock_t         * inbox_lock;
+    hb_buffer_list_t    inbox;
+    int                 queue_len;
+
+    // 1st pass output is recorded here for the 2nd pass
+    hb_frame_cache_stream_t * cache;
+
     // PTS synchronization
     hb_list_t         * delta_list;
     int64_t             pts_slip;
@@ -147,6 +158,7 @@ struct sync_common_s
     // Audio/Video sync thread synchronization
     hb_job_t      * job;
     hb_lock_t     * mutex;
+    int             pending;    // buffers waiting in stream inboxes
     int             stream_count;
     sync_stream_t * streams;
     int             found_first_pts;
@@ -191,6 +203,8 @@ static int  UpdateSCR( sync_stream_t * stream, hb_buffer_t * buf );
 static hb_buffer_t * FilterAudioFrame( sync_stream_t * stream,
                                        hb_buffer_t *buf );
 static void SortedQueueBuffer( sync_stream_t * stream, hb_buffer_t * buf );
+static void drainInboxes( sync_common_t * common );
+static void syncUnlock( sync_common_t * common );
 static hb_buffer_t * sanitizeSubtitle(sync_stream_t        * stream,
                                       hb_buffer_t          * sub);
 
@@ -372,7 +386,7 @@ static hb_buffer_t * CreateBlackBuf( sync_stream_t * stream,
         }
         else
         {
-            buf = hb_buffer_dup(buf);
+            buf = hb_buffer_ref(buf);
         }
         buf->s.start     = next_pts;
         next_pts        += frame_dur;
@@ -1158,6 +1172,15 @@ static void fifo_push( hb_fifo_t * fifo, hb_buffer_t * buf )
     }
 }
 
+static void streamPush( sync_stream_t * stream, hb_buffer_t * buf )
+{
+    if (stream->cache != NULL && stream->fifo_out != NULL)
+    {
+        hb_frame_cache_write(stream->cache, buf);
+    }
+    fifo_push(stream->fifo_out, buf);
+}
+
 static void streamFlush( sync_stream_t * stream )
 {
     while (hb_list_count(stream->in_queue) > 0)
@@ -1278,10 +1301,10 @@ static void streamFlush( sync_stream_t * stream )
                 hb_buffer_close(&buf);
             }
             restoreChap(stream, buf);
-            fifo_push(stream->fifo_out, buf);
+            streamPush(stream, buf);
         }
     }
-    fifo_push(stream->fifo_out, hb_buffer_eof_init());
+    streamPush(stream, hb_buffer_eof_init());
 }
 
 static void flushStreams( sync_common_t * common )
@@ -1310,11 +1333,37 @@ static void flushStreams( sync_common_t * common )
     }
 }
 
-static void flushStreamsLock( sync_common_t * common )
+// Called by a stream when it receives EOF.  The flush flag is set after
+// the stream's inbox is drained so that flushStreams never sees a flushed
+// stream that still has buffers waiting in its inbox.
+//
+// Returns 1 if all subtitle streams have received EOF.
+static int flushStreamsLock( sync_stream_t * stream )
 {
+    sync_common_t * common = stream->common;
+    int             ii, subtitles_done = 1;
+
     hb_lock(common->mutex);
+    drainInboxes(common);
+    if (stream->type == SYNC_TYPE_SUBTITLE)
+    {
+        // sanitizeSubtitle requires EOF buffer to recognize that
+        // it needs to flush all subtitles.
+        hb_list_add(stream->in_queue, hb_buffer_eof_init());
+    }
+    stream->flush = 1;
     flushStreams(common);
-    hb_unlock(common->mutex);
+    for (ii = 0; ii < common->stream_count; ii++)
+    {
+        if (common->streams[ii].type == SYNC_TYPE_SUBTITLE &&
+            !common->streams[ii].flush && !common->streams[ii].done)
+        {
+            subtitles_done = 0;
+        }
+    }
+    syncUnlock(common);
+
+    return subtitles_done;
 }
 
 static void log_chapter( sync_common_t *common, int chap_num,
@@ -1463,7 +1512,7 @@ static void terminateSubtitleStreams( sync_common_t * common )
         {
             continue;
         }
-        fifo_push(stream->fifo_out, hb_buffer_eof_init());
+        streamPush(stream, hb_buffer_eof_init());
         fifo_push(stream->fifo_in,  hb_buffer_eof_init());
         stream->done = 1;
     }
@@ -1648,7 +1697,7 @@ static void OutputBuffer( sync_common_t * common )
                     break;
             }
             out_stream->done = 1;
-            fifo_push(out_stream->fifo_out, hb_buffer_eof_init());
+            streamPush(out_stream, hb_buffer_eof_init());
             terminateSubtitleStreams(common);
             flushStreams(common);
             continue;
@@ -1661,7 +1710,7 @@ static void OutputBuffer( sync_common_t * common )
                    out_stream->frame_count);
             common->stop_pts = buf->s.start;
             out_stream->done = 1;
-            fifo_push(out_stream->fifo_out, hb_buffer_eof_init());
+            streamPush(out_stream, hb_buffer_eof_init());
             terminateSubtitleStreams(common);
             flushStreams(common);
             continue;
@@ -1787,7 +1836,7 @@ static void OutputBuffer( sync_common_t * common )
             hb_buffer_close(&buf);
         }
         restoreChap(out_stream, buf);
-        fifo_push(out_stream->fifo_out, buf);
+        streamPush(out_stream, buf);
     } while (full);
 }
 
@@ -1795,16 +1844,61 @@ static void FlushBuffer( sync_common_t * common )
 {
     hb_lock(common->mutex);
 
+    drainInboxes(common);
     if (!common->found_first_pts)
     {
         checkFirstPts(common);
     }
     OutputBuffer(common);
 
-    hb_unlock(common->mutex);
+    syncUnlock(common);
 }
 
-static void Synchronize( sync_stream_t * stream )
+// Called with common->mutex held
+static void syncProcess( sync_common_t * common )
+{
+    drainInboxes(common);
+    if (!fillQueues(common))
+    {
+        return;
+    }
+    if (!common->found_first_pts)
+    {
+        checkFirstPts(common);
+    }
+    OutputBuffer(common);
+}
+
+// Releases common->mutex.
+//
+// A stream that finds common->mutex held leaves its input in its inbox
+// for the lock holder to process.  Buffers can land in an inbox after
+// the holder's last drain, so check for them after unlocking and take
+// the lock back if nobody else has.
+static void syncUnlock( sync_common_t * common )
+{
+    int ii;
+
+    while (1)
+    {
+        for (ii = 0; ii < common->stream_count; ii++)
+        {
+            sync_stream_t * stream = &common->streams[ii];
+            hb_atomic_store(&stream->queue_len,
+                            hb_list_count(stream->in_queue));
+        }
+        hb_unlock(common->mutex);
+
+        if (hb_atomic_load(&common->pending) == 0 ||
+            !hb_trylock(common->mutex))
+        {
+            break;
+        }
+        syncProcess(common);
+    }
+}
+
+static void waitFifoOut( sync_stream_t * stream )
 {
     sync_common_t * common = stream->common;
 
@@ -1822,21 +1916,35 @@ static void Synchronize( sync_stream_t * stream )
             }
         }
     }
+}
 
-    hb_lock(common->mutex);
+static void Synchronize( sync_stream_t * stream )
+{
+    sync_common_t * common = stream->common;
 
-    if (!fillQueues(common))
+    waitFifoOut(stream);
+
+    // If another stream is synchronizing, it picks up this stream's
+    // inbox before it releases the lock.
+    if (!hb_trylock(common->mutex))
     {
-        hb_unlock(common->mutex);
         return;
     }
-    if (!common->found_first_pts)
-    {
-        checkFirstPts(common);
-    }
-    OutputBuffer(common);
+    syncProcess(common);
+    syncUnlock(common);
+}
 
-    hb_unlock(common->mutex);
+// Like Synchronize, but does not return until output has been attempted.
+// Used when a stream's queue is full and it must not queue more input.
+static void SynchronizeWait( sync_stream_t * stream )
+{
+    sync_common_t * common = stream->common;
+
+    waitFifoOut(stream);
+
+    hb_lock(common->mutex);
+    syncProcess(common);
+    syncUnlock(common);
 }
 
 static void updateDuration( sync_stream_t * stream )
@@ -2106,22 +2214,9 @@ static void SortedQueueBuffer( sync_stream_t * stream, hb_buffer_t * buf )
     }
 }
 
-static void QueueBuffer( sync_stream_t * stream, hb_buffer_t * buf )
+// Called with common->mutex held
+static void queueInboxBuffer( sync_stream_t * stream, hb_buffer_t * buf )
 {
-    hb_lock(stream->common->mutex);
-
-    while (hb_list_count(stream->in_queue) > stream->max_len &&
-           !stream->done && !stream->common->job->done &&
-           !*stream->common->job->die)
-    {
-        // If the in_queue is full, we have to force some output to
-        // unblock it.  Blocking here would back up the pipeline and
-        // stall out reader eventually.
-        hb_unlock(stream->common->mutex);
-        Synchronize(stream);
-        hb_lock(stream->common->mutex);
-    }
-
     // Reader can change job->reader_pts_offset after initialization
     // and before we receive the first buffer here.  Calculate
     // common->pts_to_start here since this is the first opportunity where
@@ -2172,7 +2267,6 @@ static void QueueBuffer( sync_stream_t * stream, hb_buffer_t * buf )
             // We require an initial pts to start synchronization
             saveChap(stream, buf);
             hb_buffer_close(&buf);
-            hb_unlock(stream->common->mutex);
             return;
         }
         SortedQueueBuffer(stream, buf);
@@ -2180,8 +2274,83 @@ static void QueueBuffer( sync_stream_t * stream, hb_buffer_t * buf )
 
     // Make adjustments for gaps found in other streams
     applyDeltas(stream->common);
+}
+
+// Moves buffers from the stream inboxes to the stream in_queues.
+// Called with common->mutex held
+static void drainInboxes( sync_common_t * common )
+{
+    int           ii;
+    hb_buffer_t * buf, * next;
+
+    for (ii = 0; ii < common->stream_count; ii++)
+    {
+        sync_stream_t * stream = &common->streams[ii];
+
+        if (stream->inbox_lock == NULL)
+        {
+            // Stream not configured
+            continue;
+        }
+        hb_lock(stream->inbox_lock);
+        buf = hb_buffer_list_clear(&stream->inbox);
+        hb_unlock(stream->inbox_lock);
 
-    hb_unlock(stream->common->mutex);
+        while (buf != NULL)
+        {
+            next      = buf->next;
+            buf->next = NULL;
+            hb_atomic_sub(&common->pending, 1);
+            queueInboxBuffer(stream, buf);
+            buf = next;
+        }
+    }
+}
+
+static void closeInboxes( sync_common_t * common )
+{
+    int ii;
+
+    for (ii = 0; ii < common->stream_count; ii++)
+    {
+        sync_stream_t * stream = &common->streams[ii];
+
+        hb_buffer_list_close(&stream->inbox);
+        hb_lock_close(&stream->inbox_lock);
+    }
+}
+
+static int streamQueueLen( sync_stream_t * stream )
+{
+    int len;
+
+    hb_lock(stream->inbox_lock);
+    len = hb_atomic_load(&stream->queue_len) +
+          hb_buffer_list_count(&stream->inbox);
+    hb_unlock(stream->inbox_lock);
+
+    return len;
+}
+
+// Queues input without taking common->mutex.  The buffer is processed
+// by whichever stream next synchronizes.
+static void QueueBuffer( sync_stream_t * stream, hb_buffer_t * buf )
+{
+    sync_common_t * common = stream->common;
+
+    while (streamQueueLen(stream) > stream->max_len &&
+           !stream->done && !common->job->done && !*common->job->die)
+    {
+        // If the in_queue is full, we have to force some output to
+        // unblock it.  Blocking here would back up the pipeline and
+        // stall out reader eventually.
+        SynchronizeWait(stream);
+    }
+
+    hb_lock(stream->inbox_lock);
+    hb_buffer_list_append(&stream->inbox, buf);
+    hb_unlock(stream->inbox_lock);
+    hb_atomic_add(&common->pending, 1);
 }
 
 static int InitAudio( sync_common_t * common, int index )
@@ -2220,6 +2389,8 @@ static int InitAudio( sync_common_t * common, int index )
     pv->stream->max_len         = SYNC_MAX_AUDIO_QUEUE_LEN;
     pv->stream->min_len         = SYNC_MIN_AUDIO_QUEUE_LEN;
     if (pv->stream->in_queue == NULL) goto fail;
+    pv->stream->inbox_lock      = hb_lock_init();
+    if (pv->stream->inbox_lock == NULL) goto fail;
     pv->stream->delta_list      = hb_list_init();
     if (pv->stream->delta_list == NULL) goto fail;
     pv->stream->type            = SYNC_TYPE_AUDIO;
@@ -2231,6 +2402,12 @@ static int InitAudio( sync_common_t * common, int index )
     pv->stream->last_duration   = (int64_t)AV_NOPTS_VALUE;
     pv->stream->audio.audio     = audio;
     pv->stream->fifo_out        = w->fifo_out;
+    if (common->job->pass_id == HB_PASS_ENCODE_1ST)
+    {
+        hb_interjob_t * interjob = common->job->interjob;
+        pv->stream->cache = hb_frame_cache_audio(interjob->frame_cache,
+                                                 index);
+    }
 
     if (!(audio->config.out.codec & HB_ACODEC_PASS_FLAG) &&
         audio->config.in.samplerate != audio->config.out.samplerate)
@@ -2261,6 +2438,7 @@ fail:
             }
             hb_list_close(&pv->stream->delta_list);
             hb_list_close(&pv->stream->in_queue);
+            hb_lock_close(&pv->stream->inbox_lock);
         }
     }
     free(pv);
@@ -2293,6 +2471,8 @@ static int InitSubtitle( sync_common_t * common, int index )
     pv->stream->max_len           = SYNC_MAX_SUBTITLE_QUEUE_LEN;
     pv->stream->min_len           = SYNC_MIN_SUBTITLE_QUEUE_LEN;
     if (pv->stream->in_queue == NULL) goto fail;
+    pv->stream->inbox_lock        = hb_lock_init();
+    if (pv->stream->inbox_lock == NULL) goto fail;
     pv->stream->delta_list        = hb_list_init();
     if (pv->stream->delta_list == NULL) goto fail;
     pv->stream->type              = SYNC_TYPE_SUBTITLE;
@@ -2305,6 +2485,12 @@ static int InitSubtitle( sync_common_t * common, int index )
     pv->stream->subtitle.subtitle = subtitle;
     pv->stream->fifo_out          = subtitle->fifo_out;
     pv->stream->fifo_in           = subtitle->fifo_in;
+    if (common->job->pass_id == HB_PASS_ENCODE_1ST)
+    {
+        hb_interjob_t * interjob = common->job->interjob;
+        pv->stream->cache = hb_frame_cache_subtitle(interjob->frame_cache,
+                                                    index);
+    }
 
     w = hb_get_work(common->job->h, WORK_SYNC_SUBTITLE);
     w->private_data = pv;
@@ -2342,6 +2528,7 @@ fail:
         {
             hb_list_close(&pv->stream->delta_list);
             hb_list_close(&pv->stream->in_queue);
+            hb_lock_close(&pv->stream->inbox_lock);
         }
     }
     free(pv);
@@ -2391,6 +2578,8 @@ static int syncVideoInit( hb_work_object_t * w, hb_job_t * job)
     pv->stream->max_len         = SYNC_MAX_VIDEO_QUEUE_LEN;
     pv->stream->min_len         = SYNC_MIN_VIDEO_QUEUE_LEN;
     if (pv->stream->in_queue == NULL) goto fail;
+    pv->stream->inbox_lock      = hb_lock_init();
+    if (pv->stream->inbox_lock == NULL) goto fail;
     pv->stream->delta_list      = hb_list_init();
     if (pv->stream->delta_list == NULL) goto fail;
     pv->stream->type            = SYNC_TYPE_VIDEO;
@@ -2409,7 +2598,7 @@ static int syncVideoInit( hb_work_object_t * w, hb_job_t * job)
     if (job->pass_id == HB_PASS_ENCODE_2ND)
     {
         /* We already have an accurate frame count from pass 1 */
-        hb_interjob_t * interjob = hb_interjob_get(job->h);
+        hb_interjob_t * interjob = job->interjob;
         pv->common->est_frame_count = interjob->frame_count;
     }
     else
@@ -2522,6 +2711,10 @@ fail:
             }
             hb_list_close(&pv->common->list_work);
             hb_lock_close(&pv->common->mutex);
+            if (pv->common->streams != NULL)
+            {
+                closeInboxes(pv->common);
+            }
             if (pv->stream != NULL)
             {
                 hb_list_close(&pv->stream->delta_list);
@@ -2570,7 +2763,7 @@ static void syncVideoClose( hb_work_object_t * w )
     if( job->pass_id == HB_PASS_ENCODE_1ST )
     {
         /* Preserve frame count for better accuracy in pass 2 */
-        hb_interjob_t * interjob = hb_interjob_get( job->h );
+        hb_interjob_t * interjob = job->interjob;
         interjob->frame_count = pv->stream->frame_count;
     }
     sync_delta_t * delta;
@@ -2597,6 +2790,9 @@ static void syncVideoClose( hb_work_object_t * w )
     }
     hb_list_close(&pv->common->list_work);
 
+    // Any sync thread may drain any stream's inbox, so the inboxes can
+    // only be freed once all the sync threads have exited
+    closeInboxes(pv->common);
     hb_lock_close(&pv->common->mutex);
     free(pv->common->streams);
     free(pv->common);
@@ -2974,12 +3170,16 @@ static int syncVideoWork( hb_work_object_t * w, hb_buffer_t ** buf_in,
     }
     if (in->s.flags & HB_BUF_FLAG_EOF)
     {
-        pv->stream->flush = 1;
-        flushStreamsLock(pv->common);
+        hb_job_t * job = pv->common->job;
+        int subtitles_done = flushStreamsLock(pv->stream);
         // Ideally, we would only do this subtitle scan check in
         // syncSubtitleWork, but someone might try to do a subtitle
         // scan on a source that has no subtitles :-(
-        if (pv->common->job->indepth_scan)
+        //
+        // When no video is decoded, the reader sends the video EOF
+        // straight here while the subtitle decoders are still counting.
+        // Then the subtitle EOFs end the scan.
+        if (job->indepth_scan && (job->fifo_mpeg2 != NULL || subtitles_done))
         {
             // When doing subtitle indepth scan, the pipeline ends at sync.
             // Terminate job when EOF reached.
@@ -3065,8 +3265,7 @@ static int syncAudioWork( hb_work_object_t * w, hb_buffer_t ** buf_in,
     }
     if (in->s.flags & HB_BUF_FLAG_EOF)
     {
-        pv->stream->flush = 1;
-        flushStreamsLock(pv->common);
+        flushStreamsLock(pv->stream);
         return HB_WORK_DONE;
     }
 
@@ -3232,7 +3431,7 @@ static void UpdateState( sync_common_t * common, int frame_count )
         common->st_counts[3] = frame_count;
     }
 
-    hb_get_state2(job->h, &state);
+    hb_get_job_state(job, &state);
     state.state = HB_STATE_WORKING;
 
 #define p state.param.working
@@ -3262,7 +3461,7 @@ static void UpdateState( sync_common_t * common, int frame_count )
     }
 #undef p
 
-    hb_set_state(job->h, &state);
+    hb_set_job_state(job, &state);
 }
 
 static void UpdateSearchState( sync_common_t * common, int64_t start,
@@ -3289,7 +3488,7 @@ static void UpdateSearchState( sync_common_t * common, int64_t start,
         job->st_paused = 0;
     }
 
-    hb_get_state2(job->h, &state);
+    hb_get_job_state(job, &state);
     state.state = HB_STATE_SEARCHING;
 
 #define p state.param.working
@@ -3330,7 +3529,7 @@ static void UpdateSearchState( sync_common_t * common, int64_t start,
     }
 #undef p
 
-    hb_set_state(job->h, &state);
+    hb_set_job_state(job, &state);
 }
 
 static int syncSubtitleInit( hb_work_object_t * w, hb_job_t * job )
@@ -3374,12 +3573,11 @@ static int syncSubtitleWork( hb_work_object_t * w, hb_buffer_t ** buf_in,
     }
     if (in->s.flags & HB_BUF_FLAG_EOF)
     {
-        pv->stream->flush = 1;
-        // sanitizeSubtitle requires EOF buffer to recognize that
-        // it needs to flush all subtitles.
-        hb_list_add(pv->stream->in_queue, hb_buffer_eof_init());
-        flushStreamsLock(pv->common);
-        if (pv->common->job->indepth_scan)
+        hb_job_t * job = pv->common->job;
+        int subtitles_done = flushStreamsLock(pv->stream);
+        // Without a video decoder, wait for the EOF of every subtitle
+        // stream, see syncVideoWork
+        if (job->indepth_scan && (job->fifo_mpeg2 != NULL || subtitles_done))
         {
             // When doing subtitle indepth scan, the pipeline ends at sync.
             // Terminate job when EOF reached.
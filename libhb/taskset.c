@@ -11,187 +11,419 @@
 #include "ports.h"
 #include "taskset.h"
 
+/*
+ * Process-wide thread pool
+ *
+ * All tasksets share one pool of hb_get_cpu_count() worker threads, so the
+ * number of threads doing filter work matches the hardware no matter how
+ * many multi-threaded filters are in the chain.
+ *
+ * Every worker has its own deque of tasks.  taskset_cycle spreads the
+ * taskset's tasks across the worker deques, wakes the workers and then
+ * helps run its own tasks until all of them have completed.  A worker
+ * takes tasks from the bottom of its own deque and, when that is empty,
+ * steals from the top of the other workers' deques.  So cores that a
+ * filter leaves idle are picked up by whichever filters have work queued.
+ *
+ * The workers are started by the first taskset_init and stopped by
+ * hb_taskset_pool_close.
+ *
+ * A task must not call taskset_cycle.  The nested cycle would block the
+ * worker running the task until the nested tasks complete, so its tasks
+ * are run inline instead.
+ */
+
+struct hb_task_s
+{
+    taskset_t * ts;
+    int         index;
+};
+
+typedef struct
+{
+    hb_lock_t  * lock;
+    hb_task_t ** tasks;     // Circular buffer
+    int          capacity;  // Power of 2
+    int          top;       // Next task to steal
+    int          bottom;    // Next free slot
+} task_deque_t;
+
+static struct
+{
+    hb_lock_t     * lock;       // Protects startup and sleeping workers
+    hb_cond_t     * cond;       // Idle workers wait here for tasks
+    int             pending;    // Tasks queued and not yet taken
+    int             stop;
+    int             count;      // Number of workers
+    uint32_t        next;       // Next deque to queue a task to
+    hb_thread_t  ** threads;
+    task_deque_t  * deques;
+    hb_tls_t      * in_task;    // Set while a thread runs a task
+    int             nested;     // Nested cycles run inline so far
+} pool;
+
+typedef struct
+{
+    int index;
+} pool_thread_arg_t;
+
+static pool_thread_arg_t * pool_args;
+
+static void deque_push( task_deque_t * dq, hb_task_t * task )
+{
+    hb_lock( dq->lock );
+    if( dq->bottom - dq->top >= dq->capacity )
+    {
+        int          ii, capacity = dq->capacity ? dq->capacity * 2 : 16;
+        hb_task_t ** tasks = malloc( capacity * sizeof( hb_task_t * ) );
+
+        for( ii = dq->top; ii < dq->bottom; ii++ )
+        {
+            tasks[ii & ( capacity - 1 )] =
+                dq->tasks[ii & ( dq->capacity - 1 )];
+        }
+        free( dq->tasks );
+        dq->tasks    = tasks;
+        dq->capacity = capacity;
+    }
+    dq->tasks[dq->bottom & ( dq->capacity - 1 )] = task;
+    dq->bottom++;
+    hb_unlock( dq->lock );
+}
+
+// Takes the most recently queued task. Used by the deque's own worker.
+static hb_task_t * deque_pop( task_deque_t * dq )
+{
+    hb_task_t * task = NULL;
+
+    hb_lock( dq->lock );
+    if( dq->bottom > dq->top )
+    {
+        dq->bottom--;
+        task = dq->tasks[dq->bottom & ( dq->capacity - 1 )];
+    }
+    hb_unlock( dq->lock );
+
+    return task;
+}
+
+// Takes the oldest queued task. If 'ts' is not NULL, only a task
+// belonging to that taskset is taken.
+static hb_task_t * deque_steal( task_deque_t * dq, taskset_t * ts )
+{
+    hb_task_t * task = NULL;
+
+    hb_lock( dq->lock );
+    if( dq->bottom > dq->top )
+    {
+        task = dq->tasks[dq->top & ( dq->capacity - 1 )];
+        if( ts == NULL || task->ts == ts )
+        {
+            dq->top++;
+        }
+        else
+        {
+            task = NULL;
+        }
+    }
+    hb_unlock( dq->lock );
+
+    return task;
+}
+
+static hb_task_t * pool_steal( unsigned first, taskset_t * ts )
+{
+    hb_task_t * task;
+    int         ii;
+
+    for( ii = 0; ii < pool.count; ii++ )
+    {
+        task = deque_steal( &pool.deques[( first + ii ) % pool.count], ts );
+        if( task != NULL )
+        {
+            return task;
+        }
+    }
+    return NULL;
+}
+
+static void task_run( hb_task_t * task )
+{
+    taskset_t * ts = task->ts;
+
+    hb_atomic_sub( &pool.pending, 1 );
+    if( pool.in_task != NULL )
+    {
+        hb_tls_set( pool.in_task, task );
+    }
+    ts->task_func( taskset_thread_args( ts, task->index ) );
+    if( pool.in_task != NULL )
+    {
+        hb_tls_set( pool.in_task, NULL );
+    }
+
+    if( hb_atomic_sub( &ts->remaining, 1 ) == 0 )
+    {
+        hb_lock( ts->task_cond_lock );
+        hb_cond_signal( ts->task_complete );
+        hb_unlock( ts->task_cond_lock );
+    }
+}
+
+static void pool_thread( void * _arg )
+{
+    pool_thread_arg_t * arg = _arg;
+    task_deque_t      * dq  = &pool.deques[arg->index];
+    hb_task_t         * task;
+
+    // pool_start holds pool.lock until it has started all the workers
+    // and set pool.count to the number that did start
+    hb_lock( pool.lock );
+    hb_unlock( pool.lock );
+
+    while( 1 )
+    {
+        task = deque_pop( dq );
+        if( task == NULL )
+        {
+            task = pool_steal( arg->index + 1, NULL );
+        }
+        if( task != NULL )
+        {
+            task_run( task );
+            continue;
+        }
+
+        hb_lock( pool.lock );
+        if( pool.stop )
+        {
+            hb_unlock( pool.lock );
+            break;
+        }
+        if( hb_atomic_load( &pool.pending ) == 0 )
+        {
+            hb_cond_wait( pool.cond, pool.lock );
+        }
+        hb_unlock( pool.lock );
+    }
+}
+
+void hb_taskset_pool_init( void )
+{
+    memset( &pool, 0, sizeof( pool ) );
+    pool.lock    = hb_lock_init();
+    pool.cond    = hb_cond_init();
+    pool.in_task = hb_tls_init( NULL );
+}
+
+// Starts the worker threads. Called with pool.lock held.
+static int pool_start( void )
+{
+    int ii;
+
+    if( pool.count > 0 )
+    {
+        return 1;
+    }
+
+    int count    = hb_get_cpu_count();
+    pool.deques  = calloc( count, sizeof( task_deque_t ) );
+    pool.threads = calloc( count, sizeof( hb_thread_t * ) );
+    pool_args    = calloc( count, sizeof( pool_thread_arg_t ) );
+    if( pool.deques == NULL || pool.threads == NULL || pool_args == NULL )
+    {
+        free( pool.deques );
+        free( pool.threads );
+        free( pool_args );
+        pool.deques  = NULL;
+        pool.threads = NULL;
+        pool_args    = NULL;
+        return 0;
+    }
+    for( ii = 0; ii < count; ii++ )
+    {
+        pool.deques[ii].lock = hb_lock_init();
+    }
+    for( ii = 0; ii < count; ii++ )
+    {
+        pool_args[ii].index = ii;
+        pool.threads[ii] = hb_thread_init( "taskset_pool", pool_thread,
+                                           &pool_args[ii], HB_NORMAL_PRIORITY );
+        if( pool.threads[ii] == NULL )
+        {
+            break;
+        }
+    }
+    if( ii < count )
+    {
+        hb_error( "taskset: could only start %d of %d pool threads",
+                  ii, count );
+        // Workers wait for pool.lock before they look at the deques,
+        // so the pool can still shrink to the workers that did start
+        for( ; count > ii; count-- )
+        {
+            hb_lock_close( &pool.deques[count - 1].lock );
+        }
+        if( count == 0 )
+        {
+            free( pool.deques );
+            free( pool.threads );
+            free( pool_args );
+            pool.deques  = NULL;
+            pool.threads = NULL;
+            pool_args    = NULL;
+            return 0;
+        }
+    }
+    pool.count = count;
+    hb_log( "taskset: started thread pool with %d threads", count );
+
+    return 1;
+}
+
+void hb_taskset_pool_close( void )
+{
+    int ii;
+
+    if( pool.lock == NULL )
+    {
+        return;
+    }
+
+    hb_lock( pool.lock );
+    pool.stop = 1;
+    hb_cond_broadcast( pool.cond );
+    hb_unlock( pool.lock );
+
+    for( ii = 0; ii < pool.count; ii++ )
+    {
+        hb_thread_close( &pool.threads[ii] );
+        hb_lock_close( &pool.deques[ii].lock );
+        free( pool.deques[ii].tasks );
+    }
+    free( pool.threads );
+    free( pool.deques );
+    free( pool_args );
+    pool_args = NULL;
+
+    hb_lock_close( &pool.lock );
+    hb_cond_close( &pool.cond );
+    hb_tls_close( &pool.in_task );
+    memset( &pool, 0, sizeof( pool ) );
+}
+
 int
-taskset_init( taskset_t *ts, int thread_count, size_t arg_size )
+taskset_init( taskset_t *ts, int thread_count, size_t arg_size,
+              thread_func_t *task_func )
 {
-    int init_step;
+    int ii, started;
 
-    init_step = 0;
     memset( ts, 0, sizeof( *ts ) );
     ts->thread_count = thread_count;
     ts->arg_size = arg_size;
-    ts->bitmap_elements = ( ts->thread_count + 31 ) / 32;
-    ts->task_threads = malloc( sizeof( hb_thread_t* ) * ts->thread_count );
-    if( ts->task_threads == NULL )
+    ts->task_func = task_func;
+
+    hb_lock( pool.lock );
+    started = pool_start();
+    hb_unlock( pool.lock );
+    if( !started )
+        goto fail;
+
+    ts->tasks = calloc( thread_count, sizeof( hb_task_t ) );
+    if( ts->tasks == NULL )
         goto fail;
-    init_step++;
+    for( ii = 0; ii < thread_count; ii++ )
+    {
+        ts->tasks[ii].ts    = ts;
+        ts->tasks[ii].index = ii;
+    }
 
+    /*
+     * Initialize all arg data to 0.
+     */
     if( arg_size != 0 )
     {
-        ts->task_threads_args = malloc( arg_size * ts->thread_count );
-        if( ts->task_threads == NULL )
+        ts->task_threads_args = calloc( thread_count, arg_size );
+        if( ts->task_threads_args == NULL )
             goto fail;
     }
-    init_step++;
-
-    ts->task_begin_bitmap = malloc( sizeof( uint32_t  ) * ts->bitmap_elements );
-    if( ts->task_begin_bitmap == NULL )
-        goto fail;
-    init_step++;
-
-    ts->task_complete_bitmap = malloc( sizeof( uint32_t ) * ts->bitmap_elements );
-    if( ts->task_complete_bitmap == NULL )
-        goto fail;
-    init_step++;
-
-    ts->task_stop_bitmap = malloc( sizeof( uint32_t ) * ts->bitmap_elements );
-    if( ts->task_stop_bitmap == NULL )
-        goto fail;
-    init_step++;
 
     ts->task_cond_lock = hb_lock_init();
     if( ts->task_cond_lock == NULL)
         goto fail;
-    init_step++;
-
-    ts->task_begin = hb_cond_init();
-    if( ts->task_begin == NULL)
-        goto fail;
-    init_step++;
 
     ts->task_complete = hb_cond_init();
     if( ts->task_complete == NULL)
         goto fail;
-    init_step++;
-
-    /*
-     * Initialize all arg data to 0.
-     */
-    memset(ts->task_threads_args, 0, ts->arg_size * ts->thread_count );
 
-    /*
-     * Inialize bitmaps to all bits set.  This means that any unused bits
-     * in the bitmap are already in the "condition satisfied" state allowing
-     * us to test the bitmap 32bits at a time without having to mask off
-     * the end.
-     */
-    memset(ts->task_begin_bitmap, 0xFF, sizeof( uint32_t ) * ts->bitmap_elements );
-    memset(ts->task_complete_bitmap, 0xFF, sizeof( uint32_t ) * ts->bitmap_elements );
-    memset(ts->task_stop_bitmap, 0, sizeof( uint32_t ) * ts->bitmap_elements );
-    
-    /*
-     * Important to start off with the threads locked waiting
-     * on input, no work completed, and not asked to stop.
-     */
-    bit_nclear( ts->task_begin_bitmap, 0, ts->thread_count - 1 );
-    bit_nclear( ts->task_complete_bitmap, 0, ts->thread_count - 1 );
-    bit_nclear( ts->task_stop_bitmap, 0, ts->thread_count - 1 );
     return (1);
 
 fail:
-    switch (init_step)
-    {
-        default:
-            hb_cond_close( &ts->task_complete );
-            /* FALL THROUGH */
-        case 7:
-            hb_cond_close( &ts->task_begin );
-            /* FALL THROUGH */
-        case 6:
-            hb_lock_close( &ts->task_cond_lock );
-            /* FALL THROUGH */
-        case 5:
-            free( ts->task_stop_bitmap );
-            /* FALL THROUGH */
-        case 4:
-            free( ts->task_complete_bitmap );
-            /* FALL THROUGH */
-        case 3:
-            free( ts->task_begin_bitmap );
-            /* FALL THROUGH */
-        case 2:
-            if( ts->task_threads_args == NULL )
-                free( ts->task_threads_args );
-            /* FALL THROUGH */
-        case 1:
-            free( ts->task_threads );
-            /* FALL THROUGH */
-        case 0:
-            break;
-    }
+    hb_lock_close( &ts->task_cond_lock );
+    free( ts->task_threads_args );
+    free( ts->tasks );
+    memset( ts, 0, sizeof( *ts ) );
     return (0);
 }
 
-int
-taskset_thread_spawn( taskset_t *ts, int thr_idx, const char *descr,
-                      thread_func_t *func, int priority )
-{
-    ts->task_threads[thr_idx] = hb_thread_init( descr, func,
-                                                taskset_thread_args( ts, thr_idx ),
-                                                priority);
-    return( ts->task_threads[thr_idx] != NULL );
-}
-
 void
 taskset_cycle( taskset_t *ts )
 {
-    hb_lock( ts->task_cond_lock );
+    hb_task_t * task;
+    int         ii;
+    unsigned    first;
 
-    /*
-     * Signal all threads that their work is available.
-     */
-    bit_nset( ts->task_begin_bitmap, 0, ts->thread_count - 1 );
-    hb_cond_broadcast( ts->task_begin );
+    if( ts->tasks == NULL )
+        return;
 
-    /*
-     * Wait until all threads have completed.  Note that we must
-     * loop here as hb_cond_wait() on some platforms (e.g pthead_cond_wait)
-     * may unblock prematurely.
-     */
-    do
+    // See the restriction on nested cycles at the top of this file
+    if( pool.in_task != NULL && hb_tls_get( pool.in_task ) != NULL )
     {
-        hb_cond_wait( ts->task_complete, ts->task_cond_lock );
-    } while ( !allbits_set( ts->task_complete_bitmap, ts->bitmap_elements ) );
+        if( hb_atomic_add( &pool.nested, 1 ) == 1 )
+        {
+            hb_error( "taskset: taskset_cycle called from a task, "
+                      "running the nested tasks inline" );
+        }
+        for( ii = 0; ii < ts->thread_count; ii++ )
+        {
+            ts->task_func( taskset_thread_args( ts, ii ) );
+        }
+        return;
+    }
 
     /*
-     * Clear completion indications for next time.
+     * Queue all tasks, spread over the workers' deques.
      */
-    bit_nclear( ts->task_complete_bitmap, 0, ts->thread_count - 1 );
+    hb_atomic_store( &ts->remaining, ts->thread_count );
+    first = hb_atomic_add( &pool.next, ts->thread_count ) - ts->thread_count;
+    for( ii = 0; ii < ts->thread_count; ii++ )
+    {
+        deque_push( &pool.deques[( first + ii ) % pool.count], &ts->tasks[ii] );
+    }
+    hb_atomic_add( &pool.pending, ts->thread_count );
 
-    hb_unlock( ts->task_cond_lock );
-}
-
-/*
- * Block current thread until work is available for it.
- */
-void
-taskset_thread_wait4start( taskset_t *ts, int thr_idx )
-{
-    hb_lock( ts->task_cond_lock );
-    while ( bit_is_clear( ts->task_begin_bitmap, thr_idx ) )
-        hb_cond_wait( ts->task_begin, ts->task_cond_lock );
+    hb_lock( pool.lock );
+    hb_cond_broadcast( pool.cond );
+    hb_unlock( pool.lock );
 
     /*
-     * We've been released for one run.  Insure we block the next
-     * time through the loop.
+     * Help run this taskset's tasks while waiting for them to complete.
      */
-    bit_clear( ts->task_begin_bitmap, thr_idx );
-    hb_unlock( ts->task_cond_lock );
-}
+    while( hb_atomic_load( &ts->remaining ) > 0 &&
+           ( task = pool_steal( first, ts ) ) != NULL )
+    {
+        task_run( task );
+    }
 
-/*
- * Current thread has completed its work.  Indicate completion,
- * and if all threads in this task set have completed, wakeup
- * anyone waiting for this condition.
- */
-void
-taskset_thread_complete( taskset_t *ts, int thr_idx )
-{
+    /*
+     * Wait until all tasks have completed.  Note that we must
+     * loop here as hb_cond_wait() on some platforms (e.g pthead_cond_wait)
+     * may unblock prematurely.
+     */
     hb_lock( ts->task_cond_lock );
-    bit_set( ts->task_complete_bitmap, thr_idx );
-    if( allbits_set( ts->task_complete_bitmap, ts->bitmap_elements ) )
+    while( hb_atomic_load( &ts->remaining ) > 0 )
     {
-        hb_cond_signal( ts->task_complete );
+        hb_cond_wait( ts->task_complete, ts->task_cond_lock );
     }
     hb_unlock( ts->task_cond_lock );
 }
@@ -199,36 +431,13 @@ taskset_thread_complete( taskset_t *ts, int thr_idx )
 void
 taskset_fini( taskset_t *ts )
 {
-    int i;
-
-    hb_lock( ts->task_cond_lock );
     /*
-     * Tell each thread to stop, and then cleanup.
+     * Tasks only run inside taskset_cycle, so there is nothing running
+     * that could still reference the taskset.
      */
-    bit_nset( ts->task_stop_bitmap, 0, ts->thread_count - 1 );
-    bit_nset( ts->task_begin_bitmap, 0, ts->thread_count - 1 );
-    hb_cond_broadcast( ts->task_begin );
-
-    /*
-     * Wait for all threads to exit.
-     */
-    hb_cond_wait( ts->task_complete, ts->task_cond_lock );
-    hb_unlock( ts->task_cond_lock );
-
-    /*
-     * Clean up taskset memory.
-     */
-    for( i = 0; i < ts->thread_count; i++)
-    {
-        hb_thread_close( &ts->task_threads[i] );
-    }
     hb_lock_close( &ts->task_cond_lock );
-    hb_cond_close( &ts->task_begin );
     hb_cond_close( &ts->task_complete );
-    free( ts->task_threads );
-    if( ts->task_threads_args != NULL )
-        free( ts->task_threads_args );
-    free( ts->task_begin_bitmap );
-    free( ts->task_complete_bitmap );
-    free( ts->task_stop_bitmap );
+    free( ts->tasks );
+    free( ts->task_threads_args );
+    memset( ts, 0, sizeof( *ts ) );
 }
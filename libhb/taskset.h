@@ -10,35 +10,39 @@
 #ifndef HB_TASKSET_H
 #define HB_TASKSET_H
 
-#define TASKSET_POSIX_COMPLIANT 1
+/*
+ * A taskset is a fixed number of tasks that all run the same function,
+ * each with its own argument block (e.g. one task per slice of a frame).
+ * taskset_cycle runs every task once on the process-wide thread pool
+ * and returns when all of them have completed.
+ *
+ * Tasks must not call taskset_cycle themselves; a nested cycle would tie
+ * up the pool worker running the outer task.  A nested cycle is logged
+ * as an error and runs its tasks one after another on the calling thread.
+ */
 
-#include "bits.h"
+typedef struct hb_task_s hb_task_t;
 
 typedef struct hb_taskset_s {
-    int                thread_count;
+    int                thread_count;         // Number of tasks
     int                arg_size;
-    int                bitmap_elements;
-    hb_thread_t     ** task_threads;
     uint8_t          * task_threads_args;
-    uint32_t         * task_begin_bitmap;    // Threads can begin
-    uint32_t         * task_complete_bitmap; // Threads have completed
-    uint32_t         * task_stop_bitmap;     // Threads should exit
+    thread_func_t    * task_func;            // Run once per task per cycle
+    hb_task_t        * tasks;
+    int                remaining;            // Tasks not yet completed
     hb_lock_t        * task_cond_lock;       // Held during condition tests
-    hb_cond_t        * task_begin;           // Threads can begin work
-    hb_cond_t        * task_complete;        // Threads have finished work.
+    hb_cond_t        * task_complete;        // All tasks have finished
 } taskset_t;
 
-int taskset_init( taskset_t *, int /*thread_count*/, size_t /*user_arg_size*/ );
+int taskset_init( taskset_t *, int /*thread_count*/, size_t /*user_arg_size*/,
+                  thread_func_t * /*task_func*/ );
 void taskset_cycle( taskset_t * );
 void taskset_fini( taskset_t * );
 
-int  taskset_thread_spawn( taskset_t *, int /*thr_idx*/, const char * /*descr*/,
-                           thread_func_t *, int /*priority*/ );
-void taskset_thread_wait4start( taskset_t *, int );
-void taskset_thread_complete( taskset_t *, int );
+void hb_taskset_pool_init( void );
+void hb_taskset_pool_close( void );
 
 static inline void *taskset_thread_args( taskset_t *, int );
-static inline int   taskset_thread_stop( taskset_t *, int );
 
 static inline void *
 taskset_thread_args( taskset_t *ts, int thr_idx )
@@ -46,10 +50,4 @@ taskset_thread_args( taskset_t *ts, int thr_idx )
     return( ts->task_threads_args + ( ts->arg_size * thr_idx ) );
 }
 
-static inline int
-taskset_thread_stop( taskset_t *ts, int thr_idx )
-{
-    return bit_is_set( ts->task_stop_bitmap, thr_idx );
-}
-
 #endif /* HB_TASKSET_H */
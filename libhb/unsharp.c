@@ -9,6 +9,8 @@
  */
 
 #include "hb.h"
+#include "taskset.h"
+#include "unsharp.h"
 
 #define UNSHARP_STRENGTH_LUMA_DEFAULT 0.25
 #define UNSHARP_SIZE_LUMA_DEFAULT 7
@@ -33,15 +35,28 @@ typedef struct
 typedef struct
 {
     uint32_t * SC[UNSHARP_SIZE_MAX - 1];
+    uint32_t * line;    // Row being blurred
+    uint32_t * tmp;     // Scratch for blur_h
 } unsharp_thread_context_t;
 
 typedef unsharp_thread_context_t unsharp_thread_context3_t[3];
 
+typedef struct
+{
+    hb_filter_private_t * pv;
+    int                   segment;
+} unsharp_thread_arg_t;
+
 struct hb_filter_private_s
 {
     unsharp_plane_context_t     plane_ctx[3];
+    UnsharpFunctions            functions;
     unsharp_thread_context3_t * thread_ctx;
     int                         threads;
+
+    taskset_t                   taskset;  // Tasks - one band of rows each
+    hb_buffer_t               * in;
+    hb_buffer_t               * out;
 };
 
 static int unsharp_init(hb_filter_object_t *filter,
@@ -52,9 +67,6 @@ static int unsharp_init_thread(hb_filter_object_t *filter, int threads);
 static int unsharp_work(hb_filter_object_t *filter,
                         hb_buffer_t ** buf_in,
                         hb_buffer_t ** buf_out);
-static int unsharp_work_thread(hb_filter_object_t *filter,
-                               hb_buffer_t ** buf_in,
-                               hb_buffer_t ** buf_out, int thread);
 
 static void unsharp_close(hb_filter_object_t *filter);
 
@@ -70,28 +82,102 @@ hb_filter_object_t hb_filter_unsharp =
     .name              = "Sharpen (unsharp)",
     .settings          = NULL,
     .init              = unsharp_init,
-    .init_thread       = unsharp_init_thread,
     .work              = unsharp_work,
-    .work_thread       = unsharp_work_thread,
     .close             = unsharp_close,
     .settings_template = unsharp_template,
 };
 
-static void unsharp(const uint8_t *src,
+static void unsharp_blur_h(const uint8_t  *src,
+                                 uint32_t *dst,
+                                 uint32_t *tmp,
+                                 int       width,
+                                 int       steps)
+{
+    uint32_t SR[UNSHARP_SIZE_MAX - 1],
+             Tmp1,
+             Tmp2;
+    int x, z;
+
+    memset(SR, 0, sizeof(SR[0]) * (2 * steps));
+
+    for (x = -steps; x < width + steps; x++)
+    {
+        Tmp1 = x <= 0 ? src[0] : x >= width ? src[width - 1] : src[x];
+
+        for (z = 0; z < steps * 2; z += 2)
+        {
+            Tmp2 = SR[z + 0] + Tmp1; SR[z + 0] = Tmp1;
+            Tmp1 = SR[z + 1] + Tmp2; SR[z + 1] = Tmp2;
+        }
+
+        if (x >= steps)
+        {
+            dst[x - steps] = Tmp1;
+        }
+    }
+}
+
+static void unsharp_blur_v(uint32_t  *line,
+                           uint32_t **SC,
+                           int        width,
+                           int        steps)
+{
+    uint32_t Tmp1,
+             Tmp2;
+    int x, z;
+
+    for (x = 0; x < width; x++)
+    {
+        Tmp1 = line[x];
+
+        for (z = 0; z < steps * 2; z += 2)
+        {
+            Tmp2 = SC[z + 0][x] + Tmp1; SC[z + 0][x] = Tmp1;
+            Tmp1 = SC[z + 1][x] + Tmp2; SC[z + 1][x] = Tmp2;
+        }
+
+        line[x] = Tmp1;
+    }
+}
+
+static void unsharp_apply(const uint8_t  *src,
+                                uint8_t  *dst,
+                          const uint32_t *blur,
+                                int       width,
+                                int       amount,
+                                int       scalebits,
+                                int32_t   halfscale)
+{
+    int32_t res;
+    int x;
+
+    for (x = 0; x < width; x++)
+    {
+        res = (int32_t)src[x] + ((((int32_t)src[x] -
+             (int32_t)((blur[x] + halfscale) >> scalebits)) * amount) >> 16);
+        dst[x] = res > 255 ? 255 : res < 0 ? 0 : (uint8_t)res;
+    }
+}
+
+/*
+ * Sharpens rows y_start to y_end - 1.  A blurred row only depends on the
+ * 2 * steps + 1 source rows around it, so the column sums are primed with
+ * the 2 * steps rows above the band and bands can be done independently.
+ */
+static void unsharp(hb_filter_private_t *pv,
+                    const uint8_t *src,
                           uint8_t *dst,
                     const int width,
                     const int height,
                     const int stride,
+                    const int y_start,
+                    const int y_end,
                     unsharp_plane_context_t * ctx,
                     unsharp_thread_context_t * tctx)
 {
+    UnsharpFunctions * functions = &pv->functions;
     uint32_t **SC = tctx->SC;
-    uint32_t SR[UNSHARP_SIZE_MAX - 1],
-             Tmp1,
-             Tmp2;
-    const uint8_t *src2 = src; // avoid gcc warning
-    int32_t res;
-    int x, y, z;
+    int y;
     int amount        = ctx->amount;
     int steps         = ctx->steps;
     int scalebits     = ctx->scalebits;
@@ -101,7 +187,8 @@ static void unsharp(const uint8_t *src,
     {
         if (src != dst)
         {
-            memcpy(dst, src, stride*height);
+            memcpy(dst + stride*y_start, src + stride*y_start,
+                   stride*(y_end - y_start));
         }
 
         return;
@@ -109,50 +196,50 @@ static void unsharp(const uint8_t *src,
 
     for (y = 0; y < 2 * steps; y++)
     {
-        memset(SC[y], 0, sizeof(SC[y][0]) * (width + 2 * steps));
+        memset(SC[y], 0, sizeof(SC[y][0]) * width);
     }
 
-    for (y = -steps; y < height + steps; y++)
+    for (y = y_start - steps; y < y_end + steps; y++)
     {
-        if (y < height)
-        {
-            src2 = src;
-        }
+        const uint8_t * src2 = src + stride * (y < 0 ? 0 :
+                                               y >= height ? height - 1 : y);
 
-        memset(SR, 0, sizeof(SR[0]) * (2 * steps - 1));
+        functions->blur_h(src2, tctx->line, tctx->tmp, width, steps);
+        functions->blur_v(tctx->line, SC, width, steps);
 
-        for (x = -steps; x < width + steps; x++)
+        if (y >= y_start + steps)
         {
-            Tmp1 = x <= 0 ? src2[0] : x >= width ? src2[width - 1] : src2[x];
-
-            for (z = 0; z < steps * 2; z += 2)
-            {
-                Tmp2 = SR[z + 0] + Tmp1; SR[z + 0] = Tmp1;
-                Tmp1 = SR[z + 1] + Tmp2; SR[z + 1] = Tmp2;
-            }
-
-            for (z = 0; z < steps * 2; z += 2)
-            {
-                Tmp2 = SC[z + 0][x + steps] + Tmp1; SC[z + 0][x + steps] = Tmp1;
-                Tmp1 = SC[z + 1][x + steps] + Tmp2; SC[z + 1][x + steps] = Tmp2;
-            }
-
-            if (x >= steps && y >= steps)
-            {
-                const uint8_t * srx = src - steps * stride + x - steps;
-                uint8_t       * dsx = dst - steps * stride + x - steps;
-        
-                res = (int32_t)*srx + ((((int32_t)*srx -
-                     (int32_t)((Tmp1 + halfscale) >> scalebits)) * amount) >> 16);
-                *dsx = res > 255 ? 255 : res < 0 ? 0 : (uint8_t)res;
-            }
+            functions->apply(src + stride * (y - steps),
+                             dst + stride * (y - steps),
+                             tctx->line, width, amount, scalebits, halfscale);
         }
+    }
+}
 
-        if (y >= 0)
-        {
-            dst += stride;
-            src += stride;
-        }
+/*
+ * Sharpens this task's band of rows of each plane
+ */
+static void unsharp_thread(void *thread_args_v)
+{
+    unsharp_thread_arg_t * thread_args = thread_args_v;
+    hb_filter_private_t  * pv          = thread_args->pv;
+    int                    segment     = thread_args->segment;
+
+    for (int c = 0; c < 3; c++)
+    {
+        unsharp_plane_context_t  * ctx  = &pv->plane_ctx[c];
+        unsharp_thread_context_t * tctx = &pv->thread_ctx[segment][c];
+        int height = pv->in->plane[c].height;
+
+        unsharp(pv,
+                pv->in->plane[c].data,
+                pv->out->plane[c].data,
+                pv->in->plane[c].width,
+                height,
+                pv->in->plane[c].stride,
+                height *  segment      / pv->threads,
+                height * (segment + 1) / pv->threads,
+                ctx, tctx);
     }
 }
 
@@ -230,11 +317,34 @@ static int unsharp_init(hb_filter_object_t *filter,
         ctx->halfscale = 1 << (ctx->scalebits - 1);
     }
 
-    if (unsharp_init_thread(filter, 1) < 0)
+    pv->functions.blur_h = unsharp_blur_h;
+    pv->functions.blur_v = unsharp_blur_v;
+    pv->functions.apply  = unsharp_apply;
+#if defined(ARCH_X86)
+    unsharp_init_x86(&pv->functions);
+#endif
+
+    int threads = hb_get_cpu_count();
+    if (unsharp_init_thread(filter, threads) < 0)
+    {
+        return -1;
+    }
+
+    if (taskset_init(&pv->taskset, threads,
+                     sizeof(unsharp_thread_arg_t), unsharp_thread) == 0)
     {
+        hb_error("Unsharp could not initialize taskset");
         unsharp_close(filter);
         return -1;
     }
+    for (int ii = 0; ii < threads; ii++)
+    {
+        unsharp_thread_arg_t * thread_args;
+
+        thread_args = taskset_thread_args(&pv->taskset, ii);
+        thread_args->pv      = pv;
+        thread_args->segment = ii;
+    }
 
     return 0;
 }
@@ -253,6 +363,10 @@ static void unsharp_thread_close(hb_filter_private_t *pv)
                 free(tctx->SC[z]);
                 tctx->SC[z] = NULL;
             }
+            free(tctx->line);
+            free(tctx->tmp);
+            tctx->line = NULL;
+            tctx->tmp  = NULL;
         }
     }
     free(pv->thread_ctx);
@@ -276,8 +390,7 @@ static int unsharp_init_thread(hb_filter_object_t *filter, int threads)
             int z;
             for (z = 0; z < 2 * ctx->steps; z++)
             {
-                tctx->SC[z] = malloc(sizeof(*(tctx->SC[z])) *
-                                     (w + 2 * ctx->steps));
+                tctx->SC[z] = malloc(sizeof(*(tctx->SC[z])) * w);
                 if (tctx->SC[z] == NULL)
                 {
                     hb_error("Unsharp calloc failed");
@@ -285,6 +398,14 @@ static int unsharp_init_thread(hb_filter_object_t *filter, int threads)
                     return -1;
                 }
             }
+            tctx->line = malloc(sizeof(*(tctx->line)) * w);
+            tctx->tmp  = malloc(sizeof(*(tctx->tmp)) * (w + 2 * ctx->steps));
+            if (tctx->line == NULL || tctx->tmp == NULL)
+            {
+                hb_error("Unsharp calloc failed");
+                unsharp_close(filter);
+                return -1;
+            }
         }
     }
     return 0;
@@ -299,14 +420,15 @@ static void unsharp_close(hb_filter_object_t * filter)
         return;
     }
 
+    taskset_fini(&pv->taskset);
     unsharp_thread_close(pv);
     free(pv);
     filter->private_data = NULL;
 }
 
-static int unsharp_work_thread(hb_filter_object_t *filter,
-                               hb_buffer_t ** buf_in,
-                               hb_buffer_t ** buf_out, int thread)
+static int unsharp_work(hb_filter_object_t *filter,
+                        hb_buffer_t ** buf_in,
+                        hb_buffer_t ** buf_out)
 {
     hb_filter_private_t *pv = filter->private_data;
     hb_buffer_t *in = *buf_in, *out;
@@ -320,28 +442,12 @@ static int unsharp_work_thread(hb_filter_object_t *filter,
 
     out = hb_frame_buffer_init(in->f.fmt, in->f.width, in->f.height);
 
-    int c;
-    for (c = 0; c < 3; c++)
-    {
-        unsharp_plane_context_t  * ctx  = &pv->plane_ctx[c];
-        unsharp_thread_context_t * tctx = &pv->thread_ctx[thread][c];
-        unsharp(in->plane[c].data,
-                out->plane[c].data,
-                in->plane[c].width,
-                in->plane[c].height,
-                in->plane[c].stride,
-                ctx, tctx);
-    }
+    pv->in  = in;
+    pv->out = out;
+    taskset_cycle(&pv->taskset);
 
     out->s = in->s;
     *buf_out = out;
 
     return HB_FILTER_OK;
 }
-
-static int unsharp_work(hb_filter_object_t *filter,
-                        hb_buffer_t ** buf_in,
-                        hb_buffer_t ** buf_out)
-{
-    return unsharp_work_thread(filter, buf_in, buf_out, 0);
-}
@@ -0,0 +1,45 @@
+/* unsharp.h
+
+   Copyright (c) 2003-2018 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#ifndef HB_UNSHARP_H
+#define HB_UNSHARP_H
+
+/*
+ * The blur is a binomial filter of 2 * steps + 1 taps, applied first to
+ * rows and then to columns.  All sums are done with wrapping 32 bit
+ * arithmetic, so every implementation gives the same result.
+ */
+typedef struct
+{
+    // Horizontal blur of the row at src.  tmp has room for
+    // width + 2 * steps values.
+    void (*blur_h)(const uint8_t  *src,
+                         uint32_t *dst,
+                         uint32_t *tmp,
+                         int       width,
+                         int       steps);
+    // Vertical blur, line is a row blurred by blur_h.  SC holds the
+    // 2 * steps rows of column sums carried from row to row.
+    void (*blur_v)(uint32_t  *line,
+                   uint32_t **SC,
+                   int        width,
+                   int        steps);
+    // Writes src sharpened by the difference to the blurred row
+    void (*apply)(const uint8_t  *src,
+                        uint8_t  *dst,
+                  const uint32_t *blur,
+                        int       width,
+                        int       amount,
+                        int       scalebits,
+                        int32_t   halfscale);
+} UnsharpFunctions;
+
+void unsharp_init_x86(UnsharpFunctions *functions);
+
+#endif // HB_UNSHARP_H
@@ -0,0 +1,166 @@
+/* unsharp_x86.c
+
+   Copyright (c) 2003-2018 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#include "hb.h"     // needed for ARCH_X86
+
+#if defined(ARCH_X86)
+
+#include <immintrin.h>
+
+#include "libavutil/cpu.h"
+#include "unsharp.h"
+
+/*
+ * The horizontal blur is done as 2 * steps passes of adding each value
+ * to its left neighbour, which gives the same binomial sums as the
+ * running sums of the scalar code.
+ */
+__attribute__((target("avx2")))
+static void unsharp_blur_h_avx2(const uint8_t  *src,
+                                      uint32_t *dst,
+                                      uint32_t *tmp,
+                                      int       width,
+                                      int       steps)
+{
+    const int n = width + 2 * steps;
+    int x, pass;
+
+    for (x = 0; x < steps; x++)
+    {
+        tmp[x]                 = src[0];
+        tmp[width + steps + x] = src[width - 1];
+    }
+    for (x = 0; x + 8 <= width; x += 8)
+    {
+        __m128i pix = _mm_loadl_epi64((const __m128i*)(src + x));
+        _mm256_storeu_si256((__m256i*)(tmp + steps + x),
+                            _mm256_cvtepu8_epi32(pix));
+    }
+    for (; x < width; x++)
+    {
+        tmp[steps + x] = src[x];
+    }
+
+    for (pass = 1; pass <= 2 * steps; pass++)
+    {
+        // Top down so that the left neighbours are still unchanged
+        for (x = n - 8; x >= pass; x -= 8)
+        {
+            __m256i a = _mm256_loadu_si256((const __m256i*)(tmp + x));
+            __m256i b = _mm256_loadu_si256((const __m256i*)(tmp + x - 1));
+            _mm256_storeu_si256((__m256i*)(tmp + x), _mm256_add_epi32(a, b));
+        }
+        for (x += 7; x >= pass; x--)
+        {
+            tmp[x] += tmp[x - 1];
+        }
+    }
+
+    memcpy(dst, tmp + 2 * steps, width * sizeof(*dst));
+}
+
+__attribute__((target("avx2")))
+static void unsharp_blur_v_avx2(uint32_t  *line,
+                                uint32_t **SC,
+                                int        width,
+                                int        steps)
+{
+    uint32_t Tmp1,
+             Tmp2;
+    int x, z;
+
+    for (x = 0; x + 8 <= width; x += 8)
+    {
+        __m256i t1 = _mm256_loadu_si256((const __m256i*)(line + x));
+        __m256i t2, sc;
+
+        for (z = 0; z < steps * 2; z += 2)
+        {
+            sc = _mm256_loadu_si256((const __m256i*)(SC[z + 0] + x));
+            t2 = _mm256_add_epi32(sc, t1);
+            _mm256_storeu_si256((__m256i*)(SC[z + 0] + x), t1);
+            sc = _mm256_loadu_si256((const __m256i*)(SC[z + 1] + x));
+            t1 = _mm256_add_epi32(sc, t2);
+            _mm256_storeu_si256((__m256i*)(SC[z + 1] + x), t2);
+        }
+        _mm256_storeu_si256((__m256i*)(line + x), t1);
+    }
+
+    for (; x < width; x++)
+    {
+        Tmp1 = line[x];
+
+        for (z = 0; z < steps * 2; z += 2)
+        {
+            Tmp2 = SC[z + 0][x] + Tmp1; SC[z + 0][x] = Tmp1;
+            Tmp1 = SC[z + 1][x] + Tmp2; SC[z + 1][x] = Tmp2;
+        }
+
+        line[x] = Tmp1;
+    }
+}
+
+__attribute__((target("avx2")))
+static void unsharp_apply_avx2(const uint8_t  *src,
+                                     uint8_t  *dst,
+                               const uint32_t *blur,
+                                     int       width,
+                                     int       amount,
+                                     int       scalebits,
+                                     int32_t   halfscale)
+{
+    int32_t res;
+    int x = 0;
+
+    // Shifts of 32 bits or more behave differently in vector registers,
+    // the scalar loop handles the largest sizes
+    if (scalebits < 32)
+    {
+        const __m256i half  = _mm256_set1_epi32(halfscale);
+        const __m256i amt   = _mm256_set1_epi32(amount);
+        const __m128i shift = _mm_cvtsi32_si128(scalebits);
+
+        for (; x + 8 <= width; x += 8)
+        {
+            __m256i s = _mm256_cvtepu8_epi32(
+                            _mm_loadl_epi64((const __m128i*)(src + x)));
+            __m256i b = _mm256_loadu_si256((const __m256i*)(blur + x));
+            __m256i r;
+
+            b = _mm256_srl_epi32(_mm256_add_epi32(b, half), shift);
+            r = _mm256_mullo_epi32(_mm256_sub_epi32(s, b), amt);
+            r = _mm256_add_epi32(s, _mm256_srai_epi32(r, 16));
+
+            // Saturating packs clamp to 0..255
+            __m128i p = _mm_packs_epi32(_mm256_castsi256_si128(r),
+                                        _mm256_extracti128_si256(r, 1));
+            _mm_storel_epi64((__m128i*)(dst + x), _mm_packus_epi16(p, p));
+        }
+    }
+
+    for (; x < width; x++)
+    {
+        res = (int32_t)src[x] + ((((int32_t)src[x] -
+             (int32_t)((blur[x] + halfscale) >> scalebits)) * amount) >> 16);
+        dst[x] = res > 255 ? 255 : res < 0 ? 0 : (uint8_t)res;
+    }
+}
+
+void unsharp_init_x86(UnsharpFunctions *functions)
+{
+    if (av_get_cpu_flags() & AV_CPU_FLAG_AVX2)
+    {
+        functions->blur_h = unsharp_blur_h_avx2;
+        functions->blur_v = unsharp_blur_v_avx2;
+        functions->apply  = unsharp_apply_avx2;
+        hb_log("Unsharp using AVX2 optimizations");
+    }
+}
+
+#endif // ARCH_X86
@@ -8,10 +8,18 @@
  */
 
 #include "hb.h"
+#include "taskset.h"
+#include "vfr.h"
 
 //#define HB_DEBUG_CFR_DROPS 1
 #define MAX_FRAME_ANALYSIS_DEPTH 10
 
+typedef struct metric_arguments_s
+{
+    hb_buffer_t * a;
+    hb_buffer_t * b;
+} metric_arguments_t;
+
 struct hb_filter_private_s
 {
     hb_job_t      * job;
@@ -38,6 +46,12 @@ struct hb_filter_private_s
     double        * frame_metric;
 
     unsigned        gamma_lut[256];
+
+    // Motion metric, computed on the taskset thread pool
+    VfrFunctions         functions;
+    int                  metric_segments;
+    taskset_t            metric_taskset;    // Tasks - one per segment
+    metric_arguments_t   metric_arguments;
 #if defined(HB_DEBUG_CFR_DROPS)
     int64_t         sequence;
 #endif
@@ -53,6 +67,15 @@ static int hb_vfr_work( hb_filter_object_t * filter,
 static void hb_vfr_close( hb_filter_object_t * filter );
 static hb_filter_info_t * hb_vfr_info( hb_filter_object_t * filter );
 
+typedef struct metric_thread_arg_s
+{
+    hb_filter_private_t * pv;
+    int                   segment;
+    uint64_t              sum;
+} metric_thread_arg_t;
+
+static void metric_thread( void * thread_args_v );
+
 static const char hb_vfr_template[] =
     "mode=^([012])$:rate=^"HB_RATIONAL_REG"$";
 
@@ -87,7 +110,9 @@ static void build_gamma_lut( hb_filter_private_t * pv )
 // Compute the sum of squared errors for a 16x16 block
 // Gamma adjusts pixel values so that less visible differences
 // count less.
-static inline unsigned sse_block16( unsigned *gamma_lut, uint8_t *a, uint8_t *b, int stride )
+static inline unsigned sse_block16( const unsigned *gamma_lut,
+                                    const uint8_t *a, const uint8_t *b,
+                                    int stride )
 {
     int x, y;
     unsigned sum = 0;
@@ -106,28 +131,76 @@ static inline unsigned sse_block16( unsigned *gamma_lut, uint8_t *a, uint8_t *b,
     return sum;
 }
 
-// Sum of squared errors.  Computes and sums the SSEs for all
-// 16x16 blocks in the images.  Only checks the Y component.
-static float motion_metric( unsigned * gamma_lut, hb_buffer_t * a, hb_buffer_t * b )
+// Sums the SSEs of the 16x16 blocks of a band of rows.
+// height is a multiple of 16.
+static uint64_t sse_rows_c( const unsigned *gamma_lut,
+                            const uint8_t *a, const uint8_t *b,
+                            int stride, int width, int height )
 {
-    int bw = a->f.width / 16;
-    int bh = a->f.height / 16;
-    int stride = a->plane[0].stride;
-    uint8_t * pa = a->plane[0].data;
-    uint8_t * pb = b->plane[0].data;
     int x, y;
     uint64_t sum = 0;
 
-    for( y = 0; y < bh; y++ )
+    for( y = 0; y < height; y += 16 )
     {
-        for( x = 0; x < bw; x++ )
+        for( x = 0; x < width; x += 16 )
         {
-            sum +=  sse_block16( gamma_lut, pa + y * 16 * stride + x * 16,
-                                            pb + y * 16 * stride + x * 16,
-                                            stride );
+            sum +=  sse_block16( gamma_lut, a + y * stride + x,
+                                            b + y * stride + x, stride );
         }
     }
-    return (float)sum / ( a->f.width * a->f.height );;
+    return sum;
+}
+
+/*
+ * Sums the SSEs of this segment's rows of 16x16 blocks.
+ */
+static void metric_thread( void * thread_args_v )
+{
+    metric_thread_arg_t * thread_args = thread_args_v;
+    hb_filter_private_t * pv          = thread_args->pv;
+    int                   segment     = thread_args->segment;
+    hb_buffer_t         * a           = pv->metric_arguments.a;
+    hb_buffer_t         * b           = pv->metric_arguments.b;
+
+    int bh     = a->f.height / 16;
+    int stride = a->plane[0].stride;
+    int segment_start = bh *  segment      / pv->metric_segments;
+    int segment_stop  = bh * (segment + 1) / pv->metric_segments;
+
+    thread_args->sum = 0;
+    if (segment_stop > segment_start)
+    {
+        thread_args->sum = pv->functions.sse_rows(pv->gamma_lut,
+                            a->plane[0].data + segment_start * 16 * stride,
+                            b->plane[0].data + segment_start * 16 * stride,
+                            stride, (a->f.width / 16) * 16,
+                            (segment_stop - segment_start) * 16);
+    }
+}
+
+// Sum of squared errors.  Computes and sums the SSEs for all
+// 16x16 blocks in the images.  Only checks the Y component.
+// Rows of blocks are split among the taskset threads.
+static float motion_metric( hb_filter_private_t * pv,
+                            hb_buffer_t * a, hb_buffer_t * b )
+{
+    uint64_t sum = 0;
+    int ii;
+
+    pv->metric_arguments.a = a;
+    pv->metric_arguments.b = b;
+    taskset_cycle(&pv->metric_taskset);
+    pv->metric_arguments.a = NULL;
+    pv->metric_arguments.b = NULL;
+
+    for (ii = 0; ii < pv->metric_segments; ii++)
+    {
+        metric_thread_arg_t * thread_args;
+
+        thread_args = taskset_thread_args(&pv->metric_taskset, ii);
+        sum += thread_args->sum;
+    }
+    return (float)sum / ( a->f.width * a->f.height );
 }
 
 static void delete_metric(double * metrics, int pos, int size)
@@ -206,8 +279,8 @@ static hb_buffer_t * adjust_frame_rate( hb_filter_private_t * pv,
         penultimate = hb_list_item(pv->frame_rate_list, count - 2);
         ultimate    = hb_list_item(pv->frame_rate_list, count - 1);
 
-        pv->frame_metric[count - 1] = motion_metric(pv->gamma_lut,
-                                                    penultimate, ultimate);
+        pv->frame_metric[count - 1] = motion_metric(pv, penultimate,
+                                                    ultimate);
 
         if (count < pv->frame_analysis_depth)
         {
@@ -311,7 +384,7 @@ static hb_buffer_t * adjust_frame_rate( hb_filter_private_t * pv,
         for (; excess >= pv->frame_duration; excess -= pv->frame_duration)
         {
             /* next frame too far ahead - dup current frame */
-            hb_buffer_t *dup = hb_buffer_dup( out );
+            hb_buffer_t *dup = hb_buffer_ref( out );
             dup->s.new_chap = 0;
             dup->s.start = cfr_stop;
             cfr_stop += pv->frame_duration;
@@ -424,6 +497,47 @@ static int hb_vfr_init(hb_filter_object_t *filter, hb_filter_init_t *init)
     pv->out_last_stop  = (int64_t)AV_NOPTS_VALUE;
     init->cfr          = pv->cfr;
 
+    if (pv->cfr)
+    {
+        // The motion metric is only used when frames may be dropped
+        pv->functions.sse_rows = sse_rows_c;
+#if defined(ARCH_X86)
+        vfr_init_x86(&pv->functions);
+#endif
+        // One segment per CPU the job may use, and at least one row of
+        // blocks per segment
+        pv->metric_segments = hb_get_cpu_count();
+        if (pv->job->cpu_count > 0 &&
+            pv->job->cpu_count < pv->metric_segments)
+        {
+            pv->metric_segments = pv->job->cpu_count;
+        }
+        pv->metric_segments = MIN(pv->metric_segments,
+                                  init->geometry.height / 16);
+        pv->metric_segments = MAX(pv->metric_segments, 1);
+        if (taskset_init(&pv->metric_taskset, pv->metric_segments,
+                         sizeof(metric_thread_arg_t), metric_thread) == 0)
+        {
+            hb_error("vfr: could not initialize taskset");
+            hb_fifo_close(&pv->delay_queue);
+            hb_list_close(&pv->frame_rate_list);
+            free(pv->frame_metric);
+            free(pv);
+            filter->private_data = NULL;
+            return -1;
+        }
+
+        int ii;
+        for (ii = 0; ii < pv->metric_segments; ii++)
+        {
+            metric_thread_arg_t * thread_args;
+
+            thread_args = taskset_thread_args(&pv->metric_taskset, ii);
+            thread_args->pv      = pv;
+            thread_args->segment = ii;
+        }
+    }
+
     return 0;
 }
 
@@ -503,7 +617,7 @@ static void hb_vfr_close( hb_filter_object_t * filter )
 
     if( pv->job )
     {
-        hb_interjob_t * interjob = hb_interjob_get( pv->job->h );
+        hb_interjob_t * interjob = pv->job->interjob;
 
         /* Preserve dropped frame count for more accurate
          * framerates in 2nd passes.
@@ -531,6 +645,11 @@ static void hb_vfr_close( hb_filter_object_t * filter )
     free(pv->frame_metric);
     hb_list_close(&pv->frame_rate_list);
 
+    if (pv->metric_segments > 0)
+    {
+        taskset_fini(&pv->metric_taskset);
+    }
+
     /* Cleanup render work structure */
     free( pv );
     filter->private_data = NULL;
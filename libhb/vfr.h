@@ -0,0 +1,32 @@
+/* vfr.h
+
+   Copyright (c) 2003-2018 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#ifndef HB_VFR_H
+#define HB_VFR_H
+
+/*
+ * gamma_lut maps an 8 bit luma value to a value no larger than 4095,
+ * so the squared differences of a 16x16 block fit in 32 bits and every
+ * implementation gives the exact same sum.
+ */
+typedef struct
+{
+    // Sum of squared differences of the gamma adjusted samples of
+    // 'height' rows of 'width' samples.  width is a multiple of 16.
+    uint64_t (*sse_rows)(const unsigned *gamma_lut,
+                         const uint8_t  *a,
+                         const uint8_t  *b,
+                         int             stride,
+                         int             width,
+                         int             height);
+} VfrFunctions;
+
+void vfr_init_x86(VfrFunctions *functions);
+
+#endif // HB_VFR_H
@@ -0,0 +1,105 @@
+/* vfr_x86.c
+
+   Copyright (c) 2003-2018 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#include "hb.h"     // needed for ARCH_X86
+
+#if defined(ARCH_X86)
+
+#include <immintrin.h>
+
+#include "libavutil/cpu.h"
+#include "vfr.h"
+
+// Each 32 bit lane of the accumulator gains at most 2 * 4095^2 per
+// 16 samples, so it can take 128 rounds before it wraps.  Move it to
+// the 64 bit accumulator well before that.
+#define SSE_FLUSH_ROUNDS 64
+
+__attribute__((target("avx2")))
+static inline __m256i sse_flush_avx2(__m256i acc64, __m256i acc32)
+{
+    acc64 = _mm256_add_epi64(acc64,
+                _mm256_cvtepu32_epi64(_mm256_castsi256_si128(acc32)));
+    acc64 = _mm256_add_epi64(acc64,
+                _mm256_cvtepu32_epi64(_mm256_extracti128_si256(acc32, 1)));
+    return acc64;
+}
+
+/*
+ * The gamma lookups are done with 32 bit gathers, 8 samples at a time.
+ * Gamma adjusted values fit in 16 bits, so the differences are packed
+ * and squared and summed in pairs by madd.
+ */
+__attribute__((target("avx2")))
+static uint64_t sse_rows_avx2(const unsigned *gamma_lut,
+                              const uint8_t  *a,
+                              const uint8_t  *b,
+                              int             stride,
+                              int             width,
+                              int             height)
+{
+    const int *lut   = (const int*)gamma_lut;
+    __m256i    acc64 = _mm256_setzero_si256();
+    __m256i    acc32 = _mm256_setzero_si256();
+    int        rounds = 0;
+    int        x, y;
+
+    for (y = 0; y < height; y++)
+    {
+        for (x = 0; x < width; x += 16)
+        {
+            __m256i ia0 = _mm256_cvtepu8_epi32(
+                            _mm_loadl_epi64((const __m128i*)(a + x)));
+            __m256i ia1 = _mm256_cvtepu8_epi32(
+                            _mm_loadl_epi64((const __m128i*)(a + x + 8)));
+            __m256i ib0 = _mm256_cvtepu8_epi32(
+                            _mm_loadl_epi64((const __m128i*)(b + x)));
+            __m256i ib1 = _mm256_cvtepu8_epi32(
+                            _mm_loadl_epi64((const __m128i*)(b + x + 8)));
+
+            __m256i d0 = _mm256_sub_epi32(_mm256_i32gather_epi32(lut, ia0, 4),
+                                          _mm256_i32gather_epi32(lut, ib0, 4));
+            __m256i d1 = _mm256_sub_epi32(_mm256_i32gather_epi32(lut, ia1, 4),
+                                          _mm256_i32gather_epi32(lut, ib1, 4));
+
+            // Sample order does not matter for the sum
+            __m256i d = _mm256_packs_epi32(d0, d1);
+            acc32 = _mm256_add_epi32(acc32, _mm256_madd_epi16(d, d));
+
+            if (++rounds == SSE_FLUSH_ROUNDS)
+            {
+                acc64  = sse_flush_avx2(acc64, acc32);
+                acc32  = _mm256_setzero_si256();
+                rounds = 0;
+            }
+        }
+        a += stride;
+        b += stride;
+    }
+    acc64 = sse_flush_avx2(acc64, acc32);
+
+    __m128i sum = _mm_add_epi64(_mm256_castsi256_si128(acc64),
+                                _mm256_extracti128_si256(acc64, 1));
+    sum = _mm_add_epi64(sum, _mm_unpackhi_epi64(sum, sum));
+
+    uint64_t result;
+    _mm_storel_epi64((__m128i*)&result, sum);
+    return result;
+}
+
+void vfr_init_x86(VfrFunctions *functions)
+{
+    if (av_get_cpu_flags() & AV_CPU_FLAG_AVX2)
+    {
+        functions->sse_rows = sse_rows_avx2;
+        hb_log("vfr: using AVX2 optimizations");
+    }
+}
+
+#endif // ARCH_X86
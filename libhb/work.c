@@ -19,13 +19,34 @@
 typedef struct
 {
     hb_list_t * jobs;
-    hb_job_t  ** current_job;
     hb_error_code * error;
     volatile int * die;
+    int job_limit;
+
+    hb_lock_t * lock;       // Protects jobs and failed
+    hb_lock_t * setup_lock; // Serializes use of the handle's title set
+    int failed;             // A job failed, start no more jobs
+    int cpu_count;          // Logical CPUs each running job may use
 
 } hb_work_t;
 
+/* One of the threads that take jobs from the queue. When only one
+ * runner is started (a job limit of 1 or a single queued job), work_func
+ * itself is the runner and the passes share the handle's die flag, error
+ * and interjob data, as they always did. */
+typedef struct
+{
+    hb_work_t     * work;
+    int             index;
+    int             concurrent; // Other runners may be processing jobs
+    hb_interjob_t * interjob;
+    volatile int    die;
+    hb_error_code   error;
+
+} hb_work_runner_t;
+
 static void work_func();
+static void runner_func( void * );
 static void do_job( hb_job_t *);
 static void filter_loop( void * );
 
@@ -43,20 +64,22 @@ static void filter_loop( void * );
  * @param jobs Handle to hb_list_t.
  * @param die Handle to user inititated exit indicator.
  * @param error Handle to error indicator.
+ * @param job_limit Number of jobs to process at the same time.
  */
-hb_thread_t * hb_work_init( hb_list_t * jobs, volatile int * die, hb_error_code * error, hb_job_t ** job )
+hb_thread_t * hb_work_init( hb_list_t * jobs, volatile int * die,
+                            hb_error_code * error, int job_limit )
 {
     hb_work_t * work = calloc( sizeof( hb_work_t ), 1 );
 
     work->jobs      = jobs;
-    work->current_job = job;
     work->die       = die;
     work->error     = error;
+    work->job_limit = job_limit;
 
     return hb_thread_init( "work", work_func, work, HB_LOW_PRIORITY );
 }
 
-static void InitWorkState(hb_handle_t *h, int pass_id, int pass, int pass_count)
+static void InitWorkState(hb_job_t *job, int pass_id, int pass, int pass_count)
 {
     hb_state_t state;
 
@@ -73,27 +96,102 @@ static void InitWorkState(hb_handle_t *h, int pass_id, int pass, int pass_count)
     p.seconds    = -1;
 #undef p
 
-    hb_set_state( h, &state );
+    hb_set_job_state( job, &state );
 
 }
 
 /**
- * Iterates through job list and calls do_job for each job.
+ * Starts the job runners and waits for them to empty the job list.
  * @param _work Handle work object.
  */
 static void work_func( void * _work )
 {
     hb_work_t  * work = _work;
-    hb_job_t   * job;
+    int          ii, count;
 
     hb_log( "%d job(s) to process", hb_list_count( work->jobs ) );
 
-    while( !*work->die && ( job = hb_list_item( work->jobs, 0 ) ) )
+    count = MIN( work->job_limit, hb_list_count( work->jobs ) );
+    count = MAX( count, 1 );
+    work->lock       = hb_lock_init();
+    work->setup_lock = hb_lock_init();
+    work->cpu_count  = MAX( hb_get_cpu_count() / count, 1 );
+
+    if (count == 1)
     {
-        hb_handle_t * h = job->h;
+        hb_work_runner_t runner = { .work = work, .concurrent = 0 };
+        runner_func( &runner );
+    }
+    else
+    {
+        hb_work_runner_t * runners = calloc( count, sizeof( hb_work_runner_t ) );
+        hb_thread_t     ** threads = calloc( count, sizeof( hb_thread_t * ) );
+
+        hb_log( "work: processing %d jobs at a time, %d cpus each",
+                count, work->cpu_count );
+        for (ii = 0; ii < count; ii++)
+        {
+            runners[ii].work       = work;
+            runners[ii].index      = ii;
+            runners[ii].concurrent = 1;
+            runners[ii].interjob = calloc( 1, sizeof( hb_interjob_t ) );
+            threads[ii] = hb_thread_init( "job", runner_func, &runners[ii],
+                                          HB_LOW_PRIORITY );
+        }
+        for (ii = 0; ii < count; ii++)
+        {
+            hb_thread_close( &threads[ii] );
+            hb_subtitle_close( &runners[ii].interjob->select_subtitle );
+            hb_frame_cache_close( &runners[ii].interjob->frame_cache );
+            free( runners[ii].interjob );
+        }
+        free( threads );
+        free( runners );
+
+        // The buffer pools are shared by all runners, release them
+        // once every job is done
+        hb_buffer_pool_free();
+    }
+
+    hb_lock_close( &work->lock );
+    hb_lock_close( &work->setup_lock );
+    free( work );
+}
 
-        hb_list_rem( work->jobs, job );
+/**
+ * Takes jobs from the job list and processes their passes in order.
+ * @param _runner Handle to hb_work_runner_t.
+ */
+static void runner_func( void * _runner )
+{
+    hb_work_runner_t * runner = _runner;
+    hb_work_t        * work = runner->work;
+    hb_job_t         * job;
+    hb_title_t       * title;
+    int                concurrent = runner->concurrent;
+
+    while( !*work->die )
+    {
+        hb_lock( work->lock );
+        job = work->failed ? NULL : hb_list_item( work->jobs, 0 );
+        if (job != NULL)
+        {
+            hb_list_rem( work->jobs, job );
+        }
+        hb_unlock( work->lock );
+        if (job == NULL)
+        {
+            break;
+        }
+
+        hb_handle_t * h = job->h;
         hb_list_t * passes = hb_list_init();
+        volatile int  * die   = concurrent ? &runner->die   : work->die;
+        hb_error_code * error = concurrent ? &runner->error : work->error;
+
+        // The title scan of json jobs and the title lookups of all jobs
+        // use the title set of the handle, one job at a time.
+        hb_lock( work->setup_lock );
 
         // JSON jobs get special treatment.  We want to perform the title
         // scan for the JSON job automatically.  This requires that we delay
@@ -110,10 +208,17 @@ static void work_func( void * _work )
             hb_job_t *new_job = hb_json_to_job(job->h, job->json);
             if (new_job == NULL)
             {
+                hb_unlock( work->setup_lock );
                 hb_job_close(&job);
                 hb_list_close(&passes);
+                hb_lock( work->lock );
                 *work->error = HB_ERROR_INIT;
-                *work->die = 1;
+                work->failed = 1;
+                hb_unlock( work->lock );
+                if (!concurrent)
+                {
+                    *work->die = 1;
+                }
                 break;
             }
             new_job->h = job->h;
@@ -124,17 +229,38 @@ static void work_func( void * _work )
         hb_job_setup_passes(job->h, job, passes);
         hb_job_close(&job);
 
+        // Jobs running side by side each work on their own copy of the
+        // title. The pipeline writes to it (demuxer context, closed
+        // caption tracks) and the next json job may rescan the handle.
+        title = NULL;
+        if (concurrent && hb_list_count(passes) > 0)
+        {
+            job = hb_list_item(passes, 0);
+            title = hb_title_copy(job->title);
+        }
+        hb_unlock( work->setup_lock );
+
         int pass_count, pass;
         pass_count = hb_list_count(passes);
-        for (pass = 0; pass < pass_count && !*work->die; pass++)
+        for (pass = 0; pass < pass_count && !*work->die && !*die; pass++)
         {
             job = hb_list_item(passes, pass);
-            job->die = work->die;
-            job->done_error = work->error;
-            *(work->current_job) = job;
-            InitWorkState(job->h, job->pass_id, pass + 1, pass_count);
+            if (title != NULL)
+            {
+                job->title = title;
+            }
+            job->die = die;
+            job->done_error = error;
+            job->interjob = concurrent ? runner->interjob : hb_interjob_get(h);
+            job->cpu_count = work->cpu_count;
+            hb_add_running_job(h, job);
+            InitWorkState(job, job->pass_id, pass + 1, pass_count);
             do_job( job );
-            *(work->current_job) = NULL;
+            hb_rem_running_job(h, job);
+            if (!concurrent)
+            {
+                hb_buffer_pool_free();
+            }
         }
         // Clean up any incomplete jobs
         for (; pass < pass_count; pass++)
@@ -143,13 +269,36 @@ static void work_func( void * _work )
             hb_job_close(&job);
         }
         hb_list_close(&passes);
+        if (title != NULL)
+        {
+            hb_title_close(&title);
+        }
+
+        if (concurrent)
+        {
+            // A failed job stops the queue like it does when jobs run
+            // one at a time, but lets the other running jobs finish.
+            hb_lock( work->lock );
+            if (runner->error != HB_ERROR_NONE)
+            {
+                if (*work->error == HB_ERROR_NONE)
+                {
+                    *work->error = runner->error;
+                }
+                work->failed = 1;
+            }
+            hb_unlock( work->lock );
+            runner->die   = 0;
+            runner->error = HB_ERROR_NONE;
+        }
 
         // Force rescan of next source processed by this hb_handle_t
         // TODO: Fix this ugly hack!
-        hb_force_rescan(h);
+        if (!concurrent)
+        {
+            hb_force_rescan(h);
+        }
     }
-
-    free( work );
 }
 
 hb_work_object_t * hb_get_work( hb_handle_t *h, int id )
@@ -765,7 +914,7 @@ static void analyze_subtitle_scan( hb_job_t * job )
         subtitle = hb_list_item( job->list_subtitle, i );
         if (subtitle->id == subtitle_hit)
         {
-            hb_interjob_t *interjob = hb_interjob_get(job->h);
+            hb_interjob_t *interjob = job->interjob;
 
             subtitle->config = job->select_subtitle_config;
             // Remove from list since we are taking ownership
@@ -781,7 +930,7 @@ static int sanitize_subtitles( hb_job_t * job )
 {
     int             i;
     uint8_t         one_burned = 0;
-    hb_interjob_t * interjob = hb_interjob_get(job->h);
+    hb_interjob_t * interjob = job->interjob;
     hb_subtitle_t * subtitle;
 
     if (job->indepth_scan)
@@ -1339,6 +1488,80 @@ static void sanitize_filter_list(hb_list_t *list)
     hb_avfilter_combine(list);
 }
 
+static hb_dict_t * stage_stats( const char * name, const char * type,
+                                hb_work_stats_t * stats )
+{
+    hb_log( "work: stage %s: work %.3fs, input wait %.3fs, "
+            "output wait %.3fs, buffers in %d out %d",
+            name, stats->work / 1e6, stats->wait_in / 1e6,
+            stats->wait_out / 1e6, stats->buf_in, stats->buf_out );
+
+    hb_dict_t * dict = hb_dict_init();
+    hb_dict_set_string(dict, "Name", name);
+    hb_dict_set_string(dict, "Type", type);
+    hb_dict_set_double(dict, "WorkTime", stats->work / 1e6);
+    hb_dict_set_double(dict, "InputWaitTime", stats->wait_in / 1e6);
+    hb_dict_set_double(dict, "OutputWaitTime", stats->wait_out / 1e6);
+    hb_dict_set_int(dict, "BuffersIn", stats->buf_in);
+    hb_dict_set_int(dict, "BuffersOut", stats->buf_out);
+    return dict;
+}
+
+/*
+ * Logs where each work and filter thread of the job spent its time
+ * and stores it with the job's sequence id for the json state (see
+ * hb_get_state_json).
+ * The bottleneck is the stage that rarely waits while the stages
+ * before it wait for output and the stages after it wait for input.
+ */
+static void report_stage_stats( hb_job_t * job )
+{
+    hb_value_array_t * stages = hb_value_array_init();
+    int                i;
+
+    for (i = 0; i < hb_list_count(job->list_work); i++)
+    {
+        hb_work_object_t * w = hb_list_item(job->list_work, i);
+        hb_value_array_append(stages,
+                              stage_stats(w->name, "Work", &w->stats));
+    }
+    if (job->list_filter && !job->indepth_scan)
+    {
+        for (i = 0; i < hb_list_count(job->list_filter); i++)
+        {
+            hb_filter_object_t * filter = hb_list_item(job->list_filter, i);
+            hb_value_array_append(stages,
+                            stage_stats(filter->name, "Filter", &filter->stats));
+        }
+    }
+    hb_set_work_stats(job->h, job, stages);
+}
+
+/*
+ * The subtitle search pass only counts subtitles, which is done by the
+ * subtitle decoders.  Video has to be decoded only to locate a start
+ * or stop point, or for closed captions which come from the video decoder.
+ */
+static int subtitle_scan_needs_video( hb_job_t * job )
+{
+    hb_subtitle_t * subtitle;
+    int             i;
+
+    if (job->pts_to_start || job->pts_to_stop ||
+        job->frame_to_start || job->frame_to_stop || job->start_at_preview)
+    {
+        return 1;
+    }
+    for (i = 0; (subtitle = hb_list_item(job->list_subtitle, i)); i++)
+    {
+        if (subtitle->source == CC608SUB)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
 /**
  * Job initialization routine.
  *
@@ -1352,7 +1575,7 @@ static void sanitize_filter_list(hb_list_t *list)
  */
 static void do_job(hb_job_t *job)
 {
-    int                i, result;
+    int                i, result, started = 0, replay = 0;
     hb_title_t       * title;
     hb_interjob_t    * interjob;
     hb_work_object_t * w;
@@ -1361,18 +1584,17 @@ static void do_job(hb_job_t *job)
 
     title = job->title;
 
-    interjob = hb_interjob_get(job->h);
+    interjob = job->interjob;
     if (job->sequence_id != interjob->sequence_id)
     {
         // New job sequence, clear interjob
         hb_subtitle_close(&interjob->select_subtitle);
+        hb_frame_cache_close(&interjob->frame_cache);
         memset(interjob, 0, sizeof(*interjob));
         interjob->sequence_id = job->sequence_id;
     }
 
     job->list_work = hb_list_init();
-    w = hb_get_work(job->h, WORK_READER);
-    hb_list_add(job->list_work, w);
 
     hb_log( "starting job" );
 
@@ -1497,14 +1719,22 @@ static void do_job(hb_job_t *job)
 #endif // QSV zerocopy path
 #endif
     {
-        job->fifo_mpeg2  = hb_fifo_init( FIFO_SMALL, FIFO_SMALL_WAKE );
-        job->fifo_raw    = hb_fifo_init( FIFO_SMALL, FIFO_SMALL_WAKE );
+        // Fifos that connect exactly one producer thread to one consumer
+        // thread use the lock-free spsc fifo. Sync may output to any of
+        // its streams from whichever sync thread holds its lock, so fifos
+        // filled by sync use the regular fifo.
+        if (!job->indepth_scan || subtitle_scan_needs_video(job))
+        {
+            job->fifo_mpeg2  = hb_fifo_init_spsc( FIFO_SMALL,
+                                                  FIFO_SMALL_WAKE );
+        }
+        job->fifo_raw    = hb_fifo_init_spsc( FIFO_SMALL, FIFO_SMALL_WAKE );
         if (!job->indepth_scan)
         {
             // When doing subtitle indepth scan, the pipeline ends at sync
             job->fifo_sync   = hb_fifo_init( FIFO_SMALL, FIFO_SMALL_WAKE );
             job->fifo_render = NULL; // Attached to filter chain
-            job->fifo_mpeg4  = hb_fifo_init( FIFO_LARGE, FIFO_LARGE_WAKE );
+            job->fifo_mpeg4  = hb_fifo_init_spsc( FIFO_LARGE, FIFO_LARGE_WAKE );
         }
     }
 
@@ -1516,6 +1746,42 @@ static void do_job(hb_job_t *job)
         goto cleanup;
     }
 
+    // The 1st pass records what it hands to the encoders and the muxer.
+    // The 2nd pass replays that instead of reading, decoding,
+    // synchronizing and filtering the source again.
+    if (job->pass_id == HB_PASS_ENCODE_1ST)
+    {
+        hb_frame_cache_close(&interjob->frame_cache);
+        if (job->frame_cache
+#ifdef USE_QSV
+            && !(job->vcodec & HB_VCODEC_QSV_MASK)
+#endif
+           )
+        {
+            interjob->frame_cache = hb_frame_cache_init(job);
+        }
+    }
+    else if (job->pass_id == HB_PASS_ENCODE_2ND &&
+             interjob->frame_cache != NULL)
+    {
+        replay = hb_frame_cache_usable(interjob->frame_cache, job);
+        if (replay)
+        {
+            hb_log("work: 2nd pass replays the frame cache");
+        }
+        else
+        {
+            hb_log("work: frame cache unusable, decoding again");
+            hb_frame_cache_close(&interjob->frame_cache);
+        }
+    }
+
+    if (!replay)
+    {
+        w = hb_get_work(job->h, WORK_READER);
+        hb_list_add(job->list_work, w);
+    }
+
     if (!job->indepth_scan)
     {
         // Set up audio decoder work objects
@@ -1525,10 +1791,36 @@ static void do_job(hb_job_t *job)
             audio = hb_list_item(job->list_audio, i);
 
             /* set up the audio work fifos */
-            audio->priv.fifo_in   = hb_fifo_init(FIFO_LARGE, FIFO_LARGE_WAKE);
-            audio->priv.fifo_raw  = hb_fifo_init(FIFO_SMALL, FIFO_SMALL_WAKE);
+            audio->priv.fifo_in   = hb_fifo_init_spsc(FIFO_LARGE, FIFO_LARGE_WAKE);
+            audio->priv.fifo_raw  = hb_fifo_init_spsc(FIFO_SMALL, FIFO_SMALL_WAKE);
             audio->priv.fifo_sync = hb_fifo_init(FIFO_SMALL, FIFO_SMALL_WAKE);
-            audio->priv.fifo_out  = hb_fifo_init(FIFO_LARGE, FIFO_LARGE_WAKE);
+            if (audio->config.out.codec & HB_ACODEC_PASS_FLAG)
+            {
+                // Passthru audio goes straight from sync to the muxer
+                audio->priv.fifo_out = hb_fifo_init(FIFO_LARGE, FIFO_LARGE_WAKE);
+            }
+            else
+            {
+                audio->priv.fifo_out = hb_fifo_init_spsc(FIFO_LARGE,
+                                                         FIFO_LARGE_WAKE);
+            }
+
+            if (replay)
+            {
+                // Replaces the decoder and sync for this track
+                w = hb_get_work(job->h, WORK_CACHE_REPLAY);
+                if (audio->config.out.codec & HB_ACODEC_PASS_FLAG)
+                {
+                    w->fifo_out = audio->priv.fifo_out;
+                }
+                else
+                {
+                    w->fifo_out = audio->priv.fifo_sync;
+                }
+                w->audio = audio;
+                hb_list_add(job->list_work, w);
+                continue;
+            }
 
             // Add audio decoder work object
             w = hb_audio_decoder(job->h, audio->config.in.codec);
@@ -1553,6 +1845,20 @@ static void do_job(hb_job_t *job)
     for (i = 0; i < hb_list_count( job->list_subtitle ); i++)
     {
         subtitle = hb_list_item( job->list_subtitle, i );
+        if (replay)
+        {
+            // Burned in subtitles are part of the cached video frames
+            if (subtitle->config.dest == PASSTHRUSUB)
+            {
+                subtitle->fifo_out = hb_fifo_init( FIFO_SMALL,
+                                                   FIFO_SMALL_WAKE );
+                w = hb_get_work( job->h, WORK_CACHE_REPLAY );
+                w->fifo_out = subtitle->fifo_out;
+                w->subtitle = subtitle;
+                hb_list_add( job->list_work, w );
+            }
+            continue;
+        }
         w = hb_get_work( job->h, subtitle->codec );
         // Must set capacity of the raw-FIFO to be set >= the maximum
         // number of subtitle lines that could be decoded prior to a
@@ -1568,7 +1874,8 @@ static void do_job(hb_job_t *job)
         //      is needed to consume the subtitle lines in the raw-FIFO.
         // Since that number is unbounded, the FIFO must be made
         // (effectively) unbounded in capacity.
-        subtitle->fifo_raw  = hb_fifo_init( FIFO_UNBOUNDED, FIFO_UNBOUNDED_WAKE );
+        subtitle->fifo_raw  = hb_fifo_init_spsc( FIFO_UNBOUNDED,
+                                                 FIFO_UNBOUNDED_WAKE );
         if (w->id != WORK_DECSRTSUB)
         {
             // decsrtsub is a buffer source like reader.  It's input comes
@@ -1587,21 +1894,36 @@ static void do_job(hb_job_t *job)
         hb_list_add( job->list_work, w );
     }
 
-    // Video decoder
-    w = hb_video_decoder(job->h, title->video_codec, title->video_codec_param);
-    if (w == NULL)
+    if (replay)
     {
-        *job->done_error = HB_ERROR_WRONG_INPUT;
-        *job->die = 1;
-        goto cleanup;
+        // Filtered video frames go straight to the encoder
+        w = hb_get_work(job->h, WORK_CACHE_REPLAY);
+        w->fifo_out = job->fifo_sync;
+        hb_list_add(job->list_work, w);
     }
-    w->fifo_in  = job->fifo_mpeg2;
-    w->fifo_out = job->fifo_raw;
-    hb_list_add(job->list_work, w);
+    else
+    {
+        // Video decoder, the subtitle search may not need one.
+        // Then the reader sends eof directly to sync.
+        if (job->fifo_mpeg2 != NULL)
+        {
+            w = hb_video_decoder(job->h, title->video_codec,
+                                 title->video_codec_param);
+            if (w == NULL)
+            {
+                *job->done_error = HB_ERROR_WRONG_INPUT;
+                *job->die = 1;
+                goto cleanup;
+            }
+            w->fifo_in  = job->fifo_mpeg2;
+            w->fifo_out = job->fifo_raw;
+            hb_list_add(job->list_work, w);
+        }
 
-    // Synchronization
-    w = hb_get_work(job->h, WORK_SYNC_VIDEO);
-    hb_list_add(job->list_work, w);
+        // Synchronization
+        w = hb_get_work(job->h, WORK_SYNC_VIDEO);
+        hb_list_add(job->list_work, w);
+    }
 
     if (!job->indepth_scan)
     {
@@ -1636,17 +1958,29 @@ static void do_job(hb_job_t *job)
         }
 
         /* Set up the video filter fifo pipeline */
-        if ( job->list_filter )
+        if ( replay )
+        {
+            // Cached frames have been filtered already
+            job->fifo_render = NULL;
+        }
+        else if ( job->list_filter )
         {
             hb_fifo_t * fifo_in = job->fifo_sync;
+            hb_filter_object_t * filter = NULL;
             for (i = 0; i < hb_list_count(job->list_filter); i++)
             {
-                hb_filter_object_t * filter = hb_list_item(job->list_filter, i);
+                filter = hb_list_item(job->list_filter, i);
                 filter->fifo_in = fifo_in;
-                filter->fifo_out = hb_fifo_init( FIFO_MINI, FIFO_MINI_WAKE );
+                filter->fifo_out = hb_fifo_init_spsc( FIFO_MINI,
+                                                      FIFO_MINI_WAKE );
                 fifo_in = filter->fifo_out;
             }
             job->fifo_render = fifo_in;
+            if (filter != NULL)
+            {
+                // The last filter's output is what the encoder gets
+                filter->cache = hb_frame_cache_video(interjob->frame_cache);
+            }
         }
         else if ( !job->list_filter )
         {
@@ -1716,7 +2050,7 @@ static void do_job(hb_job_t *job)
         w = hb_list_item(job->list_work, i);
         w->thread = hb_thread_init(w->name, hb_work_loop, w, HB_LOW_PRIORITY);
     }
-    if (job->list_filter && !job->indepth_scan)
+    if (job->list_filter && !job->indepth_scan && !replay)
     {
         for (i = 0; i < hb_list_count(job->list_filter); i++)
         {
@@ -1728,6 +2062,7 @@ static void do_job(hb_job_t *job)
                                              HB_LOW_PRIORITY );
         }
     }
+    started = 1;
 
     // Wait for the thread of the last work object to complete
     // Note that other threads may still be running even though the
@@ -1737,9 +2072,8 @@ static void do_job(hb_job_t *job)
     w->die = job->die;
     hb_thread_close(&w->thread);
 
-    hb_handle_t * h = job->h;
     hb_state_t state;
-    hb_get_state2( h, &state );
+    hb_get_job_state( job, &state );
 
     hb_log("work: average encoding speed for job is %f fps",
            state.param.working.rate_avg);
@@ -1772,6 +2106,11 @@ cleanup:
             hb_thread_close(&w->thread);
         }
     }
+    if (started)
+    {
+        report_stage_stats(job);
+    }
+
     while ((w = hb_list_item(job->list_work, 0)))
     {
         hb_list_rem(job->list_work, w);
@@ -1781,6 +2120,15 @@ cleanup:
 
     hb_list_close( &job->list_work );
 
+    if (job->pass_id == HB_PASS_ENCODE_1ST)
+    {
+        hb_frame_cache_finish(interjob->frame_cache, job);
+    }
+    else if (job->pass_id == HB_PASS_ENCODE_2ND)
+    {
+        hb_frame_cache_close(&interjob->frame_cache);
+    }
+
     /* Close fifos */
     hb_fifo_close( &job->fifo_mpeg2 );
     hb_fifo_close( &job->fifo_raw );
@@ -1824,11 +2172,20 @@ cleanup:
         analyze_subtitle_scan(job);
     }
 
-    hb_buffer_pool_free();
-
     hb_job_close(&job);
 }
 
+static int buffer_count( hb_buffer_t * buf )
+{
+    int count = 0;
+
+    for ( ; buf != NULL; buf = buf->next )
+    {
+        count++;
+    }
+    return count;
+}
+
 static inline void copy_chapter( hb_buffer_t * dst, hb_buffer_t * src )
 {
     // Propagate any chapter breaks for the worker if and only if the
@@ -1854,6 +2211,7 @@ void hb_work_loop( void * _w )
 {
     hb_work_object_t * w = _w;
     hb_buffer_t      * buf_in = NULL, * buf_out = NULL;
+    uint64_t           start;
 
     while ((w->die == NULL || !*w->die) && !*w->done &&
            w->status != HB_WORK_DONE)
@@ -1861,9 +2219,12 @@ void hb_work_loop( void * _w )
         // fifo_in == NULL means this is a data source (e.g. reader)
         if (w->fifo_in != NULL)
         {
+            start = hb_get_time_us();
             buf_in = hb_fifo_get_wait( w->fifo_in );
+            w->stats.wait_in += hb_get_time_us() - start;
             if ( buf_in == NULL )
                 continue;
+            w->stats.buf_in++;
             if ( *w->done )
             {
                 if( buf_in )
@@ -1876,7 +2237,9 @@ void hb_work_loop( void * _w )
         // Invalidate buf_out so that if there is no output
         // we don't try to pass along junk.
         buf_out = NULL;
+        start = hb_get_time_us();
         w->status = w->work( w, &buf_in, &buf_out );
+        w->stats.work += hb_get_time_us() - start;
 
         copy_chapter( buf_out, buf_in );
 
@@ -1890,6 +2253,8 @@ void hb_work_loop( void * _w )
         }
         if( buf_out )
         {
+            w->stats.buf_out += buffer_count( buf_out );
+            start = hb_get_time_us();
             while ( !*w->done )
             {
                 if ( hb_fifo_full_wait( w->fifo_out ) )
@@ -1899,6 +2264,7 @@ void hb_work_loop( void * _w )
                     break;
                 }
             }
+            w->stats.wait_out += hb_get_time_us() - start;
         }
         else if (w->fifo_in == NULL)
         {
@@ -1938,12 +2304,16 @@ static void filter_loop( void * _f )
 {
     hb_filter_object_t * f = _f;
     hb_buffer_t      * buf_in, * buf_out = NULL;
+    uint64_t           start;
 
     while( !*f->done && f->status != HB_FILTER_DONE )
     {
+        start = hb_get_time_us();
         buf_in = hb_fifo_get_wait( f->fifo_in );
+        f->stats.wait_in += hb_get_time_us() - start;
         if ( buf_in == NULL )
             continue;
+        f->stats.buf_in++;
 
         // Filters can drop buffers.  Remember chapter information
         // so that it can be propagated to the next buffer
@@ -1969,7 +2339,9 @@ static void filter_loop( void * _f )
         hb_buffer_t *last_buf_in = buf_in;
 #endif
 
+        start = hb_get_time_us();
         f->status = f->work( f, &buf_in, &buf_out );
+        f->stats.work += hb_get_time_us() - start;
 
 #ifdef USE_QSV
         if (f->status == HB_FILTER_DELAY &&
@@ -1999,8 +2371,14 @@ static void filter_loop( void * _f )
         {
             hb_buffer_close( &buf_out );
         }
+        if ( buf_out && f->cache != NULL )
+        {
+            hb_frame_cache_write( f->cache, buf_out );
+        }
         if( buf_out )
         {
+            f->stats.buf_out += buffer_count( buf_out );
+            start = hb_get_time_us();
             while ( !*f->done )
             {
                 if ( hb_fifo_full_wait( f->fifo_out ) )
@@ -2010,6 +2388,7 @@ static void filter_loop( void * _f )
                     break;
                 }
             }
+            f->stats.wait_out += hb_get_time_us() - start;
         }
     }
     if ( buf_out )
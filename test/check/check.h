@@ -0,0 +1,105 @@
+/* check.h
+
+   Copyright (c) 2003-2018 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*
+ * Helpers of the check programs, see test/module.defs.
+ *
+ * A check program includes the libhb source file it checks, so it can
+ * call the file's static functions.  Most compare the results of the
+ * plain C code with those of the SIMD code for each x86 instruction set
+ * the CPU supports.  It prints one line per comparison and exits with 1
+ * if any of them failed.
+ */
+
+#ifndef HB_CHECK_H
+#define HB_CHECK_H
+
+#include <stdarg.h>
+#include <stdio.h>
+#include "libavutil/cpu.h"
+
+typedef struct
+{
+    const char * name;
+    int          flags;
+} check_cpu_t;
+
+/* The instruction sets the SIMD code selects between, in the order they
+ * are checked.  The first entry disables all SIMD code. */
+static const check_cpu_t check_cpus[] =
+{
+    { "c",    0 },
+#if defined(ARCH_X86)
+    { "sse2", AV_CPU_FLAG_MMX | AV_CPU_FLAG_MMXEXT | AV_CPU_FLAG_SSE |
+              AV_CPU_FLAG_SSE2 },
+    { "avx2", AV_CPU_FLAG_MMX | AV_CPU_FLAG_MMXEXT | AV_CPU_FLAG_SSE |
+              AV_CPU_FLAG_SSE2 | AV_CPU_FLAG_SSE3 | AV_CPU_FLAG_SSSE3 |
+              AV_CPU_FLAG_SSE4 | AV_CPU_FLAG_SSE42 | AV_CPU_FLAG_AVX |
+              AV_CPU_FLAG_AVX2 },
+#endif
+    { NULL,   0 }
+};
+
+static int check_failed;
+
+/* Makes the *_init_x86 functions select the code for 'cpu'.  Returns 0
+ * if this CPU can not run it. */
+static int check_set_cpu( const check_cpu_t * cpu )
+{
+    static int host_flags = -1;
+
+    if (host_flags == -1)
+    {
+        host_flags = av_get_cpu_flags();
+    }
+    if ((host_flags & cpu->flags) != cpu->flags)
+    {
+        printf( "skipped: %s, not supported by this CPU\n", cpu->name );
+        return 0;
+    }
+    av_force_cpu_flags( cpu->flags );
+    return 1;
+}
+
+/* The same pseudo random numbers on every run, so that a failure can be
+ * reproduced */
+static uint32_t check_seed = 1;
+
+static uint32_t check_rand( void )
+{
+    check_seed = check_seed * 1664525 + 1013904223;
+    return check_seed >> 8;
+}
+
+static void check_fill( uint8_t * buf, size_t size )
+{
+    size_t ii;
+
+    for (ii = 0; ii < size; ii++)
+    {
+        buf[ii] = check_rand();
+    }
+}
+
+static void check_result( int ok, const char * fmt, ... )
+{
+    va_list args;
+
+    printf( "%s: ", ok ? "ok" : "FAILED" );
+    va_start( args, fmt );
+    vprintf( fmt, args );
+    va_end( args );
+    printf( "\n" );
+    if (!ok)
+    {
+        check_failed = 1;
+    }
+}
+
+#endif // HB_CHECK_H
@@ -0,0 +1,141 @@
+/* deblock_check.c
+
+   Copyright (c) 2003-2018 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*
+ * Checks that pp7 deblocking a plane in row bands, with the C and the
+ * SIMD DCT and threshold kernels, gives exactly the output of the C
+ * kernels filtering the whole plane at once.  Luma and the subsampled
+ * chroma planes are padded to different strides, so all three are
+ * checked.
+ */
+
+#include "../../libhb/deblock.c"
+#include "check.h"
+
+static const int sizes[][2] =
+{
+    { 64, 48 },
+    { 72, 37 },     // width not a multiple of the 16 pixel stride padding
+    { 45, 19 },
+};
+
+static const int qps[] = { 1, 5, 15, 63 };
+
+#define BANDS 3
+
+static void set_functions( PP7Functions * functions, int mode )
+{
+    functions->dct_a = pp7_dct_a;
+    functions->dct_b = pp7_dct_b;
+    switch (mode)
+    {
+        case 0:
+        default:
+            functions->requantize = pp7_hard_threshold;
+            break;
+        case 1:
+            functions->requantize = pp7_soft_threshold;
+            break;
+        case 2:
+            functions->requantize = pp7_medium_threshold;
+            break;
+    }
+}
+
+// Filters the padded plane in 'bands' bands of rows
+static void filter( hb_filter_private_t * pv, DCTELEM * block, int plane,
+                    uint8_t * dst, int width, int height, int bands )
+{
+    for (int band = 0; band < bands; band++)
+    {
+        pp7_filter(pv, block, plane, dst, width, height, NULL, 0,
+                   height *  band      / bands,
+                   height * (band + 1) / bands);
+    }
+}
+
+// Blocky noise, so that all thresholds see some coefficients
+static void plane_fill( uint8_t * src, int width, int height )
+{
+    check_fill(src, width * height);
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            src[y * width + x] = ((x / 8 + y / 8) & 1) * 64 + x + y +
+                                 (src[y * width + x] & 31);
+        }
+    }
+}
+
+int main( int argc, char ** argv )
+{
+    for (int ii = 0; ii < sizeof(sizes) / sizeof(sizes[0]); ii++)
+    {
+        const int h = (sizes[ii][1] + 16 + 15) & (~15);
+        hb_filter_private_t pv = { .pp7_mpeg2 = 1 };
+        DCTELEM * block;
+
+        // As hb_deblock_init allocates them, for the luma size
+        pv.pp7_temp_stride = (sizes[ii][0] + 16 + 15) & (~15);
+        block              = malloc(4 * pv.pp7_temp_stride * sizeof(DCTELEM));
+        pp7_init_threshold(&pv);
+
+        for (int plane = 0; plane < 3; plane++)
+        {
+            // 4:2:0 chroma planes are half the size, rounded up
+            const int width  = plane ? (sizes[ii][0] + 1) / 2 : sizes[ii][0];
+            const int height = plane ? (sizes[ii][1] + 1) / 2 : sizes[ii][1];
+            uint8_t * src    = malloc(width * height);
+            uint8_t * ref    = malloc(width * height);
+            uint8_t * out    = malloc(width * height);
+
+            pv.pp7_src[plane] = malloc(pv.pp7_temp_stride * (h + 8));
+            plane_fill(src, width, height);
+            pp7_pad(&pv, plane, src, width, height);
+
+            for (int mode = 0; mode <= 2; mode++)
+            {
+                for (int q = 0; q < sizeof(qps) / sizeof(qps[0]); q++)
+                {
+                    pv.pp7_qp = qps[q];
+                    set_functions(&pv.functions, mode);
+                    filter(&pv, block, plane, ref, width, height, 1);
+
+                    for (int cpu = 0; check_cpus[cpu].name != NULL; cpu++)
+                    {
+                        if (!check_set_cpu(&check_cpus[cpu]))
+                        {
+                            continue;
+                        }
+                        set_functions(&pv.functions, mode);
+#if defined(ARCH_X86)
+                        pp7_init_x86(&pv.functions, mode);
+#endif
+                        memset(out, 0, width * height);
+                        filter(&pv, block, plane, out, width, height, BANDS);
+                        check_result(!memcmp(ref, out, width * height),
+                                     "deblock %s plane %d %dx%d mode %d "
+                                     "qp %d, %d bands", check_cpus[cpu].name,
+                                     plane, width, height, mode, pv.pp7_qp,
+                                     BANDS);
+                    }
+                }
+            }
+
+            free(pv.pp7_src[plane]);
+            free(src);
+            free(ref);
+            free(out);
+        }
+        free(block);
+    }
+
+    return check_failed;
+}
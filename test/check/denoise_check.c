@@ -0,0 +1,146 @@
+/* denoise_check.c
+
+   Copyright (c) 2003-2018 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*
+ * Checks that hqdn3d denoising a stream with its band pipeline gives
+ * exactly the frames of a single band, for band counts that do and do not
+ * divide the plane heights, with and without the spatial filter.
+ */
+
+#include "../../libhb/denoise.c"
+#include "check.h"
+
+static const int band_counts[] = { 2, 3, 5, HQDN3D_BANDS_MAX };
+
+static const struct
+{
+    double spatial;
+    double temporal;
+} strengths[] =
+{
+    { 4.0, 6.0 },
+    { 0.0, 6.0 },   // temporal only
+};
+
+#define WIDTH   160
+#define HEIGHT  138
+#define FRAMES  8
+
+// As hb_denoise_init sets it up, with 'bands' bands
+static hb_filter_private_t * denoise_init( int bands, double spatial,
+                                           double temporal )
+{
+    hb_filter_private_t * pv = calloc(sizeof(struct hb_filter_private_s), 1);
+
+    for (int c = 0; c < 3; c++)
+    {
+        hqdn3d_precalc_coef(pv->hqdn3d_coef[c * 2],     spatial);
+        hqdn3d_precalc_coef(pv->hqdn3d_coef[c * 2 + 1], temporal);
+    }
+    pv->bands = bands;
+    taskset_init(&pv->taskset, pv->bands, sizeof(hqdn3d_thread_arg_t),
+                 hqdn3d_thread);
+    for (int ii = 0; ii < pv->bands; ii++)
+    {
+        hqdn3d_thread_arg_t * thread_args;
+
+        thread_args = taskset_thread_args(&pv->taskset, ii);
+        thread_args->pv      = pv;
+        thread_args->segment = ii;
+    }
+    return pv;
+}
+
+// Denoises the frames of 'in' and flushes the pipeline, as
+// hb_denoise_work does
+static void denoise( hb_buffer_t ** in, hb_buffer_list_t * out, int bands,
+                     double spatial, double temporal )
+{
+    hb_filter_object_t filter = { 0 };
+
+    filter.private_data = denoise_init(bands, spatial, temporal);
+    hb_buffer_list_clear(out);
+    for (int ii = 0; ii < FRAMES; ii++)
+    {
+        hb_buffer_list_append(out, hqdn3d_cycle(filter.private_data,
+                                                hb_buffer_dup(in[ii])));
+    }
+    for (int ii = 1; ii < bands; ii++)
+    {
+        hb_buffer_list_append(out, hqdn3d_cycle(filter.private_data, NULL));
+    }
+    hb_denoise_close(&filter);
+}
+
+static int same_frames( hb_buffer_list_t * a, hb_buffer_list_t * b )
+{
+    hb_buffer_t * fa, * fb;
+
+    if (hb_buffer_list_count(a) != FRAMES || hb_buffer_list_count(b) != FRAMES)
+    {
+        return 0;
+    }
+    for (fa = hb_buffer_list_head(a), fb = hb_buffer_list_head(b);
+         fa != NULL; fa = fa->next, fb = fb->next)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            if (memcmp(fa->plane[c].data, fb->plane[c].data,
+                       fa->plane[c].stride * fa->plane[c].height))
+            {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+int main( int argc, char ** argv )
+{
+    hb_buffer_t * in[FRAMES];
+
+    hb_platform_init();     // for the number of pool threads
+    hb_buffer_pool_init();
+    hb_taskset_pool_init();
+    for (int ii = 0; ii < FRAMES; ii++)
+    {
+        in[ii] = hb_frame_buffer_init(AV_PIX_FMT_YUV420P, WIDTH, HEIGHT);
+        check_fill(in[ii]->data, in[ii]->size);
+        in[ii]->s.start = ii * 3003;
+    }
+
+    for (int s = 0; s < sizeof(strengths) / sizeof(strengths[0]); s++)
+    {
+        hb_buffer_list_t ref;
+
+        denoise(in, &ref, 1, strengths[s].spatial, strengths[s].temporal);
+        for (int b = 0; b < sizeof(band_counts) / sizeof(band_counts[0]); b++)
+        {
+            hb_buffer_list_t out;
+
+            denoise(in, &out, band_counts[b], strengths[s].spatial,
+                    strengths[s].temporal);
+            check_result(same_frames(&ref, &out),
+                         "denoise %dx%d spatial %.1f temporal %.1f, %d bands",
+                         WIDTH, HEIGHT, strengths[s].spatial,
+                         strengths[s].temporal, band_counts[b]);
+            hb_buffer_list_close(&out);
+        }
+        hb_buffer_list_close(&ref);
+    }
+
+    for (int ii = 0; ii < FRAMES; ii++)
+    {
+        hb_buffer_close(&in[ii]);
+    }
+    hb_taskset_pool_close();
+    hb_buffer_pool_close();
+
+    return check_failed;
+}
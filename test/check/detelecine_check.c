@@ -0,0 +1,113 @@
+/* detelecine_check.c
+
+   Copyright (c) 2003-2018 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*
+ * Checks that the SIMD pullup metrics (diff, comb and var) give exactly
+ * the values of the C metrics, on random frames and on frames combed as
+ * hard as possible, for block counts that are not a multiple of the
+ * number of blocks the SIMD code handles at once.
+ */
+
+#include "../../libhb/detelecine.c"
+#include "check.h"
+
+static const int block_counts[] = { 1, 2, 3, 4, 5, 7, 9, 90 };
+
+#define ROWS 12     // frame rows; the metrics read 4 rows of each field
+
+// A random frame, or one whose fields are all black and all white
+static void frame_fill( uint8_t * frame, int width, int combed )
+{
+    if (!combed)
+    {
+        check_fill(frame, width * ROWS);
+        return;
+    }
+    for (int yy = 0; yy < ROWS; yy++)
+    {
+        memset(frame + yy * width, yy & 1 ? 0 : 255, width);
+    }
+}
+
+static const char * const metrics[] = { "diff", "comb", "var" };
+
+static void set_functions( PullupFunctions * functions )
+{
+    functions->diff = pullup_diff_y;
+    functions->comb = pullup_licomb_y;
+    functions->var  = pullup_var_y;
+}
+
+typedef void (*metric_t)( const uint8_t * a, const uint8_t * b, int s,
+                          int blocks, int * dest );
+
+static metric_t metric( const PullupFunctions * functions, int index )
+{
+    return index == 0 ? functions->diff :
+           index == 1 ? functions->comb : functions->var;
+}
+
+int main( int argc, char ** argv )
+{
+    for (int ii = 0; ii < sizeof(block_counts) / sizeof(block_counts[0]); ii++)
+    {
+        const int blocks = block_counts[ii];
+        const int width  = blocks * 8;
+        const int s      = width * 2;  // field stride
+        uint8_t * frame  = malloc(width * ROWS);
+        uint8_t * other  = malloc(width * ROWS);
+        int     * ref    = malloc(blocks * sizeof(int));
+        int     * out    = malloc(blocks * sizeof(int));
+
+        for (int combed = 0; combed < 2; combed++)
+        {
+            frame_fill(frame, width, combed);
+            check_fill(other, width * ROWS);
+
+            for (int mm = 0; mm < 3; mm++)
+            {
+                // As pullup_submit_field passes them: diff compares a
+                // field with the same field of another frame, comb the
+                // two fields of one frame, var a field with itself
+                const uint8_t * a = frame + s;
+                const uint8_t * b = mm == 0 ? other + s :
+                                    mm == 1 ? frame + s + width : a;
+                PullupFunctions functions;
+
+                set_functions(&functions);
+                metric(&functions, mm)(a, b, s, blocks, ref);
+
+                for (int cpu = 0; check_cpus[cpu].name != NULL; cpu++)
+                {
+                    if (!check_set_cpu(&check_cpus[cpu]))
+                    {
+                        continue;
+                    }
+                    set_functions(&functions);
+#if defined(ARCH_X86)
+                    detelecine_init_x86(&functions);
+#endif
+                    memset(out, 0xff, blocks * sizeof(int));
+                    metric(&functions, mm)(a, b, s, blocks, out);
+                    check_result(!memcmp(ref, out, blocks * sizeof(int)),
+                                 "detelecine %s %s %d blocks, %s",
+                                 metrics[mm], check_cpus[cpu].name, blocks,
+                                 combed ? "combed" : "random");
+                }
+            }
+        }
+
+        free(frame);
+        free(other);
+        free(ref);
+        free(out);
+    }
+
+    return check_failed;
+}
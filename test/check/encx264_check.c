@@ -0,0 +1,66 @@
+/* encx264_check.c
+
+   Copyright (c) 2003-2018 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*
+ * Checks that the SIMD code widening 8 bit rows for high bit-depth x264
+ * gives exactly the output of the C code, and writes nothing past the
+ * row, whatever the width.
+ */
+
+#include "../../libhb/encx264.c"
+#include "check.h"
+
+static const int widths[] =
+{
+    1, 7, 15, 16, 17, 31, 32, 33, 47, 63, 65, 719, 1919, 1921
+};
+
+static const int shifts[] = { 2, 4, 8 };
+
+#define MAX_WIDTH 2048
+#define GUARD     40    // samples past the row that must stay untouched
+
+int main( int argc, char ** argv )
+{
+    uint8_t  src[MAX_WIDTH];
+    uint16_t ref[MAX_WIDTH + GUARD];
+    uint16_t out[MAX_WIDTH + GUARD];
+
+    check_fill(src, sizeof(src));
+    for (int ii = 0; ii < sizeof(widths) / sizeof(widths[0]); ii++)
+    {
+        const int width = widths[ii];
+
+        for (int s = 0; s < sizeof(shifts) / sizeof(shifts[0]); s++)
+        {
+            memset(ref, 0x5a, sizeof(ref));
+            expand_row_c(ref, src, shifts[s], width);
+
+            for (int cpu = 0; check_cpus[cpu].name != NULL; cpu++)
+            {
+                ExpandFunctions functions = { expand_row_c };
+
+                if (!check_set_cpu(&check_cpus[cpu]))
+                {
+                    continue;
+                }
+#if defined(ARCH_X86)
+                encx264_init_x86(&functions);
+#endif
+                memset(out, 0x5a, sizeof(out));
+                functions.expand_row(out, src, shifts[s], width);
+                check_result(!memcmp(ref, out, sizeof(out)),
+                             "encx264 expand %s width %d shift %d",
+                             check_cpus[cpu].name, width, shifts[s]);
+            }
+        }
+    }
+
+    return check_failed;
+}
@@ -0,0 +1,268 @@
+/* framecache_check.c
+
+   Copyright (c) 2003-2018 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*
+ * Checks that replaying the frame cache returns every recorded video frame
+ * and audio buffer in order, with the same payload, timestamps and flags,
+ * whether the buffers were kept in memory, spilled to the temp file or
+ * split between the two.
+ */
+
+#include "../../libhb/framecache.c"
+#include "check.h"
+
+static const int frame_sizes[][2] =
+{
+    { 64, 48 },
+    { 37, 21 },     // the size may change within the stream
+};
+
+#define FRAMES  12
+#define SAMPLES 20
+
+// A cache of one video and one audio stream, spilling past 'ram_limit'
+static hb_frame_cache_t * cache_init( int64_t ram_limit )
+{
+    hb_frame_cache_t * cache = calloc(1, sizeof(hb_frame_cache_t));
+
+    cache->audio_count  = 1;
+    cache->stream_count = 2;
+    cache->streams      = calloc(cache->stream_count,
+                                 sizeof(hb_frame_cache_stream_t));
+    cache->lock         = hb_lock_init();
+    cache->ram_limit    = ram_limit;
+    for (int ii = 0; ii < cache->stream_count; ii++)
+    {
+        hb_frame_cache_stream_t * stream = &cache->streams[ii];
+
+        stream->cache = cache;
+        stream->index = ii;
+        stream->used  = 1;
+        snprintf(stream->filename, sizeof(stream->filename),
+                 "framecache_check%d.bin", ii);
+    }
+    return cache;
+}
+
+static hb_buffer_t * video_init( int index )
+{
+    const int   * size = frame_sizes[index * 2 / FRAMES];
+    hb_buffer_t * buf  = hb_frame_buffer_init(AV_PIX_FMT_YUV420P,
+                                              size[0], size[1]);
+
+    check_fill(buf->data, buf->size);
+    buf->s.start        = index * 3003;
+    buf->s.stop         = buf->s.start + 3003;
+    buf->s.duration     = 3003;
+    buf->s.renderOffset = buf->s.start - 6006;
+    buf->s.new_chap     = index == 5 ? 2 : 0;
+    buf->s.frametype    = index % 4 ? HB_FRAME_P : HB_FRAME_IDR;
+    buf->s.flags        = index & 1 ? PIC_FLAG_TOP_FIELD_FIRST : 0;
+    return buf;
+}
+
+static hb_buffer_t * audio_init( int index )
+{
+    hb_buffer_t * buf = hb_buffer_init(1 + check_rand() % 4096);
+
+    check_fill(buf->data, buf->size);
+    buf->s.type      = AUDIO_BUF;
+    buf->s.start     = index * 1920;
+    buf->s.stop      = buf->s.start + 1920;
+    buf->s.duration  = 1920;
+    buf->s.frametype = HB_FRAME_AUDIO;
+    return buf;
+}
+
+static int same_settings( const hb_buffer_t * a, const hb_buffer_t * b )
+{
+    return a->s.type         == b->s.type         &&
+           a->s.start        == b->s.start        &&
+           a->s.stop         == b->s.stop         &&
+           a->s.duration     == b->s.duration     &&
+           a->s.renderOffset == b->s.renderOffset &&
+           a->s.new_chap     == b->s.new_chap     &&
+           a->s.frametype    == b->s.frametype    &&
+           a->s.flags        == b->s.flags        &&
+           !memcmp(&a->f, &b->f, sizeof(a->f));
+}
+
+// Compares the visible pixels of frames, the payload of anything else
+static int same_payload( const hb_buffer_t * a, const hb_buffer_t * b )
+{
+    if (a->s.type != FRAME_BUF)
+    {
+        return a->size == b->size && !memcmp(a->data, b->data, a->size);
+    }
+    for (int pp = 0; pp < 4; pp++)
+    {
+        if ((a->plane[pp].data == NULL) != (b->plane[pp].data == NULL) ||
+            a->plane[pp].width  != b->plane[pp].width ||
+            a->plane[pp].height != b->plane[pp].height)
+        {
+            return 0;
+        }
+        for (int yy = 0; yy < a->plane[pp].height; yy++)
+        {
+            if (memcmp(a->plane[pp].data + yy * a->plane[pp].stride,
+                       b->plane[pp].data + yy * b->plane[pp].stride,
+                       a->plane[pp].width))
+            {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+// hb_frame_cache_write records the whole chain 'buf' starts
+static void write_one( hb_frame_cache_stream_t * stream, hb_buffer_t * buf )
+{
+    hb_buffer_t * next = buf->next;
+
+    buf->next = NULL;
+    hb_frame_cache_write(stream, buf);
+    buf->next = next;
+}
+
+// Records the buffers of 'video' and 'audio', interleaved like the
+// encoders and the muxer see them
+static void record( hb_frame_cache_t * cache, hb_buffer_list_t * video,
+                    hb_buffer_list_t * audio )
+{
+    hb_frame_cache_stream_t * vs   = hb_frame_cache_video(cache);
+    hb_frame_cache_stream_t * as   = hb_frame_cache_audio(cache, 0);
+    hb_buffer_t             * vbuf = hb_buffer_list_head(video);
+    hb_buffer_t             * abuf = hb_buffer_list_head(audio);
+    hb_buffer_t             * eof;
+
+    while (vbuf != NULL || abuf != NULL)
+    {
+        if (vbuf != NULL)
+        {
+            write_one(vs, vbuf);
+            vbuf = vbuf->next;
+        }
+        if (abuf != NULL)
+        {
+            write_one(as, abuf);
+            abuf = abuf->next;
+        }
+    }
+    eof = hb_buffer_eof_init();
+    hb_frame_cache_write(vs, eof);
+    hb_frame_cache_write(as, eof);
+    hb_buffer_close(&eof);
+}
+
+// Replays 'stream' and compares it with the buffers that were recorded
+static int replay( hb_frame_cache_stream_t * stream, hb_buffer_list_t * list )
+{
+    hb_buffer_t * ref, * buf;
+    int           ok = 1;
+
+    if (stream->file != NULL && fseeko(stream->file, 0, SEEK_SET) != 0)
+    {
+        return 0;
+    }
+    for (ref = hb_buffer_list_head(list); ref != NULL; ref = ref->next)
+    {
+        buf = cache_read(stream);
+        if (buf == NULL)
+        {
+            return 0;
+        }
+        ok &= same_settings(ref, buf) && same_payload(ref, buf);
+        hb_buffer_close(&buf);
+    }
+    buf = cache_read(stream);
+    ok &= buf == NULL && !stream->error;
+    hb_buffer_close(&buf);
+    return ok;
+}
+
+int main( int argc, char ** argv )
+{
+    hb_buffer_list_t video, audio;
+    hb_buffer_t    * buf;
+    int64_t          total = 0;
+
+    hb_buffer_pool_init();
+    hb_buffer_list_clear(&video);
+    hb_buffer_list_clear(&audio);
+    for (int ii = 0; ii < FRAMES || ii < SAMPLES; ii++)
+    {
+        if (ii < FRAMES)
+        {
+            buf = video_init(ii);
+            total += buf->size;
+            hb_buffer_list_append(&video, buf);
+        }
+        if (ii < SAMPLES)
+        {
+            buf = audio_init(ii);
+            total += buf->size;
+            hb_buffer_list_append(&audio, buf);
+        }
+    }
+
+    const struct
+    {
+        const char * name;
+        int64_t      ram_limit;
+    } budgets[] =
+    {
+        { "memory", total },
+        { "file",   0 },
+        { "split",  total / 2 },
+    };
+
+    for (int bb = 0; bb < sizeof(budgets) / sizeof(budgets[0]); bb++)
+    {
+        hb_frame_cache_t        * cache = cache_init(budgets[bb].ram_limit);
+        hb_frame_cache_stream_t * vs    = hb_frame_cache_video(cache);
+        hb_frame_cache_stream_t * as    = hb_frame_cache_audio(cache, 0);
+        int                       spilled;
+
+        record(cache, &video, &audio);
+        check_result(vs->eof && !vs->error && vs->count == FRAMES &&
+                     as->eof && !as->error && as->count == SAMPLES,
+                     "frame cache %s recording", budgets[bb].name);
+        spilled = vs->spill_count;
+        check_result(replay(vs, &video), "frame cache %s video replay, "
+                     "%d frames spilled", budgets[bb].name, spilled);
+        check_result(replay(as, &audio), "frame cache %s audio replay",
+                     budgets[bb].name);
+        check_result(cache->ram_size == 0, "frame cache %s memory released",
+                     budgets[bb].name);
+
+        hb_frame_cache_close(&cache);
+    }
+
+    // The caches of jobs that run at the same time share one budget
+    hb_frame_cache_t * first  = cache_init(total);
+    hb_frame_cache_t * second = cache_init(total);
+
+    record(first, &video, &audio);
+    record(second, &video, &audio);
+    check_result(hb_frame_cache_video(first)->spill_count     == 0      &&
+                 hb_frame_cache_audio(first, 0)->spill_count  == 0      &&
+                 hb_frame_cache_video(second)->spill_count    == FRAMES &&
+                 hb_frame_cache_audio(second, 0)->spill_count == SAMPLES,
+                 "frame cache shared budget");
+    hb_frame_cache_close(&first);
+    hb_frame_cache_close(&second);
+    check_result(cache_ram_used == 0, "frame cache shared budget released");
+
+    hb_buffer_list_close(&video);
+    hb_buffer_list_close(&audio);
+    hb_buffer_pool_close();
+
+    return check_failed;
+}
@@ -0,0 +1,94 @@
+/* lapsharp_check.c
+
+   Copyright (c) 2003-2018 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*
+ * Checks that lapsharp sharpening a plane in row bands, with the C and the
+ * SIMD row kernels, gives exactly the output of the C kernel sharpening
+ * the whole plane at once.
+ */
+
+#include "../../libhb/lapsharp.c"
+#include "check.h"
+
+static const int sizes[][2] =
+{
+    { 64, 48 },
+    { 75, 37 },     // width not a multiple of the vector size
+    { 21,  9 },
+};
+
+static const double strengths[] = { 0.2, 1.0, 4.0 };
+
+#define BORDER 16
+#define BANDS  3
+
+// Sharpens the plane in 'bands' bands of rows
+static void filter( hb_filter_private_t * pv, const uint8_t * src,
+                    uint8_t * dst, int width, int height, int stride,
+                    lapsharp_plane_context_t * ctx, int bands )
+{
+    for (int band = 0; band < bands; band++)
+    {
+        hb_lapsharp(pv, src, dst, width, height, stride,
+                    height *  band      / bands,
+                    height * (band + 1) / bands, ctx);
+    }
+}
+
+int main( int argc, char ** argv )
+{
+    for (int ii = 0; ii < sizeof(sizes) / sizeof(sizes[0]); ii++)
+    {
+        const int width  = sizes[ii][0];
+        const int height = sizes[ii][1];
+        const int stride = width + 2 * BORDER;
+        hb_filter_private_t pv = { .thread_count = BANDS };
+        uint8_t * src = malloc(stride * height);
+        uint8_t * ref = malloc(stride * height);
+        uint8_t * out = malloc(stride * height);
+
+        check_fill(src, stride * height);
+
+        for (int k = 0; k < LAPSHARP_KERNELS; k++)
+        {
+            for (int s = 0; s < sizeof(strengths) / sizeof(strengths[0]); s++)
+            {
+                lapsharp_plane_context_t ctx = { strengths[s], k };
+
+                pv.functions.filter_row = lapsharp_filter_row;
+                memset(ref, 0, stride * height);
+                filter(&pv, src, ref, width, height, stride, &ctx, 1);
+
+                for (int cpu = 0; check_cpus[cpu].name != NULL; cpu++)
+                {
+                    if (!check_set_cpu(&check_cpus[cpu]))
+                    {
+                        continue;
+                    }
+                    pv.functions.filter_row = lapsharp_filter_row;
+#if defined(ARCH_X86)
+                    lapsharp_init_x86(&pv.functions);
+#endif
+                    memset(out, 0, stride * height);
+                    filter(&pv, src, out, width, height, stride, &ctx, BANDS);
+                    check_result(!memcmp(ref, out, stride * height),
+                                 "lapsharp %s %dx%d kernel %d strength %.1f, "
+                                 "%d bands", check_cpus[cpu].name, width,
+                                 height, k, ctx.strength, BANDS);
+                }
+            }
+        }
+
+        free(src);
+        free(ref);
+        free(out);
+    }
+
+    return check_failed;
+}
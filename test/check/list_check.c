@@ -0,0 +1,125 @@
+/* list_check.c
+
+   Copyright (c) 2003-2018 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*
+ * Checks the hb_list ring against a plain array, with random adds,
+ * inserts and removes at the ends and in the middle, so that the ring
+ * wraps around and grows while it is wrapped.
+ */
+
+#include "../../libhb/common.c"
+#include "check.h"
+
+#define OPERATIONS 200000
+#define MAX_ITEMS  600
+
+static intptr_t model[MAX_ITEMS];
+static int      model_count;
+
+static void model_insert( int pos, intptr_t item )
+{
+    memmove(&model[pos + 1], &model[pos],
+            (model_count - pos) * sizeof(model[0]));
+    model[pos] = item;
+    model_count++;
+}
+
+static void model_remove( int pos )
+{
+    memmove(&model[pos], &model[pos + 1],
+            (model_count - pos - 1) * sizeof(model[0]));
+    model_count--;
+}
+
+static int same_items( const hb_list_t * l )
+{
+    if (hb_list_count(l) != model_count ||
+        hb_list_item(l, model_count) != NULL)
+    {
+        return 0;
+    }
+    for (int ii = 0; ii < model_count; ii++)
+    {
+        if (hb_list_item(l, ii) != (void *)model[ii])
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int main( int argc, char ** argv )
+{
+    hb_list_t * l               = hb_list_init();
+    intptr_t    next            = 1;
+    int         ok              = 1;
+    int         wrapped_growths = 0;
+    int         op;
+
+    for (op = 0; op < OPERATIONS && ok; op++)
+    {
+        // Mostly grow in the first half, mostly shrink in the second,
+        // so every size is passed through in both directions
+        int grow = op < OPERATIONS / 2 ? 60 : 40;
+        int r    = check_rand() % 100;
+
+        if (model_count == MAX_ITEMS)
+        {
+            r = 100;
+        }
+        if (model_count > 0 && r >= grow)
+        {
+            int pos;
+
+            // Remove from either end or from the middle
+            switch (check_rand() % 3)
+            {
+                case 0:  pos = 0;                            break;
+                case 1:  pos = model_count - 1;              break;
+                default: pos = check_rand() % model_count;   break;
+            }
+            hb_list_rem(l, (void *)model[pos]);
+            model_remove(pos);
+        }
+        else
+        {
+            if (l->items_count == l->items_alloc && l->items_head != 0)
+            {
+                wrapped_growths++;
+            }
+            if (r % 2)
+            {
+                hb_list_add(l, (void *)next);
+                model_insert(model_count, next);
+            }
+            else
+            {
+                int pos = check_rand() % (model_count + 1);
+
+                hb_list_insert(l, pos, (void *)next);
+                model_insert(pos, next);
+            }
+            next++;
+        }
+        ok = same_items(l);
+    }
+    check_result(ok, "list %d random operations, %d items at most",
+                 op, MAX_ITEMS);
+    check_result(wrapped_growths > 0, "list grown %d times while wrapped",
+                 wrapped_growths);
+
+    // Removing a missing item leaves the list as it is
+    hb_list_rem(l, (void *)next);
+    check_result(same_items(l), "list remove of a missing item");
+
+    hb_list_close(&l);
+    check_result(l == NULL, "list close");
+
+    return check_failed;
+}
@@ -0,0 +1,142 @@
+/* nlmeans_check.c
+
+   Copyright (c) 2003-2018 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*
+ * Checks that denoising a plane with the SIMD integral image and weight
+ * accumulation kernels gives exactly the output of the C kernels.
+ */
+
+#include "../../libhb/nlmeans.c"
+#include "check.h"
+
+typedef struct
+{
+    int    w, h;
+    int    patch_size;
+    int    range;
+    int    nframes;
+    double strength;
+} nlmeans_case_t;
+
+static const nlmeans_case_t cases[] =
+{
+    {  64,  48, 7, 3, 1, 6.0 },
+    {  67,  35, 7, 3, 2, 6.0 },     // widths that leave SIMD tails
+    {  33,  21, 3, 5, 1, 8.0 },
+    { 123,  40, 5, 7, 2, 4.0 },
+    {  17,  17, 7, 3, 1, 80.0 },    // large diff_max
+};
+
+// Sets up the weight table like nlmeans_init
+static void weights_init( const nlmeans_case_t * c, float * exptable,
+                          float * weight_fact_table, int * diff_max )
+{
+    const float weight_factor       = 1.0 / c->patch_size / c->patch_size /
+                                      (c->strength * c->strength);
+    const float min_weight_in_table = 0.0005;
+    const float stretch             = NLMEANS_EXPSIZE /
+                                      (-log(min_weight_in_table));
+
+    *weight_fact_table = weight_factor * stretch;
+    *diff_max          = NLMEANS_EXPSIZE / *weight_fact_table;
+    for (int i = 0; i < NLMEANS_EXPSIZE; i++)
+    {
+        exptable[i] = exp(-i / stretch);
+    }
+    exptable[NLMEANS_EXPSIZE - 1] = 0;
+}
+
+static void frames_init( const nlmeans_case_t * c, Frame * frame )
+{
+    const int border = ((c->range + 2) / 2 + 15) / 16 * 16;
+    uint8_t * src = malloc(c->w * c->h);
+
+    for (int f = 0; f < c->nframes; f++)
+    {
+        // Noisy gradient, so that patches are similar but not equal
+        check_fill(src, c->w * c->h);
+        for (int y = 0; y < c->h; y++)
+        {
+            for (int x = 0; x < c->w; x++)
+            {
+                src[y * c->w + x] = (x * 3 + y * 2 + f * 5) +
+                                    (src[y * c->w + x] & 15);
+            }
+        }
+        memset(&frame[f], 0, sizeof(frame[f]));
+        nlmeans_alloc(src, c->w, c->w, c->h, &frame[f].plane[0], border);
+        frame[f].plane[0].mutex = hb_lock_init();
+    }
+    free(src);
+}
+
+static void frames_close( const nlmeans_case_t * c, Frame * frame )
+{
+    for (int f = 0; f < c->nframes; f++)
+    {
+        free(frame[f].plane[0].mem);
+        hb_lock_close(&frame[f].plane[0].mutex);
+    }
+}
+
+static void denoise( NLMeansFunctions * functions, const nlmeans_case_t * c,
+                     Frame * frame, uint8_t * dst )
+{
+    float exptable[NLMEANS_EXPSIZE];
+    float weight_fact_table;
+    int   diff_max;
+
+    weights_init(c, exptable, &weight_fact_table, &diff_max);
+    nlmeans_plane(functions, frame, 0, 0, c->nframes, dst, c->w, c->w, c->h,
+                  0, c->h, c->strength, 1.0, c->patch_size, c->range,
+                  exptable, weight_fact_table, diff_max);
+}
+
+int main( int argc, char ** argv )
+{
+    NLMeansFunctions c_functions =
+    {
+        .build_integral     = build_integral_scalar,
+        .accumulate_weights = accumulate_weights_scalar,
+    };
+
+    for (int ii = 0; ii < sizeof(cases) / sizeof(cases[0]); ii++)
+    {
+        const nlmeans_case_t * c = &cases[ii];
+        Frame     frame[2];
+        uint8_t * ref = malloc(c->w * c->h);
+        uint8_t * out = malloc(c->w * c->h);
+
+        frames_init(c, frame);
+        denoise(&c_functions, c, frame, ref);
+
+        for (int cpu = 1; check_cpus[cpu].name != NULL; cpu++)
+        {
+            NLMeansFunctions functions = c_functions;
+
+            if (!check_set_cpu(&check_cpus[cpu]))
+            {
+                continue;
+            }
+            nlmeans_init_x86(&functions);
+            memset(out, 0, c->w * c->h);
+            denoise(&functions, c, frame, out);
+            check_result(!memcmp(ref, out, c->w * c->h),
+                         "nlmeans %s %dx%d patch %d range %d frames %d",
+                         check_cpus[cpu].name, c->w, c->h, c->patch_size,
+                         c->range, c->nframes);
+        }
+
+        frames_close(c, frame);
+        free(ref);
+        free(out);
+    }
+
+    return check_failed;
+}
@@ -0,0 +1,214 @@
+/* rendersub_check.c
+
+   Copyright (c) 2003-2018 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*
+ * Checks that the SIMD subtitle blend kernels give exactly the output of
+ * blend_row_c, for luma rows (alpha_shift 0) and subsampled chroma rows
+ * (alpha_shift 1) of all widths up to a few SIMD vectors, at all
+ * alignments.
+ *
+ * Also checks that blend, which clips the subtitle to the frame and skips
+ * its transparent borders, gives exactly the frame of blending every
+ * visible sample, for subtitles partly off each edge of the frame.
+ */
+
+#include "../../libhb/rendersub.c"
+#include "check.h"
+
+#define MAX_WIDTH  100
+#define MAX_OFFSET 32
+
+#define FRAME_WIDTH  64
+#define FRAME_HEIGHT 48
+#define SUB_WIDTH    21
+#define SUB_HEIGHT   17
+
+// Subtitle positions, relative to the frame
+static const int positions[][2] =
+{
+    {  20,  14 },   // inside
+    {  -7,  15 },   // off the left edge
+    {  51,  16 },   // off the right edge
+    {  22,  -6 },   // off the top edge
+    {  23,  37 },   // off the bottom edge
+    {  -5,  -9 },   // off the top left corner
+    {  53,  41 },   // off the bottom right corner
+    { -30,  10 },   // entirely off the frame
+};
+
+// Blends every sample of the subtitle that is on the frame
+static void blend_ref( hb_buffer_t *dst, hb_buffer_t *src, int left, int top )
+{
+    int x0  = MAX( -left, 0 ), y0 = MAX( -top, 0 );
+    int ww  = MIN( src->f.width,  dst->f.width  - left );
+    int hh  = MIN( src->f.height, dst->f.height - top );
+    int cx0 = ( x0 + 1 ) >> 1, cy0 = ( y0 + 1 ) >> 1;
+    int yy;
+
+    for( yy = y0; yy < hh && x0 < ww; yy++ )
+    {
+        blend_row_c( dst->plane[0].data + ( yy + top ) * dst->plane[0].stride +
+                     left + x0,
+                     src->plane[0].data + yy * src->plane[0].stride + x0,
+                     src->plane[3].data + yy * src->plane[3].stride + x0,
+                     0, ww - x0 );
+    }
+    for( yy = cy0; yy < hh >> 1 && cx0 < ww >> 1; yy++ )
+    {
+        for( int pp = 1; pp < 3; pp++ )
+        {
+            blend_row_c( dst->plane[pp].data +
+                         ( yy + ( top >> 1 ) ) * dst->plane[pp].stride +
+                         ( left >> 1 ) + cx0,
+                         src->plane[pp].data + yy * src->plane[pp].stride +
+                         cx0,
+                         src->plane[3].data + ( yy << 1 ) * src->plane[3].stride +
+                         ( cx0 << 1 ),
+                         1, ( ww >> 1 ) - cx0 );
+        }
+    }
+}
+
+static int same_frame( hb_buffer_t * a, hb_buffer_t * b )
+{
+    for (int pp = 0; pp < 3; pp++)
+    {
+        if (memcmp(a->plane[pp].data, b->plane[pp].data,
+                   a->plane[pp].stride * a->plane[pp].height))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// A subtitle with random samples inside transparent borders of
+// different widths, and a transparent row
+static hb_buffer_t * subtitle_init( void )
+{
+    hb_buffer_t * sub = hb_frame_buffer_init(AV_PIX_FMT_YUVA420P,
+                                             SUB_WIDTH, SUB_HEIGHT);
+
+    check_fill(sub->data, sub->size);
+    for (int yy = 0; yy < SUB_HEIGHT; yy++)
+    {
+        uint8_t * a = sub->plane[3].data + yy * sub->plane[3].stride;
+
+        if (yy < 2 || yy == 9 || yy >= SUB_HEIGHT - 3)
+        {
+            memset(a, 0, SUB_WIDTH);
+        }
+        memset(a, 0, 3);
+        memset(a + SUB_WIDTH - 2, 0, 2);
+    }
+    return sub;
+}
+
+static void check_blend( void )
+{
+    hb_buffer_t * frame = hb_frame_buffer_init(AV_PIX_FMT_YUV420P,
+                                               FRAME_WIDTH, FRAME_HEIGHT);
+    hb_buffer_t * ref   = hb_frame_buffer_init(AV_PIX_FMT_YUV420P,
+                                               FRAME_WIDTH, FRAME_HEIGHT);
+    hb_buffer_t * out   = hb_frame_buffer_init(AV_PIX_FMT_YUV420P,
+                                               FRAME_WIDTH, FRAME_HEIGHT);
+    hb_buffer_t * sub   = subtitle_init();
+
+    check_fill(frame->data, frame->size);
+    for (int pp = 0; pp < sizeof(positions) / sizeof(positions[0]); pp++)
+    {
+        const int left = positions[pp][0];
+        const int top  = positions[pp][1];
+
+        memcpy(ref->data, frame->data, frame->size);
+        blend_ref(ref, sub, left, top);
+
+        for (int cpu = 0; check_cpus[cpu].name != NULL; cpu++)
+        {
+            BlendFunctions functions = { .blend_row = blend_row_c };
+
+            if (!check_set_cpu(&check_cpus[cpu]))
+            {
+                continue;
+            }
+#if defined(ARCH_X86)
+            rendersub_init_x86(&functions);
+#endif
+            memcpy(out->data, frame->data, frame->size);
+            blend(&functions, out, sub, left, top);
+            check_result(same_frame(ref, out), "blend %s %dx%d at %d,%d",
+                         check_cpus[cpu].name, SUB_WIDTH, SUB_HEIGHT,
+                         left, top);
+        }
+    }
+
+    hb_buffer_close(&frame);
+    hb_buffer_close(&ref);
+    hb_buffer_close(&out);
+    hb_buffer_close(&sub);
+}
+
+int main( int argc, char ** argv )
+{
+    uint8_t src[MAX_OFFSET + MAX_WIDTH];
+    uint8_t alpha[(MAX_OFFSET + MAX_WIDTH) * 2];
+    uint8_t dst[MAX_OFFSET + MAX_WIDTH];
+    uint8_t ref[MAX_OFFSET + MAX_WIDTH];
+    uint8_t out[MAX_OFFSET + MAX_WIDTH];
+
+    check_fill(src, sizeof(src));
+    check_fill(dst, sizeof(dst));
+    check_fill(alpha, sizeof(alpha));
+    // Fully transparent and fully opaque runs
+    memset(alpha + 10, 0, 20);
+    memset(alpha + 60, 255, 20);
+
+    for (int cpu = 1; check_cpus[cpu].name != NULL; cpu++)
+    {
+        BlendFunctions functions = { .blend_row = blend_row_c };
+
+        if (!check_set_cpu(&check_cpus[cpu]))
+        {
+            continue;
+        }
+        rendersub_init_x86(&functions);
+
+        for (int shift = 0; shift <= 1; shift++)
+        {
+            int ok = 1;
+
+            for (int offset = 0; offset < MAX_OFFSET && ok; offset++)
+            {
+                for (int width = 1; width <= MAX_WIDTH && ok; width++)
+                {
+                    memcpy(ref, dst, sizeof(dst));
+                    memcpy(out, dst, sizeof(dst));
+                    blend_row_c(ref + offset, src + offset,
+                                alpha + (offset << shift), shift, width);
+                    functions.blend_row(out + offset, src + offset,
+                                        alpha + (offset << shift), shift,
+                                        width);
+                    if (memcmp(ref, out, sizeof(out)))
+                    {
+                        printf("offset %d width %d differs\n", offset, width);
+                        ok = 0;
+                    }
+                }
+            }
+            check_result(ok, "blend_row %s alpha_shift %d",
+                         check_cpus[cpu].name, shift);
+        }
+    }
+
+    hb_buffer_pool_init();
+    check_blend();
+    hb_buffer_pool_close();
+
+    return check_failed;
+}
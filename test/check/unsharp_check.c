@@ -0,0 +1,119 @@
+/* unsharp_check.c
+
+   Copyright (c) 2003-2018 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*
+ * Checks that unsharp sharpening a plane in row bands, with the C and the
+ * SIMD blur and apply kernels, gives exactly the output of the C kernels
+ * sharpening the whole plane at once.
+ */
+
+#include "../../libhb/unsharp.c"
+#include "check.h"
+
+static const int sizes[][2] =
+{
+    { 64, 48 },
+    { 75, 37 },     // width not a multiple of the vector size
+    { 21,  9 },     // bands shorter than the blur
+};
+
+static const int    blur_sizes[] = { 3, 7, 13 };
+static const double strengths[]  = { 0.25, 1.5 };
+
+#define BANDS 3
+
+static void set_functions( UnsharpFunctions * functions )
+{
+    functions->blur_h = unsharp_blur_h;
+    functions->blur_v = unsharp_blur_v;
+    functions->apply  = unsharp_apply;
+}
+
+// Sharpens the plane in 'bands' bands of rows
+static void filter( hb_filter_private_t * pv, const uint8_t * src,
+                    uint8_t * dst, int width, int height,
+                    unsharp_plane_context_t * ctx,
+                    unsharp_thread_context_t * tctx, int bands )
+{
+    for (int band = 0; band < bands; band++)
+    {
+        unsharp(pv, src, dst, width, height, width,
+                height *  band      / bands,
+                height * (band + 1) / bands, ctx, tctx);
+    }
+}
+
+int main( int argc, char ** argv )
+{
+    for (int ii = 0; ii < sizeof(sizes) / sizeof(sizes[0]); ii++)
+    {
+        const int width  = sizes[ii][0];
+        const int height = sizes[ii][1];
+        hb_filter_private_t      pv   = { 0 };
+        unsharp_thread_context_t tctx = { { 0 } };
+        uint8_t * src = malloc(width * height);
+        uint8_t * ref = malloc(width * height);
+        uint8_t * out = malloc(width * height);
+
+        check_fill(src, width * height);
+        for (int z = 0; z < UNSHARP_SIZE_MAX - 1; z++)
+        {
+            tctx.SC[z] = malloc(sizeof(*tctx.SC[z]) * width);
+        }
+        tctx.line = malloc(sizeof(*tctx.line) * width);
+        tctx.tmp  = malloc(sizeof(*tctx.tmp) * (width + UNSHARP_SIZE_MAX));
+
+        for (int b = 0; b < sizeof(blur_sizes) / sizeof(blur_sizes[0]); b++)
+        {
+            for (int s = 0; s < sizeof(strengths) / sizeof(strengths[0]); s++)
+            {
+                // As set up by unsharp_init
+                unsharp_plane_context_t ctx = { .size = blur_sizes[b] };
+                ctx.strength  = strengths[s];
+                ctx.amount    = ctx.strength * 65536.0;
+                ctx.steps     = ctx.size / 2;
+                ctx.scalebits = ctx.steps * 4;
+                ctx.halfscale = 1 << (ctx.scalebits - 1);
+
+                set_functions(&pv.functions);
+                filter(&pv, src, ref, width, height, &ctx, &tctx, 1);
+
+                for (int cpu = 0; check_cpus[cpu].name != NULL; cpu++)
+                {
+                    if (!check_set_cpu(&check_cpus[cpu]))
+                    {
+                        continue;
+                    }
+                    set_functions(&pv.functions);
+#if defined(ARCH_X86)
+                    unsharp_init_x86(&pv.functions);
+#endif
+                    memset(out, 0, width * height);
+                    filter(&pv, src, out, width, height, &ctx, &tctx, BANDS);
+                    check_result(!memcmp(ref, out, width * height),
+                                 "unsharp %s %dx%d size %d strength %.2f, "
+                                 "%d bands", check_cpus[cpu].name, width,
+                                 height, ctx.size, ctx.strength, BANDS);
+                }
+            }
+        }
+
+        for (int z = 0; z < UNSHARP_SIZE_MAX - 1; z++)
+        {
+            free(tctx.SC[z]);
+        }
+        free(tctx.line);
+        free(tctx.tmp);
+        free(src);
+        free(ref);
+        free(out);
+    }
+
+    return check_failed;
+}
@@ -0,0 +1,91 @@
+/* vfr_check.c
+
+   Copyright (c) 2003-2018 HandBrake Team
+   This file is part of the HandBrake source code
+   Homepage: <http://handbrake.fr/>.
+   It may be used under the terms of the GNU General Public License v2.
+   For full terms see the file COPYING file or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*
+ * Checks that the SIMD motion metric gives exactly the sum of the C
+ * metric, on random frames and on frames that differ as much as possible
+ * everywhere, over enough rows that the SIMD code has to move its 32 bit
+ * sums to 64 bits several times.
+ */
+
+#include "../../libhb/vfr.c"
+#include "check.h"
+
+static const int sizes[][2] =
+{
+    {   16,  16 },
+    {   48, 112 },  // narrow, the sums are moved in the middle of a row
+    {  720, 480 },
+    { 1920, 144 },
+};
+
+// Fills 'a' with a checkerboard of black and white samples and 'b' with
+// its inverse, or both with random samples
+static void frames_fill( uint8_t * a, uint8_t * b, int width, int height,
+                         int worst )
+{
+    if (!worst)
+    {
+        check_fill(a, width * height);
+        check_fill(b, width * height);
+        return;
+    }
+    for (int yy = 0; yy < height; yy++)
+    {
+        for (int xx = 0; xx < width; xx++)
+        {
+            a[yy * width + xx] = (xx ^ yy) & 1 ? 255 : 0;
+            b[yy * width + xx] = 255 - a[yy * width + xx];
+        }
+    }
+}
+
+int main( int argc, char ** argv )
+{
+    hb_filter_private_t pv = { 0 };
+
+    build_gamma_lut(&pv);
+    for (int ii = 0; ii < sizeof(sizes) / sizeof(sizes[0]); ii++)
+    {
+        const int width  = sizes[ii][0];
+        const int height = sizes[ii][1];
+        uint8_t * a      = malloc(width * height);
+        uint8_t * b      = malloc(width * height);
+
+        for (int worst = 0; worst < 2; worst++)
+        {
+            uint64_t ref, out;
+
+            frames_fill(a, b, width, height, worst);
+            ref = sse_rows_c(pv.gamma_lut, a, b, width, width, height);
+
+            for (int cpu = 0; check_cpus[cpu].name != NULL; cpu++)
+            {
+                if (!check_set_cpu(&check_cpus[cpu]))
+                {
+                    continue;
+                }
+                pv.functions.sse_rows = sse_rows_c;
+#if defined(ARCH_X86)
+                vfr_init_x86(&pv.functions);
+#endif
+                out = pv.functions.sse_rows(pv.gamma_lut, a, b, width,
+                                            width, height);
+                check_result(out == ref, "vfr sse %s %dx%d, %s",
+                             check_cpus[cpu].name, width, height,
+                             worst ? "worst case" : "random");
+            }
+        }
+
+        free(a);
+        free(b);
+    }
+
+    return check_failed;
+}
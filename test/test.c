@@ -162,11 +162,13 @@ static char *   advanced_opts   = NULL;
 static int      maxHeight     = 0;
 static int      maxWidth      = 0;
 static int      fastfirstpass = -1;
+static int      frame_cache   = 0;
 static char *   preset_export_name   = NULL;
 static char *   preset_export_desc   = NULL;
 static char *   preset_export_file   = NULL;
 static char *   preset_name          = NULL;
 static char *   queue_import_name    = NULL;
+static int      queue_jobs           = 1;
 static int      cfr           = -1;
 static int      mp4_optimize  = -1;
 static int      ipod_atom     = -1;
@@ -437,6 +439,34 @@ int RunQueue(hb_handle_t *h, const char *queue_import_name)
     {
         return RunQueueJob(h, hb_dict_get(queue, "Job"));
     }
+    else if (hb_value_type(queue) == HB_VALUE_TYPE_ARRAY && queue_jobs > 1)
+    {
+        int ii, count;
+
+        // Queue all jobs and let libhb run several at once
+        count = hb_value_array_len(queue);
+        for (ii = 0; ii < count; ii++)
+        {
+            hb_dict_t * entry = hb_value_array_get(queue, ii);
+            char      * json_job;
+
+            json_job = hb_value_get_json(hb_dict_get(entry, "Job"));
+            if (json_job == NULL)
+            {
+                fprintf(stderr, "Error in setting up job! Aborting.\n");
+                return -1;
+            }
+            hb_add_json(h, json_job);
+            free(json_job);
+        }
+        hb_set_job_limit(h, queue_jobs);
+        job_running = 1;
+        hb_start( h );
+
+        EventLoop(h, NULL);
+
+        return done_error == HB_ERROR_NONE ? 0 : -1;
+    }
     else if (hb_value_type(queue) == HB_VALUE_TYPE_ARRAY)
     {
         int ii, count, result = 0;
@@ -999,6 +1029,16 @@ static int HandleEvents(hb_handle_t * h, hb_dict_t *preset_dict)
                          "%02dh%02dm%02ds)", p.rate_cur, p.rate_avg,
                          p.hours, p.minutes, p.seconds );
             }
+            if (queue_jobs > 1)
+            {
+                hb_state_t * job_states;
+                int          job_count = hb_get_job_states(h, &job_states);
+                if (job_count > 1)
+                {
+                    fprintf( stdout, " [%d jobs running]", job_count );
+                }
+                free(job_states);
+            }
             fflush(stdout);
             break;
 #undef p
@@ -1301,6 +1341,9 @@ static void ShowHelp()
 "                           '--preset-export'\n"
 "   --queue-import-file <filename>\n"
 "                           Import an encode queue file created by the GUI\n"
+"   --queue-jobs <number>   Encode up to <number> jobs of the imported queue\n"
+"                           at the same time, sharing the CPUs between them\n"
+"                           (default: 1)\n"
 "       --no-dvdnav         Do not use dvdnav for reading DVDs\n"
 "\n"
 "\n"
@@ -1403,6 +1446,9 @@ static void ShowHelp()
 "                           first pass to improve speed\n"
 "                           (works with x264 and x265)\n"
 "       --no-turbo          Disable 2-pass mode's \"turbo\" first pass\n"
+"       --frame-cache       When using 2-pass keep the filtered frames of the\n"
+"                           first pass and encode them again in the second\n"
+"                           pass instead of decoding and filtering twice\n"
 "   -r, --rate <float>      Set video framerate\n"
 "                           (" );
     i = 0;
@@ -2094,6 +2140,7 @@ static int ParseOptions( int argc, char ** argv )
     #define FILTER_LAPSHARP      314
     #define FILTER_LAPSHARP_TUNE 315
     #define JSON_LOGGING         316
+    #define QUEUE_JOBS           317
 
     for( ;; )
     {
@@ -2236,6 +2283,7 @@ static int ParseOptions( int argc, char ** argv )
             { "arate",       required_argument, NULL,    'R' },
             { "turbo",       no_argument,       NULL,    'T' },
             { "no-turbo",    no_argument,       &fastfirstpass,    0 },
+            { "frame-cache", no_argument,       &frame_cache,      1 },
             { "maxHeight",   required_argument, NULL,    'Y' },
             { "maxWidth",    required_argument, NULL,    'X' },
             { "preset",      required_argument, NULL,    'Z' },
@@ -2246,6 +2294,7 @@ static int ParseOptions( int argc, char ** argv )
             { "preset-export-file", required_argument, NULL, PRESET_EXPORT_FILE },
             { "preset-export-description", required_argument, NULL, PRESET_EXPORT_DESC },
             { "queue-import-file",  required_argument, NULL, QUEUE_IMPORT },
+            { "queue-jobs",         required_argument, NULL, QUEUE_JOBS },
 
             { "aname",       required_argument, NULL,    'A' },
             { "color-matrix",required_argument, NULL,    'M' },
@@ -2347,6 +2396,13 @@ static int ParseOptions( int argc, char ** argv )
             case QUEUE_IMPORT:
                 queue_import_name = strdup(optarg);
                 break;
+            case QUEUE_JOBS:
+                queue_jobs = atoi(optarg);
+                if (queue_jobs < 1)
+                {
+                    queue_jobs = 1;
+                }
+                break;
             case DVDNAV:
                 dvdnav = 0;
                 break;
@@ -4368,6 +4424,12 @@ PrepareJob(hb_handle_t *h, hb_title_t *title, hb_dict_t *preset_dict)
         hb_dict_set(source_dict, "Angle", hb_value_int(angle));
     }
 
+    if (frame_cache)
+    {
+        hb_dict_t *video_dict = hb_dict_get(job_dict, "Video");
+        hb_dict_set(video_dict, "FrameCache", hb_value_bool(1));
+    }
+
     hb_dict_t *subtitles_dict = hb_dict_get(job_dict, "Subtitle");
     hb_value_array_t * subtitle_array;
     hb_dict_t        * subtitle_search;